@@ -1089,6 +1089,27 @@ draw_collect_pipeline_statistics(struct draw_context *draw,
    draw->collect_statistics = enable;
 }
 
+/**
+ * Return the average cache miss ratio achieved by the vertex cache so far,
+ * that is the number of vertices shaded per triangle of indexed draws,
+ * along with these two counts if asked for.
+ */
+float
+draw_get_acmr(const struct draw_context *draw,
+              uint64_t *vertices, uint64_t *triangles)
+{
+   if (vertices)
+      *vertices = draw->pt.vcache_stats.vertices;
+   if (triangles)
+      *triangles = draw->pt.vcache_stats.triangles;
+
+   if (draw->pt.vcache_stats.triangles == 0)
+      return 0.0f;
+
+   return (float) ((double) draw->pt.vcache_stats.vertices /
+                   (double) draw->pt.vcache_stats.triangles);
+}
+
 /**
  * Computes clipper invocation statistics.
  *
@@ -291,6 +291,9 @@ void draw_set_force_passthrough( struct draw_context *draw,
 void draw_collect_pipeline_statistics(struct draw_context *draw,
                                       boolean enable);
 
+float draw_get_acmr(const struct draw_context *draw,
+                    uint64_t *vertices, uint64_t *triangles);
+
 /*******************************************************************************
  * Draw pipeline 
  */
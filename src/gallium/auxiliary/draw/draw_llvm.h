@@ -343,6 +343,18 @@ struct draw_gs_llvm_variant_key
     PIPE_MAX_SHADER_SAMPLER_VIEWS * sizeof(struct draw_sampler_static_state))
 
 
+/**
+ * Number of vertices the vertex shader processes per loop iteration.
+ * Only the fragment shader uses 512-bit vectors; the vertex shader stays
+ * at most 8 wide.
+ */
+static inline unsigned
+draw_llvm_vs_vector_length(void)
+{
+   return (lp_native_vector_width > 256 ? 256 : lp_native_vector_width) / 32;
+}
+
+
 static inline size_t
 draw_llvm_variant_key_size(unsigned nr_vertex_elements,
                            unsigned nr_samplers)
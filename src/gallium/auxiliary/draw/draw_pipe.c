@@ -210,6 +210,155 @@ static void do_triangle( struct draw_context *draw,
 #include "draw_pt_decompose.h"
 
 
+/** Number of triangles tested per iteration of the batched cull */
+#define CULL_BATCH 8
+
+
+/**
+ * Batched pre-cull state, derived from the rasterizer state so it holds
+ * before the pipeline is validated.
+ */
+struct cull_batch {
+   unsigned pos;        /**< position output */
+   unsigned cull_face;  /**< PIPE_FACE_x to cull */
+   unsigned front_ccw;
+   boolean clip;        /**< whether the clip stage rejects triangles */
+};
+
+
+/**
+ * Whether a triangle list is worth running through the batched cull, and
+ * if so, set up the state for it.
+ *
+ * The batch only drops triangles the clip and cull stages would drop
+ * anyway: those entirely outside one clip plane, and the back-facing or
+ * zero-area ones among those which don't need clipping.  The survivors
+ * still go through the whole pipeline.
+ */
+static boolean
+cull_batch_init(const struct draw_context *draw,
+                unsigned prim,
+                struct cull_batch *cull)
+{
+   const struct pipe_rasterizer_state *rast = draw->rasterizer;
+
+   if (prim != PIPE_PRIM_TRIANGLES)
+      return FALSE;
+
+   cull->pos = draw_current_shader_position_output(draw);
+   cull->cull_face = rast->cull_face;
+   cull->front_ccw = rast->front_ccw;
+   cull->clip = draw->clip_xy || draw->clip_z || draw->clip_user;
+
+   return cull->cull_face != PIPE_FACE_NONE || cull->clip;
+}
+
+
+/**
+ * Test a batch of triangles, given as vertex indices, and write the
+ * indices of those which may be visible to out.
+ * \return number of indices written
+ */
+static unsigned
+cull_batch_run(const struct cull_batch *cull,
+               const char *verts,
+               unsigned stride,
+               const ushort *idx,
+               unsigned num_tris,
+               ushort *out)
+{
+   unsigned and_mask[CULL_BATCH], or_mask[CULL_BATCH];
+   float ex[CULL_BATCH], ey[CULL_BATCH], fx[CULL_BATCH], fy[CULL_BATCH];
+   boolean keep[CULL_BATCH];
+   unsigned i, n = 0;
+
+   assert(num_tris <= CULL_BATCH);
+
+   /* Gather.  Lanes past num_tris repeat the first triangle. */
+   for (i = 0; i < CULL_BATCH; i++) {
+      const unsigned t = i < num_tris ? i : 0;
+      const struct vertex_header *v0 =
+         (const struct vertex_header *)(verts + stride * idx[t * 3 + 0]);
+      const struct vertex_header *v1 =
+         (const struct vertex_header *)(verts + stride * idx[t * 3 + 1]);
+      const struct vertex_header *v2 =
+         (const struct vertex_header *)(verts + stride * idx[t * 3 + 2]);
+      const float *p0 = v0->data[cull->pos];
+      const float *p1 = v1->data[cull->pos];
+      const float *p2 = v2->data[cull->pos];
+
+      and_mask[i] = v0->clipmask & v1->clipmask & v2->clipmask;
+      or_mask[i] = v0->clipmask | v1->clipmask | v2->clipmask;
+
+      /* edge vectors, as in the cull stage */
+      ex[i] = p0[0] - p2[0];
+      ey[i] = p0[1] - p2[1];
+      fx[i] = p1[0] - p2[0];
+      fy[i] = p1[1] - p2[1];
+   }
+
+   /* The tests themselves have no branches, so the compiler can do all
+    * the lanes at once.
+    */
+   for (i = 0; i < CULL_BATCH; i++) {
+      const float det = ex[i] * fy[i] - ey[i] * fx[i];
+      const unsigned ccw = det < 0.0f;
+      const unsigned face = ccw == cull->front_ccw ?
+                            PIPE_FACE_FRONT : PIPE_FACE_BACK;
+      const boolean culled = cull->cull_face != PIPE_FACE_NONE &&
+                             or_mask[i] == 0 &&
+                             (det == 0.0f || (face & cull->cull_face));
+      const boolean rejected = cull->clip && and_mask[i] != 0;
+
+      keep[i] = !(culled | rejected);
+   }
+
+   for (i = 0; i < num_tris; i++) {
+      if (keep[i]) {
+         out[n + 0] = idx[i * 3 + 0];
+         out[n + 1] = idx[i * 3 + 1];
+         out[n + 2] = idx[i * 3 + 2];
+         n += 3;
+      }
+   }
+
+   return n;
+}
+
+
+/**
+ * Run a triangle list through the batched cull, then the pipeline.
+ * \param elts  vertex indices, or NULL for linear vertices
+ */
+static void
+pipe_run_culled_tris(struct draw_context *draw,
+                     const struct cull_batch *cull,
+                     unsigned prim_flags,
+                     struct vertex_header *vertices,
+                     unsigned stride,
+                     const ushort *elts,
+                     unsigned count,
+                     unsigned max_index)
+{
+   const char *verts = (const char *)vertices;
+   ushort idx[CULL_BATCH * 3];
+   ushort out[CULL_BATCH * 3];
+   unsigned start, i;
+
+   for (start = 0; start + 2 < count; start += CULL_BATCH * 3) {
+      const unsigned num_tris = MIN2(CULL_BATCH, (count - start) / 3);
+      unsigned n;
+
+      for (i = 0; i < num_tris * 3; i++)
+         idx[i] = elts ? MIN2(elts[start + i], max_index) : start + i;
+
+      n = cull_batch_run(cull, verts, stride, idx, num_tris, out);
+      if (n)
+         pipe_run_elts(draw, PIPE_PRIM_TRIANGLES, prim_flags,
+                       vertices, stride, out, n, max_index);
+   }
+}
+
 
 /**
  * Code to run the pipeline on a fairly arbitrary collection of vertices.
@@ -227,6 +376,8 @@ void draw_pipeline_run( struct draw_context *draw,
                         const struct draw_vertex_info *vert_info,
                         const struct draw_prim_info *prim_info)
 {
+   struct cull_batch cull;
+   const boolean batch_cull = cull_batch_init(draw, prim_info->prim, &cull);
    unsigned i, start;
 
    draw->pipeline.verts = (char *)vert_info->verts;
@@ -258,14 +409,24 @@ void draw_pipeline_run( struct draw_context *draw,
       }
 #endif
 
-      pipe_run_elts(draw,
-                    prim_info->prim,
-                    prim_info->flags,
-                    vert_info->verts,
-                    vert_info->stride,
-                    prim_info->elts + start,
-                    count,
-                    vert_info->count - 1);
+      if (batch_cull)
+         pipe_run_culled_tris(draw,
+                              &cull,
+                              prim_info->flags,
+                              vert_info->verts,
+                              vert_info->stride,
+                              prim_info->elts + start,
+                              count,
+                              vert_info->count - 1);
+      else
+         pipe_run_elts(draw,
+                       prim_info->prim,
+                       prim_info->flags,
+                       vert_info->verts,
+                       vert_info->stride,
+                       prim_info->elts + start,
+                       count,
+                       vert_info->count - 1);
    }
 
    draw->pipeline.verts = NULL;
@@ -314,6 +475,8 @@ void draw_pipeline_run_linear( struct draw_context *draw,
                                const struct draw_vertex_info *vert_info,
                                const struct draw_prim_info *prim_info)
 {
+   struct cull_batch cull;
+   const boolean batch_cull = cull_batch_init(draw, prim_info->prim, &cull);
    unsigned i, start;
 
    for (start = i = 0;
@@ -330,12 +493,23 @@ void draw_pipeline_run_linear( struct draw_context *draw,
 
       assert(count <= vert_info->count);
 
-      pipe_run_linear(draw,
-                      prim_info->prim,
-                      prim_info->flags,
-                      (struct vertex_header*)verts,
-                      vert_info->stride,
-                      count);
+      /* the batched cull passes the vertices as 16-bit indices */
+      if (batch_cull && count <= 0xffff)
+         pipe_run_culled_tris(draw,
+                              &cull,
+                              prim_info->flags,
+                              (struct vertex_header*)verts,
+                              vert_info->stride,
+                              NULL,
+                              count,
+                              count - 1);
+      else
+         pipe_run_linear(draw,
+                         prim_info->prim,
+                         prim_info->flags,
+                         (struct vertex_header*)verts,
+                         vert_info->stride,
+                         count);
    }
 
    draw->pipeline.verts = NULL;
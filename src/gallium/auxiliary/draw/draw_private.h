@@ -160,6 +160,12 @@ struct draw_context
 
       boolean rebind_parameters;
 
+      /** Vertices shaded and triangles drawn, see draw_get_acmr() */
+      struct {
+         uint64_t vertices;
+         uint64_t triangles;
+      } vcache_stats;
+
       struct {
          struct draw_pt_middle_end *fetch_emit;
          struct draw_pt_middle_end *fetch_shade_emit;
@@ -124,6 +124,11 @@ struct draw_pt_middle_end {
 
    int (*get_max_vertex_count)( struct draw_pt_middle_end * );
 
+   /* Optional.  Complete the work the run functions may have deferred;
+    * called at the end of each draw.
+    */
+   void (*flush)( struct draw_pt_middle_end * );
+
    void (*finish)( struct draw_pt_middle_end * );
    void (*destroy)( struct draw_pt_middle_end * );
 };
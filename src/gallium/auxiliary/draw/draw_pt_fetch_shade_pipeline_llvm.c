@@ -25,9 +25,11 @@
  *
  **************************************************************************/
 
+#include "util/u_cpu_detect.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_queue.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -39,6 +41,48 @@
 #include "gallivm/lp_bld_init.h"
 
 
+/** Max number of worker threads shading vertices */
+#define DRAW_MAX_THREADS 8
+
+/** Max number of chunks of a draw shaded in parallel */
+#define DRAW_MAX_CHUNKS 32
+
+
+DEBUG_GET_ONCE_NUM_OPTION(draw_threads, "DRAW_THREADS",
+                          MIN2(util_cpu_caps.nr_cpus - 1, DRAW_MAX_THREADS))
+
+
+struct llvm_middle_end;
+
+
+/**
+ * A chunk of a draw, as cut by the front end.
+ *
+ * The vertices of the chunks of a draw are fetched and shaded in parallel
+ * by the worker threads, then the chunks go through the rest of the
+ * pipeline in order on the calling thread.
+ */
+struct llvm_chunk {
+   struct llvm_middle_end *fpme;
+
+   struct draw_fetch_info fetch_info;
+   struct draw_prim_info prim_info;
+   unsigned draw_count;
+
+   /** Copy of the fetch and draw elements, which the front end reuses.
+    * Kept from draw to draw, and only grown.
+    */
+   void *elts;
+   unsigned elts_size;
+
+   struct draw_vertex_info vert_info;
+   unsigned clipped;
+
+   unsigned fpstate;
+   struct util_queue_fence fence;
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -56,6 +100,12 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   /** Worker threads, if any */
+   struct util_queue queue;
+
+   struct llvm_chunk chunks[DRAW_MAX_CHUNKS];
+   unsigned num_chunks;
 };
 
 
@@ -336,46 +386,32 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Fetch and shade the vertices of a chunk.
+ * Only reads shared state, so that chunks can be shaded in parallel.
+ */
 static void
-llvm_pipeline_generic(struct draw_pt_middle_end *middle,
-                      const struct draw_fetch_info *fetch_info,
-                      const struct draw_prim_info *in_prim_info)
+llvm_pipeline_shade(struct llvm_middle_end *fpme,
+                    const struct draw_fetch_info *fetch_info,
+                    struct draw_vertex_info *vert_info,
+                    unsigned *clipped)
 {
-   struct llvm_middle_end *fpme = llvm_middle_end(middle);
    struct draw_context *draw = fpme->draw;
-   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
-   struct draw_prim_info gs_prim_info;
-   struct draw_vertex_info llvm_vert_info;
-   struct draw_vertex_info gs_vert_info;
-   struct draw_vertex_info *vert_info;
-   struct draw_prim_info ia_prim_info;
-   struct draw_vertex_info ia_vert_info;
-   const struct draw_prim_info *prim_info = in_prim_info;
-   boolean free_prim_info = FALSE;
-   unsigned opt = fpme->opt;
-   unsigned clipped = 0;
 
-   llvm_vert_info.count = fetch_info->count;
-   llvm_vert_info.vertex_size = fpme->vertex_size;
-   llvm_vert_info.stride = fpme->vertex_size;
-   llvm_vert_info.verts = (struct vertex_header *)
+   vert_info->count = fetch_info->count;
+   vert_info->vertex_size = fpme->vertex_size;
+   vert_info->stride = fpme->vertex_size;
+   vert_info->verts = (struct vertex_header *)
       MALLOC(fpme->vertex_size *
-             align(fetch_info->count, lp_native_vector_width / 32));
-   if (!llvm_vert_info.verts) {
+             align(fetch_info->count, draw_llvm_vs_vector_length()));
+   if (!vert_info->verts) {
       assert(0);
       return;
    }
 
-   if (draw->collect_statistics) {
-      draw->statistics.ia_vertices += prim_info->count;
-      draw->statistics.ia_primitives +=
-         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
-   }
-
    if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
+      *clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                       vert_info->verts,
                                        draw->pt.user.vbuffer,
                                        fetch_info->start,
                                        fetch_info->count,
@@ -385,8 +421,8 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                        draw->start_index,
                                        draw->start_instance);
    else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
+      *clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                            vert_info->verts,
                                             draw->pt.user.vbuffer,
                                             fetch_info->elts,
                                             draw->pt.user.eltMax,
@@ -396,11 +432,40 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                                             draw->instance_id,
                                             draw->pt.user.eltBias,
                                             draw->start_instance);
+}
 
-   /* Finished with fetch and vs:
-    */
-   fetch_info = NULL;
-   vert_info = &llvm_vert_info;
+
+/**
+ * Run the shaded vertices of a chunk through the rest of the pipeline.
+ * Takes ownership of the vertices.
+ */
+static void
+llvm_pipeline_finish(struct llvm_middle_end *fpme,
+                     unsigned fetch_count,
+                     struct draw_vertex_info *in_vert_info,
+                     const struct draw_prim_info *in_prim_info,
+                     unsigned clipped)
+{
+   struct draw_context *draw = fpme->draw;
+   struct draw_geometry_shader *gshader = draw->gs.geometry_shader;
+   struct draw_prim_info gs_prim_info;
+   struct draw_vertex_info gs_vert_info;
+   struct draw_vertex_info *vert_info = in_vert_info;
+   struct draw_prim_info ia_prim_info;
+   struct draw_vertex_info ia_vert_info;
+   const struct draw_prim_info *prim_info = in_prim_info;
+   boolean free_prim_info = FALSE;
+   unsigned opt = fpme->opt;
+
+   if (!vert_info->verts)
+      return;
+
+   if (draw->collect_statistics) {
+      draw->statistics.ia_vertices += prim_info->count;
+      draw->statistics.ia_primitives +=
+         u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
+      draw->statistics.vs_invocations += fetch_count;
+   }
 
    if ((opt & PT_SHADE) && gshader) {
       struct draw_vertex_shader *vshader = draw->vs.vertex_shader;
@@ -474,6 +539,147 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
 }
 
 
+static void
+llvm_chunk_shade(void *data, int thread_index)
+{
+   struct llvm_chunk *chunk = (struct llvm_chunk *) data;
+   unsigned fpstate = util_fpstate_get();
+
+   /* shade with the floating point state of the calling thread */
+   util_fpstate_set(chunk->fpstate);
+
+   llvm_pipeline_shade(chunk->fpme, &chunk->fetch_info, &chunk->vert_info,
+                       &chunk->clipped);
+
+   util_fpstate_set(fpstate);
+}
+
+
+/**
+ * Process the queued chunks: shade them on the worker threads, and
+ * finish them in order as they become ready.
+ */
+static void
+llvm_middle_end_flush(struct draw_pt_middle_end *middle)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   const unsigned num_chunks = fpme->num_chunks;
+   unsigned fpstate;
+   unsigned i;
+
+   if (num_chunks == 0)
+      return;
+
+   fpme->num_chunks = 0;
+
+   /* the first chunk is shaded here, while the workers get the others */
+   fpstate = util_fpstate_get();
+   for (i = 1; i < num_chunks; i++) {
+      struct llvm_chunk *chunk = &fpme->chunks[i];
+
+      chunk->fpstate = fpstate;
+      util_queue_add_job(&fpme->queue, chunk, &chunk->fence,
+                         llvm_chunk_shade, NULL);
+   }
+
+   llvm_pipeline_shade(fpme, &fpme->chunks[0].fetch_info,
+                       &fpme->chunks[0].vert_info, &fpme->chunks[0].clipped);
+
+   for (i = 0; i < num_chunks; i++) {
+      struct llvm_chunk *chunk = &fpme->chunks[i];
+
+      if (i > 0)
+         util_queue_job_wait(&chunk->fence);
+
+      llvm_pipeline_finish(fpme, chunk->fetch_info.count,
+                           &chunk->vert_info, &chunk->prim_info,
+                           chunk->clipped);
+   }
+}
+
+
+/**
+ * Queue a chunk for llvm_middle_end_flush(), copying the elements into
+ * the chunk slot's buffer.
+ * Returns FALSE if the chunk must be run right away instead.
+ */
+static boolean
+llvm_middle_end_queue(struct llvm_middle_end *fpme,
+                      const struct draw_fetch_info *fetch_info,
+                      const struct draw_prim_info *prim_info)
+{
+   struct llvm_chunk *chunk;
+   unsigned fetch_size = 0, draw_size = 0;
+
+   if (!util_queue_is_initialized(&fpme->queue))
+      return FALSE;
+
+   if (fpme->num_chunks == ARRAY_SIZE(fpme->chunks))
+      llvm_middle_end_flush(&fpme->base);
+
+   chunk = &fpme->chunks[fpme->num_chunks];
+
+   if (!fetch_info->linear)
+      fetch_size = fetch_info->count * sizeof(fetch_info->elts[0]);
+   if (!prim_info->linear)
+      draw_size = prim_info->count * sizeof(prim_info->elts[0]);
+
+   if (fetch_size + draw_size > chunk->elts_size) {
+      FREE(chunk->elts);
+      chunk->elts = MALLOC(fetch_size + draw_size);
+      if (!chunk->elts) {
+         chunk->elts_size = 0;
+         /* keep the order of the chunks */
+         llvm_middle_end_flush(&fpme->base);
+         return FALSE;
+      }
+      chunk->elts_size = fetch_size + draw_size;
+   }
+
+   chunk->fetch_info = *fetch_info;
+   if (!fetch_info->linear) {
+      memcpy(chunk->elts, fetch_info->elts, fetch_size);
+      chunk->fetch_info.elts = (const unsigned *) chunk->elts;
+   }
+
+   chunk->prim_info = *prim_info;
+   if (!prim_info->linear) {
+      ushort *draw_elts = (ushort *) ((char *) chunk->elts + fetch_size);
+
+      memcpy(draw_elts, prim_info->elts, draw_size);
+      chunk->prim_info.elts = draw_elts;
+   }
+   chunk->draw_count = prim_info->count;
+   chunk->prim_info.primitive_lengths = &chunk->draw_count;
+
+   assert(prim_info->primitive_count == 1);
+
+   chunk->fpme = fpme;
+   chunk->clipped = 0;
+   fpme->num_chunks++;
+
+   return TRUE;
+}
+
+
+static void
+llvm_pipeline_generic(struct draw_pt_middle_end *middle,
+                      const struct draw_fetch_info *fetch_info,
+                      const struct draw_prim_info *prim_info)
+{
+   struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   struct draw_vertex_info vert_info;
+   unsigned clipped = 0;
+
+   if (llvm_middle_end_queue(fpme, fetch_info, prim_info))
+      return;
+
+   llvm_pipeline_shade(fpme, fetch_info, &vert_info, &clipped);
+   llvm_pipeline_finish(fpme, fetch_info->count, &vert_info, prim_info,
+                        clipped);
+}
+
+
 static inline unsigned
 prim_type(unsigned prim, unsigned flags)
 {
@@ -577,7 +783,7 @@ llvm_middle_end_linear_run_elts(struct draw_pt_middle_end *middle,
 static void
 llvm_middle_end_finish(struct draw_pt_middle_end *middle)
 {
-   /* nothing to do */
+   llvm_middle_end_flush(middle);
 }
 
 
@@ -585,6 +791,16 @@ static void
 llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
 {
    struct llvm_middle_end *fpme = llvm_middle_end(middle);
+   unsigned i;
+
+   if (util_queue_is_initialized(&fpme->queue)) {
+      llvm_middle_end_flush(middle);
+      util_queue_destroy(&fpme->queue);
+      for (i = 0; i < ARRAY_SIZE(fpme->chunks); i++) {
+         util_queue_fence_destroy(&fpme->chunks[i].fence);
+         FREE(fpme->chunks[i].elts);
+      }
+   }
 
    if (fpme->fetch)
       draw_pt_fetch_destroy( fpme->fetch );
@@ -606,6 +822,8 @@ struct draw_pt_middle_end *
 draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 {
    struct llvm_middle_end *fpme = 0;
+   unsigned num_threads;
+   unsigned i;
 
    if (!draw->llvm)
       return NULL;
@@ -619,6 +837,7 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
    fpme->base.run             = llvm_middle_end_run;
    fpme->base.run_linear      = llvm_middle_end_linear_run;
    fpme->base.run_linear_elts = llvm_middle_end_linear_run_elts;
+   fpme->base.flush           = llvm_middle_end_flush;
    fpme->base.finish          = llvm_middle_end_finish;
    fpme->base.destroy         = llvm_middle_end_destroy;
 
@@ -646,6 +865,17 @@ draw_pt_fetch_pipeline_or_emit_llvm(struct draw_context *draw)
 
    fpme->current_variant = NULL;
 
+   /* Shade the chunks of big draws in parallel */
+   num_threads = debug_get_option_draw_threads();
+   if (num_threads > 0) {
+      num_threads = MIN2(num_threads, DRAW_MAX_THREADS);
+      if (util_queue_init(&fpme->queue, "draw", DRAW_MAX_CHUNKS,
+                          num_threads)) {
+         for (i = 0; i < ARRAY_SIZE(fpme->chunks); i++)
+            util_queue_fence_init(&fpme->chunks[i].fence);
+      }
+   }
+
    return &fpme->base;
 
  fail:
@@ -25,13 +25,21 @@
 
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/u_prim.h"
 
 #include "draw/draw_context.h"
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
 
-#define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+/** Max number of draw elements per segment */
+#define SEGMENT_SIZE 4096
+
+/** Default number of draw elements per segment */
+#define DEFAULT_SEGMENT_SIZE 1024
+
+/** Size of the fetch element hash table, with a load of at most 1/2 */
+#define MAP_ORDER    13
+#define MAP_SIZE     (1 << MAP_ORDER)
 
 /* The largest possible index withing an index buffer */
 #define MAX_ELT_IDX 0xffffffff
@@ -52,11 +60,17 @@ struct vsplit_frontend {
    ushort draw_elts[SEGMENT_SIZE];
    ushort identity_draw_elts[SEGMENT_SIZE];
 
+   /*
+    * Post-transform vertex cache: each distinct fetch element of a segment
+    * is fetched and shaded once.
+    */
    struct {
-      /* map a fetch element to a draw element */
+      /* map a fetch element to a draw element, with open addressing */
       unsigned fetches[MAP_SIZE];
       ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      /* entries are valid when their stamp is the current one */
+      unsigned stamps[MAP_SIZE];
+      unsigned stamp;
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
@@ -64,18 +78,45 @@ struct vsplit_frontend {
 };
 
 
+DEBUG_GET_ONCE_NUM_OPTION(vertex_cache_size, "DRAW_VERTEX_CACHE_SIZE",
+                          DEFAULT_SEGMENT_SIZE)
+
+
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
+   /* invalidate all the entries at once */
+   if (++vsplit->cache.stamp == 0) {
+      memset(vsplit->cache.stamps, 0, sizeof(vsplit->cache.stamps));
+      vsplit->cache.stamp = 1;
+   }
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
 
+
+/**
+ * Account the vertices shaded for a segment, to evaluate the vertex cache.
+ */
+static inline void
+vsplit_count_vertices(struct vsplit_frontend *vsplit,
+                      unsigned fetch_count, unsigned draw_count)
+{
+   struct draw_context *draw = vsplit->draw;
+
+   if (u_reduced_prim(vsplit->prim) == PIPE_PRIM_TRIANGLES) {
+      draw->pt.vcache_stats.vertices += fetch_count;
+      draw->pt.vcache_stats.triangles +=
+         u_decomposed_prims_for_vertices(vsplit->prim, draw_count);
+   }
+}
+
 static void
 vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 {
+   vsplit_count_vertices(vsplit, vsplit->cache.num_fetch_elts,
+                         vsplit->cache.num_draw_elts);
+
    vsplit->middle->run(vsplit->middle,
          vsplit->fetch_elts, vsplit->cache.num_fetch_elts,
          vsplit->draw_elts, vsplit->cache.num_draw_elts, flags);
@@ -87,23 +128,37 @@ vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 static inline void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch, unsigned ofbias)
 {
-   unsigned hash;
+   /* Fibonacci hashing, which spreads strided indices */
+   unsigned hash = (fetch * 2654435769u) >> (32 - MAP_ORDER);
+   ushort draw;
 
-   hash = fetch % MAP_SIZE;
+   /* An overflow due to the element bias always gets its own vertex */
+   if (ofbias) {
+      draw = vsplit->cache.num_fetch_elts;
+   }
+   else {
+      while (vsplit->cache.stamps[hash] == vsplit->cache.stamp &&
+             vsplit->cache.fetches[hash] != fetch)
+         hash = (hash + 1) & (MAP_SIZE - 1);
+
+      if (vsplit->cache.stamps[hash] == vsplit->cache.stamp) {
+         vsplit->draw_elts[vsplit->cache.num_draw_elts++] =
+            vsplit->cache.draws[hash];
+         return;
+      }
 
-   /* If the value isn't in the cache or it's an overflow due to the
-    * element bias */
-   if (vsplit->cache.fetches[hash] != fetch || ofbias) {
       /* update cache */
+      draw = vsplit->cache.num_fetch_elts;
+      vsplit->cache.stamps[hash] = vsplit->cache.stamp;
       vsplit->cache.fetches[hash] = fetch;
-      vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
-
-      /* add fetch */
-      assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
-      vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
+      vsplit->cache.draws[hash] = draw;
    }
 
-   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[hash];
+   /* add fetch */
+   assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
+   vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
+
+   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = draw;
 }
 
 /**
@@ -198,16 +253,7 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
                       unsigned start, unsigned fetch, int elt_bias)
 {
    struct draw_context *draw = vsplit->draw;
-   unsigned raw_elem_idx = start + fetch + elt_bias;
    VSPLIT_CREATE_IDX(elts, start, fetch, elt_bias);
-
-   /* special care for DRAW_MAX_FETCH_IDX */
-   if (raw_elem_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = fetch % MAP_SIZE;
-      vsplit->cache.fetches[hash] = raw_elem_idx - 1; /* force update */
-      vsplit->cache.has_max_fetch = TRUE;
-   }
-
    vsplit_add_cache(vsplit, elt_idx, ofbias);
 }
 
@@ -237,6 +283,7 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
                            unsigned opt)
 {
    struct vsplit_frontend *vsplit = (struct vsplit_frontend *) frontend;
+   unsigned cache_size;
 
    switch (vsplit->draw->pt.user.eltSize) {
    case 0:
@@ -262,7 +309,9 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
    vsplit->middle = middle;
    middle->prepare(middle, vsplit->prim, opt, &vsplit->max_vertices);
 
-   vsplit->segment_size = MIN2(SEGMENT_SIZE, vsplit->max_vertices);
+   /* the segment size is the reach of the vertex cache */
+   cache_size = CLAMP(debug_get_option_vertex_cache_size(), 64, SEGMENT_SIZE);
+   vsplit->segment_size = MIN2(cache_size, vsplit->max_vertices);
 }
 
 
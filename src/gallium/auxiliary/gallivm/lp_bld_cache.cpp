@@ -0,0 +1,345 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#ifndef __STDC_LIMIT_MACROS
+#define __STDC_LIMIT_MACROS
+#endif
+
+#ifndef __STDC_CONSTANT_MACROS
+#define __STDC_CONSTANT_MACROS
+#endif
+
+// Undef these vars just to silence warnings
+#undef PACKAGE_BUGREPORT
+#undef PACKAGE_NAME
+#undef PACKAGE_STRING
+#undef PACKAGE_TARNAME
+#undef PACKAGE_VERSION
+
+
+#include <stddef.h>
+
+// Workaround http://llvm.org/PR23628
+#if HAVE_LLVM >= 0x0307
+#  pragma push_macro("DEBUG")
+#  undef DEBUG
+#endif
+
+#include <llvm-c/Core.h>
+#include <llvm-c/ExecutionEngine.h>
+#if HAVE_LLVM >= 0x0306
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#endif
+
+// Workaround http://llvm.org/PR23628
+#if HAVE_LLVM >= 0x0307
+#  pragma pop_macro("DEBUG")
+#endif
+
+#include "pipe/p_config.h"
+#include "util/u_debug.h"
+#include "util/u_cpu_detect.h"
+#include "util/mesa-sha1.h"
+
+#include "lp_bld_type.h"
+#include "lp_bld_cache.h"
+
+
+/**
+ * Bump when the layout of the cache entries or of the key changes.
+ */
+#define LP_OBJECT_CACHE_VERSION 1
+
+
+#if HAVE_LLVM >= 0x0306
+
+
+DEBUG_GET_ONCE_OPTION(cache_dir, "LP_CACHE_DIR", NULL)
+
+
+/**
+ * The cache of a single module.
+ *
+ * MCJIT asks it for the object before compiling the module, and hands it
+ * the object once compiled otherwise.
+ */
+struct lp_object_cache : public llvm::ObjectCache {
+   std::string Path;
+   std::unique_ptr<llvm::MemoryBuffer> Object;
+
+   void
+   notifyObjectCompiled(const llvm::Module *M,
+                        llvm::MemoryBufferRef Obj) override
+   {
+      using namespace llvm;
+
+      SmallString<256> TmpPath;
+      int FD;
+
+      /* Write to a unique file and rename it, so that concurrent processes
+       * never see a partially written entry.
+       */
+      sys::fs::create_directories(debug_get_option_cache_dir());
+      if (sys::fs::createUniqueFile(Path + ".%%%%%%.tmp", FD, TmpPath))
+         return;
+
+      {
+         raw_fd_ostream OS(FD, true);
+         OS.write(Obj.getBufferStart(), Obj.getBufferSize());
+         OS.close();
+         if (OS.has_error()) {
+            OS.clear_error();
+            sys::fs::remove(TmpPath);
+            return;
+         }
+      }
+
+      if (sys::fs::rename(TmpPath, Path))
+         sys::fs::remove(TmpPath);
+   }
+
+   std::unique_ptr<llvm::MemoryBuffer>
+   getObject(const llvm::Module *M) override
+   {
+      return std::move(Object);
+   }
+};
+
+
+/**
+ * Give the defined functions names that don't depend on how many shaders
+ * and variants were created before, so that the same variant produces the
+ * same IR, and the same symbols, in every process.
+ */
+static void
+canonicalize_names(llvm::Module *M)
+{
+   unsigned i = 0;
+
+   for (llvm::Function &F : *M) {
+      if (!F.isDeclaration())
+         F.setName("func" + llvm::Twine(i++));
+   }
+}
+
+
+/**
+ * Hash the module and everything else which affects the generated code.
+ * \return false if hashing isn't available
+ */
+static bool
+hash_module(llvm::Module *M, unsigned OptLevel, unsigned char sha1[20])
+{
+   using namespace llvm;
+
+   const unsigned version = LP_OBJECT_CACHE_VERSION;
+   const unsigned llvm_version = HAVE_LLVM;
+   const unsigned pointer_size = sizeof(void *);
+   SmallVector<char, 0> Bitcode;
+   std::string CPU = sys::getHostCPUName().str();
+   std::string ModuleID = M->getModuleIdentifier();
+   struct mesa_sha1 *ctx;
+
+   /* The module name carries the shader and variant numbers */
+   M->setModuleIdentifier("");
+#if HAVE_LLVM >= 0x0309
+   M->setSourceFileName("");
+#endif
+   {
+      raw_svector_ostream OS(Bitcode);
+      WriteBitcodeToFile(M, OS);
+   }
+   M->setModuleIdentifier(ModuleID);
+#if HAVE_LLVM >= 0x0309
+   M->setSourceFileName(ModuleID);
+#endif
+
+   ctx = _mesa_sha1_init();
+   if (!ctx)
+      return false;
+
+   _mesa_sha1_update(ctx, &version, sizeof version);
+   _mesa_sha1_update(ctx, &llvm_version, sizeof llvm_version);
+#ifdef LLVM_VERSION_STRING
+   _mesa_sha1_update(ctx, LLVM_VERSION_STRING, sizeof LLVM_VERSION_STRING);
+#endif
+   _mesa_sha1_update(ctx, &pointer_size, sizeof pointer_size);
+   _mesa_sha1_update(ctx, CPU.data(), CPU.size());
+   _mesa_sha1_update(ctx, &util_cpu_caps, sizeof util_cpu_caps);
+   _mesa_sha1_update(ctx, &lp_native_vector_width,
+                     sizeof lp_native_vector_width);
+   _mesa_sha1_update(ctx, &OptLevel, sizeof OptLevel);
+   _mesa_sha1_update(ctx, Bitcode.data(), Bitcode.size());
+
+   return _mesa_sha1_final(ctx, sha1) != 0;
+}
+
+
+/**
+ * Whether modules get cached at all.
+ */
+extern "C" boolean
+lp_object_cache_enabled(void)
+{
+   return debug_get_option_cache_dir() != NULL;
+}
+
+
+/**
+ * The directory of the cache, for the JIT code of other components.
+ * \return NULL if caching is disabled
+ */
+extern "C" const char *
+lp_object_cache_dir(void)
+{
+   return debug_get_option_cache_dir();
+}
+
+
+/**
+ * Look up a module in the cache.
+ * Must be called on the complete, unoptimized module.
+ * \return NULL if caching is disabled
+ */
+extern "C" struct lp_object_cache *
+lp_object_cache_create(LLVMModuleRef module, unsigned opt_level)
+{
+   using namespace llvm;
+
+   const char *dir = debug_get_option_cache_dir();
+   Module *M = unwrap(module);
+   unsigned char sha1[20];
+   char name[41];
+
+   if (!dir)
+      return NULL;
+
+   canonicalize_names(M);
+
+   if (!hash_module(M, opt_level, sha1))
+      return NULL;
+
+   _mesa_sha1_format(name, sha1);
+
+   lp_object_cache *cache = new lp_object_cache;
+   cache->Path = std::string(dir) + "/" + name + ".o";
+
+   ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFile(cache->Path, -1, false);
+   if (Buffer && (*Buffer)->getBufferSize())
+      cache->Object = std::move(*Buffer);
+
+   return cache;
+}
+
+
+/**
+ * Whether the object code of the module was found on disk.
+ */
+extern "C" boolean
+lp_object_cache_has_object(const struct lp_object_cache *cache)
+{
+   return cache->Object != nullptr;
+}
+
+
+/**
+ * Make the engine use the cache.
+ * Must be called before the engine generates code.
+ */
+extern "C" void
+lp_object_cache_attach(struct lp_object_cache *cache,
+                       LLVMExecutionEngineRef engine)
+{
+   llvm::unwrap(engine)->setObjectCache(cache);
+}
+
+
+/**
+ * Must be called after the engine using the cache is disposed of.
+ */
+extern "C" void
+lp_object_cache_destroy(struct lp_object_cache *cache)
+{
+   delete cache;
+}
+
+
+#else /* HAVE_LLVM < 0x0306 */
+
+
+extern "C" boolean
+lp_object_cache_enabled(void)
+{
+   return FALSE;
+}
+
+
+extern "C" const char *
+lp_object_cache_dir(void)
+{
+   return NULL;
+}
+
+
+extern "C" struct lp_object_cache *
+lp_object_cache_create(LLVMModuleRef module, unsigned opt_level)
+{
+   return NULL;
+}
+
+
+extern "C" boolean
+lp_object_cache_has_object(const struct lp_object_cache *cache)
+{
+   return FALSE;
+}
+
+
+extern "C" void
+lp_object_cache_attach(struct lp_object_cache *cache,
+                       LLVMExecutionEngineRef engine)
+{
+}
+
+
+extern "C" void
+lp_object_cache_destroy(struct lp_object_cache *cache)
+{
+}
+
+
+#endif /* HAVE_LLVM < 0x0306 */
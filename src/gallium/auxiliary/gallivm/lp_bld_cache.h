@@ -0,0 +1,86 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * On-disk cache of MCJIT object code.
+ *
+ * When LP_CACHE_DIR is set, the object code of each compiled module is
+ * written to that directory, and loaded from it instead of optimizing and
+ * compiling the module again in a later process.  MCJIT relocates the
+ * loaded object just like a freshly compiled one.
+ *
+ * An entry is named after a hash of the unoptimized IR, which is itself a
+ * function of the variant key and the shader, together with the CPU
+ * features, the LLVM version and the optimization level.  Modules which
+ * embed addresses of the running process (see lp_build_const_int_pointer())
+ * are never cached.
+ */
+
+
+#ifndef LP_BLD_CACHE_H
+#define LP_BLD_CACHE_H
+
+
+#include "lp_bld.h"
+#include <llvm-c/ExecutionEngine.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct lp_object_cache;
+
+
+boolean
+lp_object_cache_enabled(void);
+
+const char *
+lp_object_cache_dir(void);
+
+
+struct lp_object_cache *
+lp_object_cache_create(LLVMModuleRef module, unsigned opt_level);
+
+boolean
+lp_object_cache_has_object(const struct lp_object_cache *cache);
+
+void
+lp_object_cache_attach(struct lp_object_cache *cache,
+                       LLVMExecutionEngineRef engine);
+
+void
+lp_object_cache_destroy(struct lp_object_cache *cache);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* !LP_BLD_CACHE_H */
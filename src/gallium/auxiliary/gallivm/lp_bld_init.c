@@ -28,14 +28,18 @@
 
 #include "pipe/p_config.h"
 #include "pipe/p_compiler.h"
+#include "util/u_atomic.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
+#include "os/os_thread.h"
 #include "os/os_time.h"
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
 #include "lp_bld_misc.h"
+#include "lp_bld_cache.h"
+#include "lp_bld_type.h"
 #include "lp_bld_init.h"
 
 #include <llvm-c/Analysis.h>
@@ -52,6 +56,14 @@
 static bool USE_MCJIT = 0;
 #endif
 
+/* The ORC JIT C bindings, for the shared JIT session */
+#if HAVE_LLVM >= 0x0309 && !defined(_WIN32) && \
+    (defined(PIPE_ARCH_X86) || defined(PIPE_ARCH_X86_64))
+#  define HAVE_JIT_SESSION 1
+#  include <llvm-c/OrcBindings.h>
+#  include <llvm-c/Support.h>
+#endif
+
 
 #ifdef DEBUG
 unsigned gallivm_debug = 0;
@@ -67,6 +79,7 @@ static const struct debug_named_value lp_bld_debug_flags[] = {
    { "no_quad_lod", GALLIVM_DEBUG_NO_QUAD_LOD, NULL },
    { "gc",     GALLIVM_DEBUG_GC, NULL },
    { "dumpbc", GALLIVM_DEBUG_DUMP_BC, NULL },
+   { "no_shared_tex", GALLIVM_DEBUG_NO_SHARED_TEX, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -96,9 +109,60 @@ enum LLVM_CodeGenOpt_Level {
 };
 
 
+static enum LLVM_CodeGenOpt_Level
+get_opt_level(const struct gallivm_state *gallivm)
+{
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) || gallivm->fast)
+      return None;
+   else
+      return Default;
+}
+
+
+static enum gallivm_tier
+get_tier(const struct gallivm_state *gallivm)
+{
+   return gallivm->fast ? GALLIVM_TIER_FAST : GALLIVM_TIER_OPTIMIZED;
+}
+
+
+static const char *tier_names[GALLIVM_NUM_TIERS] = {
+   "fast",
+   "optimized"
+};
+
+static struct gallivm_compile_stats compile_stats[GALLIVM_NUM_TIERS];
+
+
+/**
+ * Account compile time to the module and its tier.
+ */
+static void
+add_compile_time(struct gallivm_state *gallivm, int64_t usecs)
+{
+   gallivm->compile_time += usecs;
+   p_atomic_add(&compile_stats[get_tier(gallivm)].usecs, (uint64_t)usecs);
+}
+
+
+/**
+ * Get the number of modules compiled with a tier and the time spent on
+ * them, by this process.
+ */
+void
+gallivm_get_compile_stats(enum gallivm_tier tier,
+                          struct gallivm_compile_stats *stats)
+{
+   assert(tier < GALLIVM_NUM_TIERS);
+   stats->modules = p_atomic_read(&compile_stats[tier].modules);
+   stats->usecs = p_atomic_read(&compile_stats[tier].usecs);
+}
+
+
 /**
- * Create the LLVM (optimization) pass manager and install
- * relevant optimization passes.
+ * Create the LLVM (optimization) pass manager.
+ * The passes are only added by add_passes(), once it is known whether the
+ * module is to be compiled fast.
  * \return  TRUE for success, FALSE for failure
  */
 static boolean
@@ -145,7 +209,31 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMSetDataLayout(gallivm->module, "");
 #endif
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   return TRUE;
+}
+
+
+/**
+ * Install the relevant optimization passes.
+ */
+static void
+add_passes(struct gallivm_state *gallivm)
+{
+   if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      /* We need at least this pass to prevent the backends to fail in
+       * unexpected ways.
+       */
+      LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
+   }
+   else if (gallivm->fast) {
+      /* Only the cheap passes which shrink the IR the most, as a smaller
+       * module is also faster to generate code for.
+       */
+      LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
+      LLVMAddEarlyCSEPass(gallivm->passmgr);
+      LLVMAddCFGSimplificationPass(gallivm->passmgr);
+   }
+   else {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -159,17 +247,222 @@ create_pass_manager(struct gallivm_state *gallivm)
       LLVMAddInstructionCombiningPass(gallivm->passmgr);
       LLVMAddGVNPass(gallivm->passmgr);
    }
-   else {
-      /* We need at least this pass to prevent the backends to fail in
-       * unexpected ways.
-       */
-      LLVMAddPromoteMemoryToRegisterPass(gallivm->passmgr);
+}
+
+
+#ifdef HAVE_JIT_SESSION
+
+/*
+ * JIT sessions shared by all the modules, one per optimization level.
+ *
+ * Giving each module its own MCJIT engine means setting up a target
+ * machine and a code generator for each of the potentially thousands of
+ * variants.  Instead the modules are compiled into one long-lived ORC JIT
+ * stack, and removed from it when their code is freed.
+ *
+ * Only the target machine and the JIT stack are shared: no code is shared
+ * between the modules.  Modules of different contexts and variants use the
+ * same symbol names, so the globals of each module get a unique ".<id>"
+ * suffix in the session, and a module can't refer to the globals of
+ * another.  Declarations are only resolved against the symbols of the
+ * process (the C helpers the generated code calls).
+ */
+struct gallivm_session {
+   LLVMTargetMachineRef target_machine;
+   LLVMOrcJITStackRef stack;
+};
+
+static struct gallivm_session gallivm_sessions[Aggressive + 1];
+static unsigned gallivm_session_next_id = 1;
+pipe_static_mutex(gallivm_session_mutex);
+
+DEBUG_GET_ONCE_BOOL_OPTION(jit_session, "GALLIVM_JIT_SESSION", TRUE)
+
+
+/**
+ * Resolve the declarations of a module compiled into the session.  Only the
+ * process is searched, never the modules already in the session.
+ */
+static uint64_t
+session_resolve_symbol(const char *name, void *ctx)
+{
+#ifdef __APPLE__
+   /* skip the global prefix the session mangles names with */
+   if (name[0] == '_')
+      name++;
+#endif
+   return (uint64_t)(uintptr_t)LLVMSearchForAddressOfSymbol(name);
+}
+
+
+/**
+ * Return the session for an optimization level, creating it on first use.
+ * The session mutex must be held.
+ */
+static struct gallivm_session *
+get_session(enum LLVM_CodeGenOpt_Level level)
+{
+   struct gallivm_session *session = &gallivm_sessions[level];
+
+   if (!session->stack) {
+      session->target_machine = lp_build_create_target_machine(level);
+      if (!session->target_machine)
+         return NULL;
+
+      /* Make the symbols of the process visible to the resolver */
+      LLVMLoadLibraryPermanently(NULL);
+
+      session->stack = LLVMOrcCreateInstance(session->target_machine);
+   }
+
+   return session;
+}
+
+
+/**
+ * Name of a global of a module in the session.
+ */
+static void
+session_symbol_name(char *buf, size_t size, LLVMValueRef global, unsigned id)
+{
+   util_snprintf(buf, size, "%s.%u", LLVMGetValueName(global), id);
+}
+
+
+static void
+session_rename_global(LLVMValueRef global, unsigned id)
+{
+   LLVMLinkage linkage = LLVMGetLinkage(global);
+   char name[256];
+
+   if (LLVMIsDeclaration(global) ||
+       linkage == LLVMInternalLinkage ||
+       linkage == LLVMPrivateLinkage)
+      return;
+
+   session_symbol_name(name, sizeof name, global, id);
+   LLVMSetValueName(global, name);
+}
+
+
+/**
+ * Compile the module into the shared session of its optimization level.
+ * \return  FALSE if it has to be compiled by its own engine instead
+ */
+static boolean
+session_add_module(struct gallivm_state *gallivm)
+{
+   const enum LLVM_CodeGenOpt_Level level = get_opt_level(gallivm);
+   struct gallivm_session *session;
+   LLVMModuleRef module;
+   LLVMValueRef global;
+
+   if (!debug_get_option_jit_session())
+      return FALSE;
+
+   /* The session takes ownership of the module it compiles, but the
+    * functions are looked up by their LLVMValueRef afterwards.
+    */
+   module = LLVMCloneModule(gallivm->module);
+   if (!module)
+      return FALSE;
+
+   pipe_mutex_lock(gallivm_session_mutex);
+
+   session = get_session(level);
+   if (session) {
+      gallivm->session.id = gallivm_session_next_id++;
+      gallivm->session.level = level;
+
+      for (global = LLVMGetFirstFunction(module); global;
+           global = LLVMGetNextFunction(global))
+         session_rename_global(global, gallivm->session.id);
+      for (global = LLVMGetFirstGlobal(module); global;
+           global = LLVMGetNextGlobal(global))
+         session_rename_global(global, gallivm->session.id);
+
+      gallivm->session.handle =
+         LLVMOrcAddEagerlyCompiledIR(session->stack, module,
+                                     session_resolve_symbol, NULL);
+   }
+
+   pipe_mutex_unlock(gallivm_session_mutex);
+
+   if (!session) {
+      LLVMDisposeModule(module);
+      return FALSE;
    }
 
    return TRUE;
 }
 
 
+static void *
+session_get_function(const struct gallivm_state *gallivm, LLVMValueRef func)
+{
+   struct gallivm_session *session = &gallivm_sessions[gallivm->session.level];
+   LLVMOrcTargetAddress address;
+   char name[256];
+
+   session_symbol_name(name, sizeof name, func, gallivm->session.id);
+
+   pipe_mutex_lock(gallivm_session_mutex);
+   address = LLVMOrcGetSymbolAddress(session->stack, name);
+   pipe_mutex_unlock(gallivm_session_mutex);
+
+   return (void *)(uintptr_t)address;
+}
+
+
+static void
+session_remove_module(struct gallivm_state *gallivm)
+{
+   struct gallivm_session *session = &gallivm_sessions[gallivm->session.level];
+
+   pipe_mutex_lock(gallivm_session_mutex);
+   LLVMOrcRemoveModule(session->stack, gallivm->session.handle);
+   pipe_mutex_unlock(gallivm_session_mutex);
+
+   gallivm->session.id = 0;
+}
+
+#else /* !HAVE_JIT_SESSION */
+
+static boolean
+session_add_module(struct gallivm_state *gallivm)
+{
+   return FALSE;
+}
+
+static void *
+session_get_function(const struct gallivm_state *gallivm, LLVMValueRef func)
+{
+   assert(0);
+   return NULL;
+}
+
+static void
+session_remove_module(struct gallivm_state *gallivm)
+{
+   assert(0);
+}
+
+#endif /* !HAVE_JIT_SESSION */
+
+
+/**
+ * Address of the code of a compiled function.
+ */
+static void *
+get_function_code(struct gallivm_state *gallivm, LLVMValueRef func)
+{
+   if (gallivm->session.id)
+      return session_get_function(gallivm, func);
+   else
+      return LLVMGetPointerToGlobal(gallivm->engine, func);
+}
+
+
 /**
  * Free gallivm object's LLVM allocations, but not any generated code
  * nor the gallivm object itself.
@@ -188,6 +481,9 @@ gallivm_free_ir(struct gallivm_state *gallivm)
       LLVMDisposeModule(gallivm->module);
    }
 
+   /* Only after the engine, which may still refer to it */
+   lp_object_cache_destroy(gallivm->cache);
+
    FREE(gallivm->module_name);
 
    if (!USE_MCJIT) {
@@ -204,6 +500,7 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    /* The LLVMContext should be owned by the parent of gallivm. */
 
    gallivm->engine = NULL;
+   gallivm->cache = NULL;
    gallivm->target = NULL;
    gallivm->module = NULL;
    gallivm->module_name = NULL;
@@ -221,6 +518,8 @@ gallivm_free_code(struct gallivm_state *gallivm)
 {
    assert(!gallivm->module);
    assert(!gallivm->engine);
+   if (gallivm->session.id)
+      session_remove_module(gallivm);
    lp_free_generated_code(gallivm->code);
    gallivm->code = NULL;
    lp_free_memory_manager(gallivm->memorymgr);
@@ -232,17 +531,10 @@ static boolean
 init_gallivm_engine(struct gallivm_state *gallivm)
 {
    if (1) {
-      enum LLVM_CodeGenOpt_Level optlevel;
+      enum LLVM_CodeGenOpt_Level optlevel = get_opt_level(gallivm);
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
-         optlevel = None;
-      }
-      else {
-         optlevel = Default;
-      }
-
       ret = lp_build_create_jit_compiler_for_module(&gallivm->engine,
                                                     &gallivm->code,
                                                     gallivm->module,
@@ -419,6 +711,11 @@ lp_build_init(void)
       util_cpu_caps.has_sse4_2 = 0;
       util_cpu_caps.has_avx = 0;
       util_cpu_caps.has_avx2 = 0;
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512dq = 0;
+      util_cpu_caps.has_avx512cd = 0;
+      util_cpu_caps.has_avx512bw = 0;
+      util_cpu_caps.has_avx512vl = 0;
       util_cpu_caps.has_f16c = 0;
       util_cpu_caps.has_fma = 0;
    }
@@ -441,8 +738,33 @@ lp_build_init(void)
       lp_native_vector_width = 128;
    }
  
-   lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
-                                                 lp_native_vector_width);
+   /*
+    * 512-bit vectors, i.e. a whole 4x4 stamp per vector in the fragment
+    * shader, have to be asked for: AVX-512 code makes the cores run at a
+    * lower clock frequency, so whether it pays off depends on the load.
+    */
+   {
+      unsigned default_width = lp_native_vector_width;
+
+      lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
+                                                    lp_native_vector_width);
+
+      if (lp_native_vector_width > 256 &&
+          (!util_cpu_caps.has_avx512f ||
+           HAVE_LLVM < 0x0309 || !USE_MCJIT)) {
+         lp_native_vector_width = default_width;
+      }
+      lp_native_vector_width = MIN2(lp_native_vector_width,
+                                    LP_MAX_VECTOR_WIDTH);
+   }
+
+   if (lp_native_vector_width <= 256) {
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512dq = 0;
+      util_cpu_caps.has_avx512cd = 0;
+      util_cpu_caps.has_avx512bw = 0;
+      util_cpu_caps.has_avx512vl = 0;
+   }
 
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
@@ -551,13 +873,15 @@ gallivm_verify_function(struct gallivm_state *gallivm,
 
 /**
  * Compile a module.
- * This does IR optimization on all functions in the module.
+ * This does IR optimization on all functions in the module, unless its
+ * object code is found in the on-disk cache (see lp_bld_cache.h).
  */
 void
 gallivm_compile_module(struct gallivm_state *gallivm)
 {
    LLVMValueRef func;
    int64_t time_begin = 0;
+   int64_t compile_begin = os_time_get();
 
    assert(!gallivm->compiled);
 
@@ -566,10 +890,25 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       gallivm->builder = NULL;
    }
 
+   if (USE_MCJIT && !gallivm->no_cache) {
+      /* Before optimizing, as that's part of what the cache saves */
+      gallivm->cache = lp_object_cache_create(gallivm->module,
+                                              get_opt_level(gallivm));
+   }
+
+   if (gallivm->cache && lp_object_cache_has_object(gallivm->cache)) {
+      if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+         assert(gallivm->module_name);
+         debug_printf("module %s found in cache\n", gallivm->module_name);
+      }
+      goto compile;
+   }
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF)
       time_begin = os_time_get();
 
    /* Run optimization passes */
+   add_passes(gallivm);
    LLVMInitializeFunctionPassManager(gallivm->passmgr);
    func = LLVMGetFirstFunction(gallivm->module);
    while (func) {
@@ -609,16 +948,26 @@ gallivm_compile_module(struct gallivm_state *gallivm)
       debug_printf("Invoke as \"llc -o - %s\"\n", filename);
    }
 
+compile:
    if (USE_MCJIT) {
       assert(!gallivm->engine);
-      if (!init_gallivm_engine(gallivm)) {
-         assert(0);
+      /* The on-disk cache hooks into MCJIT */
+      if (gallivm->cache || !session_add_module(gallivm)) {
+         if (!init_gallivm_engine(gallivm)) {
+            assert(0);
+         }
+         if (gallivm->cache) {
+            lp_object_cache_attach(gallivm->cache, gallivm->engine);
+         }
       }
    }
-   assert(gallivm->engine);
+   assert(gallivm->engine || gallivm->session.id);
 
    ++gallivm->compiled;
 
+   p_atomic_inc(&compile_stats[get_tier(gallivm)].modules);
+   add_compile_time(gallivm, os_time_get() - compile_begin);
+
    if (gallivm_debug & GALLIVM_DEBUG_ASM) {
       LLVMValueRef llvm_func = LLVMGetFirstFunction(gallivm->module);
 
@@ -629,7 +978,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
           * LLVMGetPointerToGlobal() will abort otherwise.
           */
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = get_function_code(gallivm, llvm_func);
             lp_disassemble(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -642,7 +991,7 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
       while (llvm_func) {
          if (!LLVMIsDeclaration(llvm_func)) {
-            void *func_code = LLVMGetPointerToGlobal(gallivm->engine, llvm_func);
+            void *func_code = get_function_code(gallivm, llvm_func);
             lp_profile(llvm_func, func_code);
          }
          llvm_func = LLVMGetNextFunction(llvm_func);
@@ -659,23 +1008,29 @@ gallivm_jit_function(struct gallivm_state *gallivm,
 {
    void *code;
    func_pointer jit_func;
-   int64_t time_begin = 0;
+   int64_t time_begin, time_end;
 
    assert(gallivm->compiled);
-   assert(gallivm->engine);
+   assert(gallivm->engine || gallivm->session.id);
 
-   if (gallivm_debug & GALLIVM_DEBUG_PERF)
-      time_begin = os_time_get();
+   time_begin = os_time_get();
 
-   code = LLVMGetPointerToGlobal(gallivm->engine, func);
+   code = get_function_code(gallivm, func);
    assert(code);
    jit_func = pointer_to_func(code);
 
+   /* MCJIT generates the code of the whole module on the first lookup */
+   time_end = os_time_get();
+   add_compile_time(gallivm, time_end - time_begin);
+
    if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-      int64_t time_end = os_time_get();
       int time_msec = (int)(time_end - time_begin) / 1000;
       debug_printf("   jitting func %s took %d msec\n",
                    LLVMGetValueName(func), time_msec);
+      assert(gallivm->module_name);
+      debug_printf("module %s (%s tier) compiled in %d msec so far\n",
+                   gallivm->module_name, tier_names[get_tier(gallivm)],
+                   (int)(gallivm->compile_time / 1000));
    }
 
    return jit_func;
@@ -39,6 +39,29 @@
 extern "C" {
 #endif
 
+struct lp_object_cache;
+
+
+/**
+ * Optimization tiers.  Modules are compiled with the fast tier when the
+ * code is needed right away, and recompiled with the optimized tier once
+ * they turn out to be used a lot.
+ */
+enum gallivm_tier {
+   GALLIVM_TIER_FAST,
+   GALLIVM_TIER_OPTIMIZED,
+   GALLIVM_NUM_TIERS
+};
+
+
+/**
+ * Compile time spent on a tier, by all gallivm_state objects.
+ */
+struct gallivm_compile_stats {
+   unsigned modules;    /**< number of modules compiled */
+   uint64_t usecs;      /**< time spent optimizing and generating code */
+};
+
 struct gallivm_state
 {
    char *module_name;
@@ -50,7 +73,20 @@ struct gallivm_state
    LLVMBuilderRef builder;
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
+   struct lp_object_cache *cache;
    unsigned compiled;
+   /** The IR refers to addresses of this process, can't cache the code */
+   boolean no_cache;
+   /** Compile with the fast tier (set before compiling) */
+   boolean fast;
+   /** Time spent compiling so far, in usecs */
+   int64_t compile_time;
+   /** Where the code lives when compiled in the shared JIT session */
+   struct {
+      unsigned id;      /**< suffix of the symbol names, 0 if not there */
+      unsigned level;   /**< optimization level, selects the session */
+      uint32_t handle;  /**< module handle within the session */
+   } session;
 };
 
 
@@ -78,6 +114,10 @@ func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func);
 
+void
+gallivm_get_compile_stats(enum gallivm_tier tier,
+                          struct gallivm_compile_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
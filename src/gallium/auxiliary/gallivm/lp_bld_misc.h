@@ -33,6 +33,7 @@
 #include "lp_bld.h"
 #include <llvm-c/ExecutionEngine.h>
 #include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
 
 
 #ifdef __cplusplus
@@ -64,6 +65,11 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         int useMCJIT,
                                         char **OutError);
 
+#if HAVE_LLVM >= 0x0309
+extern LLVMTargetMachineRef
+lp_build_create_target_machine(unsigned OptLevel);
+#endif
+
 extern void
 lp_free_generated_code(struct lp_generated_code *code);
 
@@ -2069,3 +2069,30 @@ lp_build_sample_offset(struct lp_build_context *bld,
 
    *out_offset = offset;
 }
+
+
+/**
+ * Remap the x, y texel coordinates of a tiled texture, such that
+ * lp_build_sample_offset() then returns the offset of the texel.
+ *
+ * Tiled textures keep the row and image strides of the linear layout,
+ * but each group of 4 rows is stored as a sequence of 4x4 texel tiles,
+ * so texel (x, y) lives at column ((x & ~3) + (y & 3)) * 4 + (x & 3) of
+ * row y & ~3.  This must match llvmpipe's tiled_offset().
+ */
+void
+lp_build_sample_tiled_coords(struct lp_build_context *bld,
+                             LLVMValueRef *x,
+                             LLVMValueRef *y)
+{
+   LLVMValueRef mask = lp_build_const_int_vec(bld->gallivm, bld->type, 3);
+   LLVMValueRef x_lo, x_hi, y_lo;
+
+   x_lo = lp_build_and(bld, *x, mask);
+   x_hi = lp_build_andnot(bld, *x, mask);
+   y_lo = lp_build_and(bld, *y, mask);
+
+   *x = lp_build_shl_imm(bld, lp_build_add(bld, x_hi, y_lo), 2);
+   *x = lp_build_or(bld, *x, x_lo);
+   *y = lp_build_andnot(bld, *y, mask);
+}
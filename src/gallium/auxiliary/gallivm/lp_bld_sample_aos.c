@@ -1617,6 +1617,8 @@ lp_build_sample_aos(struct lp_build_sample_context *bld,
       assert(lp_is_simple_wrap_mode(bld->static_sampler_state->wrap_t));
    if (dims >= 3)
       assert(lp_is_simple_wrap_mode(bld->static_sampler_state->wrap_r));
+   /* nor tiled textures */
+   assert(!bld->static_texture_state->tiled);
 
 
    /* make 8-bit unorm builder context */
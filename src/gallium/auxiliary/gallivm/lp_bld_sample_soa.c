@@ -36,14 +36,20 @@
 #include "pipe/p_defines.h"
 #include "pipe/p_state.h"
 #include "pipe/p_shader_tokens.h"
+#include "os/os_thread.h"
 #include "util/u_debug.h"
 #include "util/u_dump.h"
+#include "util/u_hash.h"
+#include "util/u_hash_table.h"
 #include "util/u_memory.h"
+#include "util/u_pointer.h"
 #include "util/u_math.h"
 #include "util/u_format.h"
 #include "util/u_cpu_detect.h"
 #include "util/format_rgb9e5.h"
 #include "lp_bld_debug.h"
+#include "lp_bld_cache.h"
+#include "lp_bld_init.h"
 #include "lp_bld_type.h"
 #include "lp_bld_const.h"
 #include "lp_bld_conv.h"
@@ -135,6 +141,10 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
       }
    }
 
+   if (bld->static_texture_state->tiled && y) {
+      lp_build_sample_tiled_coords(&bld->int_coord_bld, &x, &y);
+   }
+
    /* convert x,y,z coords to linear offset from start of texture, in bytes */
    lp_build_sample_offset(&bld->int_coord_bld,
                           bld->format_desc,
@@ -2391,6 +2401,10 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
       }
    }
 
+   if (bld->static_texture_state->tiled && y) {
+      lp_build_sample_tiled_coords(int_coord_bld, &x, &y);
+   }
+
    lp_build_sample_offset(int_coord_bld,
                           bld->format_desc,
                           x, y, z, row_stride_vec, img_stride_vec,
@@ -2829,6 +2843,10 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
          /* theoretically possible with AoS filtering but not implemented (complex!) */
          use_aos = 0;
       }
+      if (static_texture_state->tiled) {
+         /* the AoS path computes linear offsets */
+         use_aos = 0;
+      }
 
       if ((gallivm_debug & GALLIVM_DEBUG_PERF) &&
           !use_aos && util_format_fits_8unorm(bld.format_desc)) {
@@ -3203,6 +3221,173 @@ lp_build_sample_gen_func(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Key of a sampling function shared by all modules.
+ */
+struct lp_sample_func_key
+{
+   struct lp_static_texture_state texture_state;
+   struct lp_static_sampler_state sampler_state;
+   struct lp_type type;
+   unsigned sample_key;
+   unsigned texture_index;
+   unsigned sampler_index;
+   boolean need_cache;
+   /** The code the dynamic state generates depends on its implementation */
+   func_pointer dynamic_state_impl;
+};
+
+
+struct lp_sample_func
+{
+   struct lp_sample_func_key key;
+   struct gallivm_state *gallivm;
+   func_pointer code;
+};
+
+
+/** Past this many shared functions, modules get their own copies again */
+#define LP_MAX_SHARED_TEX_FUNCS 1024
+
+static struct util_hash_table *shared_tex_funcs;
+static unsigned num_shared_tex_funcs;
+pipe_static_mutex(shared_tex_funcs_mutex);
+
+
+static unsigned
+shared_tex_func_hash(void *key)
+{
+   return util_hash_crc32(key, sizeof(struct lp_sample_func_key));
+}
+
+
+static int
+shared_tex_func_compare(void *key1, void *key2)
+{
+   return memcmp(key1, key2, sizeof(struct lp_sample_func_key));
+}
+
+
+/**
+ * Add a sampling function prototype to a module.
+ */
+static LLVMValueRef
+lp_build_sample_add_func(LLVMModuleRef module,
+                         const char *name,
+                         LLVMTypeRef function_type)
+{
+   LLVMTypeRef arg_types[LP_MAX_TEX_FUNC_ARGS];
+   unsigned num_param = LLVMCountParamTypes(function_type);
+   LLVMValueRef function;
+   unsigned i;
+
+   assert(num_param <= LP_MAX_TEX_FUNC_ARGS);
+   LLVMGetParamTypes(function_type, arg_types);
+
+   function = LLVMAddFunction(module, name, function_type);
+
+   for (i = 0; i < num_param; ++i) {
+      if(LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind) {
+         LLVMAddAttribute(LLVMGetParam(function, i), LLVMNoAliasAttribute);
+      }
+   }
+
+   return function;
+}
+
+
+/**
+ * Get the code of a sampling function shared by all modules, compiling it
+ * on first use.
+ *
+ * The sampling code only depends on the key, so there's no need to
+ * generate, optimize and compile it again for each shader variant.  The
+ * function is compiled in a module of its own, in the LLVMContext of the
+ * module which first needs it, and called through a pointer with the C
+ * calling convention, so it works with any JIT engine.
+ *
+ * \return NULL if the function can't be shared
+ */
+static func_pointer
+lp_build_sample_shared_func(struct gallivm_state *gallivm,
+                            const struct lp_sample_func_key *key,
+                            struct lp_sampler_dynamic_state *dynamic_state,
+                            LLVMTypeRef function_type)
+{
+   struct lp_sample_func *func = NULL;
+   func_pointer code = NULL;
+
+   pipe_mutex_lock(shared_tex_funcs_mutex);
+
+   if (!shared_tex_funcs) {
+      shared_tex_funcs = util_hash_table_create(shared_tex_func_hash,
+                                                shared_tex_func_compare);
+      if (!shared_tex_funcs)
+         goto out;
+   }
+
+   func = util_hash_table_get(shared_tex_funcs, (void *)key);
+   if (func) {
+      code = func->code;
+      goto out;
+   }
+
+   if (num_shared_tex_funcs >= LP_MAX_SHARED_TEX_FUNCS)
+      goto out;
+
+   func = CALLOC_STRUCT(lp_sample_func);
+   if (!func)
+      goto out;
+
+   func->key = *key;
+
+   {
+      LLVMValueRef function;
+      char func_name[64];
+
+      util_snprintf(func_name, sizeof(func_name), "texfunc_shared_%u",
+                    num_shared_tex_funcs);
+
+      func->gallivm = gallivm_create(func_name, gallivm->context);
+      if (!func->gallivm) {
+         FREE(func);
+         goto out;
+      }
+
+      function = lp_build_sample_add_func(func->gallivm->module, func_name,
+                                          function_type);
+
+      lp_build_sample_gen_func(func->gallivm,
+                               &key->texture_state,
+                               &key->sampler_state,
+                               dynamic_state,
+                               key->type,
+                               key->texture_index,
+                               key->sampler_index,
+                               function,
+                               LLVMCountParamTypes(function_type),
+                               key->sample_key);
+
+      gallivm_compile_module(func->gallivm);
+      func->code = gallivm_jit_function(func->gallivm, function);
+      gallivm_free_ir(func->gallivm);
+   }
+
+   if (util_hash_table_set(shared_tex_funcs, &func->key, func) != PIPE_OK) {
+      gallivm_destroy(func->gallivm);
+      FREE(func);
+      goto out;
+   }
+
+   num_shared_tex_funcs++;
+   code = func->code;
+
+out:
+   pipe_mutex_unlock(shared_tex_funcs_mutex);
+   return code;
+}
+
+
 /**
  * Call the matching function for texture sampling.
  * If there's no match, generate a new one.
@@ -3219,8 +3404,13 @@ lp_build_sample_soa_func(struct gallivm_state *gallivm,
                              LLVMGetInsertBlock(builder)));
    LLVMValueRef function, inst;
    LLVMValueRef args[LP_MAX_TEX_FUNC_ARGS];
+   LLVMTypeRef arg_types[LP_MAX_TEX_FUNC_ARGS];
+   LLVMTypeRef ret_type;
+   LLVMTypeRef function_type;
+   LLVMTypeRef val_type[4];
    LLVMBasicBlockRef bb;
    LLVMValueRef tex_ret;
+   func_pointer code = NULL;
    unsigned num_args = 0;
    char func_name[64];
    unsigned i, num_coords, num_derivs, num_offsets, layer;
@@ -3250,127 +3440,128 @@ lp_build_sample_soa_func(struct gallivm_state *gallivm,
          need_cache = TRUE;
       }
    }
+
    /*
-    * texture function matches are found by name.
-    * Thus the name has to include both the texture and sampler unit
-    * (which covers all static state) plus the actual texture function
-    * (including things like offsets, shadow coord, lod control).
-    * Additionally lod_property has to be included too.
+    * Generate the function prototype and arguments.
     */
 
-   util_snprintf(func_name, sizeof(func_name), "texfunc_res_%d_sam_%d_%x",
-                 texture_index, sampler_index, sample_key);
-
-   function = LLVMGetNamedFunction(module, func_name);
-
-   if(!function) {
-      LLVMTypeRef arg_types[LP_MAX_TEX_FUNC_ARGS];
-      LLVMTypeRef ret_type;
-      LLVMTypeRef function_type;
-      LLVMTypeRef val_type[4];
-      unsigned num_param = 0;
-
-      /*
-       * Generate the function prototype.
-       */
-
-      arg_types[num_param++] = LLVMTypeOf(params->context_ptr);
-      if (need_cache) {
-         arg_types[num_param++] = LLVMTypeOf(params->thread_data_ptr);
-      }
-      for (i = 0; i < num_coords; i++) {
-         arg_types[num_param++] = LLVMTypeOf(coords[0]);
-         assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[i]));
-      }
-      if (layer) {
-         arg_types[num_param++] = LLVMTypeOf(coords[layer]);
-         assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[layer]));
-      }
-      if (sample_key & LP_SAMPLER_SHADOW) {
-         arg_types[num_param++] = LLVMTypeOf(coords[0]);
-      }
-      if (sample_key & LP_SAMPLER_OFFSETS) {
-         for (i = 0; i < num_offsets; i++) {
-            arg_types[num_param++] = LLVMTypeOf(offsets[0]);
-            assert(LLVMTypeOf(offsets[0]) == LLVMTypeOf(offsets[i]));
-         }
-      }
-      if (lod_control == LP_SAMPLER_LOD_BIAS ||
-          lod_control == LP_SAMPLER_LOD_EXPLICIT) {
-         arg_types[num_param++] = LLVMTypeOf(params->lod);
-      }
-      else if (lod_control == LP_SAMPLER_LOD_DERIVATIVES) {
-         for (i = 0; i < num_derivs; i++) {
-            arg_types[num_param++] = LLVMTypeOf(derivs->ddx[i]);
-            arg_types[num_param++] = LLVMTypeOf(derivs->ddy[i]);
-            assert(LLVMTypeOf(derivs->ddx[0]) == LLVMTypeOf(derivs->ddx[i]));
-            assert(LLVMTypeOf(derivs->ddy[0]) == LLVMTypeOf(derivs->ddy[i]));
-         }
-      }
-
-      val_type[0] = val_type[1] = val_type[2] = val_type[3] =
-         lp_build_vec_type(gallivm, params->type);
-      ret_type = LLVMStructTypeInContext(gallivm->context, val_type, 4, 0);
-      function_type = LLVMFunctionType(ret_type, arg_types, num_param, 0);
-      function = LLVMAddFunction(module, func_name, function_type);
-
-      for (i = 0; i < num_param; ++i) {
-         if(LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind) {
-            LLVMAddAttribute(LLVMGetParam(function, i), LLVMNoAliasAttribute);
-         }
-      }
-
-      LLVMSetFunctionCallConv(function, LLVMFastCallConv);
-      LLVMSetLinkage(function, LLVMInternalLinkage);
-
-      lp_build_sample_gen_func(gallivm,
-                               static_texture_state,
-                               static_sampler_state,
-                               dynamic_state,
-                               params->type,
-                               texture_index,
-                               sampler_index,
-                               function,
-                               num_param,
-                               sample_key);
-   }
-
-   num_args = 0;
+   arg_types[num_args] = LLVMTypeOf(params->context_ptr);
    args[num_args++] = params->context_ptr;
    if (need_cache) {
+      arg_types[num_args] = LLVMTypeOf(params->thread_data_ptr);
       args[num_args++] = params->thread_data_ptr;
    }
    for (i = 0; i < num_coords; i++) {
+      arg_types[num_args] = LLVMTypeOf(coords[0]);
+      assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[i]));
       args[num_args++] = coords[i];
    }
    if (layer) {
+      arg_types[num_args] = LLVMTypeOf(coords[layer]);
+      assert(LLVMTypeOf(coords[0]) == LLVMTypeOf(coords[layer]));
       args[num_args++] = coords[layer];
    }
    if (sample_key & LP_SAMPLER_SHADOW) {
+      arg_types[num_args] = LLVMTypeOf(coords[0]);
       args[num_args++] = coords[4];
    }
    if (sample_key & LP_SAMPLER_OFFSETS) {
       for (i = 0; i < num_offsets; i++) {
+         arg_types[num_args] = LLVMTypeOf(offsets[0]);
+         assert(LLVMTypeOf(offsets[0]) == LLVMTypeOf(offsets[i]));
          args[num_args++] = offsets[i];
       }
    }
    if (lod_control == LP_SAMPLER_LOD_BIAS ||
        lod_control == LP_SAMPLER_LOD_EXPLICIT) {
+      arg_types[num_args] = LLVMTypeOf(params->lod);
       args[num_args++] = params->lod;
    }
    else if (lod_control == LP_SAMPLER_LOD_DERIVATIVES) {
       for (i = 0; i < num_derivs; i++) {
+         arg_types[num_args] = LLVMTypeOf(derivs->ddx[i]);
          args[num_args++] = derivs->ddx[i];
+         arg_types[num_args] = LLVMTypeOf(derivs->ddy[i]);
          args[num_args++] = derivs->ddy[i];
+         assert(LLVMTypeOf(derivs->ddx[0]) == LLVMTypeOf(derivs->ddx[i]));
+         assert(LLVMTypeOf(derivs->ddy[0]) == LLVMTypeOf(derivs->ddy[i]));
       }
    }
 
    assert(num_args <= LP_MAX_TEX_FUNC_ARGS);
 
-   tex_ret = LLVMBuildCall(builder, function, args, num_args, "");
-   bb = LLVMGetInsertBlock(builder);
-   inst = LLVMGetLastInstruction(bb);
-   LLVMSetInstructionCallConv(inst, LLVMFastCallConv);
+   val_type[0] = val_type[1] = val_type[2] = val_type[3] =
+      lp_build_vec_type(gallivm, params->type);
+   ret_type = LLVMStructTypeInContext(gallivm->context, val_type, 4, 0);
+   function_type = LLVMFunctionType(ret_type, arg_types, num_args, 0);
+
+   /*
+    * Modules going to the on-disk cache can't call into code of this
+    * process, but then the whole module compile is what gets saved.
+    */
+   if (!(gallivm_debug & GALLIVM_DEBUG_NO_SHARED_TEX) &&
+       !lp_object_cache_enabled()) {
+      struct lp_sample_func_key key;
+
+      memset(&key, 0, sizeof key);
+      key.texture_state = *static_texture_state;
+      key.sampler_state = *static_sampler_state;
+      key.type = params->type;
+      key.sample_key = sample_key;
+      key.texture_index = texture_index;
+      key.sampler_index = sampler_index;
+      key.need_cache = need_cache;
+      key.dynamic_state_impl = (func_pointer)dynamic_state->width;
+
+      code = lp_build_sample_shared_func(gallivm, &key, dynamic_state,
+                                         function_type);
+   }
+
+   if (code) {
+      function = LLVMBuildBitCast(builder,
+                                  lp_build_const_int_pointer(gallivm,
+                                                             func_to_pointer(code)),
+                                  LLVMPointerType(function_type, 0), "");
+
+      tex_ret = LLVMBuildCall(builder, function, args, num_args, "");
+   }
+   else {
+      /*
+       * texture function matches are found by name.
+       * Thus the name has to include both the texture and sampler unit
+       * (which covers all static state) plus the actual texture function
+       * (including things like offsets, shadow coord, lod control).
+       * Additionally lod_property has to be included too.
+       */
+
+      util_snprintf(func_name, sizeof(func_name), "texfunc_res_%d_sam_%d_%x",
+                    texture_index, sampler_index, sample_key);
+
+      function = LLVMGetNamedFunction(module, func_name);
+
+      if(!function) {
+         function = lp_build_sample_add_func(module, func_name, function_type);
+
+         LLVMSetFunctionCallConv(function, LLVMFastCallConv);
+         LLVMSetLinkage(function, LLVMInternalLinkage);
+
+         lp_build_sample_gen_func(gallivm,
+                                  static_texture_state,
+                                  static_sampler_state,
+                                  dynamic_state,
+                                  params->type,
+                                  texture_index,
+                                  sampler_index,
+                                  function,
+                                  num_args,
+                                  sample_key);
+      }
+
+      tex_ret = LLVMBuildCall(builder, function, args, num_args, "");
+      bb = LLVMGetInsertBlock(builder);
+      inst = LLVMGetLastInstruction(bb);
+      LLVMSetInstructionCallConv(inst, LLVMFastCallConv);
+   }
 
    for (i = 0; i < 4; i++) {
       params->texel[i] = LLVMBuildExtractValue(gallivm->builder, tex_ret, i, "");
@@ -170,6 +170,11 @@ struct lp_bld_tgsi_system_values {
    LLVMValueRef prim_id;
    LLVMValueRef basevertex;
    LLVMValueRef invocation_id;
+   /* compute shaders: thread_id is a vector, the others are scalars */
+   LLVMValueRef thread_id[3];
+   LLVMValueRef block_id[3];
+   LLVMValueRef grid_size[3];
+   LLVMValueRef block_size[3];
 };
 
 
@@ -198,6 +203,70 @@ struct lp_build_sampler_soa
 };
 
 
+/**
+ * Parameters of an image load, store, atomic or size query of a single
+ * shader invocation.  All values are scalar i32.
+ */
+struct lp_img_params
+{
+   unsigned image_index;
+   unsigned target;      /**< TGSI_TEXTURE_x */
+   unsigned opcode;      /**< TGSI_OPCODE_LOAD/STORE/ATOMx/RESQ */
+   LLVMValueRef context_ptr;
+   LLVMValueRef coords[3];
+   LLVMValueRef indata[4];   /**< texel to store, atomic operand, or the
+                                  compare value of ATOMCAS */
+   LLVMValueRef indata2[4];  /**< new value of ATOMCAS */
+   LLVMValueRef *outdata;    /**< loaded texel, atomic result, or size */
+};
+
+
+/**
+ * Image code generation interface.
+ *
+ * Images are accessed one shader invocation at a time, the TGSI
+ * translation takes care of looping over the active invocations.
+ */
+struct lp_build_image_soa
+{
+   void
+   (*destroy)(struct lp_build_image_soa *image);
+
+   void
+   (*emit_op)(const struct lp_build_image_soa *image,
+              struct gallivm_state *gallivm,
+              const struct lp_img_params *params);
+
+   void
+   (*emit_size_query)(const struct lp_build_image_soa *image,
+                      struct gallivm_state *gallivm,
+                      const struct lp_img_params *params);
+};
+
+
+/**
+ * Memory interface of shaders with side effects: shader buffers, compute
+ * shared memory, images and workgroup barriers.  Members a shader
+ * stage doesn't support are NULL.
+ */
+struct lp_build_tgsi_mem_iface
+{
+   /** Array of shader buffer base pointers (i32 *) */
+   LLVMValueRef ssbo_ptr;
+   /** Array of shader buffer sizes in bytes */
+   LLVMValueRef ssbo_sizes_ptr;
+   /** Shared memory of the workgroup (i8 *) */
+   LLVMValueRef shared_ptr;
+   /** Size of the shared memory in bytes */
+   unsigned shared_size;
+
+   const struct lp_build_image_soa *image;
+
+   void (*emit_barrier)(const struct lp_build_tgsi_mem_iface *mem_iface,
+                        struct gallivm_state *gallivm);
+};
+
+
 struct lp_build_sampler_aos
 {
    LLVMValueRef
@@ -230,7 +299,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface);
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_mem_iface *mem_iface);
 
 
 void
@@ -452,6 +522,7 @@ struct lp_build_tgsi_soa_context
    LLVMValueRef thread_data_ptr;
 
    const struct lp_build_sampler_soa *sampler;
+   const struct lp_build_tgsi_mem_iface *mem_iface;
 
    struct tgsi_declaration_sampler_view sv[PIPE_MAX_SHADER_SAMPLER_VIEWS];
 
@@ -1690,6 +1690,36 @@ emit_fetch_system_value(
       atype = TGSI_TYPE_UNSIGNED;
       break;
 
+   case TGSI_SEMANTIC_THREAD_ID:
+      res = swizzle < 3 ? bld->system_values.thread_id[swizzle] :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_ID:
+      res = swizzle < 3 ?
+            lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                      bld->system_values.block_id[swizzle]) :
+            bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_GRID_SIZE:
+      res = swizzle < 3 ?
+            lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                      bld->system_values.grid_size[swizzle]) :
+            bld_base->uint_bld.one;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_SIZE:
+      res = swizzle < 3 ?
+            lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                      bld->system_values.block_size[swizzle]) :
+            bld_base->uint_bld.one;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
    default:
       assert(!"unexpected semantic in emit_fetch_system_value");
       res = bld_base->base.zero;
@@ -3755,6 +3785,573 @@ cont_emit(
    lp_exec_continue(&bld->exec_mask);
 }
 
+#if HAVE_LLVM >= 0x0307
+
+/**
+ * Mask of the invocations which are live and inside the current control
+ * flow, i.e. of the ones whose side effects must happen.
+ */
+static LLVMValueRef
+mem_exec_mask(struct lp_build_tgsi_soa_context *bld)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMValueRef mask;
+
+   if (bld->mask)
+      mask = lp_build_mask_value(bld->mask);
+   else
+      mask = lp_build_const_int_vec(gallivm, bld->bld_base.int_bld.type, -1);
+
+   if (bld->exec_mask.has_mask)
+      mask = LLVMBuildAnd(gallivm->builder, mask,
+                          bld->exec_mask.exec_mask, "");
+
+   return mask;
+}
+
+
+/**
+ * Loop over the active invocations one at a time, for memory accesses
+ * which can't be vectorized: the code emitted between lane_loop_begin()
+ * and lane_loop_end() runs once per active invocation.
+ */
+struct lane_loop
+{
+   struct lp_build_loop_state loop;
+   struct lp_build_if_state ifthen;
+};
+
+static LLVMValueRef
+lane_loop_begin(struct lp_build_tgsi_soa_context *bld,
+                struct lane_loop *ll,
+                LLVMValueRef exec_mask)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef lane, active;
+
+   lp_build_loop_begin(&ll->loop, gallivm, lp_build_const_int32(gallivm, 0));
+   lane = ll->loop.counter;
+
+   active = LLVMBuildExtractElement(builder, exec_mask, lane, "");
+   active = LLVMBuildICmp(builder, LLVMIntNE, active,
+                          lp_build_const_int32(gallivm, 0), "");
+   lp_build_if(&ll->ifthen, gallivm, active);
+
+   return lane;
+}
+
+static void
+lane_loop_end(struct lp_build_tgsi_soa_context *bld,
+              struct lane_loop *ll)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+
+   lp_build_endif(&ll->ifthen);
+   lp_build_loop_end(&ll->loop,
+                     lp_build_const_int32(gallivm,
+                                          bld->bld_base.base.type.length),
+                     NULL);
+}
+
+static void
+lane_result_set(struct gallivm_state *gallivm,
+                LLVMValueRef result_ptr,
+                LLVMValueRef lane,
+                LLVMValueRef value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef result = LLVMBuildLoad(builder, result_ptr, "");
+
+   result = LLVMBuildInsertElement(builder, result, value, lane, "");
+   LLVMBuildStore(builder, result, result_ptr);
+}
+
+
+/**
+ * Fetch a channel of a source register as unsigned integers.
+ */
+static LLVMValueRef
+mem_fetch_uint(struct lp_build_tgsi_soa_context *bld,
+               const struct tgsi_full_instruction *inst,
+               unsigned src_op,
+               unsigned chan)
+{
+   struct lp_build_tgsi_context *bld_base = &bld->bld_base;
+   LLVMValueRef value = lp_build_emit_fetch(bld_base, inst, src_op, chan);
+
+   return LLVMBuildBitCast(bld_base->base.gallivm->builder, value,
+                           bld_base->uint_bld.vec_type, "");
+}
+
+
+/**
+ * Pointer to the dword at the given byte offset into a shader buffer or
+ * into shared memory, for a single invocation.  in_bounds is set to
+ * whether the whole dword lies inside the buffer.
+ */
+static LLVMValueRef
+mem_lane_ptr(struct lp_build_tgsi_soa_context *bld,
+             unsigned file,
+             unsigned index,
+             LLVMValueRef index_vec,
+             LLVMValueRef lane,
+             LLVMValueRef offset,
+             LLVMValueRef *in_bounds)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef i8_ptr_type =
+      LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMTypeRef i32_ptr_type =
+      LLVMPointerType(LLVMInt32TypeInContext(gallivm->context), 0);
+   LLVMValueRef base;
+
+   if (file == TGSI_FILE_MEMORY) {
+      unsigned size = bld->mem_iface->shared_size;
+
+      base = bld->mem_iface->shared_ptr;
+
+      /* offset + 4 <= size */
+      if (size >= 4)
+         *in_bounds = LLVMBuildICmp(builder, LLVMIntULE, offset,
+                                    lp_build_const_int32(gallivm, size - 4),
+                                    "");
+      else
+         *in_bounds = LLVMConstInt(LLVMInt1TypeInContext(gallivm->context),
+                                   0, 0);
+   }
+   else {
+      LLVMValueRef buf, size, four;
+
+      assert(file == TGSI_FILE_BUFFER);
+
+      if (index_vec)
+         buf = LLVMBuildExtractElement(builder, index_vec, lane, "");
+      else
+         buf = lp_build_const_int32(gallivm, index);
+
+      base = lp_build_array_get(gallivm, bld->mem_iface->ssbo_ptr, buf);
+      size = lp_build_array_get(gallivm, bld->mem_iface->ssbo_sizes_ptr, buf);
+
+      /* offset + 4 <= size, without overflowing */
+      four = lp_build_const_int32(gallivm, 4);
+      *in_bounds = LLVMBuildAnd(builder,
+                                LLVMBuildICmp(builder, LLVMIntUGE,
+                                              size, four, ""),
+                                LLVMBuildICmp(builder, LLVMIntULE, offset,
+                                              LLVMBuildSub(builder, size,
+                                                           four, ""), ""),
+                                "");
+   }
+
+   base = LLVMBuildBitCast(builder, base, i8_ptr_type, "");
+   base = LLVMBuildGEP(builder, base, &offset, 1, "");
+   return LLVMBuildBitCast(builder, base, i32_ptr_type, "");
+}
+
+
+static LLVMValueRef
+mem_index_vec(struct lp_build_tgsi_soa_context *bld,
+              const struct tgsi_src_register *reg,
+              const struct tgsi_ind_register *indirect)
+{
+   if (!reg->Indirect)
+      return NULL;
+
+   return get_indirect_index(bld, reg->File, reg->Index, indirect);
+}
+
+
+static LLVMAtomicRMWBinOp
+atomic_rmw_op(unsigned opcode)
+{
+   switch (opcode) {
+   case TGSI_OPCODE_ATOMUADD:
+      return LLVMAtomicRMWBinOpAdd;
+   case TGSI_OPCODE_ATOMXCHG:
+      return LLVMAtomicRMWBinOpXchg;
+   case TGSI_OPCODE_ATOMAND:
+      return LLVMAtomicRMWBinOpAnd;
+   case TGSI_OPCODE_ATOMOR:
+      return LLVMAtomicRMWBinOpOr;
+   case TGSI_OPCODE_ATOMXOR:
+      return LLVMAtomicRMWBinOpXor;
+   case TGSI_OPCODE_ATOMUMIN:
+      return LLVMAtomicRMWBinOpUMin;
+   case TGSI_OPCODE_ATOMUMAX:
+      return LLVMAtomicRMWBinOpUMax;
+   case TGSI_OPCODE_ATOMIMIN:
+      return LLVMAtomicRMWBinOpMin;
+   case TGSI_OPCODE_ATOMIMAX:
+      return LLVMAtomicRMWBinOpMax;
+   default:
+      assert(0);
+      return LLVMAtomicRMWBinOpXchg;
+   }
+}
+
+
+/**
+ * LOAD from a shader buffer or shared memory.
+ * Out of bounds reads return zero.
+ */
+static void
+emit_mem_load(struct lp_build_tgsi_soa_context *bld,
+              struct lp_build_emit_data *emit_data)
+{
+   struct lp_build_tgsi_context *bld_base = &bld->bld_base;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const struct tgsi_src_register *reg = &inst->Src[0].Register;
+   LLVMValueRef result[TGSI_NUM_CHANNELS];
+   LLVMValueRef index_vec, offset_vec, lane, offset;
+   struct lane_loop ll;
+   unsigned chan;
+
+   index_vec = mem_index_vec(bld, reg, &inst->Src[0].Indirect);
+   offset_vec = mem_fetch_uint(bld, inst, 1, TGSI_CHAN_X);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      result[chan] = lp_build_alloca(gallivm, bld_base->uint_bld.vec_type, "");
+   }
+
+   lane = lane_loop_begin(bld, &ll, mem_exec_mask(bld));
+   offset = LLVMBuildExtractElement(builder, offset_vec, lane, "");
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      struct lp_build_if_state ifthen;
+      LLVMValueRef chan_offset, ptr, in_bounds;
+
+      chan_offset = LLVMBuildAdd(builder, offset,
+                                 lp_build_const_int32(gallivm, chan * 4), "");
+      ptr = mem_lane_ptr(bld, reg->File, reg->Index, index_vec, lane,
+                         chan_offset, &in_bounds);
+
+      lp_build_if(&ifthen, gallivm, in_bounds);
+      lane_result_set(gallivm, result[chan], lane,
+                      LLVMBuildLoad(builder, ptr, ""));
+      lp_build_endif(&ifthen);
+   }
+
+   lane_loop_end(bld, &ll);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] = LLVMBuildLoad(builder, result[chan], "");
+   }
+}
+
+
+/**
+ * STORE to a shader buffer or shared memory.
+ * Out of bounds writes are discarded.
+ */
+static void
+emit_mem_store(struct lp_build_tgsi_soa_context *bld,
+               struct lp_build_emit_data *emit_data)
+{
+   struct lp_build_tgsi_context *bld_base = &bld->bld_base;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const struct tgsi_dst_register *reg = &inst->Dst[0].Register;
+   LLVMValueRef data[TGSI_NUM_CHANNELS];
+   LLVMValueRef index_vec = NULL, offset_vec, lane, offset;
+   struct lane_loop ll;
+   unsigned chan;
+
+   if (reg->Indirect)
+      index_vec = get_indirect_index(bld, reg->File, reg->Index,
+                                     &inst->Dst[0].Indirect);
+   offset_vec = mem_fetch_uint(bld, inst, 0, TGSI_CHAN_X);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      data[chan] = mem_fetch_uint(bld, inst, 1, chan);
+   }
+
+   lane = lane_loop_begin(bld, &ll, mem_exec_mask(bld));
+   offset = LLVMBuildExtractElement(builder, offset_vec, lane, "");
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      struct lp_build_if_state ifthen;
+      LLVMValueRef chan_offset, ptr, in_bounds, value;
+
+      chan_offset = LLVMBuildAdd(builder, offset,
+                                 lp_build_const_int32(gallivm, chan * 4), "");
+      ptr = mem_lane_ptr(bld, reg->File, reg->Index, index_vec, lane,
+                         chan_offset, &in_bounds);
+      value = LLVMBuildExtractElement(builder, data[chan], lane, "");
+
+      lp_build_if(&ifthen, gallivm, in_bounds);
+      LLVMBuildStore(builder, value, ptr);
+      lp_build_endif(&ifthen);
+   }
+
+   lane_loop_end(bld, &ll);
+}
+
+
+/**
+ * ATOM* on a shader buffer or shared memory.
+ * Out of bounds atomics return zero and have no effect.
+ */
+static void
+emit_mem_atomic(struct lp_build_tgsi_soa_context *bld,
+                struct lp_build_emit_data *emit_data)
+{
+   struct lp_build_tgsi_context *bld_base = &bld->bld_base;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const unsigned opcode = inst->Instruction.Opcode;
+   const struct tgsi_src_register *reg = &inst->Src[0].Register;
+   LLVMValueRef index_vec, offset_vec, data_vec, cmp_vec = NULL;
+   LLVMValueRef result, lane, offset, ptr, in_bounds, value;
+   struct lp_build_if_state ifthen;
+   struct lane_loop ll;
+   unsigned chan;
+
+   index_vec = mem_index_vec(bld, reg, &inst->Src[0].Indirect);
+   offset_vec = mem_fetch_uint(bld, inst, 1, TGSI_CHAN_X);
+   data_vec = mem_fetch_uint(bld, inst, 2, TGSI_CHAN_X);
+   if (opcode == TGSI_OPCODE_ATOMCAS)
+      cmp_vec = mem_fetch_uint(bld, inst, 3, TGSI_CHAN_X);
+
+   result = lp_build_alloca(gallivm, bld_base->uint_bld.vec_type, "");
+
+   lane = lane_loop_begin(bld, &ll, mem_exec_mask(bld));
+   offset = LLVMBuildExtractElement(builder, offset_vec, lane, "");
+   ptr = mem_lane_ptr(bld, reg->File, reg->Index, index_vec, lane,
+                      offset, &in_bounds);
+   value = LLVMBuildExtractElement(builder, data_vec, lane, "");
+
+   lp_build_if(&ifthen, gallivm, in_bounds);
+   if (opcode == TGSI_OPCODE_ATOMCAS) {
+      /* value holds the compare operand, src3 the new value */
+      LLVMValueRef src = LLVMBuildExtractElement(builder, cmp_vec, lane, "");
+      value = LLVMBuildAtomicCmpXchg(builder, ptr, value, src,
+                                     LLVMAtomicOrderingSequentiallyConsistent,
+                                     LLVMAtomicOrderingSequentiallyConsistent,
+                                     FALSE);
+      value = LLVMBuildExtractValue(builder, value, 0, "");
+   }
+   else {
+      value = LLVMBuildAtomicRMW(builder, atomic_rmw_op(opcode), ptr, value,
+                                 LLVMAtomicOrderingSequentiallyConsistent,
+                                 FALSE);
+   }
+   lane_result_set(gallivm, result, lane, value);
+   lp_build_endif(&ifthen);
+
+   lane_loop_end(bld, &ll);
+
+   result = LLVMBuildLoad(builder, result, "");
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] = result;
+   }
+}
+
+
+/**
+ * LOAD, STORE and ATOM* on an image, through the image interface.
+ */
+static void
+emit_image_op(struct lp_build_tgsi_soa_context *bld,
+              struct lp_build_emit_data *emit_data)
+{
+   struct lp_build_tgsi_context *bld_base = &bld->bld_base;
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const unsigned opcode = inst->Instruction.Opcode;
+   const boolean is_store = opcode == TGSI_OPCODE_STORE;
+   const unsigned target = inst->Memory.Texture;
+   const unsigned dims = tgsi_util_get_texture_coord_dim(target);
+   const unsigned coord_op = is_store ? 0 : 1;
+   LLVMValueRef coords[3], data[4], data2[4], result[4], outdata[4];
+   LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
+   struct lp_img_params params;
+   LLVMValueRef lane;
+   struct lane_loop ll;
+   unsigned num_data = 0, i;
+
+   memset(&params, 0, sizeof params);
+   params.image_index = is_store ? inst->Dst[0].Register.Index :
+                                   inst->Src[0].Register.Index;
+   params.target = target;
+   params.opcode = opcode;
+   params.context_ptr = bld->context_ptr;
+   params.outdata = outdata;
+
+   assert(dims <= 3);
+   for (i = 0; i < dims; i++)
+      coords[i] = mem_fetch_uint(bld, inst, coord_op, i);
+
+   if (is_store) {
+      num_data = 4;
+      for (i = 0; i < 4; i++)
+         data[i] = mem_fetch_uint(bld, inst, 1, i);
+   }
+   else if (opcode != TGSI_OPCODE_LOAD) {
+      num_data = 1;
+      data[0] = mem_fetch_uint(bld, inst, 2, TGSI_CHAN_X);
+      if (opcode == TGSI_OPCODE_ATOMCAS)
+         data2[0] = mem_fetch_uint(bld, inst, 3, TGSI_CHAN_X);
+   }
+
+   for (i = 0; i < 4; i++)
+      result[i] = lp_build_alloca(gallivm, bld_base->uint_bld.vec_type, "");
+
+   lane = lane_loop_begin(bld, &ll, mem_exec_mask(bld));
+
+   for (i = 0; i < 3; i++)
+      params.coords[i] = i < dims ?
+         LLVMBuildExtractElement(builder, coords[i], lane, "") : zero;
+   for (i = 0; i < 4; i++) {
+      params.indata[i] = i < num_data ?
+         LLVMBuildExtractElement(builder, data[i], lane, "") : zero;
+      params.indata2[i] = zero;
+   }
+   if (opcode == TGSI_OPCODE_ATOMCAS)
+      params.indata2[0] = LLVMBuildExtractElement(builder, data2[0], lane, "");
+
+   bld->mem_iface->image->emit_op(bld->mem_iface->image, gallivm, &params);
+
+   if (!is_store) {
+      for (i = 0; i < 4; i++)
+         lane_result_set(gallivm, result[i], lane, outdata[i]);
+   }
+
+   lane_loop_end(bld, &ll);
+
+   if (!is_store) {
+      unsigned chan;
+
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+         /* atomics return their result in x */
+         i = opcode == TGSI_OPCODE_LOAD ? chan : 0;
+         emit_data->output[chan] = LLVMBuildLoad(builder, result[i], "");
+      }
+   }
+}
+
+
+static void
+load_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+
+   if (emit_data->inst->Src[0].Register.File == TGSI_FILE_IMAGE)
+      emit_image_op(bld, emit_data);
+   else
+      emit_mem_load(bld, emit_data);
+}
+
+static void
+store_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+
+   if (emit_data->inst->Dst[0].Register.File == TGSI_FILE_IMAGE)
+      emit_image_op(bld, emit_data);
+   else
+      emit_mem_store(bld, emit_data);
+}
+
+static void
+atomic_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+
+   if (emit_data->inst->Src[0].Register.File == TGSI_FILE_IMAGE)
+      emit_image_op(bld, emit_data);
+   else
+      emit_mem_atomic(bld, emit_data);
+}
+
+static void
+resq_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   const struct tgsi_src_register *reg = &inst->Src[0].Register;
+   LLVMValueRef sizes[4];
+   unsigned chan;
+
+   if (reg->File == TGSI_FILE_IMAGE) {
+      struct lp_img_params params;
+
+      memset(&params, 0, sizeof params);
+      params.image_index = reg->Index;
+      params.target = inst->Memory.Texture;
+      params.opcode = TGSI_OPCODE_RESQ;
+      params.context_ptr = bld->context_ptr;
+      params.outdata = sizes;
+      bld->mem_iface->image->emit_size_query(bld->mem_iface->image,
+                                             gallivm, &params);
+   }
+   else {
+      LLVMValueRef index = lp_build_const_int32(gallivm, reg->Index);
+
+      /* buffer array indices must be dynamically uniform */
+      if (reg->Indirect) {
+         index = get_indirect_index(bld, reg->File, reg->Index,
+                                    &inst->Src[0].Indirect);
+         index = LLVMBuildExtractElement(gallivm->builder, index,
+                                         lp_build_const_int32(gallivm, 0), "");
+      }
+
+      assert(reg->File == TGSI_FILE_BUFFER);
+      sizes[0] = lp_build_array_get(gallivm, bld->mem_iface->ssbo_sizes_ptr,
+                                    index);
+      sizes[1] = sizes[2] = sizes[3] = lp_build_const_int32(gallivm, 0);
+   }
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan) {
+      emit_data->output[chan] =
+         lp_build_broadcast_scalar(&bld_base->uint_bld, sizes[chan]);
+   }
+}
+
+static void
+barrier_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+
+   if (bld->mem_iface->emit_barrier)
+      bld->mem_iface->emit_barrier(bld->mem_iface, bld_base->base.gallivm);
+}
+
+static void
+membar_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   LLVMBuildFence(bld_base->base.gallivm->builder,
+                  LLVMAtomicOrderingSequentiallyConsistent, FALSE, "");
+}
+
+#endif /* HAVE_LLVM >= 0x0307 */
+
+
 static void emit_prologue(struct lp_build_tgsi_context * bld_base)
 {
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
@@ -3898,7 +4495,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface)
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_mem_iface *mem_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -4026,6 +4624,27 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
    bld.bld_base.op_actions[TGSI_OPCODE_SAMPLE_L].emit = sample_l_emit;
    bld.bld_base.op_actions[TGSI_OPCODE_SVIEWINFO].emit = sviewinfo_emit;
 
+#if HAVE_LLVM >= 0x0307
+   if (mem_iface) {
+      bld.mem_iface = mem_iface;
+      bld.bld_base.op_actions[TGSI_OPCODE_LOAD].emit = load_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_STORE].emit = store_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUADD].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXCHG].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMCAS].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMAND].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_RESQ].emit = resq_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_BARRIER].emit = barrier_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_MEMBAR].emit = membar_emit;
+   }
+#endif
+
    if (gs_iface) {
       /* There's no specific value for this because it should always
        * be set, but apps using ext_geometry_shader4 quite often
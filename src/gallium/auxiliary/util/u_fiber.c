@@ -0,0 +1,310 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Fibers on top of ucontext on Unix, and of the fiber API on Windows.
+ * Elsewhere util_fibers_create() returns NULL, and compute shaders with
+ * barriers are limited to a single SIMD vector per work group.
+ */
+
+#include "pipe/p_config.h"
+
+#if defined(PIPE_OS_WINDOWS)
+#include <windows.h>
+#define UTIL_FIBER_WINDOWS
+#elif (defined(PIPE_OS_LINUX) && defined(__GLIBC__)) || defined(PIPE_OS_BSD)
+#include <ucontext.h>
+#include <stdint.h>
+#define UTIL_FIBER_UCONTEXT
+#endif
+
+#include "util/u_memory.h"
+#include "u_fiber.h"
+
+
+#if defined(UTIL_FIBER_UCONTEXT) || defined(UTIL_FIBER_WINDOWS)
+
+struct util_fiber
+{
+#ifdef UTIL_FIBER_WINDOWS
+   LPVOID handle;
+#else
+   ucontext_t context;
+   void *stack;
+#endif
+   boolean done;
+};
+
+
+struct util_fibers
+{
+#ifdef UTIL_FIBER_WINDOWS
+   LPVOID main;
+#else
+   ucontext_t main;
+#endif
+   unsigned stack_size;
+
+   struct util_fiber *fibers;
+   unsigned num_fibers;  /**< number of fibers allocated */
+
+   /** The fiber running, or about to run */
+   unsigned current;
+
+   util_fiber_func func;
+   void *data;
+};
+
+
+#ifdef UTIL_FIBER_WINDOWS
+
+/**
+ * Fibers never return, as that would end the thread.  Once done they
+ * switch back to the scheduler, and start over when it resumes them in
+ * the next util_fibers_run().
+ */
+static VOID CALLBACK
+fiber_entry(LPVOID param)
+{
+   struct util_fibers *fibers = (struct util_fibers *)param;
+
+   for (;;) {
+      unsigned index = fibers->current;
+
+      fibers->func(fibers->data, index);
+      fibers->fibers[index].done = TRUE;
+      SwitchToFiber(fibers->main);
+   }
+}
+
+#else
+
+/**
+ * makecontext() only passes int arguments, so the pointer is split.
+ * Returning resumes fibers->main through uc_link.
+ */
+static void
+fiber_entry(unsigned lo, unsigned hi)
+{
+   struct util_fibers *fibers =
+      (struct util_fibers *)(((uintptr_t)hi << 16 << 16) | (uintptr_t)lo);
+   unsigned index = fibers->current;
+
+   fibers->func(fibers->data, index);
+   fibers->fibers[index].done = TRUE;
+}
+
+#endif
+
+
+struct util_fibers *
+util_fibers_create(unsigned stack_size)
+{
+   struct util_fibers *fibers = CALLOC_STRUCT(util_fibers);
+
+   if (!fibers)
+      return NULL;
+
+   fibers->stack_size = stack_size;
+   return fibers;
+}
+
+
+void
+util_fibers_destroy(struct util_fibers *fibers)
+{
+   unsigned i;
+
+   if (!fibers)
+      return;
+
+   for (i = 0; i < fibers->num_fibers; i++) {
+#ifdef UTIL_FIBER_WINDOWS
+      DeleteFiber(fibers->fibers[i].handle);
+#else
+      FREE(fibers->fibers[i].stack);
+#endif
+   }
+
+   FREE(fibers->fibers);
+   FREE(fibers);
+}
+
+
+/**
+ * Grow the number of fibers to at least count.
+ */
+static boolean
+util_fibers_alloc(struct util_fibers *fibers, unsigned count)
+{
+   struct util_fiber *array;
+   unsigned i;
+
+   if (count <= fibers->num_fibers)
+      return TRUE;
+
+   array = REALLOC(fibers->fibers,
+                   fibers->num_fibers * sizeof *array,
+                   count * sizeof *array);
+   if (!array)
+      return FALSE;
+
+   fibers->fibers = array;
+
+   for (i = fibers->num_fibers; i < count; i++) {
+      struct util_fiber *fiber = &fibers->fibers[i];
+
+      memset(fiber, 0, sizeof *fiber);
+#ifdef UTIL_FIBER_WINDOWS
+      fiber->handle = CreateFiber(fibers->stack_size, fiber_entry, fibers);
+      if (!fiber->handle)
+         return FALSE;
+#else
+      fiber->stack = MALLOC(fibers->stack_size);
+      if (!fiber->stack)
+         return FALSE;
+#endif
+      fibers->num_fibers = i + 1;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Run func(data, i) for i in [0, count) as fibers on the calling thread,
+ * switching between them in round robin order at every util_fibers_yield().
+ */
+boolean
+util_fibers_run(struct util_fibers *fibers, unsigned count,
+                util_fiber_func func, void *data)
+{
+   unsigned pending = count;
+   unsigned i;
+
+   if (!util_fibers_alloc(fibers, count))
+      return FALSE;
+
+#ifdef UTIL_FIBER_WINDOWS
+   if (!fibers->main) {
+      fibers->main = IsThreadAFiber() ? GetCurrentFiber() :
+                                        ConvertThreadToFiber(NULL);
+      if (!fibers->main)
+         return FALSE;
+   }
+#endif
+
+   fibers->func = func;
+   fibers->data = data;
+
+   for (i = 0; i < count; i++) {
+      struct util_fiber *fiber = &fibers->fibers[i];
+
+      fiber->done = FALSE;
+
+#ifndef UTIL_FIBER_WINDOWS
+      {
+         uintptr_t ptr = (uintptr_t)fibers;
+
+         getcontext(&fiber->context);
+         fiber->context.uc_stack.ss_sp = fiber->stack;
+         fiber->context.uc_stack.ss_size = fibers->stack_size;
+         fiber->context.uc_link = &fibers->main;
+         makecontext(&fiber->context, (void (*)(void))fiber_entry, 2,
+                     (unsigned)(ptr & 0xffffffff),
+                     (unsigned)(ptr >> 16 >> 16));
+      }
+#endif
+   }
+
+   while (pending) {
+      for (i = 0; i < count; i++) {
+         struct util_fiber *fiber = &fibers->fibers[i];
+
+         if (fiber->done)
+            continue;
+
+         fibers->current = i;
+#ifdef UTIL_FIBER_WINDOWS
+         SwitchToFiber(fiber->handle);
+#else
+         swapcontext(&fibers->main, &fiber->context);
+#endif
+         if (fiber->done)
+            pending--;
+      }
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Called by the running fiber to let the others run.
+ */
+void
+util_fibers_yield(struct util_fibers *fibers)
+{
+#ifdef UTIL_FIBER_WINDOWS
+   SwitchToFiber(fibers->main);
+#else
+   swapcontext(&fibers->fibers[fibers->current].context, &fibers->main);
+#endif
+}
+
+
+#else /* !(UTIL_FIBER_UCONTEXT || UTIL_FIBER_WINDOWS) */
+
+
+struct util_fibers *
+util_fibers_create(unsigned stack_size)
+{
+   return NULL;
+}
+
+
+void
+util_fibers_destroy(struct util_fibers *fibers)
+{
+}
+
+
+boolean
+util_fibers_run(struct util_fibers *fibers, unsigned count,
+                util_fiber_func func, void *data)
+{
+   return FALSE;
+}
+
+
+void
+util_fibers_yield(struct util_fibers *fibers)
+{
+}
+
+
+#endif
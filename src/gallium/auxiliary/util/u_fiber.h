@@ -0,0 +1,71 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Cooperative fibers, for the work group barriers of compute shaders.
+ *
+ * The invocations of a work group run as one fiber per SIMD vector on a
+ * single driver thread.  A barrier yields to the next fiber, so that each
+ * fiber resumes past the barrier only once all of them reached it.
+ *
+ * Used by the llvmpipe and swr compute paths.
+ */
+
+#ifndef UTIL_FIBER_H
+#define UTIL_FIBER_H
+
+#include "pipe/p_compiler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct util_fibers;
+
+typedef void (*util_fiber_func)(void *data, unsigned index);
+
+
+struct util_fibers *
+util_fibers_create(unsigned stack_size);
+
+void
+util_fibers_destroy(struct util_fibers *fibers);
+
+boolean
+util_fibers_run(struct util_fibers *fibers, unsigned count,
+                util_fiber_func func, void *data);
+
+void
+util_fibers_yield(struct util_fibers *fibers);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UTIL_FIBER_H */
@@ -0,0 +1,336 @@
+/*
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Post-transform vertex cache optimization of index buffers, following
+ * Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+ *
+ * Triangles are emitted greedily, picking at each step the triangle with
+ * the highest score among those using the vertices of a simulated LRU
+ * cache.  A vertex scores high when it was used recently, and when few
+ * triangles are left using it, so that vertices get finished off rather
+ * than left behind.
+ */
+
+
+#include <math.h>
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_vcache_opt.h"
+
+
+/** Size of the simulated LRU cache */
+#define VCACHE_SIZE 32
+
+/** Max number of vertices referenced by the indices being optimized */
+#define VCACHE_MAX_VERTICES (1 << 24)
+
+
+static inline unsigned
+get_index(const void *indices, unsigned index_size, unsigned i)
+{
+   switch (index_size) {
+   case 1:
+      return ((const ubyte *) indices)[i];
+   case 2:
+      return ((const ushort *) indices)[i];
+   default:
+      return ((const uint *) indices)[i];
+   }
+}
+
+
+static inline void
+set_index(void *indices, unsigned index_size, unsigned i, unsigned value)
+{
+   switch (index_size) {
+   case 1:
+      ((ubyte *) indices)[i] = (ubyte) value;
+      break;
+   case 2:
+      ((ushort *) indices)[i] = (ushort) value;
+      break;
+   default:
+      ((uint *) indices)[i] = value;
+      break;
+   }
+}
+
+
+static float
+vertex_score(int cache_pos, unsigned remaining)
+{
+   float score = 0.0f;
+
+   if (remaining == 0)
+      return -1.0f;
+
+   if (cache_pos >= 0) {
+      if (cache_pos < 3) {
+         /* the vertices of the last triangle get a fixed score, so that
+          * there's no preference about the order of its edges
+          */
+         score = 0.75f;
+      }
+      else {
+         score = 1.0f - (float) (cache_pos - 3) / (VCACHE_SIZE - 3);
+         score = powf(score, 1.5f);
+      }
+   }
+
+   /* boost vertices with few triangles left */
+   score += 2.0f / sqrtf((float) remaining);
+
+   return score;
+}
+
+
+/**
+ * Reorder the triangles of a triangle list of count indices for a
+ * post-transform vertex cache.
+ *
+ * The triangles are the same, with the same winding, but in a different
+ * order.  dst and src may not overlap.  Returns FALSE and leaves dst
+ * untouched when the indices reference too many vertices, or on
+ * allocation failure.
+ */
+boolean
+util_optimize_vertex_cache(void *dst, const void *src,
+                           unsigned index_size, unsigned count)
+{
+   const unsigned num_tris = count / 3;
+   unsigned min_index = ~0u, max_index = 0;
+   unsigned num_verts;
+   unsigned *tri_verts = NULL;
+   unsigned *vert_offset = NULL;
+   unsigned *vert_remaining = NULL;
+   int *vert_cache_pos = NULL;
+   float *vert_score = NULL;
+   unsigned *vert_tris = NULL;
+   float *tri_score = NULL;
+   boolean *tri_emitted = NULL;
+   unsigned cache[VCACHE_SIZE + 3];
+   unsigned cache_len = 0;
+   unsigned next_tri = 0;
+   int best_tri;
+   unsigned i, j, k;
+   boolean ret = FALSE;
+
+   assert(index_size == 1 || index_size == 2 || index_size == 4);
+
+   if (num_tris == 0)
+      return FALSE;
+
+   for (i = 0; i < num_tris * 3; i++) {
+      unsigned index = get_index(src, index_size, i);
+      min_index = MIN2(min_index, index);
+      max_index = MAX2(max_index, index);
+   }
+
+   if (max_index - min_index >= VCACHE_MAX_VERTICES)
+      return FALSE;
+
+   num_verts = max_index - min_index + 1;
+
+   tri_verts = MALLOC(num_tris * 3 * sizeof *tri_verts);
+   vert_offset = CALLOC(num_verts + 1, sizeof *vert_offset);
+   vert_remaining = CALLOC(num_verts, sizeof *vert_remaining);
+   vert_cache_pos = MALLOC(num_verts * sizeof *vert_cache_pos);
+   vert_score = MALLOC(num_verts * sizeof *vert_score);
+   vert_tris = MALLOC(num_tris * 3 * sizeof *vert_tris);
+   tri_score = MALLOC(num_tris * sizeof *tri_score);
+   tri_emitted = CALLOC(num_tris, sizeof *tri_emitted);
+   if (!tri_verts || !vert_offset || !vert_remaining || !vert_cache_pos ||
+       !vert_score || !vert_tris || !tri_score || !tri_emitted)
+      goto out;
+
+   /*
+    * Build the list of triangles of each vertex.  The triangles still to
+    * be emitted are kept at the front of the list.
+    */
+   for (i = 0; i < num_tris * 3; i++) {
+      tri_verts[i] = get_index(src, index_size, i) - min_index;
+      vert_remaining[tri_verts[i]]++;
+   }
+
+   for (i = 0; i < num_verts; i++)
+      vert_offset[i + 1] = vert_offset[i] + vert_remaining[i];
+
+   memset(vert_remaining, 0, num_verts * sizeof *vert_remaining);
+   for (i = 0; i < num_tris * 3; i++) {
+      unsigned v = tri_verts[i];
+      vert_tris[vert_offset[v] + vert_remaining[v]++] = i / 3;
+   }
+
+   for (i = 0; i < num_verts; i++) {
+      vert_cache_pos[i] = -1;
+      vert_score[i] = vertex_score(-1, vert_remaining[i]);
+   }
+
+   best_tri = 0;
+   for (i = 0; i < num_tris; i++) {
+      tri_score[i] = vert_score[tri_verts[i * 3 + 0]] +
+                     vert_score[tri_verts[i * 3 + 1]] +
+                     vert_score[tri_verts[i * 3 + 2]];
+      if (tri_score[i] > tri_score[best_tri])
+         best_tri = i;
+   }
+
+   for (i = 0; i < num_tris; i++) {
+      unsigned new_cache[VCACHE_SIZE + 3];
+      unsigned new_cache_len = 0;
+      float best_score;
+
+      if (best_tri < 0) {
+         /* nothing left around the cache, take the next triangle left */
+         while (tri_emitted[next_tri])
+            next_tri++;
+         best_tri = next_tri;
+      }
+
+      tri_emitted[best_tri] = TRUE;
+      for (j = 0; j < 3; j++) {
+         unsigned v = tri_verts[best_tri * 3 + j];
+         unsigned *tris = &vert_tris[vert_offset[v]];
+
+         set_index(dst, index_size, i * 3 + j, v + min_index);
+
+         /* remove the triangle from the vertex's remaining triangles */
+         for (k = 0; k < vert_remaining[v]; k++) {
+            if (tris[k] == (unsigned) best_tri) {
+               tris[k] = tris[vert_remaining[v] - 1];
+               tris[vert_remaining[v] - 1] = best_tri;
+               vert_remaining[v]--;
+               break;
+            }
+         }
+
+         new_cache[new_cache_len++] = v;
+      }
+
+      /* the triangle's vertices move to the front of the cache */
+      for (j = 0; j < cache_len; j++) {
+         unsigned v = cache[j];
+         if (v != new_cache[0] && v != new_cache[1] && v != new_cache[2])
+            new_cache[new_cache_len++] = v;
+      }
+
+      for (j = 0; j < new_cache_len; j++) {
+         unsigned v = new_cache[j];
+         vert_cache_pos[v] = j < VCACHE_SIZE ? (int) j : -1;
+         vert_score[v] = vertex_score(vert_cache_pos[v], vert_remaining[v]);
+      }
+
+      /* rescore the triangles around the cache, and pick the best */
+      best_tri = -1;
+      best_score = -1.0f;
+      for (j = 0; j < new_cache_len; j++) {
+         unsigned v = new_cache[j];
+         const unsigned *tris = &vert_tris[vert_offset[v]];
+
+         for (k = 0; k < vert_remaining[v]; k++) {
+            unsigned t = tris[k];
+            float score = vert_score[tri_verts[t * 3 + 0]] +
+                          vert_score[tri_verts[t * 3 + 1]] +
+                          vert_score[tri_verts[t * 3 + 2]];
+            tri_score[t] = score;
+            if (score > best_score) {
+               best_score = score;
+               best_tri = t;
+            }
+         }
+      }
+
+      cache_len = MIN2(new_cache_len, VCACHE_SIZE);
+      memcpy(cache, new_cache, cache_len * sizeof cache[0]);
+   }
+
+   /* trailing indices of an incomplete triangle */
+   for (i = num_tris * 3; i < count; i++)
+      set_index(dst, index_size, i, get_index(src, index_size, i));
+
+   ret = TRUE;
+
+out:
+   FREE(tri_verts);
+   FREE(vert_offset);
+   FREE(vert_remaining);
+   FREE(vert_cache_pos);
+   FREE(vert_score);
+   FREE(vert_tris);
+   FREE(tri_score);
+   FREE(tri_emitted);
+   return ret;
+}
+
+
+/**
+ * Return the average cache miss ratio of a triangle list, that is the
+ * number of vertices shaded per triangle with a FIFO post-transform cache
+ * of cache_size entries.  0.5 is the best possible, for big regular
+ * meshes, and 3 the worst.
+ */
+float
+util_vertex_cache_acmr(const void *indices, unsigned index_size,
+                       unsigned count, unsigned cache_size)
+{
+   const unsigned num_tris = count / 3;
+   unsigned *fifo;
+   unsigned head = 0, len = 0;
+   unsigned misses = 0;
+   unsigned i, j;
+
+   if (num_tris == 0 || cache_size == 0)
+      return 0.0f;
+
+   fifo = MALLOC(cache_size * sizeof *fifo);
+   if (!fifo)
+      return 0.0f;
+
+   for (i = 0; i < num_tris * 3; i++) {
+      unsigned index = get_index(indices, index_size, i);
+
+      for (j = 0; j < len; j++) {
+         if (fifo[j] == index)
+            break;
+      }
+
+      if (j == len) {
+         misses++;
+         if (len < cache_size) {
+            fifo[len++] = index;
+         }
+         else {
+            fifo[head] = index;
+            head = (head + 1) % cache_size;
+         }
+      }
+   }
+
+   FREE(fifo);
+
+   return (float) misses / (float) num_tris;
+}
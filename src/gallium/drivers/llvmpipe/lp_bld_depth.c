@@ -446,6 +446,18 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
                                        LLVMInt32TypeInContext(context), bits);
       count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
    }
+   else if(util_cpu_caps.has_avx512f && type.length == 16) {
+      /* turns into a mask register compare and a popcount of the mask */
+      const char *popcntintr = "llvm.ctpop.i16";
+      LLVMTypeRef i16t = LLVMInt16TypeInContext(context);
+      LLVMValueRef bits = LLVMBuildBitCast(builder, maskvalue,
+                                           lp_build_int_vec_type(gallivm, type), "");
+      bits = LLVMBuildICmp(builder, LLVMIntNE, bits,
+                           LLVMConstNull(LLVMTypeOf(bits)), "");
+      bits = LLVMBuildBitCast(builder, bits, i16t, "");
+      count = lp_build_intrinsic_unary(builder, popcntintr, i16t, bits);
+      count = LLVMBuildZExt(builder, count, LLVMIntTypeInContext(context, 64), "");
+   }
    else if(util_cpu_caps.has_avx && type.length == 8) {
       const char *movmskintr = "llvm.x86.avx.movmsk.ps.256";
       const char *popcntintr = "llvm.ctpop.i32";
@@ -511,6 +523,119 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Index of the value of the i-th pixel of four 2x2 quads (in fragment
+ * shader order) in a linear 4x4 block, and vice versa.
+ * This just swaps bits 1 and 2, i.e. the quad's y and the block's x.
+ */
+static inline unsigned
+swizzle_4x4_index(unsigned i)
+{
+   return (i & 9) | ((i & 2) << 1) | ((i & 4) >> 1);
+}
+
+
+/**
+ * Load the depth/stencil values of a whole 4x4 block as one vector, for
+ * 16-wide fragment shaders.
+ */
+static LLVMValueRef
+load_4x4_swizzled(struct gallivm_state *gallivm,
+                  struct lp_type zs_type,
+                  LLVMValueRef depth_ptr,
+                  LLVMValueRef depth_stride)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type row_type = zs_type;
+   LLVMTypeRef row_ptr_type;
+   LLVMValueRef rows[4], halves[2];
+   LLVMValueRef shuffles[16];
+   LLVMValueRef offset;
+   unsigned i;
+
+   assert(zs_type.length == 16);
+
+   row_type.length = 4;
+   row_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, row_type), 0);
+
+   offset = lp_build_const_int32(gallivm, 0);
+   for (i = 0; i < 4; i++) {
+      LLVMValueRef ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+      ptr = LLVMBuildBitCast(builder, ptr, row_ptr_type, "");
+      rows[i] = LLVMBuildLoad(builder, ptr, "");
+      offset = LLVMBuildAdd(builder, offset, depth_stride, "");
+   }
+
+   halves[0] = lp_build_concat(gallivm, &rows[0], row_type, 2);
+   halves[1] = lp_build_concat(gallivm, &rows[2], row_type, 2);
+
+   for (i = 0; i < 16; i++) {
+      shuffles[i] = lp_build_const_int32(gallivm, swizzle_4x4_index(i));
+   }
+
+   return LLVMBuildShuffleVector(builder, halves[0], halves[1],
+                                 LLVMConstVector(shuffles, 16), "");
+}
+
+
+/**
+ * Store the depth/stencil values of a whole 4x4 block, for 16-wide fragment
+ * shaders.  Values wider than 32 bits are interleaved from z_value and
+ * s_value.
+ */
+static void
+store_4x4_swizzled(struct gallivm_state *gallivm,
+                   struct lp_type zs_type,
+                   LLVMValueRef depth_ptr,
+                   LLVMValueRef depth_stride,
+                   LLVMValueRef z_value,
+                   LLVMValueRef s_value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type row_type = zs_type;
+   LLVMTypeRef row_vec_type;
+   LLVMValueRef shuffles[32];
+   LLVMValueRef offset;
+   unsigned i, j;
+
+   assert(zs_type.length == 16);
+
+   row_type.length = 4;
+   row_vec_type = lp_build_vec_type(gallivm, row_type);
+
+   offset = lp_build_const_int32(gallivm, 0);
+   for (i = 0; i < 4; i++) {
+      LLVMValueRef ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+      LLVMValueRef row;
+
+      ptr = LLVMBuildBitCast(builder, ptr,
+                             LLVMPointerType(row_vec_type, 0), "");
+
+      if (!s_value) {
+         for (j = 0; j < 4; j++) {
+            shuffles[j] = lp_build_const_int32(gallivm,
+                                               swizzle_4x4_index(i * 4 + j));
+         }
+         row = LLVMBuildShuffleVector(builder, z_value, z_value,
+                                      LLVMConstVector(shuffles, 4), "");
+      }
+      else {
+         for (j = 0; j < 4; j++) {
+            unsigned idx = swizzle_4x4_index(i * 4 + j);
+            shuffles[j * 2] = lp_build_const_int32(gallivm, idx);
+            shuffles[j * 2 + 1] = lp_build_const_int32(gallivm, idx + 16);
+         }
+         row = LLVMBuildShuffleVector(builder, z_value, s_value,
+                                      LLVMConstVector(shuffles, 8), "");
+      }
+
+      LLVMBuildStore(builder, LLVMBuildBitCast(builder, row, row_vec_type, ""),
+                     ptr);
+      offset = LLVMBuildAdd(builder, offset, depth_stride, "");
+   }
+}
+
+
 /**
  * Load depth/stencil values.
  * The stored values are linear, swizzle them.
@@ -548,7 +673,12 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
    zs_load_type.length = zs_load_type.length / 2;
    load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
 
-   if (z_src_type.length == 4) {
+   if (z_src_type.length == 16) {
+      /* the whole 4x4 block at once, 1d resources don't use 16-wide */
+      assert(!is_1d);
+      *z_fb = load_4x4_swizzled(gallivm, zs_type, depth_ptr, depth_stride);
+   }
+   else if (z_src_type.length == 4) {
       unsigned i;
       LLVMValueRef looplsb = LLVMBuildAnd(builder, loop_counter,
                                           lp_build_const_int32(gallivm, 1), "");
@@ -580,23 +710,25 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
       }
    }
 
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+   if (z_src_type.length != 16) {
+      depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
 
-   /* Load current z/stencil values from z/stencil buffer */
-   zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-   zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
-   if (is_1d) {
-      zs_dst2 = lp_build_undef(gallivm, zs_load_type);
-   }
-   else {
-      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+      /* Load current z/stencil values from z/stencil buffer */
+      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
       zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-      zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
-   }
+      zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      if (is_1d) {
+         zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      }
+      else {
+         zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      }
 
-   *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
-                                  LLVMConstVector(shuffles, zs_type.length), "");
+      *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
+                                     LLVMConstVector(shuffles, zs_type.length), "");
+   }
    *s_fb = *z_fb;
 
    if (format_desc->block.bits < z_src_type.width) {
@@ -695,7 +827,12 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
     * This is far from ideal, at least for late depth write we should do this
     * outside the fs loop to avoid all the swizzle stuff.
     */
-   if (z_src_type.length == 4) {
+   if (z_src_type.length == 16) {
+      /* the whole 4x4 block at once, 1d resources don't use 16-wide */
+      assert(!is_1d);
+      depth_offset1 = lp_build_const_int32(gallivm, 0);
+   }
+   else if (z_src_type.length == 4) {
       LLVMValueRef looplsb = LLVMBuildAnd(builder, loop_counter,
                                           lp_build_const_int32(gallivm, 1), "");
       LLVMValueRef loopmsb = LLVMBuildAnd(builder, loop_counter,
@@ -747,6 +884,12 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                lp_build_int_vec_type(gallivm, zs_type), "");
    }
 
+   if (z_src_type.length == 16) {
+      store_4x4_swizzled(gallivm, zs_type, depth_ptr, depth_stride, z_value,
+                         format_desc->block.bits > 32 ? s_value : NULL);
+      return;
+   }
+
    if (format_desc->block.bits <= 32) {
       if (z_src_type.length == 4) {
          zs_dst1 = lp_build_extract_range(gallivm, z_value, 0, 2);
@@ -39,11 +39,15 @@
 #include "util/simple_list.h"
 #include "lp_clear.h"
 #include "lp_context.h"
+#include "lp_debug.h"
 #include "lp_flush.h"
+#include "lp_limits.h"
 #include "lp_perf.h"
+#include "lp_screen.h"
 #include "lp_state.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_rast.h"
 #include "lp_setup.h"
 
 /* This is only safe if there's just one concurrent context */
@@ -56,7 +60,21 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    uint i, j;
 
-   lp_print_counters();
+   lp_print_counters(llvmpipe);
+
+   if (LP_DEBUG & DEBUG_COUNTERS) {
+      uint64_t vertices, triangles;
+      float acmr = draw_get_acmr(llvmpipe->draw, &vertices, &triangles);
+      debug_printf("llvmpipe: nr_indexed_vertices:          %9" PRIu64 "\n",
+                   vertices);
+      debug_printf("llvmpipe: nr_indexed_triangles:         %9" PRIu64 "\n",
+                   triangles);
+      debug_printf("llvmpipe: acmr:                         %9.3f\n", acmr);
+   }
+
+   /* Pending compiles are dropped, the variants keep their fast code */
+   if (util_queue_is_initialized(&llvmpipe->compile_queue))
+      util_queue_destroy(&llvmpipe->compile_queue);
 
    if (llvmpipe->blitter) {
       util_blitter_destroy(llvmpipe->blitter);
@@ -95,6 +113,10 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
       pipe_resource_reference(&llvmpipe->vertex_buffer[i].buffer, NULL);
    }
 
+   llvmpipe_cleanup_images(llvmpipe);
+   llvmpipe_cleanup_compute(llvmpipe);
+   llvmpipe_cleanup_draw(llvmpipe);
+
    lp_delete_setup_variants(llvmpipe);
 
 #ifndef USE_GLOBAL_LLVM_CONTEXT
@@ -111,6 +133,14 @@ do_flush( struct pipe_context *pipe,
           unsigned flags)
 {
    llvmpipe_flush(pipe, fence, __FUNCTION__);
+
+   if (flags & PIPE_FLUSH_END_OF_FRAME) {
+      struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+
+      pipe_mutex_lock(screen->rast_mutex);
+      lp_rast_trace_end_frame(screen->rast);
+      pipe_mutex_unlock(screen->rast_mutex);
+   }
 }
 
 
@@ -131,6 +161,7 @@ struct pipe_context *
 llvmpipe_create_context(struct pipe_screen *screen, void *priv,
                         unsigned flags)
 {
+   struct llvmpipe_screen *lp_screen = llvmpipe_screen(screen);
    struct llvmpipe_context *llvmpipe;
 
    llvmpipe = align_malloc(sizeof(struct llvmpipe_context), 16);
@@ -168,6 +199,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe_init_vs_funcs(llvmpipe);
    llvmpipe_init_gs_funcs(llvmpipe);
    llvmpipe_init_rasterizer_funcs(llvmpipe);
+   llvmpipe_init_image_funcs(llvmpipe);
+   llvmpipe_init_compute_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs( &llvmpipe->pipe );
    llvmpipe_init_surface_functions(llvmpipe);
 
@@ -180,6 +213,13 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context)
       goto fail;
 
+   /* A variant has at most one compile pending, so the queue never fills */
+   if (lp_screen->num_compile_threads) {
+      util_queue_init(&llvmpipe->compile_queue, "llvmpipe-cc",
+                      LP_MAX_SHADER_VARIANTS,
+                      lp_screen->num_compile_threads);
+   }
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -216,8 +256,6 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    draw_wide_point_threshold(llvmpipe->draw, 10000.0);
    draw_wide_line_threshold(llvmpipe->draw, 10000.0);
 
-   lp_reset_counters();
-
    return &llvmpipe->pipe;
 
  fail:
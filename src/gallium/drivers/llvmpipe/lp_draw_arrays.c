@@ -33,16 +33,137 @@
 
 #include "pipe/p_defines.h"
 #include "pipe/p_context.h"
+#include "util/u_atomic.h"
 #include "util/u_draw.h"
+#include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_vcache_opt.h"
 
 #include "lp_context.h"
+#include "lp_screen.h"
 #include "lp_state.h"
+#include "lp_texture.h"
 #include "lp_query.h"
 
 #include "draw/draw_context.h"
 
 
+/** Smaller draws aren't worth reordering */
+#define LP_REORDER_MIN_INDICES 256
+
+/** Max number of reordered ranges kept per context */
+#define LP_MAX_REORDERED_RANGES 16
+
+
+/**
+ * Range of an index buffer, with its triangles reordered for the vertex
+ * cache (LP_OPTIMIZE_INDICES).
+ */
+struct llvmpipe_reordered_indices
+{
+   struct pipe_resource *buffer;
+   unsigned content_seqno;  /**< of the buffer when reordered */
+   unsigned offset;         /**< in bytes */
+   unsigned count;
+   unsigned index_size;
+   void *indices;
+   struct llvmpipe_reordered_indices *next;
+};
+
+
+static void
+lp_free_reordered_indices(struct llvmpipe_reordered_indices *reordered)
+{
+   pipe_resource_reference(&reordered->buffer, NULL);
+   FREE(reordered->indices);
+   FREE(reordered);
+}
+
+
+/**
+ * Return the indices of a range of an index buffer with the triangles
+ * reordered for the vertex cache, or NULL.
+ *
+ * The reordered indices are kept with the context, and reordered again
+ * once the buffer was mapped for writing, see content_seqno.  Buffers
+ * which shaders can write to, or which are persistently mapped for
+ * writing, aren't handled.
+ */
+static const void *
+lp_get_reordered_indices(struct llvmpipe_context *lp,
+                         struct pipe_resource *buffer,
+                         const ubyte *indices,
+                         unsigned offset,
+                         unsigned index_size,
+                         unsigned count)
+{
+   const struct llvmpipe_resource *lpr = llvmpipe_resource(buffer);
+   struct llvmpipe_reordered_indices **prev = &lp->reordered;
+   struct llvmpipe_reordered_indices *reordered;
+   unsigned n;
+
+   if (buffer->bind & (PIPE_BIND_STREAM_OUTPUT |
+                       PIPE_BIND_SHADER_BUFFER |
+                       PIPE_BIND_SHADER_IMAGE) ||
+       p_atomic_read(&lpr->persistent_write_maps))
+      return NULL;
+
+   while ((reordered = *prev) != NULL) {
+      if (reordered->buffer == buffer &&
+          reordered->offset == offset &&
+          reordered->count == count &&
+          reordered->index_size == index_size)
+         break;
+      prev = &reordered->next;
+   }
+
+   if (reordered) {
+      /* move to the front */
+      *prev = reordered->next;
+   }
+   else {
+      reordered = CALLOC_STRUCT(llvmpipe_reordered_indices);
+      if (!reordered)
+         return NULL;
+
+      reordered->indices = MALLOC(count * index_size);
+      if (!reordered->indices) {
+         FREE(reordered);
+         return NULL;
+      }
+
+      pipe_resource_reference(&reordered->buffer, buffer);
+      reordered->offset = offset;
+      reordered->count = count;
+      reordered->index_size = index_size;
+      reordered->content_seqno = lpr->content_seqno - 1;
+   }
+
+   if (reordered->content_seqno != lpr->content_seqno) {
+      if (!util_optimize_vertex_cache(reordered->indices, indices + offset,
+                                      index_size, count))
+         memcpy(reordered->indices, indices + offset, count * index_size);
+      reordered->content_seqno = lpr->content_seqno;
+   }
+
+   reordered->next = lp->reordered;
+   lp->reordered = reordered;
+
+   /* drop the least recently used ranges */
+   for (n = 1; reordered->next; n++) {
+      if (n == LP_MAX_REORDERED_RANGES) {
+         struct llvmpipe_reordered_indices *last = reordered->next;
+         reordered->next = last->next;
+         lp_free_reordered_indices(last);
+      }
+      else {
+         reordered = reordered->next;
+      }
+   }
+
+   return lp->reordered->indices;
+}
+
 
 /**
  * Draw vertex arrays, with optional indexing, optional instancing.
@@ -56,6 +177,7 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    struct llvmpipe_context *lp = llvmpipe_context(pipe);
    struct draw_context *draw = lp->draw;
    const void *mapped_indices = NULL;
+   struct pipe_draw_info reordered_info;
    unsigned i;
 
    if (!llvmpipe_check_render_cond(lp))
@@ -69,6 +191,8 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
    if (lp->dirty)
       llvmpipe_update_derived( lp );
 
+   llvmpipe_fs_variant_draw(lp);
+
    /*
     * Map vertex buffers
     */
@@ -87,19 +211,50 @@ llvmpipe_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
 
    /* Map index buffer, if present */
    if (info->indexed) {
+      const unsigned index_size = lp->index_buffer.index_size;
       unsigned available_space = ~0;
+      const void *reordered = NULL;
+
       mapped_indices = lp->index_buffer.user_buffer;
       if (!mapped_indices) {
+         struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+
          mapped_indices = llvmpipe_resource_data(lp->index_buffer.buffer);
          if (lp->index_buffer.buffer->width0 > lp->index_buffer.offset)
             available_space =
                (lp->index_buffer.buffer->width0 - lp->index_buffer.offset);
          else
             available_space = 0;
+
+         /* This changes the order of the triangles, which matters with
+          * blending, so it's an opt-in.
+          */
+         if (screen->optimize_indices &&
+             info->mode == PIPE_PRIM_TRIANGLES &&
+             !info->primitive_restart &&
+             info->count >= LP_REORDER_MIN_INDICES &&
+             info->start <= available_space / index_size &&
+             info->count <= available_space / index_size - info->start) {
+            reordered = lp_get_reordered_indices(
+                           lp, lp->index_buffer.buffer,
+                           mapped_indices,
+                           lp->index_buffer.offset + info->start * index_size,
+                           index_size, info->count);
+         }
+      }
+
+      if (reordered) {
+         reordered_info = *info;
+         reordered_info.start = 0;
+         info = &reordered_info;
+         draw_set_indexes(draw, reordered, index_size,
+                          info->count * index_size);
+      }
+      else {
+         draw_set_indexes(draw,
+                          (ubyte *) mapped_indices + lp->index_buffer.offset,
+                          index_size, available_space);
       }
-      draw_set_indexes(draw,
-                       (ubyte *) mapped_indices + lp->index_buffer.offset,
-                       lp->index_buffer.index_size, available_space);
    }
 
    for (i = 0; i < lp->num_so_targets; i++) {
@@ -164,3 +319,14 @@ llvmpipe_init_draw_funcs(struct llvmpipe_context *llvmpipe)
 {
    llvmpipe->pipe.draw_vbo = llvmpipe_draw_vbo;
 }
+
+
+void
+llvmpipe_cleanup_draw(struct llvmpipe_context *llvmpipe)
+{
+   while (llvmpipe->reordered) {
+      struct llvmpipe_reordered_indices *reordered = llvmpipe->reordered;
+      llvmpipe->reordered = reordered->next;
+      lp_free_reordered_indices(reordered);
+   }
+}
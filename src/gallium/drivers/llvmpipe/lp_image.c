@@ -0,0 +1,417 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Shader image load/store/atomics.
+ *
+ * Image formats are only known at draw time, so rather than generating
+ * code per format the shaders call lp_image_access() for every active
+ * invocation.  Images are always stored linearly (set_shader_images
+ * untiles them), and the view's mip level and first layer are resolved
+ * into the lp_jit_image when the image is bound.
+ */
+
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_atomic.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_pointer.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "state_tracker/sw_winsys.h"
+#include "lp_image.h"
+#include "lp_jit.h"
+#include "lp_screen.h"
+#include "lp_texture.h"
+
+
+/**
+ * Address of the texel, or NULL if the coordinates are out of bounds.
+ */
+static uint8_t *
+image_texel(const struct lp_jit_image *image, unsigned target,
+            uint32_t x, uint32_t y, uint32_t z)
+{
+   unsigned blocksize = util_format_get_blocksize(image->format);
+
+   if (target == TGSI_TEXTURE_1D_ARRAY) {
+      /* the layer is the second coordinate */
+      z = y;
+      y = 0;
+   }
+
+   if (x >= image->width || y >= image->height || z >= image->depth)
+      return NULL;
+
+   return (uint8_t *)image->base +
+          z * image->img_stride + y * image->row_stride + x * blocksize;
+}
+
+
+static uint32_t
+image_atomic_op(unsigned opcode, uint32_t old, uint32_t a, uint32_t b)
+{
+   switch (opcode) {
+   case TGSI_OPCODE_ATOMUADD:
+      return old + a;
+   case TGSI_OPCODE_ATOMXCHG:
+      return a;
+   case TGSI_OPCODE_ATOMCAS:
+      return old == a ? b : old;
+   case TGSI_OPCODE_ATOMAND:
+      return old & a;
+   case TGSI_OPCODE_ATOMOR:
+      return old | a;
+   case TGSI_OPCODE_ATOMXOR:
+      return old ^ a;
+   case TGSI_OPCODE_ATOMUMIN:
+      return MIN2(old, a);
+   case TGSI_OPCODE_ATOMUMAX:
+      return MAX2(old, a);
+   case TGSI_OPCODE_ATOMIMIN:
+      return MIN2((int32_t)old, (int32_t)a);
+   case TGSI_OPCODE_ATOMIMAX:
+      return MAX2((int32_t)old, (int32_t)a);
+   default:
+      assert(0);
+      return old;
+   }
+}
+
+
+/**
+ * Image access of a single shader invocation, called by the generated code.
+ *
+ * \param data   texel to store or atomic operand in, loaded texel or
+ *               atomic result out
+ * \param data2  new value of ATOMCAS
+ */
+static void
+lp_image_access(const struct lp_jit_image *image,
+                uint32_t target, uint32_t opcode,
+                uint32_t x, uint32_t y, uint32_t z,
+                uint32_t *data, const uint32_t *data2)
+{
+   const struct util_format_description *desc =
+      util_format_description(image->format);
+   uint8_t *texel;
+
+   if (!image->base || !desc)
+      texel = NULL;
+   else
+      texel = image_texel(image, target, x, y, z);
+
+   if (opcode == TGSI_OPCODE_LOAD) {
+      if (!texel) {
+         /* out of bounds reads return zero */
+         data[0] = data[1] = data[2] = 0;
+         data[3] = util_format_is_pure_integer(image->format) ? 1 : fui(1.0f);
+      }
+      else if (util_format_is_pure_uint(image->format))
+         desc->unpack_rgba_uint(data, 0, texel, 0, 1, 1);
+      else if (util_format_is_pure_sint(image->format))
+         desc->unpack_rgba_sint((int32_t *)data, 0, texel, 0, 1, 1);
+      else
+         desc->unpack_rgba_float((float *)data, 0, texel, 0, 1, 1);
+   }
+   else if (opcode == TGSI_OPCODE_STORE) {
+      if (!texel)
+         return;
+      if (util_format_is_pure_uint(image->format))
+         desc->pack_rgba_uint(texel, 0, data, 0, 1, 1);
+      else if (util_format_is_pure_sint(image->format))
+         desc->pack_rgba_sint(texel, 0, (const int32_t *)data, 0, 1, 1);
+      else
+         desc->pack_rgba_float(texel, 0, (const float *)data, 0, 1, 1);
+   }
+   else {
+      /* atomics are only supported on 32bit single channel formats */
+      uint32_t *ptr = (uint32_t *)texel;
+      uint32_t old, prev;
+
+      if (!texel || desc->block.bits != 32 || desc->nr_channels != 1) {
+         data[0] = 0;
+         return;
+      }
+
+      old = *ptr;
+      while ((prev = p_atomic_cmpxchg(ptr, old,
+                                      image_atomic_op(opcode, old,
+                                                      data[0],
+                                                      data2[0]))) != old)
+         old = prev;
+
+      data[0] = old;
+   }
+}
+
+
+/**
+ * This is the bridge between our images and the TGSI translator.
+ */
+struct lp_llvm_image_soa
+{
+   struct lp_build_image_soa base;
+};
+
+
+/**
+ * Pointer to the lp_jit_image of the image unit, or one of its members.
+ */
+static LLVMValueRef
+lp_llvm_image_member_ptr(struct gallivm_state *gallivm,
+                         LLVMValueRef context_ptr,
+                         unsigned image_unit,
+                         int member_index)
+{
+   LLVMValueRef indices[4];
+   unsigned num_indices = 3;
+
+   assert(image_unit < LP_MAX_TGSI_SHADER_IMAGES);
+
+   /* context[0].images[unit] */
+   indices[0] = lp_build_const_int32(gallivm, 0);
+   indices[1] = lp_build_const_int32(gallivm, LP_JIT_CTX_IMAGES);
+   indices[2] = lp_build_const_int32(gallivm, image_unit);
+   if (member_index >= 0) {
+      /* context[0].images[unit].member */
+      indices[3] = lp_build_const_int32(gallivm, member_index);
+      num_indices = 4;
+   }
+
+   return LLVMBuildGEP(gallivm->builder, context_ptr,
+                       indices, num_indices, "");
+}
+
+
+static void
+lp_llvm_image_soa_destroy(struct lp_build_image_soa *image)
+{
+   FREE(image);
+}
+
+
+static void
+lp_llvm_image_soa_emit_op(const struct lp_build_image_soa *base,
+                          struct gallivm_state *gallivm,
+                          const struct lp_img_params *params)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMContextRef context = gallivm->context;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(context);
+   LLVMTypeRef vec_type = LLVMVectorType(i32t, 4);
+   LLVMTypeRef arg_types[8];
+   LLVMValueRef args[8];
+   LLVMValueRef function, data, data2, vec;
+   unsigned i;
+
+   arg_types[0] = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+   arg_types[1] =
+   arg_types[2] =
+   arg_types[3] =
+   arg_types[4] =
+   arg_types[5] = i32t;
+   arg_types[6] =
+   arg_types[7] = LLVMPointerType(i32t, 0);
+
+   function = lp_build_const_func_pointer(gallivm,
+                                          func_to_pointer((func_pointer)lp_image_access),
+                                          LLVMVoidTypeInContext(context),
+                                          arg_types, ARRAY_SIZE(arg_types),
+                                          "lp_image_access");
+
+   data = lp_build_alloca(gallivm, vec_type, "image_data");
+   data2 = lp_build_alloca(gallivm, vec_type, "image_data2");
+
+   vec = LLVMGetUndef(vec_type);
+   for (i = 0; i < 4; i++)
+      vec = LLVMBuildInsertElement(builder, vec, params->indata[i],
+                                   lp_build_const_int32(gallivm, i), "");
+   LLVMBuildStore(builder, vec, data);
+
+   vec = LLVMGetUndef(vec_type);
+   for (i = 0; i < 4; i++)
+      vec = LLVMBuildInsertElement(builder, vec, params->indata2[i],
+                                   lp_build_const_int32(gallivm, i), "");
+   LLVMBuildStore(builder, vec, data2);
+
+   args[0] = LLVMBuildBitCast(builder,
+                              lp_llvm_image_member_ptr(gallivm,
+                                                       params->context_ptr,
+                                                       params->image_index,
+                                                       -1),
+                              arg_types[0], "");
+   args[1] = lp_build_const_int32(gallivm, params->target);
+   args[2] = lp_build_const_int32(gallivm, params->opcode);
+   for (i = 0; i < 3; i++)
+      args[3 + i] = params->coords[i];
+   args[6] = LLVMBuildBitCast(builder, data, arg_types[6], "");
+   args[7] = LLVMBuildBitCast(builder, data2, arg_types[7], "");
+
+   LLVMBuildCall(builder, function, args, ARRAY_SIZE(args), "");
+
+   if (params->opcode != TGSI_OPCODE_STORE) {
+      vec = LLVMBuildLoad(builder, data, "");
+      for (i = 0; i < 4; i++)
+         params->outdata[i] =
+            LLVMBuildExtractElement(builder, vec,
+                                    lp_build_const_int32(gallivm, i), "");
+   }
+}
+
+
+static void
+lp_llvm_image_soa_emit_size_query(const struct lp_build_image_soa *base,
+                                  struct gallivm_state *gallivm,
+                                  const struct lp_img_params *params)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef width, height, depth;
+   LLVMValueRef zero = lp_build_const_int32(gallivm, 0);
+   unsigned i;
+
+   width = LLVMBuildLoad(builder,
+                         lp_llvm_image_member_ptr(gallivm, params->context_ptr,
+                                                  params->image_index,
+                                                  LP_JIT_IMAGE_WIDTH), "");
+   height = LLVMBuildLoad(builder,
+                          lp_llvm_image_member_ptr(gallivm, params->context_ptr,
+                                                   params->image_index,
+                                                   LP_JIT_IMAGE_HEIGHT), "");
+   depth = LLVMBuildLoad(builder,
+                         lp_llvm_image_member_ptr(gallivm, params->context_ptr,
+                                                  params->image_index,
+                                                  LP_JIT_IMAGE_DEPTH), "");
+
+   for (i = 0; i < 4; i++)
+      params->outdata[i] = zero;
+
+   params->outdata[0] = width;
+
+   switch (params->target) {
+   case TGSI_TEXTURE_1D_ARRAY:
+      params->outdata[1] = depth;
+      break;
+   case TGSI_TEXTURE_2D:
+   case TGSI_TEXTURE_RECT:
+   case TGSI_TEXTURE_CUBE:
+      params->outdata[1] = height;
+      break;
+   case TGSI_TEXTURE_2D_ARRAY:
+   case TGSI_TEXTURE_3D:
+      params->outdata[1] = height;
+      params->outdata[2] = depth;
+      break;
+   case TGSI_TEXTURE_CUBE_ARRAY:
+      params->outdata[1] = height;
+      params->outdata[2] = LLVMBuildUDiv(builder, depth,
+                                         lp_build_const_int32(gallivm, 6), "");
+      break;
+   default:
+      break;
+   }
+}
+
+
+struct lp_build_image_soa *
+lp_llvm_image_soa_create(void)
+{
+   struct lp_llvm_image_soa *image;
+
+   image = CALLOC_STRUCT(lp_llvm_image_soa);
+   if (!image)
+      return NULL;
+
+   image->base.destroy = lp_llvm_image_soa_destroy;
+   image->base.emit_op = lp_llvm_image_soa_emit_op;
+   image->base.emit_size_query = lp_llvm_image_soa_emit_size_query;
+
+   return &image->base;
+}
+
+
+/**
+ * Describe the bound image view to the generated code.
+ */
+void
+lp_jit_image_from_view(struct lp_jit_image *jit_image,
+                       const struct pipe_image_view *view)
+{
+   struct pipe_resource *res = view ? view->resource : NULL;
+   struct llvmpipe_resource *lp_res;
+   unsigned level;
+
+   memset(jit_image, 0, sizeof *jit_image);
+
+   if (!res)
+      return;
+
+   lp_res = llvmpipe_resource(res);
+   jit_image->format = view->format;
+
+   if (!llvmpipe_resource_is_texture(res)) {
+      unsigned blocksize = util_format_get_blocksize(view->format);
+
+      jit_image->base = (uint8_t *)lp_res->data + view->u.buf.offset;
+      jit_image->width = view->u.buf.size / blocksize;
+      jit_image->height = 1;
+      jit_image->depth = 1;
+      return;
+   }
+
+   assert(!lp_res->tiled);
+
+   level = view->u.tex.level;
+   jit_image->width = u_minify(res->width0, level);
+   jit_image->height = u_minify(res->height0, level);
+   jit_image->row_stride = lp_res->row_stride[level];
+   jit_image->img_stride = lp_res->img_stride[level];
+
+   if (lp_res->dt) {
+      struct sw_winsys *winsys = llvmpipe_screen(res->screen)->winsys;
+
+      jit_image->base = winsys->displaytarget_map(winsys, lp_res->dt,
+                                                  PIPE_TRANSFER_READ_WRITE);
+      jit_image->depth = 1;
+      return;
+   }
+
+   jit_image->base = (uint8_t *)lp_res->tex_data + lp_res->mip_offsets[level];
+
+   if (res->target == PIPE_TEXTURE_3D) {
+      jit_image->depth = u_minify(res->depth0, level);
+   }
+   else {
+      jit_image->depth = view->u.tex.last_layer - view->u.tex.first_layer + 1;
+      jit_image->base = (uint8_t *)jit_image->base +
+                        view->u.tex.first_layer * jit_image->img_stride;
+   }
+}
@@ -45,6 +45,7 @@
 
 struct lp_build_format_cache;
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -71,6 +72,22 @@ struct lp_jit_sampler
 };
 
 
+/**
+ * A single level/layer range of a shader image (TGSI_FILE_IMAGE).
+ * Always linear; the image view's level is resolved at bind time.
+ */
+struct lp_jit_image
+{
+   uint32_t width;        /* same as number of elements */
+   uint32_t height;
+   uint32_t depth;        /* doubles as array size */
+   uint32_t row_stride;
+   uint32_t img_stride;
+   uint32_t format;       /* enum pipe_format */
+   void *base;
+};
+
+
 struct lp_jit_viewport
 {
    float min_depth;
@@ -101,6 +118,18 @@ enum {
 };
 
 
+enum {
+   LP_JIT_IMAGE_WIDTH = 0,
+   LP_JIT_IMAGE_HEIGHT,
+   LP_JIT_IMAGE_DEPTH,
+   LP_JIT_IMAGE_ROW_STRIDE,
+   LP_JIT_IMAGE_IMG_STRIDE,
+   LP_JIT_IMAGE_FORMAT,
+   LP_JIT_IMAGE_BASE,
+   LP_JIT_IMAGE_NUM_FIELDS  /* number of fields above */
+};
+
+
 enum {
    LP_JIT_VIEWPORT_MIN_DEPTH,
    LP_JIT_VIEWPORT_MAX_DEPTH,
@@ -109,7 +138,8 @@ enum {
 
 
 /**
- * This structure is passed directly to the generated fragment shader.
+ * This structure is passed directly to the generated fragment and compute
+ * shaders.
  *
  * It contains the derived state.
  *
@@ -135,6 +165,11 @@ struct lp_jit_context
 
    struct lp_jit_texture textures[PIPE_MAX_SHADER_SAMPLER_VIEWS];
    struct lp_jit_sampler samplers[PIPE_MAX_SAMPLERS];
+
+   const uint32_t *ssbos[LP_MAX_TGSI_SHADER_BUFFERS];
+   int num_ssbos[LP_MAX_TGSI_SHADER_BUFFERS];   /* in bytes */
+
+   struct lp_jit_image images[LP_MAX_TGSI_SHADER_IMAGES];
 };
 
 
@@ -153,6 +188,9 @@ enum {
    LP_JIT_CTX_VIEWPORTS,
    LP_JIT_CTX_TEXTURES,
    LP_JIT_CTX_SAMPLERS,
+   LP_JIT_CTX_SSBOS,
+   LP_JIT_CTX_NUM_SSBOS,
+   LP_JIT_CTX_IMAGES,
    LP_JIT_CTX_COUNT
 };
 
@@ -187,6 +225,15 @@ enum {
 #define lp_jit_context_samplers(_gallivm, _ptr) \
    lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_SAMPLERS, "samplers")
 
+#define lp_jit_context_ssbos(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_SSBOS, "ssbos")
+
+#define lp_jit_context_num_ssbos(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_NUM_SSBOS, "num_ssbos")
+
+#define lp_jit_context_images(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CTX_IMAGES, "images")
+
 
 struct lp_jit_thread_data
 {
@@ -233,10 +280,13 @@ enum {
  * @param dady          shader input dady
  * @param color         color buffer
  * @param depth         depth buffer
- * @param mask          mask of visible pixels in block
+ * @param mask          mask of visible pixels in block, for multisample
+ *                      variants bit 16 * s + i is sample s of pixel i
  * @param thread_data   task thread data
  * @param stride        color buffer row stride in bytes
  * @param depth_stride  depth buffer row stride in bytes
+ * @param sample_stride color buffer sample stride in bytes
+ * @param depth_sample_stride  depth buffer sample stride in bytes
  */
 typedef void
 (*lp_jit_frag_func)(const struct lp_jit_context *context,
@@ -248,10 +298,12 @@ typedef void
                     const void *dady,
                     uint8_t **color,
                     uint8_t *depth,
-                    uint32_t mask,
+                    uint64_t mask,
                     struct lp_jit_thread_data *thread_data,
                     unsigned *stride,
-                    unsigned depth_stride);
+                    unsigned depth_stride,
+                    unsigned *sample_stride,
+                    unsigned depth_sample_stride);
 
 
 void
@@ -262,8 +314,49 @@ boolean
 lp_jit_screen_init(struct llvmpipe_screen *screen);
 
 
+/**
+ * typedef for compute shader function
+ *
+ * Runs up to one vector of invocations of a work group.
+ *
+ * @param context       jit context
+ * @param block_x       work group id x
+ * @param block_y       work group id y
+ * @param block_z       work group id z
+ * @param grid_x        number of work groups x
+ * @param grid_y        number of work groups y
+ * @param grid_z        number of work groups z
+ * @param block_size_x  work group size x
+ * @param block_size_y  work group size y
+ * @param block_size_z  work group size z
+ * @param first_thread  linear index of the first invocation of the vector
+ * @param shared        work group shared memory (TGSI_FILE_MEMORY)
+ * @param barrier_data  lp_cs_barrier() argument, NULL without barriers
+ * @param thread_data   task thread data
+ */
+typedef void
+(*lp_jit_cs_func)(const struct lp_jit_context *context,
+                  uint32_t block_x,
+                  uint32_t block_y,
+                  uint32_t block_z,
+                  uint32_t grid_x,
+                  uint32_t grid_y,
+                  uint32_t grid_z,
+                  uint32_t block_size_x,
+                  uint32_t block_size_y,
+                  uint32_t block_size_z,
+                  uint32_t first_thread,
+                  void *shared,
+                  void *barrier_data,
+                  struct lp_jit_thread_data *thread_data);
+
+
 void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
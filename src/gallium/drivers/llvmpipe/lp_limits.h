@@ -61,7 +61,32 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Sanity limit for LP_NUM_THREADS.  The per-thread state is allocated
+ * at runtime, so this is not a hard limit of the rasterizer.
+ */
+#define LP_MAX_THREADS 1024
+
+/**
+ * Max number of NUMA nodes the rasterizer threads are spread over.
+ */
+#define LP_MAX_NUMA_NODES 16
+
+/**
+ * Max number of scenes per context, i.e. how many scenes can be queued
+ * for rasterization while the next one is being binned.
+ */
+#define LP_MAX_SCENES 4
+
+/**
+ * Max number of threads setting up and binning the triangles of one draw.
+ */
+#define LP_MAX_SETUP_THREADS 16
+
+/**
+ * Max number of threads compiling optimized shader variants per context.
+ */
+#define LP_MAX_COMPILE_THREADS 8
 
 
 /**
@@ -93,4 +118,15 @@
  */
 #define LP_MAX_SETUP_VARIANTS 64
 
+/**
+ * Max size of the shared memory of a compute shader work group.
+ */
+#define LP_MAX_CS_SHARED_MEM (32 * 1024)
+
+/**
+ * Number of samples of multisample render targets.  This is also the only
+ * sample count other than one which is supported.
+ */
+#define LP_MAX_SAMPLES 4
+
 #endif /* LP_LIMITS_H */
@@ -0,0 +1,216 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * NUMA topology discovery and thread pinning.
+ *
+ * The topology is read from sysfs, so that no libnuma dependency is
+ * needed.  On other platforms lp_numa_create() returns NULL and llvmpipe
+ * behaves as on a single node machine.
+ */
+
+#include "pipe/p_config.h"
+
+#if defined(PIPE_OS_LINUX)
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+
+#include "util/u_memory.h"
+#include "lp_debug.h"
+#include "lp_limits.h"
+#include "lp_numa.h"
+
+
+#if defined(PIPE_OS_LINUX)
+
+struct lp_numa
+{
+   unsigned num_nodes;
+   cpu_set_t cpus[LP_MAX_NUMA_NODES];
+};
+
+
+/**
+ * Parse a sysfs cpu/node list such as "0-7,16-23" into a set.
+ * \return FALSE if the file can't be read
+ */
+static boolean
+read_cpulist(const char *path, cpu_set_t *set)
+{
+   char buf[4096];
+   char *p;
+   FILE *f;
+   size_t n;
+
+   f = fopen(path, "r");
+   if (!f)
+      return FALSE;
+
+   n = fread(buf, 1, sizeof buf - 1, f);
+   fclose(f);
+   buf[n] = '\0';
+
+   CPU_ZERO(set);
+
+   p = buf;
+   while (*p >= '0' && *p <= '9') {
+      unsigned long first, last, i;
+
+      first = last = strtoul(p, &p, 10);
+      if (*p == '-')
+         last = strtoul(p + 1, &p, 10);
+
+      for (i = first; i <= last && i < CPU_SETSIZE; i++)
+         CPU_SET(i, set);
+
+      if (*p != ',')
+         break;
+      p++;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Detect the NUMA nodes which have CPUs.
+ * \return NULL if there's only one such node or the topology is unknown
+ */
+struct lp_numa *
+lp_numa_create(void)
+{
+   struct lp_numa *numa;
+   cpu_set_t online, allowed;
+   unsigned node;
+
+   if (!read_cpulist("/sys/devices/system/node/online", &online))
+      return NULL;
+
+   if (sched_getaffinity(0, sizeof allowed, &allowed) != 0)
+      return NULL;
+
+   numa = CALLOC_STRUCT(lp_numa);
+   if (!numa)
+      return NULL;
+
+   for (node = 0; node < CPU_SETSIZE; node++) {
+      char path[64];
+      cpu_set_t *cpus = &numa->cpus[numa->num_nodes];
+
+      if (!CPU_ISSET(node, &online))
+         continue;
+
+      snprintf(path, sizeof path,
+               "/sys/devices/system/node/node%u/cpulist", node);
+      if (!read_cpulist(path, cpus))
+         continue;
+
+      /* Respect the affinity we were started with (taskset, cgroups) and
+       * skip memory-only nodes.
+       */
+      CPU_AND(cpus, cpus, &allowed);
+      if (CPU_COUNT(cpus) == 0)
+         continue;
+
+      LP_DBG(DEBUG_RAST, "NUMA node %u: %d cpus\n", node, CPU_COUNT(cpus));
+
+      if (++numa->num_nodes == LP_MAX_NUMA_NODES)
+         break;
+   }
+
+   if (numa->num_nodes < 2) {
+      FREE(numa);
+      return NULL;
+   }
+
+   return numa;
+}
+
+
+void
+lp_numa_destroy(struct lp_numa *numa)
+{
+   FREE(numa);
+}
+
+
+unsigned
+lp_numa_num_nodes(const struct lp_numa *numa)
+{
+   return numa ? numa->num_nodes : 1;
+}
+
+
+/**
+ * Restrict the calling thread to the CPUs of a node.
+ */
+boolean
+lp_numa_bind_thread(const struct lp_numa *numa, unsigned node)
+{
+   if (!numa)
+      return FALSE;
+
+   assert(node < numa->num_nodes);
+
+   return sched_setaffinity(0, sizeof numa->cpus[node],
+                            &numa->cpus[node]) == 0;
+}
+
+
+#else /* !PIPE_OS_LINUX */
+
+
+struct lp_numa *
+lp_numa_create(void)
+{
+   return NULL;
+}
+
+
+void
+lp_numa_destroy(struct lp_numa *numa)
+{
+}
+
+
+unsigned
+lp_numa_num_nodes(const struct lp_numa *numa)
+{
+   return 1;
+}
+
+
+boolean
+lp_numa_bind_thread(const struct lp_numa *numa, unsigned node)
+{
+   return FALSE;
+}
+
+
+#endif /* !PIPE_OS_LINUX */
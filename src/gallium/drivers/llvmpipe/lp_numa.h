@@ -0,0 +1,74 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * NUMA topology and thread placement.
+ *
+ * With LP_NUMA=1 the rasterizer threads are pinned to NUMA nodes and the
+ * tile rows of a scene are split into one band per node.  Render targets
+ * are zeroed by the rasterizer threads, each band by the threads of the
+ * node that will rasterize it, so that with the kernel's first-touch
+ * policy each node mostly renders into local memory.
+ */
+
+#ifndef LP_NUMA_H
+#define LP_NUMA_H
+
+#include "pipe/p_compiler.h"
+
+
+struct lp_numa;
+
+
+struct lp_numa *
+lp_numa_create(void);
+
+void
+lp_numa_destroy(struct lp_numa *numa);
+
+unsigned
+lp_numa_num_nodes(const struct lp_numa *numa);
+
+boolean
+lp_numa_bind_thread(const struct lp_numa *numa, unsigned node);
+
+
+/**
+ * Node of rasterizer thread 'thread'.  Threads are assigned to nodes in
+ * contiguous groups, so that thread order matches tile band order.
+ */
+static inline unsigned
+lp_numa_thread_node(const struct lp_numa *numa,
+                    unsigned thread, unsigned num_threads)
+{
+   if (!numa || num_threads == 0)
+      return 0;
+   return thread * lp_numa_num_nodes(numa) / num_threads;
+}
+
+
+#endif /* LP_NUMA_H */
@@ -25,31 +25,82 @@
  *
  **************************************************************************/
 
+#include <stddef.h>
+#include <inttypes.h>
 #include "util/u_debug.h"
+#include "util/u_memory.h"
+#include "gallivm/lp_bld_init.h"
+#include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
-
-
-
-struct lp_counters lp_count;
-
-
+#include "lp_rast.h"
+#include "lp_screen.h"
+
+
+#define COUNTER(NAME, FIELD, TYPE) \
+   { NAME, offsetof(struct lp_counters, FIELD), PIPE_DRIVER_QUERY_TYPE_##TYPE }
+
+const struct lp_counter_desc lp_counter_descs[] = {
+   COUNTER("lp-triangles", nr_tris, UINT64),
+   COUNTER("lp-culled-triangles", nr_culled_tris, UINT64),
+   COUNTER("lp-hiz-culled-triangles", nr_hiz_culled_tris, UINT64),
+   COUNTER("lp-hiz-culled-64x64", nr_hiz_culled_64, UINT64),
+   COUNTER("lp-empty-64x64", nr_empty_64, UINT64),
+   COUNTER("lp-fully-covered-64x64", nr_fully_covered_64, UINT64),
+   COUNTER("lp-partially-covered-64x64", nr_partially_covered_64, UINT64),
+   COUNTER("lp-pure-shade-opaque-64x64", nr_pure_shade_opaque_64, UINT64),
+   COUNTER("lp-pure-shade-64x64", nr_pure_shade_64, UINT64),
+   COUNTER("lp-shade-64x64", nr_shade_64, UINT64),
+   COUNTER("lp-shade-opaque-64x64", nr_shade_opaque_64, UINT64),
+   COUNTER("lp-empty-16x16", nr_empty_16, UINT64),
+   COUNTER("lp-fully-covered-16x16", nr_fully_covered_16, UINT64),
+   COUNTER("lp-partially-covered-16x16", nr_partially_covered_16, UINT64),
+   COUNTER("lp-empty-4x4", nr_empty_4, UINT64),
+   COUNTER("lp-fully-covered-4x4", nr_fully_covered_4, UINT64),
+   COUNTER("lp-partially-covered-4x4", nr_partially_covered_4, UINT64),
+   COUNTER("lp-states-reused", nr_states_reused, UINT64),
+   COUNTER("lp-llvm-compiles", nr_llvm_compiles, UINT64),
+   COUNTER("lp-llvm-compile-time", llvm_compile_time, MICROSECONDS),
+   COUNTER("lp-color-tile-clears", nr_color_tile_clear, UINT64),
+   COUNTER("lp-color-tile-loads", nr_color_tile_load, UINT64),
+   COUNTER("lp-color-tile-stores", nr_color_tile_store, UINT64),
+};
+
+#undef COUNTER
+
+const unsigned lp_num_counter_descs = ARRAY_SIZE(lp_counter_descs);
+
+
+/**
+ * Sum the counters of the context and of the rasterizer threads.
+ * The rasterizer threads are shared by all contexts of the screen and may
+ * still be running, so this is only exact after a finish.
+ */
 void
-lp_reset_counters(void)
+lp_get_counters(struct llvmpipe_context *lp, struct lp_counters *counters)
 {
-   memset(&lp_count, 0, sizeof(lp_count));
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   *counters = lp->counters;
+   if (screen->rast)
+      lp_rast_add_counters(screen->rast, counters);
 }
 
 
 void
-lp_print_counters(void)
+lp_print_counters(struct llvmpipe_context *lp)
 {
    if (LP_DEBUG & DEBUG_COUNTERS) {
-      unsigned total_64, total_16, total_4;
+      struct lp_counters lp_count;
+      uint64_t total_64, total_16, total_4;
+      unsigned tier;
       float p1, p2, p3, p4, p5, p6;
 
-      debug_printf("llvmpipe: nr_triangles:                 %9u\n", lp_count.nr_tris);
-      debug_printf("llvmpipe: nr_culled_triangles:          %9u\n", lp_count.nr_culled_tris);
+      lp_get_counters(lp, &lp_count);
+
+      debug_printf("llvmpipe: nr_triangles:                 %9" PRIu64 "\n", lp_count.nr_tris);
+      debug_printf("llvmpipe: nr_culled_triangles:          %9" PRIu64 "\n", lp_count.nr_culled_tris);
+      debug_printf("llvmpipe: nr_hiz_culled_triangles:      %9" PRIu64 "\n", lp_count.nr_hiz_culled_tris);
 
       total_64 = (lp_count.nr_empty_64 + 
                   lp_count.nr_fully_covered_64 +
@@ -61,14 +112,15 @@ lp_print_counters(void)
       p5 = 100.0 * (float) lp_count.nr_shade_opaque_64 / (float) total_64;
       p6 = 100.0 * (float) lp_count.nr_shade_64 / (float) total_64;
 
-      debug_printf("llvmpipe: nr_64x64:                     %9u\n", total_64);
-      debug_printf("llvmpipe:   nr_fully_covered_64x64:     %9u (%3.0f%% of %u)\n", lp_count.nr_fully_covered_64, p2, total_64);
-      debug_printf("llvmpipe:     nr_shade_opaque_64x64:    %9u (%3.0f%% of %u)\n", lp_count.nr_shade_opaque_64, p5, total_64);
-      debug_printf("llvmpipe:        nr_pure_shade_opaque:  %9u (%3.0f%% of %u)\n", lp_count.nr_pure_shade_opaque_64, 0.0, lp_count.nr_shade_opaque_64);
-      debug_printf("llvmpipe:     nr_shade_64x64:           %9u (%3.0f%% of %u)\n", lp_count.nr_shade_64, p6, total_64);
-      debug_printf("llvmpipe:        nr_pure_shade:         %9u (%3.0f%% of %u)\n", lp_count.nr_pure_shade_64, 0.0, lp_count.nr_shade_64);
-      debug_printf("llvmpipe:   nr_partially_covered_64x64: %9u (%3.0f%% of %u)\n", lp_count.nr_partially_covered_64, p3, total_64);
-      debug_printf("llvmpipe:   nr_empty_64x64:             %9u (%3.0f%% of %u)\n", lp_count.nr_empty_64, p1, total_64);
+      debug_printf("llvmpipe: nr_64x64:                     %9" PRIu64 "\n", total_64);
+      debug_printf("llvmpipe:   nr_fully_covered_64x64:     %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_fully_covered_64, p2, total_64);
+      debug_printf("llvmpipe:     nr_shade_opaque_64x64:    %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_shade_opaque_64, p5, total_64);
+      debug_printf("llvmpipe:        nr_pure_shade_opaque:  %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_pure_shade_opaque_64, 0.0, lp_count.nr_shade_opaque_64);
+      debug_printf("llvmpipe:     nr_shade_64x64:           %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_shade_64, p6, total_64);
+      debug_printf("llvmpipe:        nr_pure_shade:         %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_pure_shade_64, 0.0, lp_count.nr_shade_64);
+      debug_printf("llvmpipe:   nr_partially_covered_64x64: %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_partially_covered_64, p3, total_64);
+      debug_printf("llvmpipe:   nr_empty_64x64:             %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_empty_64, p1, total_64);
+      debug_printf("llvmpipe: nr_hiz_culled_64x64:          %9" PRIu64 "\n", lp_count.nr_hiz_culled_64);
 
       total_16 = (lp_count.nr_empty_16 + 
                   lp_count.nr_fully_covered_16 +
@@ -78,10 +130,10 @@ lp_print_counters(void)
       p2 = 100.0 * (float) lp_count.nr_fully_covered_16 / (float) total_16;
       p3 = 100.0 * (float) lp_count.nr_partially_covered_16 / (float) total_16;
 
-      debug_printf("llvmpipe: nr_16x16:                     %9u\n", total_16);
-      debug_printf("llvmpipe:   nr_fully_covered_16x16:     %9u (%3.0f%% of %u)\n", lp_count.nr_fully_covered_16, p2, total_16);
-      debug_printf("llvmpipe:   nr_partially_covered_16x16: %9u (%3.0f%% of %u)\n", lp_count.nr_partially_covered_16, p3, total_16);
-      debug_printf("llvmpipe:   nr_empty_16x16:             %9u (%3.0f%% of %u)\n", lp_count.nr_empty_16, p1, total_16);
+      debug_printf("llvmpipe: nr_16x16:                     %9" PRIu64 "\n", total_16);
+      debug_printf("llvmpipe:   nr_fully_covered_16x16:     %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_fully_covered_16, p2, total_16);
+      debug_printf("llvmpipe:   nr_partially_covered_16x16: %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_partially_covered_16, p3, total_16);
+      debug_printf("llvmpipe:   nr_empty_16x16:             %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_empty_16, p1, total_16);
 
       total_4 = (lp_count.nr_empty_4 +
                  lp_count.nr_fully_covered_4 +
@@ -92,19 +144,29 @@ lp_print_counters(void)
       p3 = 100.0 * (float) lp_count.nr_partially_covered_4 / (float) total_4;
       p4 = 100.0 * (float) lp_count.nr_non_empty_4 / (float) total_4;
 
-      debug_printf("llvmpipe: nr_tri_4x4:                   %9u\n", total_4);
-      debug_printf("llvmpipe:   nr_fully_covered_4x4:       %9u (%3.0f%% of %u)\n", lp_count.nr_fully_covered_4, p2, total_4);
-      debug_printf("llvmpipe:   nr_partially_covered_4x4:   %9u (%3.0f%% of %u)\n", lp_count.nr_partially_covered_4, p3, total_4);
-      debug_printf("llvmpipe:   nr_empty_4x4:               %9u (%3.0f%% of %u)\n", lp_count.nr_empty_4, p1, total_4);
-      debug_printf("llvmpipe:   nr_non_empty_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_non_empty_4, p4, total_4);
+      debug_printf("llvmpipe: nr_tri_4x4:                   %9" PRIu64 "\n", total_4);
+      debug_printf("llvmpipe:   nr_fully_covered_4x4:       %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_fully_covered_4, p2, total_4);
+      debug_printf("llvmpipe:   nr_partially_covered_4x4:   %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_partially_covered_4, p3, total_4);
+      debug_printf("llvmpipe:   nr_empty_4x4:               %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_empty_4, p1, total_4);
+      debug_printf("llvmpipe:   nr_non_empty_4x4:           %9" PRIu64 " (%3.0f%% of %" PRIu64 ")\n", lp_count.nr_non_empty_4, p4, total_4);
 
-      debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
-      debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
-      debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
+      debug_printf("llvmpipe: nr_color_tile_clear:          %9" PRIu64 "\n", lp_count.nr_color_tile_clear);
+      debug_printf("llvmpipe: nr_color_tile_load:           %9" PRIu64 "\n", lp_count.nr_color_tile_load);
+      debug_printf("llvmpipe: nr_color_tile_store:          %9" PRIu64 "\n", lp_count.nr_color_tile_store);
 
-      debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
+      debug_printf("llvmpipe: nr_states_reused:             %9" PRIu64 "\n", lp_count.nr_states_reused);
+
+      debug_printf("llvmpipe: nr_llvm_compiles:             %" PRIu64 "\n", lp_count.nr_llvm_compiles);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      for (tier = 0; tier < GALLIVM_NUM_TIERS; tier++) {
+         struct gallivm_compile_stats stats;
+         gallivm_get_compile_stats(tier, &stats);
+         debug_printf("llvmpipe: %s tier modules:  %9u in %.2f sec\n",
+                      tier == GALLIVM_TIER_FAST ? "fast     " : "optimized",
+                      stats.modules, stats.usecs / 1000000.0);
+      }
+
    }
 }
@@ -34,58 +34,108 @@
 #define LP_PERF_H
 
 #include "pipe/p_compiler.h"
+#include "pipe/p_defines.h"
+
+
+struct llvmpipe_context;
+
 
 /**
- * Various counters
+ * Various counters.
+ *
+ * There's one instance per rasterizer thread (lp_rasterizer_task) and one
+ * per context for the binning and shader compilation, which runs in the
+ * context's thread, so they are always on and need no atomics.  They are
+ * exposed as driver specific queries, and therefore in the HUD.
+ *
+ * All members are 64-bit counters so that they can be accumulated and
+ * looked up generically, see lp_counter_desc.
  */
 struct lp_counters
 {
-   unsigned nr_tris;
-   unsigned nr_culled_tris;
-   unsigned nr_empty_64;
-   unsigned nr_fully_covered_64;
-   unsigned nr_partially_covered_64;
-   unsigned nr_pure_shade_opaque_64;
-   unsigned nr_pure_shade_64;
-   unsigned nr_shade_64;
-   unsigned nr_shade_opaque_64;
-   unsigned nr_empty_16;
-   unsigned nr_fully_covered_16;
-   unsigned nr_partially_covered_16;
-   unsigned nr_empty_4;
-   unsigned nr_fully_covered_4;
-   unsigned nr_partially_covered_4;
-   unsigned nr_non_empty_4;
-   unsigned nr_llvm_compiles;
-   int64_t llvm_compile_time;  /**< total, in microseconds */
-
-   unsigned nr_color_tile_clear;
-   unsigned nr_color_tile_load;
-   unsigned nr_color_tile_store;
+   uint64_t nr_tris;
+   uint64_t nr_culled_tris;
+   uint64_t nr_hiz_culled_tris;
+   uint64_t nr_hiz_culled_64;
+   uint64_t nr_empty_64;
+   uint64_t nr_fully_covered_64;
+   uint64_t nr_partially_covered_64;
+   uint64_t nr_pure_shade_opaque_64;
+   uint64_t nr_pure_shade_64;
+   uint64_t nr_shade_64;
+   uint64_t nr_shade_opaque_64;
+   uint64_t nr_empty_16;
+   uint64_t nr_fully_covered_16;
+   uint64_t nr_partially_covered_16;
+   uint64_t nr_empty_4;
+   uint64_t nr_fully_covered_4;
+   uint64_t nr_partially_covered_4;
+   uint64_t nr_non_empty_4;
+   uint64_t nr_states_reused;
+   uint64_t nr_llvm_compiles;
+   uint64_t llvm_compile_time;  /**< total, in microseconds */
+
+   uint64_t nr_color_tile_clear;
+   uint64_t nr_color_tile_load;
+   uint64_t nr_color_tile_store;
 };
 
 
-extern struct lp_counters lp_count;
+/** Increment the named counter of a struct lp_counters pointer */
+#define LP_COUNT(counters, counter) (counters)->counter++
+#define LP_COUNT_ADD(counters, counter, incr)  (counters)->counter += (incr)
+
+
+/**
+ * Description of a counter, as a driver specific query.
+ */
+struct lp_counter_desc
+{
+   const char *name;
+   unsigned offset;  /**< in struct lp_counters */
+   enum pipe_driver_query_type type;
+};
 
 
-/** Increment the named counter (only for debug builds) */
-#ifdef DEBUG
-#define LP_COUNT(counter) lp_count.counter++
-#define LP_COUNT_ADD(counter, incr)  lp_count.counter += (incr)
-#define LP_COUNT_GET(counter) (lp_count.counter)
-#else
-#define LP_COUNT(counter)
-#define LP_COUNT_ADD(counter, incr) (void)(incr)
-#define LP_COUNT_GET(counter) 0
-#endif
+extern const struct lp_counter_desc lp_counter_descs[];
+extern const unsigned lp_num_counter_descs;
+
+
+static inline uint64_t
+lp_counter_get(const struct lp_counters *counters, unsigned index)
+{
+   return *(const uint64_t *)
+      ((const uint8_t *)counters + lp_counter_descs[index].offset);
+}
+
+
+static inline void
+lp_counters_add(struct lp_counters *dst, const struct lp_counters *src)
+{
+   uint64_t *d = (uint64_t *)dst;
+   const uint64_t *s = (const uint64_t *)src;
+   unsigned i;
+
+   for (i = 0; i < sizeof *dst / sizeof *d; i++)
+      d[i] += s[i];
+}
+
+
+/** Whether a query type is one of the counters */
+static inline boolean
+lp_query_is_counter(unsigned type)
+{
+   return type >= PIPE_QUERY_DRIVER_SPECIFIC &&
+          type < PIPE_QUERY_DRIVER_SPECIFIC + lp_num_counter_descs;
+}
 
 
 extern void
-lp_reset_counters(void);
+lp_get_counters(struct llvmpipe_context *lp, struct lp_counters *counters);
 
 
 extern void
-lp_print_counters(void);
+lp_print_counters(struct llvmpipe_context *lp);
 
 
 #endif /* LP_PERF_H */
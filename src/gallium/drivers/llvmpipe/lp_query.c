@@ -53,13 +53,19 @@ llvmpipe_create_query(struct pipe_context *pipe,
                       unsigned type,
                       unsigned index)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES || lp_query_is_counter(type));
 
-   pq = CALLOC_STRUCT( llvmpipe_query );
+   /* The per-thread counters follow the struct */
+   pq = CALLOC_VARIANT_LENGTH_STRUCT(llvmpipe_query,
+                                     2 * num_threads * sizeof(uint64_t));
 
    if (pq) {
+      pq->start = (uint64_t *)(pq + 1);
+      pq->end = pq->start + num_threads;
       pq->type = type;
    }
 
@@ -176,7 +182,12 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    }
       break;
    default:
-      assert(0);
+      assert(lp_query_is_counter(pq->type));
+      /* binning and compilation, plus what the threads rasterized */
+      *result = pq->count;
+      for (i = 0; i < num_threads; i++) {
+         *result += pq->end[i];
+      }
       break;
    }
 
@@ -187,6 +198,8 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
 static boolean
 llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   unsigned num_threads = MAX2(1, screen->num_threads);
    struct llvmpipe_context *llvmpipe = llvmpipe_context( pipe );
    struct llvmpipe_query *pq = llvmpipe_query(q);
 
@@ -199,8 +212,8 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
    }
 
 
-   memset(pq->start, 0, sizeof(pq->start));
-   memset(pq->end, 0, sizeof(pq->end));
+   memset(pq->start, 0, num_threads * sizeof(pq->start[0]));
+   memset(pq->end, 0, num_threads * sizeof(pq->end[0]));
    lp_setup_begin_query(llvmpipe->setup, pq);
 
    switch (pq->type) {
@@ -233,6 +246,10 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
       llvmpipe->dirty |= LP_NEW_OCCLUSION_QUERY;
       break;
    default:
+      if (lp_query_is_counter(pq->type)) {
+         pq->count = lp_counter_get(&llvmpipe->counters,
+                                    pq->type - PIPE_QUERY_DRIVER_SPECIFIC);
+      }
       break;
    }
    return true;
@@ -296,6 +313,11 @@ llvmpipe_end_query(struct pipe_context *pipe, struct pipe_query *q)
       llvmpipe->dirty |= LP_NEW_OCCLUSION_QUERY;
       break;
    default:
+      if (lp_query_is_counter(pq->type)) {
+         pq->count = lp_counter_get(&llvmpipe->counters,
+                                    pq->type - PIPE_QUERY_DRIVER_SPECIFIC) -
+                     pq->count;
+      }
       break;
    }
 
@@ -39,16 +39,22 @@
 #include "lp_context.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_numa.h"
 #include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_rast_priv.h"
+#include "lp_rast_trace.h"
 #include "gallivm/lp_bld_format.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_scene.h"
 #include "lp_tex_sample.h"
 
 
+DEBUG_GET_ONCE_OPTION(lp_trace, "LP_TRACE", NULL)
+DEBUG_GET_ONCE_NUM_OPTION(lp_trace_frames, "LP_TRACE_FRAMES", 0)
+
+
 #ifdef DEBUG
 int jit_line = 0;
 const struct lp_rast_state *jit_state = NULL;
@@ -69,15 +75,18 @@ lp_rast_begin( struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __FUNCTION__);
 
    lp_scene_begin_rasterization( scene );
-   lp_scene_bin_iter_begin( scene );
+   lp_scene_bin_iter_begin( scene, rast->num_bands );
 }
 
 
+/**
+ * End rasterizing a scene.
+ * The scene is freed by the setup module once its fence is signalled,
+ * see lp_setup_retire_scene().
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
-   lp_scene_end_rasterization( rast->curr_scene );
-
    rast->curr_scene = NULL;
 }
 
@@ -113,6 +122,7 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
          task->color_tiles[i] = scene->cbufs[i].map +
                                 scene->cbufs[i].stride * task->y +
                                 scene->cbufs[i].format_bytes * task->x;
+         task->color_sample_stride[i] = scene->cbufs[i].sample_stride;
       }
    }
    if (task->scene->fb.zsbuf) {
@@ -136,6 +146,7 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
    unsigned cbuf = arg.clear_rb->cbuf;
    union util_color uc;
    enum pipe_format format;
+   unsigned sample;
 
    /* we never bin clear commands for non-existing buffers */
    assert(cbuf < scene->fb.nr_cbufs);
@@ -152,20 +163,23 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
           __FUNCTION__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
 
-   util_fill_box(scene->cbufs[cbuf].map,
-                 format,
-                 scene->cbufs[cbuf].stride,
-                 scene->cbufs[cbuf].layer_stride,
-                 task->x,
-                 task->y,
-                 0,
-                 task->width,
-                 task->height,
-                 scene->fb_max_layer + 1,
-                 &uc);
+   for (sample = 0; sample < scene->fb_samples; sample++) {
+      util_fill_box(scene->cbufs[cbuf].map +
+                    sample * scene->cbufs[cbuf].sample_stride,
+                    format,
+                    scene->cbufs[cbuf].stride,
+                    scene->cbufs[cbuf].layer_stride,
+                    task->x,
+                    task->y,
+                    0,
+                    task->width,
+                    task->height,
+                    scene->fb_max_layer + 1,
+                    &uc);
+   }
 
    /* this will increase for each rb which probably doesn't mean much */
-   LP_COUNT(nr_color_tile_clear);
+   LP_COUNT(&task->counters, nr_color_tile_clear);
 }
 
 
@@ -198,14 +212,17 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
     */
 
    if (scene->fb.zsbuf) {
+      const unsigned num_layers = scene->fb_max_layer + 1;
       unsigned layer;
-      uint8_t *dst_layer = task->depth_tile;
       block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
 
       clear_value &= clear_mask;
 
-      for (layer = 0; layer <= scene->fb_max_layer; layer++) {
-         dst = dst_layer;
+      /* all the layers of every sample */
+      for (layer = 0; layer < num_layers * scene->fb_samples; layer++) {
+         dst = task->depth_tile +
+               (layer % num_layers) * scene->zsbuf.layer_stride +
+               (layer / num_layers) * scene->zsbuf.sample_stride;
 
          switch (block_size) {
          case 1:
@@ -278,7 +295,6 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
             assert(0);
             break;
          }
-         dst_layer += scene->zsbuf.layer_stride;
       }
    }
 }
@@ -360,7 +376,9 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
                                             0xffff,
                                             &task->thread_data,
                                             stride,
-                                            depth_stride);
+                                            depth_stride,
+                                            task->color_sample_stride,
+                                            scene->zsbuf.sample_stride);
          END_JIT_CALL();
       }
    }
@@ -397,7 +415,7 @@ void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask)
+                         uint64_t mask)
 {
    const struct lp_rast_state *state = task->state;
    struct lp_fragment_shader_variant *variant = state->variant;
@@ -465,12 +483,43 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                                             mask,
                                             &task->thread_data,
                                             stride,
-                                            depth_stride);
+                                            depth_stride,
+                                            task->color_sample_stride,
+                                            scene->zsbuf.sample_stride);
       END_JIT_CALL();
    }
 }
 
 
+/**
+ * Shade the blocks covered by a multisample triangle, once all of its
+ * samples were rasterized into the task's coverage with
+ * lp_rast_add_coverage().  Each pixel is shaded once, with the mask of its
+ * covered samples, and the coverage is reset for the next triangle.
+ */
+void
+lp_rast_shade_coverage(struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs)
+{
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(task->coverage_blocks); i++) {
+      uint64_t blocks = task->coverage_blocks[i];
+
+      while (blocks) {
+         unsigned block = i * 64 + u_bit_scan64(&blocks);
+         unsigned x = task->x + (block % (TILE_SIZE / 4)) * 4;
+         unsigned y = task->y + (block / (TILE_SIZE / 4)) * 4;
+
+         lp_rast_shade_quads_mask(task, inputs, x, y, task->coverage[block]);
+         task->coverage[block] = 0;
+      }
+
+      task->coverage_blocks[i] = 0;
+   }
+}
+
+
 
 /**
  * Begin a new occlusion query.
@@ -492,7 +541,10 @@ lp_rast_begin_query(struct lp_rasterizer_task *task,
       pq->start[task->thread_index] = task->ps_invocations;
       break;
    default:
-      assert(0);
+      assert(lp_query_is_counter(pq->type));
+      pq->start[task->thread_index] =
+         lp_counter_get(&task->counters,
+                        pq->type - PIPE_QUERY_DRIVER_SPECIFIC);
       break;
    }
 }
@@ -525,7 +577,12 @@ lp_rast_end_query(struct lp_rasterizer_task *task,
       pq->start[task->thread_index] = 0;
       break;
    default:
-      assert(0);
+      assert(lp_query_is_counter(pq->type));
+      pq->end[task->thread_index] +=
+         lp_counter_get(&task->counters,
+                        pq->type - PIPE_QUERY_DRIVER_SPECIFIC) -
+         pq->start[task->thread_index];
+      pq->start[task->thread_index] = 0;
       break;
    }
 }
@@ -546,8 +603,29 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
 static void
 lp_rast_tile_end(struct lp_rasterizer_task *task)
 {
+   const struct cmd_bin *bin = task->bin;
    unsigned i;
 
+   /*
+    * Count before ending the queries.  Rendering happens in place, so a
+    * color tile "load" is a tile whose previous contents are kept, and
+    * every tile of a bound color buffer gets "stored".
+    */
+   if (bin->head->count == 1) {
+      if (bin->head->cmd[0] == LP_RAST_OP_SHADE_TILE_OPAQUE)
+         LP_COUNT(&task->counters, nr_pure_shade_opaque_64);
+      else if (bin->head->cmd[0] == LP_RAST_OP_SHADE_TILE)
+         LP_COUNT(&task->counters, nr_pure_shade_64);
+   }
+
+   for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
+      if (task->scene->fb.cbufs[i]) {
+         LP_COUNT(&task->counters, nr_color_tile_store);
+         if (bin->head->cmd[0] != LP_RAST_OP_CLEAR_COLOR)
+            LP_COUNT(&task->counters, nr_color_tile_load);
+      }
+   }
+
    for (i = 0; i < task->scene->num_active_queries; ++i) {
       lp_rast_end_query(task, lp_rast_arg_query(task->scene->active_queries[i]));
    }
@@ -589,7 +667,15 @@ static lp_rast_cmd_func dispatch[LP_RAST_OP_MAX] =
    lp_rast_triangle_32_8,
    lp_rast_triangle_32_3_4,
    lp_rast_triangle_32_3_16,
-   lp_rast_triangle_32_4_16
+   lp_rast_triangle_32_4_16,
+   lp_rast_triangle_ms_1,
+   lp_rast_triangle_ms_2,
+   lp_rast_triangle_ms_3,
+   lp_rast_triangle_ms_4,
+   lp_rast_triangle_ms_5,
+   lp_rast_triangle_ms_6,
+   lp_rast_triangle_ms_7,
+   lp_rast_triangle_ms_8
 };
 
 
@@ -606,7 +692,9 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
 
    for (block = bin->head; block; block = block->next) {
       for (k = 0; k < block->count; k++) {
+         uint64_t t0 = lp_rast_trace_begin(task->trace);
          dispatch[block->cmd[k]]( task, block->arg[k] );
+         lp_rast_trace_end(task->trace, block->cmd[k], t0, x, y);
       }
    }
 }
@@ -623,21 +711,17 @@ static void
 rasterize_bin(struct lp_rasterizer_task *task,
               const struct cmd_bin *bin, int x, int y )
 {
+   uint64_t t0;
+
+   t0 = lp_rast_trace_begin(task->trace);
    lp_rast_tile_begin( task, bin, x, y );
+   lp_rast_trace_end(task->trace, LP_TRACE_TILE_BEGIN, t0, x, y);
 
    do_rasterize_bin(task, bin, x, y);
 
+   t0 = lp_rast_trace_begin(task->trace);
    lp_rast_tile_end(task);
-
-
-   /* Debug/Perf flags:
-    */
-   if (bin->head->count == 1) {
-      if (bin->head->cmd[0] == LP_RAST_OP_SHADE_TILE_OPAQUE)
-         LP_COUNT(nr_pure_shade_opaque_64);
-      else if (bin->head->cmd[0] == LP_RAST_OP_SHADE_TILE)
-         LP_COUNT(nr_pure_shade_64);
-   }
+   lp_rast_trace_end(task->trace, LP_TRACE_TILE_END, t0, x, y);
 }
 
 
@@ -663,6 +747,8 @@ static void
 rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
+   uint64_t t0 = lp_rast_trace_begin(task->trace);
+
    task->scene = scene;
 
    /* Clear the cache tags. This should not always be necessary but
@@ -683,7 +769,7 @@ rasterize_scene(struct lp_rasterizer_task *task,
          int i, j;
 
          assert(scene);
-         while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+         while ((bin = lp_scene_bin_iter_next(scene, task->band, &i, &j))) {
             if (!is_empty_bin( bin ))
                rasterize_bin(task, bin, i, j);
          }
@@ -705,6 +791,8 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
+   lp_rast_trace_end(task->trace, LP_TRACE_SCENE, t0, -1, -1);
+
    if (scene->fence) {
       lp_fence_signal(scene->fence);
    }
@@ -757,18 +845,36 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Queue a job to be run by all the rasterizer threads, in order with the
+ * scenes queued before and after it.  The job's fence is signalled once
+ * every thread has returned from job->run().
+ */
 void
-lp_rast_finish( struct lp_rasterizer *rast )
+lp_rast_queue_job( struct lp_rasterizer *rast,
+                   struct lp_rast_job *job )
 {
+   job->fence->issued = TRUE;
+
    if (rast->num_threads == 0) {
-      /* nothing to do */
+      /* no threading */
+      unsigned fpstate = util_fpstate_get();
+
+      util_fpstate_set_denorms_to_zero(fpstate);
+
+      job->run(job, 0, &rast->tasks[0].thread_data);
+
+      util_fpstate_set(fpstate);
+
+      lp_fence_signal(job->fence);
    }
    else {
-      int i;
+      unsigned i;
+
+      lp_scene_enqueue_job( rast->full_scenes, job );
 
-      /* wait for work to complete */
       for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
+         pipe_semaphore_signal(&rast->tasks[i].work_ready);
       }
    }
 }
@@ -778,8 +884,7 @@ lp_rast_finish( struct lp_rasterizer *rast )
  * This is the thread's main entrypoint.
  * It's a simple loop:
  *   1. wait for work
- *   2. do work
- *   3. signal that we're done
+ *   2. do work, signalling the scene's fence when done
  */
 static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
@@ -792,6 +897,11 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    util_snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    pipe_thread_setname(thread_name);
 
+   if (rast->numa && !lp_numa_bind_thread(rast->numa, task->band)) {
+      debug_printf("llvmpipe: failed to pin thread %u to NUMA node %u\n",
+                   task->thread_index, task->band);
+   }
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -799,49 +909,74 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    util_fpstate_set_denorms_to_zero(fpstate);
 
    while (1) {
+      uint64_t t0;
+
       /* wait for work */
       if (debug)
          debug_printf("thread %d waiting for work\n", task->thread_index);
+      t0 = lp_rast_trace_begin(task->trace);
       pipe_semaphore_wait(&task->work_ready);
+      lp_rast_trace_end(task->trace, LP_TRACE_WAIT_WORK, t0, -1, -1);
 
       if (rast->exit_flag)
          break;
 
       if (task->thread_index == 0) {
          /* thread[0]:
-          *  - get next scene to rasterize
+          *  - get next scene to rasterize, or job to run
           *  - map the framebuffer surfaces
           */
-         lp_rast_begin( rast, 
-                        lp_scene_dequeue( rast->full_scenes, TRUE ) );
+         struct lp_rast_job *job;
+         struct lp_scene *scene = lp_scene_dequeue( rast->full_scenes, TRUE,
+                                                    &job );
+
+         rast->curr_job = job;
+         if (!job)
+            lp_rast_begin( rast, scene );
       }
 
       /* Wait for all threads to get here so that threads[1+] don't
        * get a null rast->curr_scene pointer.
        */
+      t0 = lp_rast_trace_begin(task->trace);
       pipe_barrier_wait( &rast->barrier );
+      lp_rast_trace_end(task->trace, LP_TRACE_WAIT_THREADS, t0, -1, -1);
 
       /* do work */
       if (debug)
          debug_printf("thread %d doing work\n", task->thread_index);
 
-      rasterize_scene(task,
-                      rast->curr_scene);
+      if (rast->curr_job) {
+         t0 = lp_rast_trace_begin(task->trace);
+         rast->curr_job->run(rast->curr_job, task->thread_index,
+                             &task->thread_data);
+         lp_rast_trace_end(task->trace, LP_TRACE_JOB, t0, -1, -1);
+      }
+      else
+         rasterize_scene(task,
+                         rast->curr_scene);
       
       /* wait for all threads to finish with this scene */
+      t0 = lp_rast_trace_begin(task->trace);
       pipe_barrier_wait( &rast->barrier );
+      lp_rast_trace_end(task->trace, LP_TRACE_WAIT_THREADS, t0, -1, -1);
 
       /* XXX: shouldn't be necessary:
        */
       if (task->thread_index == 0) {
-         lp_rast_end( rast );
+         if (rast->curr_job) {
+            /* the job may be freed as soon as the fence is signalled */
+            struct lp_rast_job *job = rast->curr_job;
+            rast->curr_job = NULL;
+            lp_fence_signal(job->fence);
+         }
+         else {
+            lp_rast_end( rast );
+         }
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -875,9 +1010,10 @@ create_rast_threads(struct lp_rasterizer *rast)
  * Create new lp_rasterizer.  If num_threads is zero, don't create any
  * new threads, do rendering synchronously.
  * \param num_threads  number of rasterizer threads to create
+ * \param numa  if not NULL, pin the threads to the nodes of this topology
  */
 struct lp_rasterizer *
-lp_rast_create( unsigned num_threads )
+lp_rast_create( unsigned num_threads, const struct lp_numa *numa )
 {
    struct lp_rasterizer *rast;
    unsigned i;
@@ -887,20 +1023,33 @@ lp_rast_create( unsigned num_threads )
       goto no_rast;
    }
 
+   rast->tasks = CALLOC(MAX2(1, num_threads), sizeof *rast->tasks);
+   rast->threads = CALLOC(MAX2(1, num_threads), sizeof *rast->threads);
+   if (!rast->tasks || !rast->threads) {
+      goto no_tasks;
+   }
+
    rast->full_scenes = lp_scene_queue_create();
    if (!rast->full_scenes) {
       goto no_full_scenes;
    }
 
+   rast->numa = numa;
+   rast->num_bands = lp_numa_num_nodes(rast->numa);
+
    for (i = 0; i < MAX2(1, num_threads); i++) {
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      task->band = lp_numa_thread_node(rast->numa, i, num_threads);
       task->thread_data.cache = align_malloc(sizeof(struct lp_build_format_cache),
                                              16);
       if (!task->thread_data.cache) {
          goto no_thread_data_cache;
       }
+      if (debug_get_option_lp_trace()) {
+         task->trace = lp_rast_trace_create();
+      }
    }
 
    rast->num_threads = num_threads;
@@ -919,20 +1068,154 @@ lp_rast_create( unsigned num_threads )
    return rast;
 
 no_thread_data_cache:
-   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+   for (i = 0; i < MAX2(1, num_threads); i++) {
       if (rast->tasks[i].thread_data.cache) {
          align_free(rast->tasks[i].thread_data.cache);
       }
+      lp_rast_trace_destroy(rast->tasks[i].trace);
    }
 
    lp_scene_queue_destroy(rast->full_scenes);
 no_full_scenes:
+no_tasks:
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 no_rast:
    return NULL;
 }
 
 
+/**
+ * Add the counters of all rasterizer threads to the given ones.
+ * The threads may be running, so this is only exact when they're idle.
+ */
+void
+lp_rast_add_counters( struct lp_rasterizer *rast,
+                      struct lp_counters *counters )
+{
+   unsigned i;
+
+   for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+      lp_counters_add(counters, &rast->tasks[i].counters);
+   }
+}
+
+
+/**
+ * Write the timelines of the rasterizer threads to a file, see
+ * lp_rast_trace.h.  The threads must not be recording events meanwhile.
+ */
+static void
+write_trace( struct lp_rasterizer *rast, const char *filename )
+{
+   struct lp_trace_buffer **bufs;
+   unsigned num_bufs = MAX2(1, rast->num_threads);
+   unsigned i;
+   FILE *f;
+
+   if (!filename || !rast->tasks[0].trace)
+      return;
+
+   bufs = MALLOC(num_bufs * sizeof *bufs);
+   if (!bufs)
+      return;
+
+   for (i = 0; i < num_bufs; i++) {
+      bufs[i] = rast->tasks[i].trace;
+      if (!bufs[i])
+         goto out;
+   }
+
+   f = fopen(filename, "w");
+   if (!f) {
+      debug_printf("llvmpipe: failed to open %s\n", filename);
+      goto out;
+   }
+
+   lp_rast_trace_write(f, bufs, num_bufs);
+   fclose(f);
+
+out:
+   FREE(bufs);
+}
+
+
+/**
+ * Write the timelines of the rasterizer threads to the file LP_TRACE
+ * names.  The threads must be idle, e.g. after a finish.
+ */
+void
+lp_rast_trace_dump( struct lp_rasterizer *rast )
+{
+   write_trace(rast, debug_get_option_lp_trace());
+}
+
+
+struct lp_trace_dump_job
+{
+   struct lp_rast_job base;
+   struct lp_rasterizer *rast;
+   char filename[256];
+};
+
+
+/**
+ * Once every thread is in here none of them records events, so thread 0
+ * can write them out before letting the others go.
+ */
+static void
+trace_dump_job_run(struct lp_rast_job *base,
+                   unsigned thread_index,
+                   struct lp_jit_thread_data *thread_data)
+{
+   struct lp_trace_dump_job *job = (struct lp_trace_dump_job *)base;
+   struct lp_rasterizer *rast = job->rast;
+
+   if (rast->num_threads > 0)
+      pipe_barrier_wait(&rast->barrier);
+
+   if (thread_index == 0)
+      write_trace(rast, job->filename);
+
+   if (rast->num_threads > 0)
+      pipe_barrier_wait(&rast->barrier);
+}
+
+
+/**
+ * Count a frame.  Every LP_TRACE_FRAMES frames, write the timelines of the
+ * rasterizer threads to "<LP_TRACE>.<frame>", after the scenes queued so
+ * far.  Waits for the write; the caller must hold the screen's rast_mutex.
+ */
+void
+lp_rast_trace_end_frame( struct lp_rasterizer *rast )
+{
+   const char *filename = debug_get_option_lp_trace();
+   unsigned frames = (unsigned)debug_get_option_lp_trace_frames();
+   struct lp_trace_dump_job job;
+
+   if (!filename || !frames || !rast->tasks[0].trace)
+      return;
+
+   if (++rast->trace_frame % frames != 0)
+      return;
+
+   job.base.run = trace_dump_job_run;
+   job.base.fence = lp_fence_create(1);
+   if (!job.base.fence)
+      return;
+   job.rast = rast;
+   util_snprintf(job.filename, sizeof job.filename, "%s.%u",
+                 filename, rast->trace_frame);
+
+   lp_rast_queue_job(rast, &job.base);
+
+   lp_fence_wait(job.base.fence);
+   lp_fence_reference(&job.base.fence, NULL);
+}
+
+
 /* Shutdown:
  */
 void lp_rast_destroy( struct lp_rasterizer *rast )
@@ -964,8 +1247,11 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
       pipe_semaphore_destroy(&rast->tasks[i].work_ready);
       pipe_semaphore_destroy(&rast->tasks[i].work_done);
    }
+   lp_rast_trace_dump(rast);
+
    for (i = 0; i < MAX2(1, rast->num_threads); i++) {
       align_free(rast->tasks[i].thread_data.cache);
+      lp_rast_trace_destroy(rast->tasks[i].trace);
    }
 
    /* for synchronizing rasterization threads */
@@ -975,6 +1261,8 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
 
    lp_scene_queue_destroy(rast->full_scenes);
 
+   FREE(rast->threads);
+   FREE(rast->tasks);
    FREE(rast);
 }
 
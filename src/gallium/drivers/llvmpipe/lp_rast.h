@@ -40,12 +40,15 @@
 #include "pipe/p_compiler.h"
 #include "util/u_pack_color.h"
 #include "lp_jit.h"
+#include "lp_limits.h"
 
 
 struct lp_rasterizer;
 struct lp_scene;
 struct lp_fence;
+struct lp_numa;
 struct cmd_bin;
+struct lp_counters;
 
 #define FIXED_TYPE_WIDTH 64
 /** For sub-pixel positioning */
@@ -70,6 +73,23 @@ struct cmd_bin;
 
 #define IMUL64(a, b) (((int64_t)(a)) * ((int64_t)(b)))
 
+
+/**
+ * Position of a sample of a multisample pixel, in 1/16th of a pixel
+ * relative to the pixel centre.  This is the standard 4x pattern.
+ */
+static inline void
+lp_sample_pos(unsigned sample, int *x, int *y)
+{
+   static const int8_t pos[LP_MAX_SAMPLES][2] = {
+      { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 }
+   };
+
+   assert(sample < LP_MAX_SAMPLES);
+   *x = pos[sample][0];
+   *y = pos[sample][1];
+}
+
 struct lp_rasterizer_task;
 
 
@@ -157,7 +177,7 @@ struct lp_rast_clear_rb {
 
 
 struct lp_rasterizer *
-lp_rast_create( unsigned num_threads );
+lp_rast_create( unsigned num_threads, const struct lp_numa *numa );
 
 void
 lp_rast_destroy( struct lp_rasterizer * );
@@ -167,7 +187,34 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
 void
-lp_rast_finish( struct lp_rasterizer *rast );
+lp_rast_add_counters( struct lp_rasterizer *rast,
+                      struct lp_counters *counters );
+
+void
+lp_rast_trace_dump( struct lp_rasterizer *rast );
+
+void
+lp_rast_trace_end_frame( struct lp_rasterizer *rast );
+
+
+/**
+ * Work other than a scene for the rasterizer threads, such as a compute
+ * grid.  run() is called once on every rasterizer thread, concurrently;
+ * the threads have to split up the work among themselves.
+ */
+struct lp_rast_job
+{
+   void (*run)(struct lp_rast_job *job,
+               unsigned thread_index,
+               struct lp_jit_thread_data *thread_data);
+
+   /** Signalled when all threads are done, created with rank 1 */
+   struct lp_fence *fence;
+};
+
+void
+lp_rast_queue_job( struct lp_rasterizer *rast,
+                   struct lp_rast_job *job );
 
 
 union lp_rast_cmd_arg {
@@ -302,8 +349,16 @@ lp_rast_arg_null( void )
 #define LP_RAST_OP_TRIANGLE_32_3_4   0x1a
 #define LP_RAST_OP_TRIANGLE_32_3_16  0x1b
 #define LP_RAST_OP_TRIANGLE_32_4_16  0x1c
-
-#define LP_RAST_OP_MAX               0x1d
+#define LP_RAST_OP_MS_TRIANGLE_1     0x1d
+#define LP_RAST_OP_MS_TRIANGLE_2     0x1e
+#define LP_RAST_OP_MS_TRIANGLE_3     0x1f
+#define LP_RAST_OP_MS_TRIANGLE_4     0x20
+#define LP_RAST_OP_MS_TRIANGLE_5     0x21
+#define LP_RAST_OP_MS_TRIANGLE_6     0x22
+#define LP_RAST_OP_MS_TRIANGLE_7     0x23
+#define LP_RAST_OP_MS_TRIANGLE_8     0x24
+
+#define LP_RAST_OP_MAX               0x25
 #define LP_RAST_OP_MASK              0xff
 
 void
@@ -32,6 +32,7 @@
 #include "util/u_format.h"
 #include "gallivm/lp_bld_debug.h"
 #include "lp_memory.h"
+#include "lp_perf.h"
 #include "lp_rast.h"
 #include "lp_scene.h"
 #include "lp_state.h"
@@ -74,6 +75,8 @@ extern const struct lp_rasterizer_task *jit_task;
 
 
 struct lp_rasterizer;
+struct lp_numa;
+struct lp_trace_buffer;
 struct cmd_bin;
 
 /**
@@ -90,6 +93,19 @@ struct lp_rasterizer_task
 
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
+   /** Sample strides of the color buffers, for the fragment shader */
+   unsigned color_sample_stride[PIPE_MAX_COLOR_BUFS];
+
+   /**
+    * Coverage of the multisample triangle being rasterized, per 4x4 block
+    * of the tile: bit 16 * s + i is set if sample s of pixel i is covered.
+    * See lp_rast_add_coverage().
+    */
+   uint64_t coverage[(TILE_SIZE / 4) * (TILE_SIZE / 4)];
+   /** Bitmask of the blocks with any coverage */
+   uint64_t coverage_blocks[(TILE_SIZE / 4) * (TILE_SIZE / 4) / 64];
+   /** Sample being rasterized */
+   unsigned sample;
 
    /** "back" pointer */
    struct lp_rasterizer *rast;
@@ -97,11 +113,20 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** Band of tile rows this thread rasterizes first, see lp_scene.c */
+   unsigned band;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
    uint64_t ps_invocations;
    uint8_t ps_inv_multiplier;
 
+   /** Always on statistics of this thread, see lp_perf.h */
+   struct lp_counters counters;
+
+   /** Timeline of this thread, NULL unless LP_TRACE is set */
+   struct lp_trace_buffer *trace;
+
    pipe_semaphore work_ready;
    pipe_semaphore work_done;
 };
@@ -123,14 +148,25 @@ struct lp_rasterizer
    /** The scene currently being rasterized by the threads */
    struct lp_scene *curr_scene;
 
-   /** A task object for each rasterization thread */
-   struct lp_rasterizer_task tasks[LP_MAX_THREADS];
+   /** The job currently being run by the threads, instead of a scene */
+   struct lp_rast_job *curr_job;
+
+   /** A task object for each rasterization thread (at least one) */
+   struct lp_rasterizer_task *tasks;
 
    unsigned num_threads;
-   pipe_thread threads[LP_MAX_THREADS];
+   pipe_thread *threads;
+
+   /** NUMA topology the threads are pinned to, or NULL */
+   const struct lp_numa *numa;
+   /** One band of tile rows per NUMA node */
+   unsigned num_bands;
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
+
+   /** Frames ended so far, for LP_TRACE_FRAMES */
+   unsigned trace_frame;
 };
 
 
@@ -138,7 +174,45 @@ void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask);
+                         uint64_t mask);
+
+void
+lp_rast_shade_coverage(struct lp_rasterizer_task *task,
+                       const struct lp_rast_shader_inputs *inputs);
+
+
+/**
+ * Offset of a plane's edge function value at a sample position, relative
+ * to the value at the pixel centre.
+ */
+static inline int64_t
+lp_rast_sample_offset(const struct lp_rast_plane *plane, unsigned sample)
+{
+   int sx, sy;
+
+   lp_sample_pos(sample, &sx, &sy);
+
+   /* dcdx and dcdy are multiples of FIXED_ONE so this is exact */
+   return (IMUL64(plane->dcdy, sy) - IMUL64(plane->dcdx, sx)) / 16;
+}
+
+
+/**
+ * Accumulate the coverage of the current sample for a 4x4 block, to be
+ * shaded by lp_rast_shade_coverage() once all samples are rasterized.
+ * \param x, y location of 4x4 block in window coords
+ */
+static inline void
+lp_rast_add_coverage(struct lp_rasterizer_task *task,
+                     unsigned x, unsigned y,
+                     unsigned mask)
+{
+   unsigned block = ((y % TILE_SIZE) / 4) * (TILE_SIZE / 4) +
+                    (x % TILE_SIZE) / 4;
+
+   task->coverage[block] |= (uint64_t)mask << (16 * task->sample);
+   task->coverage_blocks[block / 64] |= (uint64_t)1 << (block % 64);
+}
 
 
 /**
@@ -279,7 +353,9 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
                                          0xffff,
                                          &task->thread_data,
                                          stride,
-                                         depth_stride);
+                                         depth_stride,
+                                         task->color_sample_stride,
+                                         scene->zsbuf.sample_stride);
       END_JIT_CALL();
    }
 }
@@ -337,6 +413,23 @@ void lp_rast_triangle_32_3_16( struct lp_rasterizer_task *,
 void lp_rast_triangle_32_4_16( struct lp_rasterizer_task *, 
                             const union lp_rast_cmd_arg );
 
+void lp_rast_triangle_ms_1(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+void lp_rast_triangle_ms_2(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+void lp_rast_triangle_ms_3(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+void lp_rast_triangle_ms_4(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+void lp_rast_triangle_ms_5(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+void lp_rast_triangle_ms_6(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+void lp_rast_triangle_ms_7(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+void lp_rast_triangle_ms_8(struct lp_rasterizer_task *,
+                           const union lp_rast_cmd_arg);
+
 void
 lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg);
@@ -344,4 +437,7 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
 void
 lp_debug_bin( const struct cmd_bin *bin, int x, int y );
 
+const char *
+lp_rast_cmd_name(unsigned cmd);
+
 #endif
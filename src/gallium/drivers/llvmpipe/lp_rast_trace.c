@@ -0,0 +1,147 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Rasterizer thread timeline tracing, see lp_rast_trace.h.
+ */
+
+#include "util/u_debug.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "lp_rast_priv.h"
+#include "lp_rast_trace.h"
+
+
+DEBUG_GET_ONCE_NUM_OPTION(trace_events, "LP_TRACE_EVENTS", 1 << 16)
+
+
+static const char *trace_names[LP_TRACE_MAX - LP_RAST_OP_MAX] =
+{
+   "tile_begin",
+   "tile_end",
+   "scene",
+   "job",
+   "wait_work",
+   "wait_threads",
+};
+
+
+static const char *
+trace_name(unsigned type)
+{
+   if (type < LP_RAST_OP_MAX)
+      return lp_rast_cmd_name(type);
+
+   assert(type < LP_TRACE_MAX);
+   return trace_names[type - LP_RAST_OP_MAX];
+}
+
+
+/**
+ * Create an event ring buffer, of LP_TRACE_EVENTS events rounded up to a
+ * power of two.
+ */
+struct lp_trace_buffer *
+lp_rast_trace_create(void)
+{
+   struct lp_trace_buffer *buf;
+   unsigned size = util_next_power_of_two(MAX2(debug_get_option_trace_events(), 16));
+
+   buf = CALLOC_STRUCT(lp_trace_buffer);
+   if (!buf)
+      return NULL;
+
+   buf->events = MALLOC(size * sizeof *buf->events);
+   if (!buf->events) {
+      FREE(buf);
+      return NULL;
+   }
+
+   buf->mask = size - 1;
+   return buf;
+}
+
+
+void
+lp_rast_trace_destroy(struct lp_trace_buffer *buf)
+{
+   if (buf) {
+      FREE(buf->events);
+      FREE(buf);
+   }
+}
+
+
+/**
+ * Write the events of the given buffers, one per thread, in the Chrome
+ * trace event format.  The buffers must not be written to meanwhile.
+ */
+void
+lp_rast_trace_write(FILE *f,
+                    struct lp_trace_buffer * const *bufs,
+                    unsigned num_bufs)
+{
+   const char *sep = "";
+   uint64_t origin = UINT64_MAX;
+   unsigned i;
+
+   /* Timestamps relative to the oldest event, for readability */
+   for (i = 0; i < num_bufs; i++) {
+      const struct lp_trace_buffer *buf = bufs[i];
+      uint64_t first = buf->count > buf->mask ? buf->count - buf->mask - 1 : 0;
+      if (buf->count)
+         origin = MIN2(origin, buf->events[first & buf->mask].begin);
+   }
+
+   fprintf(f, "{\"traceEvents\":[\n");
+
+   for (i = 0; i < num_bufs; i++) {
+      const struct lp_trace_buffer *buf = bufs[i];
+      uint64_t first = buf->count > buf->mask ? buf->count - buf->mask - 1 : 0;
+      uint64_t n;
+
+      fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+              "\"tid\":%u,\"args\":{\"name\":\"llvmpipe-%u\"}}",
+              sep, i, i);
+      sep = ",\n";
+
+      for (n = first; n < buf->count; n++) {
+         const struct lp_trace_event *ev = &buf->events[n & buf->mask];
+
+         fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                 "\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                 sep, trace_name(ev->type),
+                 ev->type < LP_RAST_OP_MAX ? "cmd" : "rast", i,
+                 (ev->begin - origin) / 1000.0, ev->duration / 1000.0);
+         if (ev->x >= 0)
+            fprintf(f, ",\"args\":{\"x\":%d,\"y\":%d}", ev->x, ev->y);
+         fprintf(f, "}");
+      }
+   }
+
+   fprintf(f, "\n]}\n");
+}
@@ -0,0 +1,124 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Timeline tracing of the rasterizer threads.
+ *
+ * When LP_TRACE is set, every rasterizer thread records timestamped
+ * events into a ring buffer of its own: tile begin/end, every bin command
+ * executed, scenes and compute jobs, and the waits for work and for the
+ * other threads.  The buffers are written as Chrome trace JSON (to be
+ * loaded in chrome://tracing) into the file LP_TRACE names, when the
+ * screen is destroyed or on request with lp_rast_trace_dump(), and every
+ * LP_TRACE_FRAMES frames into numbered files, see lp_rast_trace_end_frame().
+ */
+
+#ifndef LP_RAST_TRACE_H
+#define LP_RAST_TRACE_H
+
+#include <stdio.h>
+
+#include "pipe/p_compiler.h"
+#include "os/os_time.h"
+#include "lp_rast.h"
+
+
+/**
+ * Trace event types, past the bin commands (LP_RAST_OP_x)
+ */
+#define LP_TRACE_TILE_BEGIN    (LP_RAST_OP_MAX + 0)
+#define LP_TRACE_TILE_END      (LP_RAST_OP_MAX + 1)
+#define LP_TRACE_SCENE         (LP_RAST_OP_MAX + 2)
+#define LP_TRACE_JOB           (LP_RAST_OP_MAX + 3)
+#define LP_TRACE_WAIT_WORK     (LP_RAST_OP_MAX + 4)
+#define LP_TRACE_WAIT_THREADS  (LP_RAST_OP_MAX + 5)
+#define LP_TRACE_MAX           (LP_RAST_OP_MAX + 6)
+
+
+struct lp_trace_event
+{
+   uint64_t begin;   /**< in nanoseconds */
+   uint32_t duration;
+   uint8_t type;     /**< LP_RAST_OP_x or LP_TRACE_x */
+   uint8_t pad;
+   int16_t x, y;     /**< tile position, or -1 */
+};
+
+
+/**
+ * Ring buffer of a thread's events.  Only the thread itself writes into
+ * it, the oldest events get overwritten.
+ */
+struct lp_trace_buffer
+{
+   struct lp_trace_event *events;
+   unsigned mask;    /**< number of events minus one, a power of two */
+   uint64_t count;   /**< events recorded so far */
+};
+
+
+struct lp_trace_buffer *
+lp_rast_trace_create(void);
+
+void
+lp_rast_trace_destroy(struct lp_trace_buffer *buf);
+
+void
+lp_rast_trace_write(FILE *f,
+                    struct lp_trace_buffer * const *bufs,
+                    unsigned num_bufs);
+
+
+/**
+ * Start timing an event.  Free when tracing is disabled (NULL buffer).
+ */
+static inline uint64_t
+lp_rast_trace_begin(const struct lp_trace_buffer *buf)
+{
+   return buf ? os_time_get_nano() : 0;
+}
+
+
+/**
+ * Record an event started with lp_rast_trace_begin().
+ */
+static inline void
+lp_rast_trace_end(struct lp_trace_buffer *buf, unsigned type,
+                  uint64_t begin, int x, int y)
+{
+   if (buf) {
+      struct lp_trace_event *ev = &buf->events[buf->count++ & buf->mask];
+      ev->begin = begin;
+      ev->duration = (uint32_t)MIN2(os_time_get_nano() - begin, ~0u);
+      ev->type = type;
+      ev->x = x;
+      ev->y = y;
+   }
+}
+
+
+#endif /* LP_RAST_TRACE_H */
@@ -684,7 +684,60 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 #endif
 
 
-#if defined PIPE_ARCH_SSE
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+
+
+/**
+ * Edge function values of a whole 4x4 block, in row order.
+ */
+static inline __m512i
+cstep_avx512(int c, int dcdx, int dcdy)
+{
+   __m128i cstep0 = _mm_setr_epi32(c, c+dcdx, c+dcdx*2, c+dcdx*3);
+   __m512i ystep = _mm512_setr_epi32(0, 0, 0, 0,
+                                     dcdy, dcdy, dcdy, dcdy,
+                                     dcdy*2, dcdy*2, dcdy*2, dcdy*2,
+                                     dcdy*3, dcdy*3, dcdy*3, dcdy*3);
+
+   return _mm512_add_epi32(_mm512_broadcast_i32x4(cstep0), ystep);
+}
+
+
+static inline void
+build_masks_avx512(int c,
+                   int cdiff,
+                   int dcdx,
+                   int dcdy,
+                   unsigned *outmask,
+                   unsigned *partmask)
+{
+   __m512i cstep = cstep_avx512(c, dcdx, dcdy);
+   __m512i zero = _mm512_setzero_si512();
+
+   *outmask |= _mm512_cmplt_epi32_mask(cstep, zero);
+
+   cstep = _mm512_add_epi32(cstep, _mm512_set1_epi32(cdiff));
+   *partmask |= _mm512_cmplt_epi32_mask(cstep, zero);
+}
+
+
+static inline unsigned
+build_mask_linear_avx512(int c, int dcdx, int dcdy)
+{
+   __m512i cstep = cstep_avx512(c, dcdx, dcdy);
+
+   return _mm512_cmplt_epi32_mask(cstep, _mm512_setzero_si512());
+}
+
+#endif
+
+
+#if defined(__AVX512F__)
+#define BUILD_MASKS(c, cdiff, dcdx, dcdy, omask, pmask) build_masks_avx512((int)c, (int)cdiff, dcdx, dcdy, omask, pmask)
+#define BUILD_MASK_LINEAR(c, dcdx, dcdy) build_mask_linear_avx512((int)c, dcdx, dcdy)
+#elif defined PIPE_ARCH_SSE
 #define BUILD_MASKS(c, cdiff, dcdx, dcdy, omask, pmask) build_masks_sse((int)c, (int)cdiff, dcdx, dcdy, omask, pmask)
 #define BUILD_MASK_LINEAR(c, dcdx, dcdy) build_mask_linear_sse((int)c, dcdx, dcdy)
 #elif (defined(_ARCH_PWR8) && defined(PIPE_ARCH_LITTLE_ENDIAN))
@@ -732,6 +785,42 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 #define NR_PLANES 8
 #include "lp_rast_tri_tmp.h"
 
+#define MULTISAMPLE 1
+
+#define TAG(x) x##_ms_1
+#define NR_PLANES 1
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_2
+#define NR_PLANES 2
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_3
+#define NR_PLANES 3
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_4
+#define NR_PLANES 4
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_5
+#define NR_PLANES 5
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_6
+#define NR_PLANES 6
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_7
+#define NR_PLANES 7
+#include "lp_rast_tri_tmp.h"
+
+#define TAG(x) x##_ms_8
+#define NR_PLANES 8
+#include "lp_rast_tri_tmp.h"
+
+#undef MULTISAMPLE
+
 #undef RASTER_64
 
 #define TAG(x) x##_32_1
@@ -63,8 +63,13 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
 
    /* Now pass to the shader:
     */
-   if (mask)
+   if (mask) {
+#ifdef MULTISAMPLE
+      lp_rast_add_coverage(task, x, y, mask);
+#else
       lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+#endif
+   }
 }
 
 /**
@@ -128,7 +133,11 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
    assert((partial_mask & inmask) == 0);
 
-   LP_COUNT_ADD(nr_empty_4, util_bitcount(0xffff & ~(partial_mask | inmask)));
+   LP_COUNT_ADD(&task->counters, nr_empty_4,
+                util_bitcount(0xffff & ~(partial_mask | inmask)));
+   LP_COUNT_ADD(&task->counters, nr_partially_covered_4,
+                util_bitcount(partial_mask));
+   LP_COUNT_ADD(&task->counters, nr_fully_covered_4, util_bitcount(inmask));
 
    /* Iterate over partials:
     */
@@ -142,8 +151,6 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
       partial_mask &= ~(1 << i);
 
-      LP_COUNT(nr_partially_covered_4);
-
       for (j = 0; j < NR_PLANES; j++)
          cx[j] = (c[j] 
                   - IMUL64(plane[j].dcdx, ix)
@@ -163,12 +170,24 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
-      LP_COUNT(nr_fully_covered_4);
+#ifdef MULTISAMPLE
+      lp_rast_add_coverage(task, px, py, 0xffff);
+#else
       block_full_4(task, tri, px, py);
+#endif
    }
 }
 
 
+#ifdef MULTISAMPLE
+/**
+ * Scan the tile in chunks and figure out which pixels have the current
+ * sample covered by this triangle.
+ */
+static void
+TAG(rasterize_sample)(struct lp_rasterizer_task *task,
+                      const union lp_rast_cmd_arg arg)
+#else
 /**
  * Scan the tile in chunks and figure out which pixels to rasterize
  * for this triangle.
@@ -176,6 +195,7 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 void
 TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
                       const union lp_rast_cmd_arg arg)
+#endif
 {
    const struct lp_rast_triangle *tri = arg.triangle.tri;
    unsigned plane_mask = arg.triangle.plane_mask;
@@ -199,6 +219,9 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       plane[j] = tri_plane[i];
       plane_mask &= ~(1 << i);
       c[j] = plane[j].c + IMUL64(plane[j].dcdy, y) - IMUL64(plane[j].dcdx, x);
+#ifdef MULTISAMPLE
+      c[j] += lp_rast_sample_offset(&plane[j], task->sample);
+#endif
 
       {
 #ifdef RASTER_64
@@ -282,7 +305,11 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
    assert((partial_mask & inmask) == 0);
 
-   LP_COUNT_ADD(nr_empty_16, util_bitcount(0xffff & ~(partial_mask | inmask)));
+   LP_COUNT_ADD(&task->counters, nr_empty_16,
+                util_bitcount(0xffff & ~(partial_mask | inmask)));
+   LP_COUNT_ADD(&task->counters, nr_partially_covered_16,
+                util_bitcount(partial_mask));
+   LP_COUNT_ADD(&task->counters, nr_fully_covered_16, util_bitcount(inmask));
 
    /* Iterate over partials:
     */
@@ -301,7 +328,6 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       partial_mask &= ~(1 << i);
 
-      LP_COUNT(nr_partially_covered_16);
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
 
@@ -316,11 +342,42 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
       inmask &= ~(1 << i);
 
-      LP_COUNT(nr_fully_covered_16);
+#ifdef MULTISAMPLE
+      {
+         unsigned ix4, iy4;
+         for (iy4 = 0; iy4 < 16; iy4 += 4)
+            for (ix4 = 0; ix4 < 16; ix4 += 4)
+               lp_rast_add_coverage(task, px + ix4, py + iy4, 0xffff);
+      }
+#else
       block_full_16(task, tri, px, py);
+#endif
    }
 }
 
+#ifdef MULTISAMPLE
+/**
+ * Rasterize the triangle once for each sample position, then shade the
+ * covered pixels once each with the mask of their covered samples.
+ */
+void
+TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
+                      const union lp_rast_cmd_arg arg)
+{
+   const struct lp_rast_triangle *tri = arg.triangle.tri;
+
+   if (tri->inputs.disable) {
+      /* This triangle was partially binned and has been disabled */
+      return;
+   }
+
+   for (task->sample = 0; task->sample < LP_MAX_SAMPLES; task->sample++)
+      TAG(rasterize_sample)(task, arg);
+
+   lp_rast_shade_coverage(task, &tri->inputs);
+}
+#endif
+
 #if defined(PIPE_ARCH_SSE) && defined(TRI_16)
 /* XXX: special case this when intersection is not required.
  *      - tile completely within bbox,
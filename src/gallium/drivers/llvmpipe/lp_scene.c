@@ -26,6 +26,7 @@
  **************************************************************************/
 
 #include "util/u_framebuffer.h"
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_inlines.h"
@@ -41,6 +42,7 @@
 /** List of resource references */
 struct resource_ref {
    struct pipe_resource *resource[RESOURCE_REF_SZ];
+   void *storage[RESOURCE_REF_SZ];   /**< see llvmpipe_resource_storage_ref() */
    int count;
    struct resource_ref *next;
 };
@@ -62,8 +64,6 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
-   pipe_mutex_init(scene->mutex);
-
 #ifdef DEBUG
    /* Do some scene limit sanity checks here */
    {
@@ -90,8 +90,8 @@ void
 lp_scene_destroy(struct lp_scene *scene)
 {
    lp_fence_reference(&scene->fence, NULL);
-   pipe_mutex_destroy(scene->mutex);
-   assert(scene->data.head->next == NULL);
+   /* A private scene loses its head block when merged, see below */
+   assert(!scene->data.head || scene->data.head->next == NULL);
    FREE(scene->data.head);
    FREE(scene);
 }
@@ -160,6 +160,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       if (!cbuf) {
          scene->cbufs[i].stride = 0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = NULL;
          continue;
       }
@@ -169,6 +170,8 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                            cbuf->u.tex.level);
          scene->cbufs[i].layer_stride = llvmpipe_layer_stride(cbuf->texture,
                                                               cbuf->u.tex.level);
+         scene->cbufs[i].sample_stride =
+            llvmpipe_resource(cbuf->texture)->sample_stride;
 
          scene->cbufs[i].map = llvmpipe_resource_map(cbuf->texture,
                                                      cbuf->u.tex.level,
@@ -181,6 +184,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
          unsigned pixstride = util_format_get_blocksize(cbuf->format);
          scene->cbufs[i].stride = cbuf->texture->width0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = lpr->data;
          scene->cbufs[i].map += cbuf->u.buf.first_element * pixstride;
          scene->cbufs[i].format_bytes = util_format_get_blocksize(cbuf->format);
@@ -191,6 +195,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       struct pipe_surface *zsbuf = scene->fb.zsbuf;
       scene->zsbuf.stride = llvmpipe_resource_stride(zsbuf->texture, zsbuf->u.tex.level);
       scene->zsbuf.layer_stride = llvmpipe_layer_stride(zsbuf->texture, zsbuf->u.tex.level);
+      scene->zsbuf.sample_stride = llvmpipe_resource(zsbuf->texture)->sample_stride;
 
       scene->zsbuf.map = llvmpipe_resource_map(zsbuf->texture,
                                                zsbuf->u.tex.level,
@@ -265,6 +270,8 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                             ref->resource[i]->height0,
                             llvmpipe_resource_size(ref->resource[i]));
             j++;
+            llvmpipe_resource_storage_unref(ref->resource[i],
+                                            ref->storage[i]);
             pipe_resource_reference(&ref->resource[i], NULL);
          }
       }
@@ -297,6 +304,13 @@ lp_scene_end_rasterization(struct lp_scene *scene )
 
    scene->alloc_failed = FALSE;
 
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i])
+         llvmpipe_resource_fb_unref(scene->fb.cbufs[i]->texture);
+   }
+   if (scene->fb.zsbuf)
+      llvmpipe_resource_fb_unref(scene->fb.zsbuf->texture);
+
    util_unreference_framebuffer_state( &scene->fb );
 }
 
@@ -376,6 +390,9 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
                                 struct pipe_resource *resource,
                                 boolean initializing_scene)
 {
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   void *storage = llvmpipe_resource_is_texture(resource) ?
+                   lpr->tex_data : lpr->data;
    struct resource_ref *ref, **last = &scene->resources;
    int i;
 
@@ -384,10 +401,12 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
    for (ref = scene->resources; ref; ref = ref->next) {
       last = &ref->next;
 
-      /* Search for this resource:
+      /* Search for this resource.  A resource renamed since it was
+       * added gets a second entry for its new storage.
        */
       for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
+         if (ref->resource[i] == resource &&
+             (!ref->storage[i] || ref->storage[i] == storage))
             return TRUE;
 
       if (ref->count < RESOURCE_REF_SZ) {
@@ -411,6 +430,7 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
    /* Append the reference to the reference block.
     */
+   ref->storage[ref->count] = llvmpipe_resource_storage_ref(resource);
    pipe_resource_reference(&ref->resource[ref->count++], resource);
    scene->resource_reference_size += llvmpipe_resource_size(resource);
 
@@ -447,63 +467,141 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
+/**
+ * Does this scene render to the given resource?
+ */
+boolean
+lp_scene_is_fb_referenced(const struct lp_scene *scene,
+                          const struct pipe_resource *resource)
+{
+   unsigned i;
+
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource)
+         return TRUE;
+   }
+
+   return scene->fb.zsbuf && scene->fb.zsbuf->texture == resource;
+}
+
+
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Estimated cost of rasterizing a bin: its number of commands.
+ * Only meant for ordering bins, so a log2 bucket is enough.
+ * \return 0 for empty bins, 1..LP_SCENE_COST_BUCKETS-1 otherwise
+ */
+static unsigned
+bin_cost_bucket(const struct cmd_bin *bin)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
-   }
-   return TRUE;
+   const struct cmd_block *block;
+   unsigned count = 0;
+
+   for (block = bin->head; block; block = block->next)
+      count += block->count;
+
+   if (!count)
+      return 0;
+
+   return MIN2(1 + util_logbase2(count), LP_SCENE_COST_BUCKETS - 1);
 }
 
 
+/**
+ * Prepare for iterating over the bins.
+ * Called by one thread before any thread calls lp_scene_bin_iter_next().
+ *
+ * The tile rows are split into bands of consecutive rows.  The non-empty
+ * bins of each band are put into bin_order with the most expensive ones
+ * first, so that the big bins get started early and the cheap ones fill
+ * the gaps at the end of the scene.  Bins of similar cost stay in raster
+ * order.
+ *
+ * \param num_bands  number of bands of tile rows to split the bins into
+ */
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene )
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_bands )
 {
-   scene->curr_x = scene->curr_y = -1;
+   unsigned pos = 0;
+   unsigned i, x, y;
+
+   num_bands = MIN3(num_bands, scene->tiles_y, LP_MAX_NUMA_NODES);
+   scene->num_bands = MAX2(1, num_bands);
+
+   for (i = 0; i < scene->num_bands; i++) {
+      unsigned start_y = i * scene->tiles_y / scene->num_bands;
+      unsigned end_y = (i + 1) * scene->tiles_y / scene->num_bands;
+      unsigned count[LP_SCENE_COST_BUCKETS] = { 0 };
+      unsigned next[LP_SCENE_COST_BUCKETS];
+      int b;
+
+      for (y = start_y; y < end_y; y++) {
+         for (x = 0; x < scene->tiles_x; x++) {
+            unsigned bucket = bin_cost_bucket(lp_scene_get_bin(scene, x, y));
+            scene->bin_bucket[y][x] = bucket;
+            count[bucket]++;
+         }
+      }
+
+      scene->band[i].start = pos;
+
+      /* bucket 0 holds the empty bins, which are skipped */
+      for (b = LP_SCENE_COST_BUCKETS - 1; b > 0; b--) {
+         next[b] = pos;
+         pos += count[b];
+      }
+
+      scene->band[i].next = scene->band[i].start;
+      scene->band[i].end = pos;
+
+      for (y = start_y; y < end_y; y++) {
+         for (x = 0; x < scene->tiles_x; x++) {
+            unsigned bucket = scene->bin_bucket[y][x];
+            if (bucket) {
+               struct lp_scene_bin_ref *ref = &scene->bin_order[next[bucket]++];
+               ref->x = x;
+               ref->y = y;
+            }
+         }
+      }
+   }
 }
 
 
 /**
- * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * Return pointer to next bin to be rendered, or NULL when all bins of
+ * the scene have been handed out.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  Bins of the given band are handed out
+ * first; once it is done, the thread steals bins of the other bands.
+ * Only empty bins are skipped.
+ *
+ * This is lock-free: each band's position is advanced atomically.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned band,
+                        int *x, int *y )
 {
-   struct cmd_bin *bin = NULL;
+   unsigned i;
 
-   pipe_mutex_lock(scene->mutex);
+   for (i = 0; i < scene->num_bands; i++) {
+      struct lp_scene_band *b = &scene->band[(band + i) % scene->num_bands];
+      unsigned pos;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+      /* Don't bounce the cache line of a band that is done */
+      if (p_atomic_read(&b->next) >= b->end)
+         continue;
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+      pos = p_atomic_inc_return(&b->next) - 1;
+      if (pos < b->end) {
+         *x = scene->bin_order[pos].x;
+         *y = scene->bin_order[pos].y;
+         return lp_scene_get_bin(scene, *x, *y);
+      }
+   }
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   return NULL;
 }
 
 
@@ -518,6 +616,13 @@ void lp_scene_begin_binning( struct lp_scene *scene,
    scene->discard = discard;
    util_copy_framebuffer_state(&scene->fb, fb);
 
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i])
+         llvmpipe_resource_fb_ref(scene->fb.cbufs[i]->texture);
+   }
+   if (scene->fb.zsbuf)
+      llvmpipe_resource_fb_ref(scene->fb.zsbuf->texture);
+
    scene->tiles_x = align(fb->width, TILE_SIZE) / TILE_SIZE;
    scene->tiles_y = align(fb->height, TILE_SIZE) / TILE_SIZE;
    assert(scene->tiles_x <= TILES_X);
@@ -546,6 +651,9 @@ void lp_scene_begin_binning( struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+   scene->fb_samples = util_framebuffer_get_num_samples(fb);
+
+   scene->hiz_valid = FALSE;
 }
 
 
@@ -562,3 +670,165 @@ void lp_scene_end_binning( struct lp_scene *scene )
          lp_debug_bins( scene );
    }
 }
+
+
+/**
+ * Prepare an empty scene for binning on behalf of 'scene' by a setup
+ * thread.  The private scene shares the tile layout of 'scene' but has
+ * its own bins and data blocks, so several threads can bin in parallel
+ * without any locking.  At most about max_size bytes of data will be
+ * allocated before lp_scene_new_data_block() starts failing.
+ */
+boolean
+lp_scene_begin_private_binning(struct lp_scene *priv,
+                               const struct lp_scene *scene,
+                               unsigned max_size)
+{
+   assert(!priv->resources);
+   assert(!priv->fb.zsbuf && priv->fb.nr_cbufs == 0);
+
+   if (!priv->data.head) {
+      priv->data.head = MALLOC_STRUCT(data_block);
+      if (!priv->data.head)
+         return FALSE;
+
+      priv->data.head->used = 0;
+      priv->data.head->next = NULL;
+   }
+
+   priv->tiles_x = scene->tiles_x;
+   priv->tiles_y = scene->tiles_y;
+   priv->fb_max_layer = scene->fb_max_layer;
+   priv->fb_samples = scene->fb_samples;
+   priv->discard = scene->discard;
+
+   /* Depth bounds only go down during a draw, so those at the start of
+    * the draw remain valid for all of its primitives.
+    *
+    * All private bins of a draw are binned with the same state, so they
+    * can start off with the state last set in the shared bins, and need
+    * no state command if it is the draw's.
+    */
+   priv->hiz_valid = scene->hiz_valid;
+   {
+      unsigned i, j;
+
+      for (i = 0; i < scene->tiles_x; i++) {
+         for (j = 0; j < scene->tiles_y; j++) {
+            priv->tile[i][j].last_state = scene->tile[i][j].last_state;
+            if (scene->hiz_valid)
+               priv->tile[i][j].zmax = scene->tile[i][j].zmax;
+         }
+      }
+   }
+
+   /* Opaque whole-tile commands must not reset private bins: whatever
+    * they would overwrite lives in the shared scene or in the bins of a
+    * preceding setup thread.  Claiming there were queries keeps
+    * lp_setup_whole_tile() from doing that.
+    */
+   priv->had_queries = TRUE;
+
+   /* Bias the size so the LP_SCENE_MAX_SIZE check in
+    * lp_scene_new_data_block() triggers after max_size bytes.
+    */
+   priv->scene_size = LP_SCENE_MAX_SIZE - MIN2(max_size, LP_SCENE_MAX_SIZE);
+   priv->alloc_failed = FALSE;
+
+   return TRUE;
+}
+
+
+/**
+ * Append the commands of each of priv's bins to the matching bin of
+ * 'scene' and hand over the data blocks they point to.  Merging the
+ * private scenes in the order their primitives were submitted gives
+ * the same per-tile command order as binning on a single thread.
+ */
+void
+lp_scene_merge_private_bins(struct lp_scene *scene,
+                            struct lp_scene *priv)
+{
+   struct data_block *block, *last = NULL;
+   unsigned nr_blocks = 0;
+   unsigned i, j;
+
+   assert(priv->tiles_x == scene->tiles_x);
+   assert(priv->tiles_y == scene->tiles_y);
+
+   if (priv->data.head->used == 0 && !priv->data.head->next) {
+      /* nothing was binned */
+      return;
+   }
+
+   for (i = 0; i < scene->tiles_x; i++) {
+      for (j = 0; j < scene->tiles_y; j++) {
+         struct cmd_bin *src = lp_scene_get_bin(priv, i, j);
+         struct cmd_bin *dst;
+
+         if (!src->head)
+            continue;
+
+         dst = lp_scene_get_bin(scene, i, j);
+         if (scene->hiz_valid)
+            dst->zmax = MIN2(dst->zmax, src->zmax);
+         if (dst->tail)
+            dst->tail->next = src->head;
+         else
+            dst->head = src->head;
+         dst->tail = src->tail;
+         dst->last_state = src->last_state;
+
+         src->head = NULL;
+         src->tail = NULL;
+         src->last_state = NULL;
+      }
+   }
+
+   /* Splice the whole block list in behind the current head of the
+    * scene, which keeps serving new allocations.  The private scene
+    * gets a new head block in lp_scene_begin_private_binning().
+    */
+   for (block = priv->data.head; block; block = block->next) {
+      last = block;
+      nr_blocks++;
+   }
+
+   last->next = scene->data.head->next;
+   scene->data.head->next = priv->data.head;
+   scene->scene_size += nr_blocks * sizeof *block;
+
+   priv->data.head = NULL;
+   priv->scene_size = 0;
+   priv->alloc_failed = FALSE;
+}
+
+
+/**
+ * Depth was cleared to 'depth' in all tiles, so that's now the depth
+ * bound of every tile.
+ */
+void
+lp_scene_hiz_clear(struct lp_scene *scene, float depth)
+{
+   unsigned i, j;
+
+   for (i = 0; i < scene->tiles_x; i++) {
+      for (j = 0; j < scene->tiles_y; j++) {
+         scene->tile[i][j].zmax = depth;
+      }
+   }
+
+   scene->hiz_valid = TRUE;
+}
+
+
+/**
+ * Throw away everything binned into a private scene, eg. when it ran
+ * out of memory and the primitives are binned again serially.
+ */
+void
+lp_scene_discard_private_bins(struct lp_scene *priv)
+{
+   lp_scene_end_rasterization(priv);
+}
@@ -67,6 +67,11 @@ struct lp_rast_state;
  */
 #define LP_SCENE_MAX_RESOURCE_SIZE (64*1024*1024)
 
+/* Bins are ordered by log2 of their command count, see
+ * lp_scene_bin_iter_begin().
+ */
+#define LP_SCENE_COST_BUCKETS 32
+
 
 /* switch to a non-pointer value for this:
  */
@@ -97,6 +102,7 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;       /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   float zmax;          /* depth bound of the tile, see lp_scene::hiz_valid */
 };
    
 
@@ -117,6 +123,19 @@ struct data_block_list {
 
 struct resource_ref;
 
+/** Position of a bin, for the rasterization order */
+struct lp_scene_bin_ref {
+   uint16_t x, y;
+};
+
+/** Range of lp_scene::bin_order covering one band of tile rows */
+struct lp_scene_band {
+   unsigned start, end;
+   unsigned next;        /**< next bin to hand out, advanced atomically */
+   /** keep the counters of different bands in separate cache lines */
+   ubyte pad[64 - 3 * sizeof(unsigned)];
+};
+
 /**
  * All bins and bin data are contained here.
  * Per-bin data goes into the 'tile' bins.
@@ -142,12 +161,16 @@ struct lp_scene {
       uint8_t *map;
       unsigned stride;
       unsigned layer_stride;
+      unsigned sample_stride;
       unsigned format_bytes;
    } zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
 
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* The number of samples of the fb attachments, 1 or LP_MAX_SAMPLES */
+   unsigned fb_samples;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
@@ -167,14 +190,25 @@ struct lp_scene {
 
    boolean alloc_failed;
    boolean discard;
+
+   /**
+    * Whether the zmax of each bin is an upper bound of the depth values
+    * the tile will hold once the commands binned so far are executed.
+    * Becomes true with a depth clear, and false as soon as a draw could
+    * increase depth values, see update_hiz_state() in lp_setup.c.
+    */
+   boolean hiz_valid;
    /**
     * Number of active tiles in each dimension.
     * This basically the framebuffer size divided by tile size
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   pipe_mutex mutex;
+   /** For iterating over bins, see lp_scene_bin_iter_begin() */
+   struct lp_scene_band band[LP_MAX_NUMA_NODES];
+   unsigned num_bands;
+   struct lp_scene_bin_ref bin_order[TILES_X * TILES_Y];
+   uint8_t bin_bucket[TILES_Y][TILES_X];
 
    struct cmd_bin tile[TILES_X][TILES_Y];
    struct data_block_list data;
@@ -202,6 +236,9 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
 boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
                                         const struct pipe_resource *resource );
 
+boolean lp_scene_is_fb_referenced(const struct lp_scene *scene,
+                                  const struct pipe_resource *resource);
+
 
 /**
  * Allocate space for a command/data in the bin's data buffer.
@@ -338,11 +375,21 @@ lp_scene_bin_cmd_with_state( struct lp_scene *scene,
    struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
 
    if (state != bin->last_state) {
+      struct cmd_block *tail = bin->tail;
+
       bin->last_state = state;
-      if (!lp_scene_bin_command(scene, x, y,
-                                LP_RAST_OP_SET_STATE,
-                                lp_rast_arg_state(state)))
+
+      /* A state command that nothing used yet is simply replaced.
+       */
+      if (tail && tail->count &&
+          tail->cmd[tail->count - 1] == LP_RAST_OP_SET_STATE) {
+         tail->arg[tail->count - 1] = lp_rast_arg_state(state);
+      }
+      else if (!lp_scene_bin_command(scene, x, y,
+                                     LP_RAST_OP_SET_STATE,
+                                     lp_rast_arg_state(state))) {
          return FALSE;
+      }
    }
 
    if (!lp_scene_bin_command( scene, x, y, cmd, arg ))
@@ -352,6 +399,42 @@ lp_scene_bin_cmd_with_state( struct lp_scene *scene,
 }
 
 
+/**
+ * Whether a primitive whose depth values are all greater than zmin
+ * would fail a LESS or LEQUAL depth test everywhere in bin[x][y].
+ */
+static inline boolean
+lp_scene_bin_is_hidden(const struct lp_scene *scene,
+                       unsigned x, unsigned y,
+                       float zmin)
+{
+   assert(scene->hiz_valid);
+
+   return zmin > scene->tile[x][y].zmax;
+}
+
+
+/**
+ * Note that a primitive with depth values at most zmax covers all of
+ * bin[x][y] and writes depth with a LESS or LEQUAL test.
+ */
+static inline void
+lp_scene_bin_lower_zmax(struct lp_scene *scene,
+                        unsigned x, unsigned y,
+                        float zmax)
+{
+   struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
+
+   assert(scene->hiz_valid);
+
+   bin->zmax = MIN2(bin->zmax, zmax);
+}
+
+
+void
+lp_scene_hiz_clear(struct lp_scene *scene, float depth);
+
+
 /* Add a command to all active bins.
  */
 static inline boolean
@@ -379,10 +462,11 @@ lp_scene_get_num_bins( const struct lp_scene *scene )
 
 
 void
-lp_scene_bin_iter_begin( struct lp_scene *scene );
+lp_scene_bin_iter_begin( struct lp_scene *scene, unsigned num_bands );
 
 struct cmd_bin *
-lp_scene_bin_iter_next( struct lp_scene *scene, int *x, int *y );
+lp_scene_bin_iter_next( struct lp_scene *scene, unsigned band,
+                        int *x, int *y );
 
 
 
@@ -397,6 +481,21 @@ void
 lp_scene_end_binning( struct lp_scene *scene );
 
 
+/* Private per-thread binning, see lp_setup_mt.c
+ */
+boolean
+lp_scene_begin_private_binning( struct lp_scene *priv,
+                                const struct lp_scene *scene,
+                                unsigned max_size );
+
+void
+lp_scene_merge_private_bins( struct lp_scene *scene,
+                             struct lp_scene *priv );
+
+void
+lp_scene_discard_private_bins( struct lp_scene *priv );
+
+
 /* Begin/end rasterization of a scene
  */
 void
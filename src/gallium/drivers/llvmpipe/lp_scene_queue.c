@@ -30,8 +30,12 @@
  * Scene queue.  We'll use two queues.  One contains "full" scenes which
  * are produced by the "setup" code.  The other contains "empty" scenes
  * which are produced by the "rast" code when it finishes rendering a scene.
+ *
+ * The full scene queue also carries other work for the rasterizer threads,
+ * such as compute grids, in submission order.
  */
 
+#include "util/macros.h"
 #include "util/u_ringbuffer.h"
 #include "util/u_memory.h"
 #include "lp_scene_queue.h"
@@ -40,9 +44,19 @@
 
 #define MAX_SCENE_QUEUE 4
 
+/** What a packet carries, in header.data24 */
+enum scene_packet_kind {
+   SCENE_PACKET_SCENE,
+   SCENE_PACKET_JOB
+};
+
+/**
+ * The ring buffer needs a power of two size, so a packet is one pointer,
+ * whose kind is stored in the header.
+ */
 struct scene_packet {
    struct util_packet header;
-   struct lp_scene *scene;
+   void *ptr;
 };
 
 /**
@@ -59,7 +73,12 @@ struct lp_scene_queue
 struct lp_scene_queue *
 lp_scene_queue_create(void)
 {
-   struct lp_scene_queue *queue = CALLOC_STRUCT(lp_scene_queue);
+   struct lp_scene_queue *queue;
+
+   STATIC_ASSERT((sizeof(struct scene_packet) &
+                  (sizeof(struct scene_packet) - 1)) == 0);
+
+   queue = CALLOC_STRUCT(lp_scene_queue);
    if (!queue)
       return NULL;
 
@@ -85,14 +104,18 @@ lp_scene_queue_destroy(struct lp_scene_queue *queue)
 }
 
 
-/** Remove first lp_scene from head of queue */
+/**
+ * Remove first entry from head of queue.  Returns the scene, or NULL and
+ * the job in \p job if the entry is a job.
+ */
 struct lp_scene *
-lp_scene_dequeue(struct lp_scene_queue *queue, boolean wait)
+lp_scene_dequeue(struct lp_scene_queue *queue, boolean wait,
+                 struct lp_rast_job **job)
 {
    struct scene_packet packet;
    enum pipe_error ret;
 
-   packet.scene = NULL;
+   *job = NULL;
 
    ret = util_ringbuffer_dequeue(queue->ring,
                                  &packet.header,
@@ -101,7 +124,12 @@ lp_scene_dequeue(struct lp_scene_queue *queue, boolean wait)
    if (ret != PIPE_OK)
       return NULL;
 
-   return packet.scene;
+   if (packet.header.data24 == SCENE_PACKET_JOB) {
+      *job = (struct lp_rast_job *) packet.ptr;
+      return NULL;
+   }
+
+   return (struct lp_scene *) packet.ptr;
 }
 
 
@@ -112,8 +140,22 @@ lp_scene_enqueue(struct lp_scene_queue *queue, struct lp_scene *scene)
    struct scene_packet packet;
 
    packet.header.dwords = sizeof packet / 4;
-   packet.header.data24 = 0;
-   packet.scene = scene;
+   packet.header.data24 = SCENE_PACKET_SCENE;
+   packet.ptr = scene;
+
+   util_ringbuffer_enqueue(queue->ring, &packet.header);
+}
+
+
+/** Add an lp_rast_job to tail of queue */
+void
+lp_scene_enqueue_job(struct lp_scene_queue *queue, struct lp_rast_job *job)
+{
+   struct scene_packet packet;
+
+   packet.header.dwords = sizeof packet / 4;
+   packet.header.data24 = SCENE_PACKET_JOB;
+   packet.ptr = job;
 
    util_ringbuffer_enqueue(queue->ring, &packet.header);
 }
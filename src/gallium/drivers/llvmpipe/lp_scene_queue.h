@@ -33,6 +33,7 @@
 
 struct lp_scene_queue;
 struct lp_scene;
+struct lp_rast_job;
 
 
 struct lp_scene_queue *
@@ -42,11 +43,15 @@ void
 lp_scene_queue_destroy(struct lp_scene_queue *queue);
 
 struct lp_scene *
-lp_scene_dequeue(struct lp_scene_queue *queue, boolean wait);
+lp_scene_dequeue(struct lp_scene_queue *queue, boolean wait,
+                 struct lp_rast_job **job);
 
 void
 lp_scene_enqueue(struct lp_scene_queue *queue, struct lp_scene *scene);
 
+void
+lp_scene_enqueue_job(struct lp_scene_queue *queue, struct lp_rast_job *job);
+
 
 
 
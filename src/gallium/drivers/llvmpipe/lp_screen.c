@@ -47,6 +47,8 @@
 #include "lp_debug.h"
 #include "lp_public.h"
 #include "lp_limits.h"
+#include "lp_numa.h"
+#include "lp_perf.h"
 #include "lp_rast.h"
 
 #include "state_tracker/sw_winsys.h"
@@ -211,7 +213,11 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
    case PIPE_CAP_COMPUTE:
+#if HAVE_LLVM >= 0x0307
+      return 1;
+#else
       return 0;
+#endif
    case PIPE_CAP_USER_VERTEX_BUFFERS:
    case PIPE_CAP_USER_INDEX_BUFFERS:
       return 1;
@@ -301,6 +307,12 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
       return 1;
    case PIPE_CAP_CULL_DISTANCE:
       return 1;
+   case PIPE_CAP_SHADER_BUFFER_OFFSET_ALIGNMENT:
+#if HAVE_LLVM >= 0x0307
+      return 4;
+#else
+      return 0;
+#endif
    case PIPE_CAP_COPY_BETWEEN_COMPRESSED_AND_PLAIN_FORMATS:
       return 1;
    case PIPE_CAP_MULTISAMPLE_Z_RESOLVE:
@@ -318,7 +330,6 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_MULTI_DRAW_INDIRECT_PARAMS:
    case PIPE_CAP_TGSI_FS_POSITION_IS_SYSVAL:
    case PIPE_CAP_TGSI_FS_FACE_IS_INTEGER_SYSVAL:
-   case PIPE_CAP_SHADER_BUFFER_OFFSET_ALIGNMENT:
    case PIPE_CAP_INVALIDATE_BUFFER:
    case PIPE_CAP_GENERATE_MIPMAP:
    case PIPE_CAP_STRING_MARKER:
@@ -350,7 +361,16 @@ llvmpipe_get_shader_param(struct pipe_screen *screen, unsigned shader, enum pipe
    switch(shader)
    {
    case PIPE_SHADER_FRAGMENT:
+#if HAVE_LLVM >= 0x0307
+   case PIPE_SHADER_COMPUTE:
+#endif
       switch (param) {
+#if HAVE_LLVM >= 0x0307
+      case PIPE_SHADER_CAP_MAX_SHADER_BUFFERS:
+         return LP_MAX_TGSI_SHADER_BUFFERS;
+      case PIPE_SHADER_CAP_MAX_SHADER_IMAGES:
+         return LP_MAX_TGSI_SHADER_IMAGES;
+#endif
       default:
          return gallivm_get_shader_param(param);
       }
@@ -379,6 +399,59 @@ llvmpipe_get_shader_param(struct pipe_screen *screen, unsigned shader, enum pipe
    }
 }
 
+static int
+llvmpipe_get_compute_param(struct pipe_screen *screen,
+                           enum pipe_shader_ir ir_type,
+                           enum pipe_compute_cap param,
+                           void *ret)
+{
+   switch (param) {
+   case PIPE_COMPUTE_CAP_IR_TARGET:
+      return 0;
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      if (ret) {
+         uint64_t *grid_size = ret;
+         grid_size[0] = 65535;
+         grid_size[1] = 65535;
+         grid_size[2] = 65535;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      if (ret) {
+         uint64_t *block_size = ret;
+         block_size[0] = 1024;
+         block_size[1] = 1024;
+         block_size[2] = 64;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      if (ret) {
+         uint64_t *max_threads_per_block = ret;
+         *max_threads_per_block = 1024;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      if (ret) {
+         uint64_t *max_local_size = ret;
+         *max_local_size = LP_MAX_CS_SHARED_MEM;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+   case PIPE_COMPUTE_CAP_MAX_GLOBAL_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_PRIVATE_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_INPUT_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_MEM_ALLOC_SIZE:
+   case PIPE_COMPUTE_CAP_MAX_CLOCK_FREQUENCY:
+   case PIPE_COMPUTE_CAP_MAX_COMPUTE_UNITS:
+   case PIPE_COMPUTE_CAP_IMAGES_SUPPORTED:
+   case PIPE_COMPUTE_CAP_SUBGROUP_SIZE:
+   case PIPE_COMPUTE_CAP_ADDRESS_BITS:
+   case PIPE_COMPUTE_CAP_MAX_VARIABLE_THREADS_PER_BLOCK:
+      break;
+   }
+   return 0;
+}
+
 static float
 llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
 {
@@ -437,8 +510,22 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
           target == PIPE_TEXTURE_CUBE ||
           target == PIPE_TEXTURE_CUBE_ARRAY);
 
-   if (sample_count > 1)
-      return FALSE;
+   if (sample_count > 1) {
+      /*
+       * Multisample surfaces can be rendered to and resolved with blits,
+       * but not sampled from (PIPE_CAP_TEXTURE_MULTISAMPLE is off).
+       */
+      if (sample_count != LP_MAX_SAMPLES)
+         return FALSE;
+
+      if (target != PIPE_TEXTURE_2D &&
+          target != PIPE_TEXTURE_2D_ARRAY &&
+          target != PIPE_TEXTURE_RECT)
+         return FALSE;
+
+      if (bind & ~(PIPE_BIND_RENDER_TARGET | PIPE_BIND_DEPTH_STENCIL))
+         return FALSE;
+   }
 
    if (bind & PIPE_BIND_RENDER_TARGET) {
       if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB) {
@@ -547,12 +634,15 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_numa_destroy(screen->numa);
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
       winsys->destroy(winsys);
 
    pipe_mutex_destroy(screen->rast_mutex);
+   pipe_mutex_destroy(screen->storage_mutex);
 
    FREE(screen);
 }
@@ -599,6 +689,29 @@ llvmpipe_get_timestamp(struct pipe_screen *_screen)
    return os_time_get_nano();
 }
 
+
+/**
+ * The counters of lp_perf.h, as driver specific queries.
+ */
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+   if (!info)
+      return lp_num_counter_descs;
+
+   if (index >= lp_num_counter_descs)
+      return 0;
+
+   memset(info, 0, sizeof *info);
+   info->name = lp_counter_descs[index].name;
+   info->query_type = PIPE_QUERY_DRIVER_SPECIFIC + index;
+   info->type = lp_counter_descs[index].type;
+   info->result_type = PIPE_DRIVER_QUERY_RESULT_TYPE_CUMULATIVE;
+   return 1;
+}
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -634,6 +747,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_device_vendor = llvmpipe_get_vendor; // TODO should be the CPU vendor
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
@@ -643,6 +757,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
 
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
@@ -653,13 +768,47 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
-   screen->rast = lp_rast_create(screen->num_threads);
+   /* Parallel triangle binning is off by default */
+   screen->num_setup_threads = debug_get_num_option("LP_NUM_SETUP_THREADS", 0);
+   screen->num_setup_threads = MIN2(screen->num_setup_threads,
+                                    LP_MAX_SETUP_THREADS);
+
+   /* By default binning waits for the rasterizer after each scene */
+   screen->num_scenes = debug_get_num_option("LP_NUM_SCENES", 1);
+   screen->num_scenes = CLAMP(screen->num_scenes, 1, LP_MAX_SCENES);
+
+   /* By default shader variants are compiled by the drawing thread */
+   screen->num_compile_threads = debug_get_num_option("LP_NUM_COMPILE_THREADS",
+                                                      0);
+   screen->num_compile_threads = MIN2(screen->num_compile_threads,
+                                      LP_MAX_COMPILE_THREADS);
+   screen->hot_variant_draws = debug_get_num_option("LP_HOT_VARIANT_DRAWS",
+                                                    16);
+
+   screen->tiled_textures = debug_get_bool_option("LP_TILED_TEXTURES", FALSE);
+
+   screen->optimize_indices = debug_get_bool_option("LP_OPTIMIZE_INDICES",
+                                                    FALSE);
+
+   /* Pinning only makes sense with at least one thread per node */
+   if (debug_get_bool_option("LP_NUMA", FALSE)) {
+      screen->numa = lp_numa_create();
+      if (screen->numa &&
+          screen->num_threads < lp_numa_num_nodes(screen->numa)) {
+         lp_numa_destroy(screen->numa);
+         screen->numa = NULL;
+      }
+   }
+
+   screen->rast = lp_rast_create(screen->num_threads, screen->numa);
    if (!screen->rast) {
+      lp_numa_destroy(screen->numa);
       lp_jit_screen_cleanup(screen);
       FREE(screen);
       return NULL;
    }
    pipe_mutex_init(screen->rast_mutex);
+   pipe_mutex_init(screen->storage_mutex);
 
    util_format_s3tc_init();
 
@@ -41,6 +41,7 @@
 
 
 struct sw_winsys;
+struct lp_numa;
 
 
 struct llvmpipe_screen
@@ -50,6 +51,20 @@ struct llvmpipe_screen
    struct sw_winsys *winsys;
 
    unsigned num_threads;
+   unsigned num_setup_threads;
+   unsigned num_scenes;
+   unsigned num_compile_threads;
+   /** Draws after which a variant gets optimized (LP_HOT_VARIANT_DRAWS) */
+   unsigned hot_variant_draws;
+
+   /** Store sampled textures in 4x4 texel tiles (LP_TILED_TEXTURES) */
+   boolean tiled_textures;
+
+   /** Reorder static index buffers for the vertex cache (LP_OPTIMIZE_INDICES) */
+   boolean optimize_indices;
+
+   /** NUMA topology when rasterizer threads are pinned (LP_NUMA), or NULL */
+   struct lp_numa *numa;
 
    /* Increments whenever textures are modified.  Contexts can track this.
     */
@@ -57,6 +72,9 @@ struct llvmpipe_screen
 
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Protects the storage reference counts of all resources */
+   pipe_mutex storage_mutex;
 };
 
 
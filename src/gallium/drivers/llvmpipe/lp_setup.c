@@ -35,6 +35,7 @@
 #include <limits.h>
 
 #include "pipe/p_defines.h"
+#include "util/u_format.h"
 #include "util/u_framebuffer.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
@@ -48,6 +49,7 @@
 #include "lp_texture.h"
 #include "lp_debug.h"
 #include "lp_fence.h"
+#include "lp_image.h"
 #include "lp_query.h"
 #include "lp_rast.h"
 #include "lp_setup_context.h"
@@ -64,24 +66,54 @@ static boolean set_scene_state( struct lp_setup_context *, enum setup_state,
 static boolean try_update_scene_state( struct lp_setup_context *setup );
 
 
-static void
-lp_setup_get_empty_scene(struct lp_setup_context *setup)
+/**
+ * Free the contents of a scene once the rasterizer is done with it.
+ * The rasterizer doesn't touch a scene after signalling its fence, so
+ * from then on the scene belongs to the setup module again.
+ * \return FALSE if the scene is still being rasterized and wait is FALSE
+ */
+static boolean
+lp_setup_retire_scene(const struct lp_setup_context *setup,
+                      struct lp_scene *scene,
+                      boolean wait)
 {
-   assert(setup->scene == NULL);
+   assert(scene != setup->scene);
 
-   setup->scene_idx++;
-   setup->scene_idx %= ARRAY_SIZE(setup->scenes);
+   if (!scene->fence) {
+      /* empty */
+      return TRUE;
+   }
 
-   setup->scene = setup->scenes[setup->scene_idx];
+   if (!lp_fence_signalled(scene->fence)) {
+      if (!wait)
+         return FALSE;
 
-   if (setup->scene->fence) {
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
-                      __FUNCTION__, setup->scene->fence->id);
+                      __FUNCTION__, scene->fence->id);
 
-      lp_fence_wait(setup->scene->fence);
+      lp_fence_wait(scene->fence);
    }
 
+   lp_scene_end_rasterization(scene);
+   return TRUE;
+}
+
+
+static void
+lp_setup_get_empty_scene(struct lp_setup_context *setup)
+{
+   struct lp_scene *scene;
+
+   assert(setup->scene == NULL);
+
+   setup->scene_idx++;
+   setup->scene_idx %= setup->num_scenes;
+
+   scene = setup->scenes[setup->scene_idx];
+   lp_setup_retire_scene(setup, scene, TRUE);
+
+   setup->scene = scene;
    lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
 
 }
@@ -129,6 +161,8 @@ void lp_setup_reset( struct lp_setup_context *setup )
       setup->constants[i].stored_data = NULL;
    }
    setup->fs.stored = NULL;
+   memset(setup->fs.recent, 0, sizeof setup->fs.recent);
+   setup->fs.recent_next = 0;
    setup->dirty = ~0;
 
    /* no current bin */
@@ -166,24 +200,18 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
       setup->last_fence->issued = TRUE;
 
    pipe_mutex_lock(screen->rast_mutex);
-
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
-    */
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
+   /* With several scenes we go on binning into the next one while the
+    * rasterizer works on this one.  It gets retired when we come back to
+    * it in lp_setup_get_empty_scene(), or earlier when it's found done.
+    */
    lp_setup_reset( setup );
 
+   if (setup->num_scenes == 1)
+      lp_setup_retire_scene(setup, scene, TRUE);
+
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
 }
 
@@ -254,6 +282,9 @@ begin_binning( struct lp_setup_context *setup )
          if (!ok)
             return FALSE;
       }
+
+      if (setup->clear.flags & PIPE_CLEAR_DEPTH)
+         lp_scene_hiz_clear(scene, setup->clear.depth);
    }
 
    setup->clear.flags = 0;
@@ -384,6 +415,7 @@ lp_setup_bind_framebuffer( struct lp_setup_context *setup,
     * scene.
     */
    util_copy_framebuffer_state(&setup->fb, fb);
+   setup->multisample = util_framebuffer_get_num_samples(fb) > 1;
    setup->framebuffer.x0 = 0;
    setup->framebuffer.y0 = 0;
    setup->framebuffer.x1 = fb->width-1;
@@ -514,6 +546,9 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
                                    LP_RAST_OP_CLEAR_ZSTENCIL,
                                    lp_rast_arg_clearzs(zsvalue, zsmask)))
          return FALSE;
+
+      if (flags & PIPE_CLEAR_DEPTH)
+         lp_scene_hiz_clear(scene, depth);
    }
    else {
       /* Put ourselves into the 'pre-clear' state, specifically to try
@@ -528,6 +563,9 @@ lp_setup_try_clear_zs(struct lp_setup_context *setup,
       setup->clear.zsmask |= zsmask;
       setup->clear.zsvalue =
          (setup->clear.zsvalue & ~zsmask) | (zsvalue & zsmask);
+
+      if (flags & PIPE_CLEAR_DEPTH)
+         setup->clear.depth = depth;
    }
 
    return TRUE;
@@ -785,6 +823,122 @@ lp_setup_set_viewports(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Describe the sampler view to the generated code.
+ */
+void
+lp_setup_jit_texture(struct lp_jit_texture *jit_tex,
+                     struct pipe_sampler_view *view)
+{
+   struct pipe_resource *res = view->texture;
+   struct llvmpipe_resource *lp_tex = llvmpipe_resource(res);
+
+   if (!lp_tex->dt) {
+      /* regular texture - setup array of mipmap level offsets */
+      int j;
+      unsigned first_level = 0;
+      unsigned last_level = 0;
+
+      if (llvmpipe_resource_is_texture(res)) {
+         first_level = view->u.tex.first_level;
+         last_level = view->u.tex.last_level;
+         assert(first_level <= last_level);
+         assert(last_level <= res->last_level);
+         jit_tex->base = lp_tex->tex_data;
+      }
+      else {
+        jit_tex->base = lp_tex->data;
+      }
+
+      if (LP_PERF & PERF_TEX_MEM) {
+         /* use dummy tile memory */
+         jit_tex->base = lp_dummy_tile;
+         jit_tex->width = TILE_SIZE/8;
+         jit_tex->height = TILE_SIZE/8;
+         jit_tex->depth = 1;
+         jit_tex->first_level = 0;
+         jit_tex->last_level = 0;
+         jit_tex->mip_offsets[0] = 0;
+         jit_tex->row_stride[0] = 0;
+         jit_tex->img_stride[0] = 0;
+      }
+      else {
+         jit_tex->width = res->width0;
+         jit_tex->height = res->height0;
+         jit_tex->depth = res->depth0;
+         jit_tex->first_level = first_level;
+         jit_tex->last_level = last_level;
+
+         if (llvmpipe_resource_is_texture(res)) {
+            for (j = first_level; j <= last_level; j++) {
+               jit_tex->mip_offsets[j] = lp_tex->mip_offsets[j];
+               jit_tex->row_stride[j] = lp_tex->row_stride[j];
+               jit_tex->img_stride[j] = lp_tex->img_stride[j];
+            }
+
+            if (res->target == PIPE_TEXTURE_1D_ARRAY ||
+                res->target == PIPE_TEXTURE_2D_ARRAY ||
+                res->target == PIPE_TEXTURE_CUBE ||
+                res->target == PIPE_TEXTURE_CUBE_ARRAY) {
+               /*
+                * For array textures, we don't have first_layer, instead
+                * adjust last_layer (stored as depth) plus the mip level offsets
+                * (as we have mip-first layout can't just adjust base ptr).
+                * XXX For mip levels, could do something similar.
+                */
+               jit_tex->depth = view->u.tex.last_layer - view->u.tex.first_layer + 1;
+               for (j = first_level; j <= last_level; j++) {
+                  jit_tex->mip_offsets[j] += view->u.tex.first_layer *
+                                             lp_tex->img_stride[j];
+               }
+               if (view->target == PIPE_TEXTURE_CUBE ||
+                   view->target == PIPE_TEXTURE_CUBE_ARRAY) {
+                  assert(jit_tex->depth % 6 == 0);
+               }
+               assert(view->u.tex.first_layer <= view->u.tex.last_layer);
+               assert(view->u.tex.last_layer < res->array_size);
+            }
+         }
+         else {
+            /*
+             * For buffers, we don't have "offset", instead adjust
+             * the size (stored as width) plus the base pointer.
+             */
+            unsigned view_blocksize = util_format_get_blocksize(view->format);
+            /* probably don't really need to fill that out */
+            jit_tex->mip_offsets[0] = 0;
+            jit_tex->row_stride[0] = 0;
+            jit_tex->img_stride[0] = 0;
+
+            /* everything specified in number of elements here. */
+            jit_tex->width = view->u.buf.size / view_blocksize;
+            jit_tex->base = (uint8_t *)jit_tex->base + view->u.buf.offset;
+            /* XXX Unsure if we need to sanitize parameters? */
+            assert(view->u.buf.offset + view->u.buf.size <= res->width0);
+         }
+      }
+   }
+   else {
+      /* display target texture/surface */
+      /*
+       * XXX: Where should this be unmapped?
+       */
+      struct llvmpipe_screen *screen = llvmpipe_screen(res->screen);
+      struct sw_winsys *winsys = screen->winsys;
+      jit_tex->base = winsys->displaytarget_map(winsys, lp_tex->dt,
+                                                   PIPE_TRANSFER_READ);
+      jit_tex->row_stride[0] = lp_tex->row_stride[0];
+      jit_tex->img_stride[0] = lp_tex->img_stride[0];
+      jit_tex->mip_offsets[0] = 0;
+      jit_tex->width = res->width0;
+      jit_tex->height = res->height0;
+      jit_tex->depth = res->depth0;
+      jit_tex->first_level = jit_tex->last_level = 0;
+      assert(jit_tex->base);
+   }
+}
+
+
 /**
  * Called during state validation when LP_NEW_SAMPLER_VIEW is set.
  */
@@ -805,119 +959,13 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
       struct pipe_sampler_view *view = i < num ? views[i] : NULL;
 
       if (view) {
-         struct pipe_resource *res = view->texture;
-         struct llvmpipe_resource *lp_tex = llvmpipe_resource(res);
-         struct lp_jit_texture *jit_tex;
-         jit_tex = &setup->fs.current.jit_context.textures[i];
-
          /* We're referencing the texture's internal data, so save a
           * reference to it.
           */
-         pipe_resource_reference(&setup->fs.current_tex[i], res);
-
-         if (!lp_tex->dt) {
-            /* regular texture - setup array of mipmap level offsets */
-            int j;
-            unsigned first_level = 0;
-            unsigned last_level = 0;
-
-            if (llvmpipe_resource_is_texture(res)) {
-               first_level = view->u.tex.first_level;
-               last_level = view->u.tex.last_level;
-               assert(first_level <= last_level);
-               assert(last_level <= res->last_level);
-               jit_tex->base = lp_tex->tex_data;
-            }
-            else {
-              jit_tex->base = lp_tex->data;
-            }
+         pipe_resource_reference(&setup->fs.current_tex[i], view->texture);
 
-            if (LP_PERF & PERF_TEX_MEM) {
-               /* use dummy tile memory */
-               jit_tex->base = lp_dummy_tile;
-               jit_tex->width = TILE_SIZE/8;
-               jit_tex->height = TILE_SIZE/8;
-               jit_tex->depth = 1;
-               jit_tex->first_level = 0;
-               jit_tex->last_level = 0;
-               jit_tex->mip_offsets[0] = 0;
-               jit_tex->row_stride[0] = 0;
-               jit_tex->img_stride[0] = 0;
-            }
-            else {
-               jit_tex->width = res->width0;
-               jit_tex->height = res->height0;
-               jit_tex->depth = res->depth0;
-               jit_tex->first_level = first_level;
-               jit_tex->last_level = last_level;
-
-               if (llvmpipe_resource_is_texture(res)) {
-                  for (j = first_level; j <= last_level; j++) {
-                     jit_tex->mip_offsets[j] = lp_tex->mip_offsets[j];
-                     jit_tex->row_stride[j] = lp_tex->row_stride[j];
-                     jit_tex->img_stride[j] = lp_tex->img_stride[j];
-                  }
-
-                  if (res->target == PIPE_TEXTURE_1D_ARRAY ||
-                      res->target == PIPE_TEXTURE_2D_ARRAY ||
-                      res->target == PIPE_TEXTURE_CUBE ||
-                      res->target == PIPE_TEXTURE_CUBE_ARRAY) {
-                     /*
-                      * For array textures, we don't have first_layer, instead
-                      * adjust last_layer (stored as depth) plus the mip level offsets
-                      * (as we have mip-first layout can't just adjust base ptr).
-                      * XXX For mip levels, could do something similar.
-                      */
-                     jit_tex->depth = view->u.tex.last_layer - view->u.tex.first_layer + 1;
-                     for (j = first_level; j <= last_level; j++) {
-                        jit_tex->mip_offsets[j] += view->u.tex.first_layer *
-                                                   lp_tex->img_stride[j];
-                     }
-                     if (view->target == PIPE_TEXTURE_CUBE ||
-                         view->target == PIPE_TEXTURE_CUBE_ARRAY) {
-                        assert(jit_tex->depth % 6 == 0);
-                     }
-                     assert(view->u.tex.first_layer <= view->u.tex.last_layer);
-                     assert(view->u.tex.last_layer < res->array_size);
-                  }
-               }
-               else {
-                  /*
-                   * For buffers, we don't have "offset", instead adjust
-                   * the size (stored as width) plus the base pointer.
-                   */
-                  unsigned view_blocksize = util_format_get_blocksize(view->format);
-                  /* probably don't really need to fill that out */
-                  jit_tex->mip_offsets[0] = 0;
-                  jit_tex->row_stride[0] = 0;
-                  jit_tex->img_stride[0] = 0;
-
-                  /* everything specified in number of elements here. */
-                  jit_tex->width = view->u.buf.size / view_blocksize;
-                  jit_tex->base = (uint8_t *)jit_tex->base + view->u.buf.offset;
-                  /* XXX Unsure if we need to sanitize parameters? */
-                  assert(view->u.buf.offset + view->u.buf.size <= res->width0);
-               }
-            }
-         }
-         else {
-            /* display target texture/surface */
-            /*
-             * XXX: Where should this be unmapped?
-             */
-            struct llvmpipe_screen *screen = llvmpipe_screen(res->screen);
-            struct sw_winsys *winsys = screen->winsys;
-            jit_tex->base = winsys->displaytarget_map(winsys, lp_tex->dt,
-                                                         PIPE_TRANSFER_READ);
-            jit_tex->row_stride[0] = lp_tex->row_stride[0];
-            jit_tex->img_stride[0] = lp_tex->img_stride[0];
-            jit_tex->mip_offsets[0] = 0;
-            jit_tex->width = res->width0;
-            jit_tex->height = res->height0;
-            jit_tex->depth = res->depth0;
-            jit_tex->first_level = jit_tex->last_level = 0;
-            assert(jit_tex->base);
-         }
+         lp_setup_jit_texture(&setup->fs.current.jit_context.textures[i],
+                              view);
       }
       else {
          pipe_resource_reference(&setup->fs.current_tex[i], NULL);
@@ -929,6 +977,67 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Called during state validation when LP_NEW_FS_SSBOS is set.
+ */
+void
+lp_setup_set_fragment_ssbos(struct lp_setup_context *setup,
+                            unsigned num,
+                            const struct pipe_shader_buffer *buffers)
+{
+   unsigned i;
+
+   LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
+
+   assert(num <= LP_MAX_TGSI_SHADER_BUFFERS);
+
+   for (i = 0; i < LP_MAX_TGSI_SHADER_BUFFERS; i++) {
+      struct pipe_resource *buffer = i < num ? buffers[i].buffer : NULL;
+
+      pipe_resource_reference(&setup->fs.current_ssbo[i], buffer);
+
+      if (buffer) {
+         setup->fs.current.jit_context.ssbos[i] = (const uint32_t *)
+            ((const ubyte *)llvmpipe_resource_data(buffer) +
+             buffers[i].buffer_offset);
+         setup->fs.current.jit_context.num_ssbos[i] = buffers[i].buffer_size;
+      }
+      else {
+         setup->fs.current.jit_context.ssbos[i] = NULL;
+         setup->fs.current.jit_context.num_ssbos[i] = 0;
+      }
+   }
+
+   setup->dirty |= LP_SETUP_NEW_FS;
+}
+
+
+/**
+ * Called during state validation when LP_NEW_FS_IMAGES is set.
+ */
+void
+lp_setup_set_fragment_images(struct lp_setup_context *setup,
+                             unsigned num,
+                             const struct pipe_image_view *images)
+{
+   unsigned i;
+
+   LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
+
+   assert(num <= LP_MAX_TGSI_SHADER_IMAGES);
+
+   for (i = 0; i < LP_MAX_TGSI_SHADER_IMAGES; i++) {
+      const struct pipe_image_view *image = i < num ? &images[i] : NULL;
+
+      pipe_resource_reference(&setup->fs.current_image[i],
+                              image ? image->resource : NULL);
+      lp_jit_image_from_view(&setup->fs.current.jit_context.images[i], image);
+   }
+
+   setup->dirty |= LP_SETUP_NEW_FS;
+}
+
+
 /**
  * Called during state validation when LP_NEW_SAMPLER is set.
  */
@@ -981,9 +1090,25 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+   /* check the scenes still queued for rasterization, and the current one */
+   for (i = 0; i < setup->num_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene != setup->scene &&
+          lp_setup_retire_scene(setup, scene, FALSE))
+         continue;
+
+      if (lp_scene_is_fb_referenced(scene, texture)) {
+         return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+      }
+   }
+
+   for (i = 0; i < setup->num_scenes; i++) {
       if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
+         /* fragment shaders may write to shader buffers and images */
+         if (texture->bind & (PIPE_BIND_SHADER_BUFFER |
+                              PIPE_BIND_SHADER_IMAGE))
+            return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
          return LP_REFERENCED_FOR_READ;
       }
    }
@@ -992,6 +1117,34 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
 }
 
 
+/**
+ * Look for a state identical to the current one among those recently
+ * stored in the scene, most recent (i.e. fs.stored) first.  Reusing it
+ * lets lp_scene_bin_cmd_with_state() skip the state command in bins which
+ * already have it set, and saves the scene memory and resource references.
+ */
+static const struct lp_rast_state *
+find_recent_state(const struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   for (i = 1; i <= LP_SETUP_RECENT_STATES; i++) {
+      const struct lp_rast_state *state =
+         setup->fs.recent[(setup->fs.recent_next + LP_SETUP_RECENT_STATES - i) %
+                          LP_SETUP_RECENT_STATES];
+
+      if (!state)
+         break;
+
+      if (state->variant == setup->fs.current.variant &&
+          memcmp(state, &setup->fs.current, sizeof *state) == 0)
+         return state;
+   }
+
+   return NULL;
+}
+
+
 /**
  * Called by vbuf code when we're about to draw something.
  *
@@ -1133,10 +1286,18 @@ try_update_scene_state( struct lp_setup_context *setup )
 
 
    if (setup->dirty & LP_SETUP_NEW_FS) {
-      if (!setup->fs.stored ||
-          memcmp(setup->fs.stored,
-                 &setup->fs.current,
-                 sizeof setup->fs.current) != 0)
+      const struct lp_rast_state *recent = find_recent_state(setup);
+
+      if (recent) {
+         /* The scene already holds this state and references its
+          * resources.
+          */
+         if (recent != setup->fs.stored) {
+            setup->fs.stored = recent;
+            LP_COUNT(setup->counters, nr_states_reused);
+         }
+      }
+      else
       {
          struct lp_rast_state *stored;
          
@@ -1154,6 +1315,9 @@ try_update_scene_state( struct lp_setup_context *setup )
                 &setup->fs.current,
                 sizeof setup->fs.current);
          setup->fs.stored = stored;
+         setup->fs.recent[setup->fs.recent_next] = stored;
+         setup->fs.recent_next = (setup->fs.recent_next + 1) %
+                                 LP_SETUP_RECENT_STATES;
          
          /* The scene now references the textures in the rasterization
           * state record.  Note that now.
@@ -1168,6 +1332,26 @@ try_update_scene_state( struct lp_setup_context *setup )
                }
             }
          }
+         for (i = 0; i < ARRAY_SIZE(setup->fs.current_ssbo); i++) {
+            if (setup->fs.current_ssbo[i]) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->fs.current_ssbo[i],
+                                                    new_scene)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
+         for (i = 0; i < ARRAY_SIZE(setup->fs.current_image); i++) {
+            if (setup->fs.current_image[i]) {
+               if (!lp_scene_add_resource_reference(scene,
+                                                    setup->fs.current_image[i],
+                                                    new_scene)) {
+                  assert(!new_scene);
+                  return FALSE;
+               }
+            }
+         }
       }
    }
 
@@ -1188,6 +1372,87 @@ try_update_scene_state( struct lp_setup_context *setup )
    return TRUE;
 }
 
+/**
+ * Work out whether the current state lets triangles be tested against,
+ * and lower, the per-tile depth bounds of the scene.
+ *
+ * The bounds stay valid as long as depth values only ever go down, so
+ * any state which could raise them invalidates the bounds until the
+ * next depth clear.
+ */
+static void
+update_hiz_state(struct lp_setup_context *setup)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+   const struct lp_fragment_shader_variant *variant = setup->fs.current.variant;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   const struct lp_tgsi_info *info = &variant->shader->info;
+   struct lp_scene *scene = setup->scene;
+   const struct util_format_description *desc;
+   unsigned func = key->depth.func;
+   boolean less = func == PIPE_FUNC_LESS || func == PIPE_FUNC_LEQUAL;
+   boolean stencil_writes_on_zfail = FALSE;
+   unsigned i;
+
+   setup->hiz.test = FALSE;
+   setup->hiz.update = FALSE;
+
+   if (!scene->hiz_valid)
+      return;
+
+   if (!setup->fb.zsbuf || scene->fb_max_layer > 0) {
+      scene->hiz_valid = FALSE;
+      return;
+   }
+
+   if (key->depth.enabled && key->depth.writemask &&
+       !less && func != PIPE_FUNC_EQUAL && func != PIPE_FUNC_NEVER) {
+      scene->hiz_valid = FALSE;
+      return;
+   }
+
+   if (!key->depth.enabled || !less ||
+       info->base.writes_z ||
+       info->base.writes_memory ||
+       key->depth_clamp ||
+       lp->rasterizer->offset_tri ||
+       lp->active_statistics_queries) {
+      return;
+   }
+
+   for (i = 0; i < 2; i++) {
+      if (key->stencil[i].enabled &&
+          key->stencil[i].writemask &&
+          key->stencil[i].zfail_op != PIPE_STENCIL_OP_KEEP)
+         stencil_writes_on_zfail = TRUE;
+   }
+
+   /* Rejected fragments would all have failed the depth test, so the
+    * only thing to worry about is what else failing it does.
+    */
+   setup->hiz.test = !stencil_writes_on_zfail;
+
+   /* Depths which differ by less than a unit of a normalized format
+    * may compare equal once converted to it.
+    */
+   desc = util_format_description(setup->fb.zsbuf->format);
+   if (desc->channel[desc->swizzle[0]].type == UTIL_FORMAT_TYPE_FLOAT)
+      setup->hiz.zbias = 0.0f;
+   else
+      setup->hiz.zbias =
+         1.0f / (float)((1ULL << desc->channel[desc->swizzle[0]].size) - 1);
+
+   /* A tile covered by a triangle gets the triangle's depth values
+    * everywhere, unless some fragments may not write depth.
+    */
+   setup->hiz.update = (key->depth.writemask &&
+                        !key->stencil[0].enabled &&
+                        !key->alpha.enabled &&
+                        !key->blend.alpha_to_coverage &&
+                        !info->base.uses_kill);
+}
+
+
 boolean
 lp_setup_update_state( struct lp_setup_context *setup,
                        boolean update_scene )
@@ -1239,8 +1504,10 @@ lp_setup_update_state( struct lp_setup_context *setup,
    if (update_scene && setup->scene) {
       assert(setup->state == SETUP_ACTIVE);
 
-      if (try_update_scene_state(setup))
+      if (try_update_scene_state(setup)) {
+         update_hiz_state(setup);
          return TRUE;
+      }
 
       /* Update failed, try to restart the scene.
        *
@@ -1256,7 +1523,10 @@ lp_setup_update_state( struct lp_setup_context *setup,
       if (!setup->scene)
          return FALSE;
 
-      return try_update_scene_state(setup);
+      if (!try_update_scene_state(setup))
+         return FALSE;
+
+      update_hiz_state(setup);
    }
 
    return TRUE;
@@ -1273,23 +1543,31 @@ lp_setup_destroy( struct lp_setup_context *setup )
 
    lp_setup_reset( setup );
 
+   lp_setup_destroy_mt( setup );
+
    util_unreference_framebuffer_state(&setup->fb);
 
    for (i = 0; i < ARRAY_SIZE(setup->fs.current_tex); i++) {
       pipe_resource_reference(&setup->fs.current_tex[i], NULL);
    }
 
+   for (i = 0; i < ARRAY_SIZE(setup->fs.current_ssbo); i++) {
+      pipe_resource_reference(&setup->fs.current_ssbo[i], NULL);
+   }
+
+   for (i = 0; i < ARRAY_SIZE(setup->fs.current_image); i++) {
+      pipe_resource_reference(&setup->fs.current_image[i], NULL);
+   }
+
    for (i = 0; i < ARRAY_SIZE(setup->constants); i++) {
       pipe_resource_reference(&setup->constants[i].current.buffer, NULL);
    }
 
    /* free the scenes in the 'empty' queue */
-   for (i = 0; i < ARRAY_SIZE(setup->scenes); i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      if (scene->fence)
-         lp_fence_wait(scene->fence);
-
+      lp_setup_retire_scene(setup, scene, TRUE);
       lp_scene_destroy(scene);
    }
 
@@ -1322,9 +1600,15 @@ lp_setup_create( struct pipe_context *pipe,
    /* Used only in update_state():
     */
    setup->pipe = pipe;
+   setup->counters = &llvmpipe_context(pipe)->counters;
 
 
    setup->num_threads = screen->num_threads;
+
+   /* Before the vbuf stage is created, as this may raise the vbuf limits.
+    */
+   lp_setup_init_mt(setup, screen->num_setup_threads);
+
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1334,7 +1618,8 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_render(draw, &setup->base);
 
    /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
+   setup->num_scenes = screen->num_scenes;
+   for (i = 0; i < setup->num_scenes; i++) {
       setup->scenes[i] = lp_scene_create( pipe );
       if (!setup->scenes[i]) {
          goto no_scenes;
@@ -1350,7 +1635,7 @@ lp_setup_create( struct pipe_context *pipe,
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       if (setup->scenes[i]) {
          lp_scene_destroy(setup->scenes[i]);
       }
@@ -1358,6 +1643,7 @@ no_scenes:
 
    setup->vbuf->destroy(setup->vbuf);
 no_vbuf:
+   lp_setup_destroy_mt(setup);
    FREE(setup);
 no_setup:
    return NULL;
@@ -1376,7 +1662,8 @@ lp_setup_begin_query(struct lp_setup_context *setup,
 
    if (!(pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
          pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
-         pq->type == PIPE_QUERY_PIPELINE_STATISTICS))
+         pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
+         lp_query_is_counter(pq->type)))
       return;
 
    /* init the query to its beginning state */
@@ -1427,7 +1714,8 @@ lp_setup_end_query(struct lp_setup_context *setup, struct llvmpipe_query *pq)
       if (pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
           pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
           pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
-          pq->type == PIPE_QUERY_TIMESTAMP) {
+          pq->type == PIPE_QUERY_TIMESTAMP ||
+          lp_query_is_counter(pq->type)) {
          if (pq->type == PIPE_QUERY_TIMESTAMP &&
                !(setup->scene->tiles_x | setup->scene->tiles_y)) {
             /*
@@ -1462,7 +1750,8 @@ fail:
     */
    if (pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
       pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
-      pq->type == PIPE_QUERY_PIPELINE_STATISTICS) {
+      pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
+      lp_query_is_counter(pq->type)) {
       unsigned i;
 
       /* remove from active binned query list */
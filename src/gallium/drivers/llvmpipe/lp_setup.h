@@ -130,6 +130,20 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                                     unsigned num,
                                     struct pipe_sampler_view **views);
 
+void
+lp_setup_set_fragment_ssbos(struct lp_setup_context *setup,
+                            unsigned num,
+                            const struct pipe_shader_buffer *buffers);
+
+void
+lp_setup_set_fragment_images(struct lp_setup_context *setup,
+                             unsigned num,
+                             const struct pipe_image_view *images);
+
+void
+lp_setup_jit_texture(struct lp_jit_texture *jit_tex,
+                     struct pipe_sampler_view *view);
+
 void
 lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
                                     unsigned num,
@@ -43,6 +43,7 @@
 #include "draw/draw_vbuf.h"
 #include "util/u_rect.h"
 #include "util/u_pack_color.h"
+#include "util/u_queue.h"
 
 #define LP_SETUP_NEW_FS          0x01
 #define LP_SETUP_NEW_CONSTANTS   0x02
@@ -50,14 +51,16 @@
 #define LP_SETUP_NEW_SCISSOR     0x08
 #define LP_SETUP_NEW_VIEWPORTS   0x10
 
+/**
+ * Number of stored states looked up before storing a new one, so that
+ * alternating between a few states doesn't emit a state command into the
+ * bins on every change.
+ */
+#define LP_SETUP_RECENT_STATES 8
 
-struct lp_setup_variant;
-
-
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
 
+struct lp_setup_variant;
+struct lp_setup_bin_job;
 
 
 /**
@@ -88,13 +91,23 @@ struct lp_setup_context
    struct draw_stage *vbuf;
    unsigned num_threads;
    unsigned scene_idx;
-   struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
+   unsigned num_scenes;
+   struct lp_scene *scenes[LP_MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
+   /* Parallel triangle binning, see lp_setup_mt.c */
+   unsigned num_setup_threads;
+   struct util_queue bin_queue;
+   struct lp_setup_bin_job *bin_jobs[LP_MAX_SETUP_THREADS];
+   struct lp_setup_bin_job *bin_job;     /**< only set in setup thread copies */
+
    struct lp_fence *last_fence;
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
 
+   /** Counters of the context, see lp_perf.h */
+   struct lp_counters *counters;
+
    boolean flatshade_first;
    boolean ccw_is_frontface;
    boolean scissor_test;
@@ -103,6 +116,8 @@ struct lp_setup_context
    unsigned cullmode;
    unsigned bottom_edge_rule;
    float pixel_offset;
+   /** Whether the framebuffer is multisample, see lp_setup_bin_triangle() */
+   boolean multisample;
    float line_width;
    float point_size;
    int8_t psize_slot;
@@ -121,8 +136,16 @@ struct lp_setup_context
       union util_color color_val[PIPE_MAX_COLOR_BUFS];
       uint64_t zsmask;
       uint64_t zsvalue;               /**< lp_rast_clear_zstencil() cmd */
+      float depth;
    } clear;
 
+   /** How the current state uses the per-tile depth bounds of the scene */
+   struct {
+      boolean test;     /**< triangles may be rejected against the bounds */
+      float zbias;      /**< rounding margin of the depth format */
+      boolean update;   /**< fully covered tiles lower the bounds */
+   } hiz;
+
    enum setup_state {
       SETUP_FLUSHED,    /**< scene is null */
       SETUP_CLEARED,    /**< scene exists but has only clears */
@@ -131,9 +154,14 @@ struct lp_setup_context
    
    struct {
       const struct lp_rast_state *stored; /**< what's in the scene */
+      /** states most recently stored in the scene, for reuse */
+      const struct lp_rast_state *recent[LP_SETUP_RECENT_STATES];
+      unsigned recent_next;
       struct lp_rast_state current;  /**< currently set state */
       struct pipe_resource *current_tex[PIPE_MAX_SHADER_SAMPLER_VIEWS];
       unsigned current_tex_num;
+      struct pipe_resource *current_ssbo[LP_MAX_TGSI_SHADER_BUFFERS];
+      struct pipe_resource *current_image[LP_MAX_TGSI_SHADER_IMAGES];
    } fs;
 
    /** fragment shader constants */
@@ -196,6 +224,16 @@ void lp_setup_destroy( struct lp_setup_context *setup );
 
 boolean lp_setup_flush_and_restart(struct lp_setup_context *setup);
 
+void lp_setup_init_mt(struct lp_setup_context *setup, unsigned num_threads);
+void lp_setup_destroy_mt(struct lp_setup_context *setup);
+void lp_setup_bin_job_failed(struct lp_setup_bin_job *job);
+
+boolean
+lp_setup_draw_triangles_mt(struct lp_setup_context *setup,
+                           const void *vertex_buffer,
+                           const ushort *indices,
+                           unsigned nr);
+
 void
 lp_setup_print_triangle(struct lp_setup_context *setup,
                         const float (*v0)[4],
@@ -214,11 +252,51 @@ lp_setup_alloc_triangle(struct lp_scene *scene,
                         unsigned nr_planes,
                         unsigned *tri_size);
 
+/** Depth range of a triangle, for the per-tile depth bounds */
+struct lp_setup_zrange
+{
+   float zmin;
+   float zmax;
+};
+
 boolean
 lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
                        const struct u_rect *bbox,
                        int nr_planes,
-                       unsigned scissor_index );
+                       unsigned scissor_index,
+                       const struct lp_setup_zrange *zrange );
+
+
+/**
+ * Grow the bounding box of the pixel centres covered by a primitive to
+ * the pixels which may have any sample covered by it, for multisample
+ * framebuffers.  Sample positions are within half a pixel of the centre.
+ */
+static inline void
+lp_setup_bbox_add_samples(struct u_rect *bbox)
+{
+   bbox->x0 -= 1;
+   bbox->y0 -= 1;
+   bbox->x1 += 1;
+   bbox->y1 += 1;
+}
+
+
+/**
+ * Move planes which run between pixel centres, like the scissor edges,
+ * to the pixel boundaries, so that they cut between the same pixels when
+ * evaluated at any sample position instead of the pixel centre.
+ * See lp_rast_sample_offset().
+ */
+static inline void
+lp_setup_pixel_planes_add_samples(struct lp_rast_plane *plane,
+                                  unsigned nr_planes)
+{
+   unsigned i;
+
+   for (i = 0; i < nr_planes; i++)
+      plane[i].c -= FIXED_ONE / 2;
+}
 
 #endif
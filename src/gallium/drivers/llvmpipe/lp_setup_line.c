@@ -340,7 +340,7 @@ try_setup_line( struct lp_setup_context *setup,
    dy = v1[0][1] - v2[0][1];
    area = (dx * dx  + dy * dy);
    if (area == 0) {
-      LP_COUNT(nr_culled_tris);
+      LP_COUNT(setup->counters, nr_culled_tris);
       return TRUE;
    }
 
@@ -566,16 +566,20 @@ try_setup_line( struct lp_setup_context *setup,
       bbox.y1--;
    }
 
+   if (setup->multisample) {
+      lp_setup_bbox_add_samples(&bbox);
+   }
+
    if (bbox.x1 < bbox.x0 ||
        bbox.y1 < bbox.y0) {
       if (0) debug_printf("empty bounding box\n");
-      LP_COUNT(nr_culled_tris);
+      LP_COUNT(setup->counters, nr_culled_tris);
       return TRUE;
    }
 
    if (!u_rect_test_intersection(&setup->draw_regions[viewport_index], &bbox)) {
       if (0) debug_printf("offscreen\n");
-      LP_COUNT(nr_culled_tris);
+      LP_COUNT(setup->counters, nr_culled_tris);
       return TRUE;
    }
 
@@ -610,7 +614,7 @@ try_setup_line( struct lp_setup_context *setup,
    line->v[1][1] = v2[0][1];
 #endif
 
-   LP_COUNT(nr_tris);
+   LP_COUNT(setup->counters, nr_tris);
 
    if (lp_context->active_statistics_queries &&
        !llvmpipe_rasterization_disabled(lp_context)) {
@@ -753,9 +757,13 @@ try_setup_line( struct lp_setup_context *setup,
          plane_s++;
       }
       assert(plane_s == &plane[nr_planes]);
+
+      if (setup->multisample) {
+         lp_setup_pixel_planes_add_samples(&plane[4], nr_planes - 4);
+      }
    }
 
-   return lp_setup_bin_triangle(setup, line, &bbox, nr_planes, viewport_index);
+   return lp_setup_bin_triangle(setup, line, &bbox, nr_planes, viewport_index, NULL);
 }
 
 
@@ -0,0 +1,362 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Multi-threaded triangle setup and binning.
+ *
+ * Triangle draws handed to us by the draw module are split into
+ * contiguous ranges of primitives.  Each range is set up and binned by
+ * one setup thread, using a private copy of the setup context whose
+ * scene is a private scene (see lp_scene_begin_private_binning()), so the
+ * regular triangle functions in lp_setup_tri.c run unchanged and without
+ * locking.  The calling thread bins the first range itself.
+ *
+ * Once all ranges are done the private bins are appended to the current
+ * scene in range order.  Every tile thus sees its commands in submission
+ * order and the result is identical to binning on a single thread.
+ *
+ * If any range runs out of scene memory, all private results are thrown
+ * away and the caller bins the draw serially, which knows how to flush
+ * and restart the scene.  The same goes for the counters, which each
+ * range keeps to itself until the merge.
+ */
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_prim.h"
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_perf.h"
+#include "lp_scene.h"
+#include "lp_setup_context.h"
+
+
+/** Don't use threads unless each gets at least this many triangles */
+#define LP_SETUP_MT_MIN_TRIS 32
+
+/**
+ * Larger vbuf limits, so that the draw module gives us enough primitives
+ * per call to be worth spreading over threads.
+ */
+#define LP_MT_VBUF_INDEXES (16 * 1024)
+#define LP_MT_VBUF_SIZE    (1024 * 1024)
+
+
+struct lp_setup_bin_job
+{
+   /** Copy of the calling setup context, binning into 'scene' */
+   struct lp_setup_context setup;
+   struct lp_scene *scene;
+   struct util_queue_fence fence;
+
+   /** Counts of this range, added to the context's once it is merged */
+   struct lp_counters counters;
+
+   const void *vertex_buffer;
+   const ushort *indices;       /**< NULL for non-indexed draws */
+   unsigned stride;
+   unsigned first_tri;
+   unsigned nr_tris;
+
+   /** The private scene ran out of memory */
+   boolean failed;
+};
+
+
+typedef const float (*const_float4_ptr)[4];
+
+static inline const_float4_ptr
+get_vert(const struct lp_setup_bin_job *job, unsigned i)
+{
+   unsigned index = job->indices ? job->indices[i] : i;
+   return (const_float4_ptr)((const char *)job->vertex_buffer +
+                             index * job->stride);
+}
+
+
+/**
+ * Vertices of triangle 'tri' of a list, strip or fan, in the same order
+ * lp_setup_draw_elements() and lp_setup_draw_arrays() use.
+ */
+static inline void
+get_triangle(unsigned prim, boolean flatshade_first, unsigned tri,
+             unsigned v[3])
+{
+   unsigned i = tri + 2;
+
+   switch (prim) {
+   case PIPE_PRIM_TRIANGLES:
+      v[0] = 3 * tri;
+      v[1] = 3 * tri + 1;
+      v[2] = 3 * tri + 2;
+      break;
+   case PIPE_PRIM_TRIANGLE_STRIP:
+      if (flatshade_first) {
+         v[0] = i - 2;
+         v[1] = i + (i & 1) - 1;
+         v[2] = i - (i & 1);
+      }
+      else {
+         v[0] = i + (i & 1) - 2;
+         v[1] = i - (i & 1) - 1;
+         v[2] = i;
+      }
+      break;
+   case PIPE_PRIM_TRIANGLE_FAN:
+      if (flatshade_first) {
+         v[0] = i - 1;
+         v[1] = i;
+         v[2] = 0;
+      }
+      else {
+         v[0] = 0;
+         v[1] = i - 1;
+         v[2] = i;
+      }
+      break;
+   default:
+      assert(0);
+      v[0] = v[1] = v[2] = 0;
+      break;
+   }
+}
+
+
+/**
+ * Set up and bin one range of triangles.
+ * Called on the setup threads and on the calling thread.
+ */
+static void
+bin_job_execute(void *data, int thread_index)
+{
+   struct lp_setup_bin_job *job = (struct lp_setup_bin_job *)data;
+   struct lp_setup_context *setup = &job->setup;
+   const unsigned end = job->first_tri + job->nr_tris;
+   unsigned tri;
+
+   for (tri = job->first_tri; tri < end && !job->failed; tri++) {
+      unsigned v[3];
+
+      get_triangle(setup->prim, setup->flatshade_first, tri, v);
+
+      setup->triangle(setup,
+                      get_vert(job, v[0]),
+                      get_vert(job, v[1]),
+                      get_vert(job, v[2]));
+   }
+}
+
+
+/**
+ * Called by retry_triangle_ccw() on a setup thread when the private
+ * scene ran out of memory.
+ */
+void
+lp_setup_bin_job_failed(struct lp_setup_bin_job *job)
+{
+   job->failed = TRUE;
+}
+
+
+/**
+ * Try to set up and bin the triangles of a draw on several threads.
+ * \param indices  the draw's indices, or NULL for non-indexed draws
+ * \param nr  number of vertices (or indices)
+ * \return FALSE if the draw was not binned and must be binned serially
+ */
+boolean
+lp_setup_draw_triangles_mt(struct lp_setup_context *setup,
+                           const void *vertex_buffer,
+                           const ushort *indices,
+                           unsigned nr)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+   struct lp_scene *scene = setup->scene;
+   unsigned nr_tris, nr_jobs, tris_per_job, max_size;
+   boolean failed = FALSE;
+   unsigned i;
+
+   if (setup->num_setup_threads < 2)
+      return FALSE;
+
+   if (setup->prim != PIPE_PRIM_TRIANGLES &&
+       setup->prim != PIPE_PRIM_TRIANGLE_STRIP &&
+       setup->prim != PIPE_PRIM_TRIANGLE_FAN)
+      return FALSE;
+
+   /* triangle_both() counts primitives for pipeline statistics queries
+    * in the context, which the setup threads can't do safely.
+    */
+   if (lp->active_statistics_queries)
+      return FALSE;
+
+   if (setup->state != SETUP_ACTIVE || !scene)
+      return FALSE;
+
+   nr_tris = u_decomposed_prims_for_vertices(setup->prim, nr);
+   nr_jobs = MIN2(setup->num_setup_threads, nr_tris / LP_SETUP_MT_MIN_TRIS);
+   if (nr_jobs < 2)
+      return FALSE;
+
+   /* The copies must not go through first_triangle(), as choosing the
+    * triangle function there only changes the copy.
+    */
+   lp_setup_choose_triangle(setup);
+
+   tris_per_job = DIV_ROUND_UP(nr_tris, nr_jobs);
+   max_size = (LP_SCENE_MAX_SIZE - MIN2(scene->scene_size,
+                                        LP_SCENE_MAX_SIZE)) / nr_jobs;
+
+   for (i = 0; i < nr_jobs; i++) {
+      struct lp_setup_bin_job *job = setup->bin_jobs[i];
+
+      if (!lp_scene_begin_private_binning(job->scene, scene, max_size)) {
+         while (i--)
+            lp_scene_discard_private_bins(setup->bin_jobs[i]->scene);
+         return FALSE;
+      }
+
+      memcpy(&job->setup, setup, sizeof *setup);
+      job->setup.scene = job->scene;
+      job->setup.bin_job = job;
+      job->setup.counters = &job->counters;
+      memset(&job->counters, 0, sizeof job->counters);
+
+      job->vertex_buffer = vertex_buffer;
+      job->indices = indices;
+      job->stride = setup->vertex_info->size * sizeof(float);
+      job->first_tri = i * tris_per_job;
+      job->nr_tris = MIN2(tris_per_job, nr_tris - job->first_tri);
+      job->failed = FALSE;
+   }
+
+   for (i = 1; i < nr_jobs; i++) {
+      util_queue_add_job(&setup->bin_queue, setup->bin_jobs[i],
+                         &setup->bin_jobs[i]->fence,
+                         bin_job_execute, NULL);
+   }
+
+   bin_job_execute(setup->bin_jobs[0], -1);
+
+   for (i = 1; i < nr_jobs; i++) {
+      util_queue_job_wait(&setup->bin_jobs[i]->fence);
+   }
+
+   for (i = 0; i < nr_jobs; i++) {
+      failed |= setup->bin_jobs[i]->failed;
+   }
+
+   if (failed) {
+      LP_DBG(DEBUG_SETUP, "%s: out of scene memory, binning serially\n",
+             __FUNCTION__);
+
+      for (i = 0; i < nr_jobs; i++)
+         lp_scene_discard_private_bins(setup->bin_jobs[i]->scene);
+      return FALSE;
+   }
+
+   for (i = 0; i < nr_jobs; i++) {
+      lp_scene_merge_private_bins(scene, setup->bin_jobs[i]->scene);
+      lp_counters_add(setup->counters, &setup->bin_jobs[i]->counters);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Create the setup threads and their private scenes.
+ * With fewer than two threads, parallel binning stays disabled.
+ */
+void
+lp_setup_init_mt(struct lp_setup_context *setup, unsigned num_threads)
+{
+   unsigned i;
+
+   setup->num_setup_threads = 0;
+
+   num_threads = MIN2(num_threads, LP_MAX_SETUP_THREADS);
+   if (num_threads < 2)
+      return;
+
+   /* The calling thread bins one range itself */
+   if (!util_queue_init(&setup->bin_queue, "llvmpipe-setup",
+                        num_threads - 1, num_threads - 1))
+      return;
+
+   for (i = 0; i < num_threads; i++) {
+      struct lp_setup_bin_job *job = CALLOC_STRUCT(lp_setup_bin_job);
+      if (!job)
+         goto fail;
+
+      setup->bin_jobs[i] = job;
+
+      job->scene = lp_scene_create(setup->pipe);
+      if (!job->scene)
+         goto fail;
+
+      util_queue_fence_init(&job->fence);
+   }
+
+   setup->num_setup_threads = num_threads;
+
+   setup->base.max_indices = LP_MT_VBUF_INDEXES;
+   setup->base.max_vertex_buffer_bytes = LP_MT_VBUF_SIZE;
+   return;
+
+fail:
+   lp_setup_destroy_mt(setup);
+}
+
+
+void
+lp_setup_destroy_mt(struct lp_setup_context *setup)
+{
+   unsigned i;
+
+   if (util_queue_is_initialized(&setup->bin_queue)) {
+      util_queue_destroy(&setup->bin_queue);
+      memset(&setup->bin_queue, 0, sizeof setup->bin_queue);
+   }
+
+   for (i = 0; i < ARRAY_SIZE(setup->bin_jobs); i++) {
+      struct lp_setup_bin_job *job = setup->bin_jobs[i];
+
+      if (!job)
+         continue;
+
+      if (job->scene) {
+         util_queue_fence_destroy(&job->fence);
+         lp_scene_destroy(job->scene);
+      }
+
+      FREE(job);
+      setup->bin_jobs[i] = NULL;
+   }
+
+   setup->num_setup_threads = 0;
+}
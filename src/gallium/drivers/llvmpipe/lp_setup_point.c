@@ -438,7 +438,7 @@ try_setup_point( struct lp_setup_context *setup,
 
    if (!u_rect_test_intersection(&setup->draw_regions[viewport_index], &bbox)) {
       if (0) debug_printf("offscreen\n");
-      LP_COUNT(nr_culled_tris);
+      LP_COUNT(setup->counters, nr_culled_tris);
       return TRUE;
    }
 
@@ -456,7 +456,7 @@ try_setup_point( struct lp_setup_context *setup,
    point->v[0][1] = v0[0][1];
 #endif
 
-   LP_COUNT(nr_tris);
+   LP_COUNT(setup->counters, nr_tris);
 
    if (lp_context->active_statistics_queries &&
        !llvmpipe_rasterization_disabled(lp_context)) {
@@ -511,9 +511,14 @@ try_setup_point( struct lp_setup_context *setup,
       plane[3].dcdy = -1 << 8;
       plane[3].c = (bbox.y1+1) << 8;
       plane[3].eo = 0;
+
+      if (setup->multisample) {
+         /* points cover all samples of the pixels of their bounding box */
+         lp_setup_pixel_planes_add_samples(plane, 4);
+      }
    }
 
-   return lp_setup_bin_triangle(setup, point, &bbox, nr_planes, viewport_index);
+   return lp_setup_bin_triangle(setup, point, &bbox, nr_planes, viewport_index, NULL);
 }
 
 
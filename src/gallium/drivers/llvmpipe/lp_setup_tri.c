@@ -194,6 +194,19 @@ lp_rast_tri_tab[MAX_PLANES+1] = {
    LP_RAST_OP_TRIANGLE_8
 };
 
+static unsigned
+lp_rast_ms_tri_tab[MAX_PLANES+1] = {
+   0,               /* should be impossible */
+   LP_RAST_OP_MS_TRIANGLE_1,
+   LP_RAST_OP_MS_TRIANGLE_2,
+   LP_RAST_OP_MS_TRIANGLE_3,
+   LP_RAST_OP_MS_TRIANGLE_4,
+   LP_RAST_OP_MS_TRIANGLE_5,
+   LP_RAST_OP_MS_TRIANGLE_6,
+   LP_RAST_OP_MS_TRIANGLE_7,
+   LP_RAST_OP_MS_TRIANGLE_8
+};
+
 static unsigned
 lp_rast_32_tri_tab[MAX_PLANES+1] = {
    0,               /* should be impossible */
@@ -221,7 +234,7 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
 {
    struct lp_scene *scene = setup->scene;
 
-   LP_COUNT(nr_fully_covered_64);
+   LP_COUNT(setup->counters, nr_fully_covered_64);
 
    /* if variant is opaque and scissor doesn't effect the tile */
    if (inputs->opaque) {
@@ -244,13 +257,13 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
          lp_scene_bin_reset( scene, tx, ty );
       }
 
-      LP_COUNT(nr_shade_opaque_64);
+      LP_COUNT(setup->counters, nr_shade_opaque_64);
       return lp_scene_bin_cmd_with_state( scene, tx, ty,
                                           setup->fs.stored,
                                           LP_RAST_OP_SHADE_TILE_OPAQUE,
                                           lp_rast_arg_inputs(inputs) );
    } else {
-      LP_COUNT(nr_shade_64);
+      LP_COUNT(setup->counters, nr_shade_64);
       return lp_scene_bin_cmd_with_state( scene, tx, ty,
                                           setup->fs.stored, 
                                           LP_RAST_OP_SHADE_TILE,
@@ -259,6 +272,33 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
 }
 
 
+/**
+ * Whether the triangle is behind the depth bounds of every tile its
+ * bounding box touches.
+ */
+static boolean
+triangle_is_hidden(struct lp_setup_context *setup,
+                   const struct u_rect *bbox,
+                   unsigned viewport_index,
+                   const struct lp_setup_zrange *zrange)
+{
+   struct u_rect box = *bbox;
+   float zmin = zrange->zmin - setup->hiz.zbias;
+   int x, y;
+
+   u_rect_find_intersection(&setup->draw_regions[viewport_index], &box);
+
+   for (y = box.y0 / TILE_SIZE; y <= box.y1 / TILE_SIZE; y++) {
+      for (x = box.x0 / TILE_SIZE; x <= box.x1 / TILE_SIZE; x++) {
+         if (!lp_scene_bin_is_hidden(setup->scene, x, y, zmin))
+            return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Do basic setup for triangle rasterization and determine which
  * framebuffer tiles are touched.  Put the triangle in the scene's
@@ -277,6 +317,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    struct lp_rast_triangle *tri;
    struct lp_rast_plane *plane;
    struct u_rect bbox;
+   struct lp_setup_zrange zrange, *zr = NULL;
    unsigned tri_bytes;
    int nr_planes = 3;
    unsigned viewport_index = 0;
@@ -322,19 +363,35 @@ do_triangle_ccw(struct lp_setup_context *setup,
       bbox.y1 = (MAX3(position->y[0], position->y[1], position->y[2]) - 1 + adj) >> FIXED_ORDER;
    }
 
+   if (setup->multisample) {
+      lp_setup_bbox_add_samples(&bbox);
+   }
+
    if (bbox.x1 < bbox.x0 ||
        bbox.y1 < bbox.y0) {
       if (0) debug_printf("empty bounding box\n");
-      LP_COUNT(nr_culled_tris);
+      LP_COUNT(setup->counters, nr_culled_tris);
       return TRUE;
    }
 
    if (!u_rect_test_intersection(&setup->draw_regions[viewport_index], &bbox)) {
       if (0) debug_printf("offscreen\n");
-      LP_COUNT(nr_culled_tris);
+      LP_COUNT(setup->counters, nr_culled_tris);
       return TRUE;
    }
 
+   if (setup->hiz.test && scene->hiz_valid) {
+      zrange.zmin = MIN3(v0[0][2], v1[0][2], v2[0][2]);
+      zrange.zmax = MAX3(v0[0][2], v1[0][2], v2[0][2]);
+
+      if (triangle_is_hidden(setup, &bbox, viewport_index, &zrange)) {
+         LP_COUNT(setup->counters, nr_hiz_culled_tris);
+         return TRUE;
+      }
+
+      zr = &zrange;
+   }
+
    /* Can safely discard negative regions, but need to keep hold of
     * information about when the triangle extends past screen
     * boundaries.  See trimmed_box in lp_setup_bin_triangle().
@@ -370,7 +427,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->v[2][1] = v2[0][1];
 #endif
 
-   LP_COUNT(nr_tris);
+   LP_COUNT(setup->counters, nr_tris);
 
    /* Setup parameter interpolants:
     */
@@ -717,9 +774,14 @@ do_triangle_ccw(struct lp_setup_context *setup,
          plane_s++;
       }
       assert(plane_s == &plane[nr_planes]);
+
+      if (setup->multisample) {
+         lp_setup_pixel_planes_add_samples(&plane[3], nr_planes - 3);
+      }
    }
 
-   return lp_setup_bin_triangle(setup, tri, &bbox, nr_planes, viewport_index);
+   return lp_setup_bin_triangle(setup, tri, &bbox, nr_planes, viewport_index,
+                                zr);
 }
 
 /*
@@ -749,12 +811,96 @@ floor_pot(uint32_t n)
 }
 
 
+/**
+ * Bin a triangle for a multisample framebuffer.  The tile-level trivial
+ * reject tests are done with the edges moved out by half a pixel, as the
+ * planes get evaluated at the sample positions rather than the pixel
+ * centres.  Triangles are binned in all non-rejected tiles, as no tile is
+ * known to have all samples covered.
+ */
+static boolean
+bin_triangle_ms(struct lp_setup_context *setup,
+                struct lp_rast_triangle *tri,
+                const struct u_rect *trimmed_box,
+                int nr_planes,
+                const struct lp_setup_zrange *zrange)
+{
+   struct lp_scene *scene = setup->scene;
+   struct lp_rast_plane *plane = GET_PLANES(tri);
+   int64_t c[MAX_PLANES];
+   int64_t eo[MAX_PLANES];
+   int64_t xstep[MAX_PLANES];
+   int64_t ystep[MAX_PLANES];
+   int ix0 = trimmed_box->x0 / TILE_SIZE;
+   int iy0 = trimmed_box->y0 / TILE_SIZE;
+   int ix1 = trimmed_box->x1 / TILE_SIZE;
+   int iy1 = trimmed_box->y1 / TILE_SIZE;
+   int x, y, i;
+
+   for (i = 0; i < nr_planes; i++) {
+      c[i] = (plane[i].c +
+              IMUL64(plane[i].dcdy, iy0) * TILE_SIZE -
+              IMUL64(plane[i].dcdx, ix0) * TILE_SIZE);
+
+      eo[i] = ((int64_t)plane[i].eo << TILE_ORDER) +
+              (llabs(plane[i].dcdx) + llabs(plane[i].dcdy)) / 2;
+      xstep[i] = -(((int64_t)plane[i].dcdx) << TILE_ORDER);
+      ystep[i] = ((int64_t)plane[i].dcdy) << TILE_ORDER;
+   }
+
+   for (y = iy0; y <= iy1; y++) {
+      int64_t cx[MAX_PLANES];
+
+      for (i = 0; i < nr_planes; i++)
+         cx[i] = c[i];
+
+      for (x = ix0; x <= ix1; x++) {
+         int out = 0;
+
+         for (i = 0; i < nr_planes; i++)
+            out |= (int) ((cx[i] + eo[i]) >> 63);
+
+         if (out) {
+            LP_COUNT(setup->counters, nr_empty_64);
+         }
+         else if (zrange &&
+                  lp_scene_bin_is_hidden(scene, x, y,
+                                         zrange->zmin - setup->hiz.zbias)) {
+            LP_COUNT(setup->counters, nr_hiz_culled_64);
+         }
+         else {
+            if (!lp_scene_bin_cmd_with_state(scene, x, y,
+                                             setup->fs.stored,
+                                             lp_rast_ms_tri_tab[nr_planes],
+                                             lp_rast_arg_triangle(tri,
+                                                (1 << nr_planes) - 1))) {
+               /* see lp_setup_bin_triangle() */
+               tri->inputs.disable = TRUE;
+               return FALSE;
+            }
+
+            LP_COUNT(setup->counters, nr_partially_covered_64);
+         }
+
+         for (i = 0; i < nr_planes; i++)
+            cx[i] += xstep[i];
+      }
+
+      for (i = 0; i < nr_planes; i++)
+         c[i] += ystep[i];
+   }
+
+   return TRUE;
+}
+
+
 boolean
 lp_setup_bin_triangle( struct lp_setup_context *setup,
                        struct lp_rast_triangle *tri,
                        const struct u_rect *bbox,
                        int nr_planes,
-                       unsigned viewport_index )
+                       unsigned viewport_index,
+                       const struct lp_setup_zrange *zrange )
 {
    struct lp_scene *scene = setup->scene;
    struct u_rect trimmed_box = *bbox;   
@@ -780,6 +926,12 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
    u_rect_find_intersection(&setup->draw_regions[viewport_index],
                             &trimmed_box);
 
+   /* Multisample triangles are always rasterized by the generic
+    * functions, once per sample, with all their planes.
+    */
+   if (setup->multisample)
+      return bin_triangle_ms(setup, tri, &trimmed_box, nr_planes, zrange);
+
    /* Determine which tile(s) intersect the triangle's bounding box
     */
    if (dx < TILE_SIZE)
@@ -916,7 +1068,14 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                /* do nothing */
                if (in)
                   break;  /* exiting triangle, all done with this row */
-               LP_COUNT(nr_empty_64);
+               LP_COUNT(setup->counters, nr_empty_64);
+            }
+            else if (zrange &&
+                     lp_scene_bin_is_hidden(scene, x, y,
+                                            zrange->zmin - setup->hiz.zbias)) {
+               /* behind everything already in the tile */
+               in = TRUE;
+               LP_COUNT(setup->counters, nr_hiz_culled_64);
             }
             else if (partial) {
                /* Not trivially accepted by at least one plane -
@@ -933,14 +1092,17 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                                                  lp_rast_arg_triangle(tri, partial) ))
                   goto fail;
 
-               LP_COUNT(nr_partially_covered_64);
+               LP_COUNT(setup->counters, nr_partially_covered_64);
             }
             else {
                /* triangle covers the whole tile- shade whole tile */
-               LP_COUNT(nr_fully_covered_64);
+               LP_COUNT(setup->counters, nr_fully_covered_64);
                in = TRUE;
                if (!lp_setup_whole_tile(setup, &tri->inputs, x, y))
                   goto fail;
+
+               if (zrange && setup->hiz.update)
+                  lp_scene_bin_lower_zmax(scene, x, y, zrange->zmax);
             }
 
             /* Iterate cx values across the region: */
@@ -978,6 +1140,14 @@ static void retry_triangle_ccw( struct lp_setup_context *setup,
 {
    if (!do_triangle_ccw( setup, position, v0, v1, v2, front ))
    {
+      if (setup->bin_job) {
+         /* Setup threads can't flush, lp_setup_draw_triangles_mt() will
+          * redo the draw serially.
+          */
+         lp_setup_bin_job_failed(setup->bin_job);
+         return;
+      }
+
       if (!lp_setup_flush_and_restart(setup))
          return;
 
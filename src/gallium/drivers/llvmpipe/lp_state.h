@@ -56,6 +56,8 @@
 #define LP_NEW_GS            0x10000
 #define LP_NEW_SO            0x20000
 #define LP_NEW_SO_BUFFERS    0x40000
+#define LP_NEW_FS_SSBOS      0x80000
+#define LP_NEW_FS_IMAGES     0x100000
 
 
 
@@ -108,6 +110,9 @@ llvmpipe_init_vertex_funcs(struct llvmpipe_context *llvmpipe);
 void
 llvmpipe_init_draw_funcs(struct llvmpipe_context *llvmpipe);
 
+void
+llvmpipe_cleanup_draw(struct llvmpipe_context *llvmpipe);
+
 void
 llvmpipe_init_clip_funcs(struct llvmpipe_context *llvmpipe);
 
@@ -126,6 +131,18 @@ llvmpipe_init_rasterizer_funcs(struct llvmpipe_context *llvmpipe);
 void
 llvmpipe_init_so_funcs(struct llvmpipe_context *llvmpipe);
 
+void
+llvmpipe_init_image_funcs(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_cleanup_images(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe);
+
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe);
+
 void
 llvmpipe_prepare_vertex_sampling(struct llvmpipe_context *ctx,
                                  unsigned num,
@@ -39,6 +39,7 @@
 #include "lp_context.h"
 #include "lp_state.h"
 #include "lp_debug.h"
+#include "lp_rast.h"
 
 
 static void *
@@ -186,6 +187,28 @@ llvmpipe_set_sample_mask(struct pipe_context *pipe,
    }
 }
 
+/**
+ * Sample positions are fixed, see lp_sample_pos().
+ */
+static void
+llvmpipe_get_sample_position(struct pipe_context *pipe,
+                             unsigned sample_count,
+                             unsigned sample_index,
+                             float *out_value)
+{
+   int x, y;
+
+   if (sample_count <= 1) {
+      out_value[0] = 0.5f;
+      out_value[1] = 0.5f;
+      return;
+   }
+
+   lp_sample_pos(sample_index, &x, &y);
+   out_value[0] = (8 + x) / 16.0f;
+   out_value[1] = (8 + y) / 16.0f;
+}
+
 void
 llvmpipe_init_blend_funcs(struct llvmpipe_context *llvmpipe)
 {
@@ -201,6 +224,7 @@ llvmpipe_init_blend_funcs(struct llvmpipe_context *llvmpipe)
 
    llvmpipe->pipe.set_stencil_ref = llvmpipe_set_stencil_ref;
    llvmpipe->pipe.set_sample_mask = llvmpipe_set_sample_mask;
+   llvmpipe->pipe.get_sample_position = llvmpipe_get_sample_position;
 
    llvmpipe->sample_mask = ~0;
 }
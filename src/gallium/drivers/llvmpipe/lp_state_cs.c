@@ -0,0 +1,896 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Compute shaders.
+ *
+ * A compute shader variant runs one SIMD vector of the invocations of a
+ * work group per call.  launch_grid hands the grid to the rasterizer
+ * threads as a job; the threads pull work groups off a shared counter and
+ * run them to completion one at a time.  Shaders with barriers run each
+ * vector of a work group as a fiber, which yields to the next one at
+ * every barrier.
+ */
+
+#include "pipe/p_defines.h"
+#include "pipe/p_shader_tokens.h"
+#include "util/u_atomic.h"
+#include "util/u_dump.h"
+#include "util/u_fiber.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_pointer.h"
+#include "util/u_string.h"
+#include "util/simple_list.h"
+#include "os/os_time.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_type.h"
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fence.h"
+#include "lp_flush.h"
+#include "lp_image.h"
+#include "lp_limits.h"
+#include "lp_perf.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_setup.h"
+#include "lp_state.h"
+#include "lp_state_cs.h"
+#include "lp_tex_sample.h"
+#include "lp_texture.h"
+
+
+/** Stack size of the fibers running work groups with barriers */
+#define LP_CS_FIBER_STACK_SIZE (256 * 1024)
+
+
+/** Per rasterizer thread state of the compute grids of a context */
+struct lp_cs_thread
+{
+   struct util_fibers *fibers;
+   void *shared;
+};
+
+
+struct lp_cs_exec
+{
+   unsigned num_threads;
+   struct lp_cs_thread *threads;
+   boolean warned_no_fibers;
+};
+
+
+/** A compute grid, run by the rasterizer threads */
+struct lp_cs_job
+{
+   struct lp_rast_job base;
+
+   const struct lp_compute_shader_variant *variant;
+   struct lp_cs_exec *exec;
+
+   struct lp_jit_context jit_context;
+
+   unsigned grid[3];
+   unsigned block[3];
+   unsigned num_blocks;
+   /** Number of jit_function calls per work group */
+   unsigned num_vectors;
+   boolean use_fibers;
+
+   /** Next work group to run, shared by all threads */
+   int32_t next_block;
+};
+
+
+/** A work group, as run by a single thread */
+struct lp_cs_block
+{
+   const struct lp_cs_job *job;
+   unsigned x, y, z;
+   void *shared;
+   void *barrier_data;
+   struct lp_jit_thread_data *thread_data;
+};
+
+
+/**
+ * Memory interface of the TGSI translation, with the barrier data.
+ */
+struct lp_cs_mem_iface
+{
+   struct lp_build_tgsi_mem_iface base;
+
+   LLVMValueRef barrier_data;
+};
+
+
+static unsigned cs_no = 0;
+
+
+/**
+ * Called by the generated code at TGSI_OPCODE_BARRIER.
+ */
+static void
+lp_cs_barrier(void *barrier_data)
+{
+   if (barrier_data)
+      util_fibers_yield((struct util_fibers *)barrier_data);
+}
+
+
+static void
+cs_emit_barrier(const struct lp_build_tgsi_mem_iface *mem_iface,
+                struct gallivm_state *gallivm)
+{
+   const struct lp_cs_mem_iface *iface =
+      (const struct lp_cs_mem_iface *)mem_iface;
+   LLVMTypeRef arg_type =
+      LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMValueRef function;
+
+   function = lp_build_const_func_pointer(gallivm,
+                                          func_to_pointer((func_pointer)lp_cs_barrier),
+                                          LLVMVoidTypeInContext(gallivm->context),
+                                          &arg_type, 1, "lp_cs_barrier");
+
+   LLVMBuildCall(gallivm->builder, function,
+                 (LLVMValueRef *)&iface->barrier_data, 1, "");
+}
+
+
+/**
+ * Generate the compute shader function of a variant.
+ */
+static void
+generate_compute(struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant *variant)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   const struct lp_compute_shader_variant_key *key = &variant->key;
+   char func_name[64];
+   struct lp_type cs_type;
+   struct lp_build_context uint_bld;
+   LLVMTypeRef arg_types[14];
+   LLVMTypeRef func_type;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int8_ptr_type =
+      LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+   LLVMValueRef function;
+   LLVMValueRef context_ptr, thread_data_ptr;
+   LLVMValueRef block_id[3], grid_size[3], block_size[3];
+   LLVMValueRef first_thread, shared_ptr, barrier_data;
+   LLVMValueRef consts_ptr, num_consts_ptr;
+   LLVMValueRef linear, tmp, mask_val;
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+   LLVMBasicBlockRef block;
+   LLVMBuilderRef builder;
+   struct lp_build_sampler_soa *sampler;
+   struct lp_build_image_soa *image;
+   struct lp_build_mask_context mask;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_cs_mem_iface mem_iface;
+   unsigned i;
+
+   memset(&cs_type, 0, sizeof cs_type);
+   cs_type.floating = TRUE;      /* floating point values */
+   cs_type.sign = TRUE;          /* values are signed */
+   cs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
+   cs_type.width = 32;           /* 32-bit float */
+   cs_type.length = variant->vector_length;
+
+   /*
+    * Generate the function prototype. Any change here must be reflected in
+    * lp_jit.h's lp_jit_cs_func function pointer type, and vice-versa.
+    */
+
+   util_snprintf(func_name, sizeof(func_name), "cs%u_variant%u",
+                 shader->no, variant->no);
+
+   arg_types[0] = variant->jit_context_ptr_type;       /* context */
+   for (i = 1; i <= 10; i++)
+      arg_types[i] = int32_type;                       /* block_id, grid_size,
+                                                          block_size,
+                                                          first_thread */
+   arg_types[11] = int8_ptr_type;                      /* shared */
+   arg_types[12] = int8_ptr_type;                      /* barrier_data */
+   arg_types[13] = variant->jit_thread_data_ptr_type;  /* per thread data */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
+                                arg_types, ARRAY_SIZE(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+
+   variant->function = function;
+
+   context_ptr = LLVMGetParam(function, 0);
+   for (i = 0; i < 3; i++) {
+      block_id[i] = LLVMGetParam(function, 1 + i);
+      grid_size[i] = LLVMGetParam(function, 4 + i);
+      block_size[i] = LLVMGetParam(function, 7 + i);
+   }
+   first_thread = LLVMGetParam(function, 10);
+   shared_ptr = LLVMGetParam(function, 11);
+   barrier_data = LLVMGetParam(function, 12);
+   thread_data_ptr = LLVMGetParam(function, 13);
+
+   lp_build_name(context_ptr, "context");
+   lp_build_name(first_thread, "first_thread");
+   lp_build_name(shared_ptr, "shared");
+   lp_build_name(barrier_data, "barrier_data");
+   lp_build_name(thread_data_ptr, "thread_data");
+
+   /*
+    * Function body
+    */
+
+   block = LLVMAppendBasicBlockInContext(gallivm->context, function, "entry");
+   builder = gallivm->builder;
+   assert(builder);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   lp_build_context_init(&uint_bld, gallivm, lp_uint_type(cs_type));
+
+   /* linear index of each invocation within the work group */
+   linear = lp_build_broadcast_scalar(&uint_bld, first_thread);
+   {
+      LLVMValueRef lanes[LP_MAX_VECTOR_LENGTH];
+
+      for (i = 0; i < cs_type.length; i++)
+         lanes[i] = lp_build_const_int32(gallivm, i);
+      linear = LLVMBuildAdd(builder, linear,
+                            LLVMConstVector(lanes, cs_type.length), "");
+   }
+
+   memset(&system_values, 0, sizeof system_values);
+
+   tmp = lp_build_broadcast_scalar(&uint_bld, block_size[0]);
+   system_values.thread_id[0] = LLVMBuildURem(builder, linear, tmp, "");
+   linear = LLVMBuildUDiv(builder, linear, tmp, "");
+   tmp = lp_build_broadcast_scalar(&uint_bld, block_size[1]);
+   system_values.thread_id[1] = LLVMBuildURem(builder, linear, tmp, "");
+   system_values.thread_id[2] = LLVMBuildUDiv(builder, linear, tmp, "");
+
+   for (i = 0; i < 3; i++) {
+      system_values.block_id[i] = block_id[i];
+      system_values.grid_size[i] = grid_size[i];
+      system_values.block_size[i] = block_size[i];
+   }
+
+   /*
+    * The last vector of a work group may be partially used: its excess
+    * invocations are the ones past the last z slice.
+    */
+   mask_val = lp_build_cmp(&uint_bld, PIPE_FUNC_LESS,
+                           system_values.thread_id[2],
+                           lp_build_broadcast_scalar(&uint_bld,
+                                                     block_size[2]));
+
+   lp_build_mask_begin(&mask, gallivm, cs_type, mask_val);
+
+   consts_ptr = lp_jit_context_constants(gallivm, context_ptr);
+   num_consts_ptr = lp_jit_context_num_constants(gallivm, context_ptr);
+
+   sampler = lp_llvm_sampler_soa_create(key->state);
+   image = lp_llvm_image_soa_create();
+
+   memset(&mem_iface, 0, sizeof mem_iface);
+   mem_iface.base.ssbo_ptr = lp_jit_context_ssbos(gallivm, context_ptr);
+   mem_iface.base.ssbo_sizes_ptr = lp_jit_context_num_ssbos(gallivm,
+                                                            context_ptr);
+   mem_iface.base.shared_ptr = shared_ptr;
+   mem_iface.base.shared_size = LP_MAX_CS_SHARED_MEM;
+   mem_iface.base.image = image;
+   mem_iface.base.emit_barrier = cs_emit_barrier;
+   mem_iface.barrier_data = barrier_data;
+
+   memset(outputs, 0, sizeof outputs);
+
+   lp_build_tgsi_soa(gallivm, shader->base.tokens, cs_type, &mask,
+                     consts_ptr, num_consts_ptr, &system_values,
+                     NULL, outputs, context_ptr, thread_data_ptr,
+                     sampler, &shader->info.base, NULL, &mem_iface.base);
+
+   lp_build_mask_end(&mask);
+
+   sampler->destroy(sampler);
+   image->destroy(image);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+}
+
+
+static void
+lp_debug_cs_variant(const struct lp_compute_shader_variant *variant)
+{
+   unsigned i;
+
+   debug_printf("llvmpipe: Compute shader #%u variant #%u:\n",
+                variant->shader->no, variant->no);
+   tgsi_dump(variant->shader->base.tokens, 0);
+   for (i = 0; i < variant->key.nr_samplers; ++i) {
+      const struct lp_static_sampler_state *sampler =
+         &variant->key.state[i].sampler_state;
+      debug_printf("sampler[%u] = \n", i);
+      debug_printf("  .wrap = %s %s %s\n",
+                   util_dump_tex_wrap(sampler->wrap_s, TRUE),
+                   util_dump_tex_wrap(sampler->wrap_t, TRUE),
+                   util_dump_tex_wrap(sampler->wrap_r, TRUE));
+   }
+   for (i = 0; i < variant->key.nr_sampler_views; ++i) {
+      const struct lp_static_texture_state *texture =
+         &variant->key.state[i].texture_state;
+      debug_printf("texture[%u] = \n", i);
+      debug_printf("  .format = %s\n",
+                   util_format_name(texture->format));
+      debug_printf("  .target = %s\n",
+                   util_dump_tex_target(texture->target, TRUE));
+   }
+   debug_printf("\n");
+}
+
+
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 const struct lp_compute_shader_variant_key *key)
+{
+   struct lp_compute_shader_variant *variant;
+   char module_name[64];
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   util_snprintf(module_name, sizeof(module_name), "cs%u_variant%u",
+                 shader->no, shader->variants_created);
+
+   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   variant->shader = shader;
+   variant->list_item_local.base = variant;
+   variant->no = shader->variants_created++;
+   variant->vector_length = MIN2(lp_native_vector_width / 32, 16);
+
+   memcpy(&variant->key, key, shader->variant_key_size);
+
+   if ((LP_DEBUG & DEBUG_FS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
+      lp_debug_cs_variant(variant);
+   }
+
+   lp_jit_init_cs_types(variant);
+
+   generate_compute(shader, variant);
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->jit_function = (lp_jit_cs_func)
+         gallivm_jit_function(variant->gallivm, variant->function);
+
+   gallivm_free_ir(variant->gallivm);
+
+   return variant;
+}
+
+
+static void
+make_variant_key(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant_key *key)
+{
+   unsigned i;
+
+   memset(key, 0, shader->variant_key_size);
+
+   key->nr_samplers = shader->info.base.file_max[TGSI_FILE_SAMPLER] + 1;
+
+   for (i = 0; i < key->nr_samplers; ++i) {
+      if (shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
+         lp_sampler_static_sampler_state(&key->state[i].sampler_state,
+                                         lp->samplers[PIPE_SHADER_COMPUTE][i]);
+      }
+   }
+
+   /*
+    * Compute sampler views are untiled when bound, so unlike fragment
+    * shaders there's no need to look at the storage layout.
+    */
+   if (shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] != -1) {
+      key->nr_sampler_views =
+         shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
+      for (i = 0; i < key->nr_sampler_views; ++i) {
+         if (shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1 << i)) {
+            lp_sampler_static_texture_state(&key->state[i].texture_state,
+                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+         }
+      }
+   }
+   else {
+      key->nr_sampler_views = key->nr_samplers;
+      for (i = 0; i < key->nr_sampler_views; ++i) {
+         if (shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
+            lp_sampler_static_texture_state(&key->state[i].texture_state,
+                                            lp->sampler_views[PIPE_SHADER_COMPUTE][i]);
+         }
+      }
+   }
+}
+
+
+/**
+ * Return the variant of the bound compute shader matching the current
+ * sampler state, generating it if needed.
+ */
+static struct lp_compute_shader_variant *
+llvmpipe_update_cs(struct llvmpipe_context *lp)
+{
+   struct lp_compute_shader *shader = lp->cs;
+   struct lp_compute_shader_variant_key key;
+   struct lp_compute_shader_variant *variant = NULL;
+   struct lp_cs_variant_list_item *li;
+
+   make_variant_key(lp, shader, &key);
+
+   /* Search the variants for one which matches the key */
+   li = first_elem(&shader->variants);
+   while (!at_end(&shader->variants, li)) {
+      if (memcmp(&li->base->key, &key, shader->variant_key_size) == 0) {
+         variant = li->base;
+         break;
+      }
+      li = next_elem(li);
+   }
+
+   if (variant) {
+      move_to_head(&shader->variants, &variant->list_item_local);
+   }
+   else {
+      int64_t t0, t1, dt;
+
+      t0 = os_time_get();
+
+      variant = generate_variant(lp, shader, &key);
+
+      t1 = os_time_get();
+      dt = t1 - t0;
+      LP_COUNT_ADD(&lp->counters, llvm_compile_time, dt);
+      LP_COUNT_ADD(&lp->counters, nr_llvm_compiles, 1);
+
+      if (variant) {
+         insert_at_head(&shader->variants, &variant->list_item_local);
+         shader->variants_cached++;
+      }
+   }
+
+   return variant;
+}
+
+
+static void
+lp_cs_destroy_variant(struct lp_compute_shader_variant *variant)
+{
+   gallivm_destroy(variant->gallivm);
+
+   remove_from_list(&variant->list_item_local);
+   variant->shader->variants_cached--;
+
+   FREE(variant);
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct lp_compute_shader *shader;
+   int nr_samplers;
+   int nr_sampler_views;
+
+   if (templ->ir_type != PIPE_SHADER_IR_TGSI)
+      return NULL;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   shader->no = cs_no++;
+   make_empty_list(&shader->variants);
+
+   /* we need to keep a local copy of the tokens */
+   shader->base.type = PIPE_SHADER_IR_TGSI;
+   shader->base.tokens = tgsi_dup_tokens(templ->prog);
+   if (!shader->base.tokens) {
+      FREE(shader);
+      return NULL;
+   }
+
+   shader->req_local_mem = templ->req_local_mem;
+   if (shader->req_local_mem > LP_MAX_CS_SHARED_MEM) {
+      FREE((void *) shader->base.tokens);
+      FREE(shader);
+      return NULL;
+   }
+
+   /* get/save the summary info for this shader */
+   lp_build_tgsi_info(shader->base.tokens, &shader->info);
+
+   nr_samplers = shader->info.base.file_max[TGSI_FILE_SAMPLER] + 1;
+   nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
+
+   shader->variant_key_size = Offset(struct lp_compute_shader_variant_key,
+                                     state[MAX2(nr_samplers, nr_sampler_views)]);
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: Create compute shader #%u %p:\n",
+                   shader->no, (void *) shader);
+      tgsi_dump(shader->base.tokens, 0);
+   }
+
+   return shader;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *)cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct lp_compute_shader *shader = cs;
+   struct lp_cs_variant_list_item *li;
+
+   assert(cs != llvmpipe->cs);
+
+   /* Grids run synchronously, so no variant can still be in use */
+   li = first_elem(&shader->variants);
+   while (!at_end(&shader->variants, li)) {
+      struct lp_cs_variant_list_item *next = next_elem(li);
+      lp_cs_destroy_variant(li->base);
+      li = next;
+   }
+
+   assert(shader->variants_cached == 0);
+   FREE((void *) shader->base.tokens);
+   FREE(shader);
+}
+
+
+/**
+ * Run the vector of invocations number index of a work group.
+ */
+static void
+lp_cs_run_vector(void *data, unsigned index)
+{
+   const struct lp_cs_block *block = (const struct lp_cs_block *)data;
+   const struct lp_cs_job *job = block->job;
+
+   job->variant->jit_function(&job->jit_context,
+                              block->x, block->y, block->z,
+                              job->grid[0], job->grid[1], job->grid[2],
+                              job->block[0], job->block[1], job->block[2],
+                              index * job->variant->vector_length,
+                              block->shared,
+                              block->barrier_data,
+                              block->thread_data);
+}
+
+
+/**
+ * Rasterizer thread entrypoint of a grid: run work groups until there are
+ * none left.
+ */
+static void
+lp_cs_job_run(struct lp_rast_job *base,
+              unsigned thread_index,
+              struct lp_jit_thread_data *thread_data)
+{
+   struct lp_cs_job *job = (struct lp_cs_job *)base;
+   struct lp_cs_thread *thread = &job->exec->threads[thread_index];
+   struct lp_cs_block block;
+   unsigned index, i;
+
+   assert(thread_index < job->exec->num_threads);
+
+   if (job->use_fibers && !thread->fibers)
+      thread->fibers = util_fibers_create(LP_CS_FIBER_STACK_SIZE);
+
+   block.job = job;
+   block.shared = thread->shared;
+   block.barrier_data = NULL;
+   block.thread_data = thread_data;
+
+   while ((index = p_atomic_inc_return(&job->next_block) - 1) <
+          job->num_blocks) {
+      block.x = index % job->grid[0];
+      block.y = (index / job->grid[0]) % job->grid[1];
+      block.z = index / job->grid[0] / job->grid[1];
+
+      if (job->use_fibers && thread->fibers) {
+         block.barrier_data = thread->fibers;
+         if (util_fibers_run(thread->fibers, job->num_vectors,
+                             lp_cs_run_vector, &block))
+            continue;
+         block.barrier_data = NULL;
+      }
+
+      if (job->use_fibers && !job->exec->warned_no_fibers) {
+         debug_printf("llvmpipe: no fibers, compute barriers are ignored\n");
+         job->exec->warned_no_fibers = TRUE;
+      }
+
+      for (i = 0; i < job->num_vectors; i++)
+         lp_cs_run_vector(&block, i);
+   }
+}
+
+
+static void
+lp_cs_exec_destroy(struct lp_cs_exec *exec)
+{
+   unsigned i;
+
+   for (i = 0; i < exec->num_threads; i++) {
+      if (exec->threads[i].fibers)
+         util_fibers_destroy(exec->threads[i].fibers);
+      align_free(exec->threads[i].shared);
+   }
+
+   FREE(exec->threads);
+   FREE(exec);
+}
+
+
+static struct lp_cs_exec *
+lp_cs_exec_create(unsigned num_threads)
+{
+   struct lp_cs_exec *exec;
+   unsigned i;
+
+   exec = CALLOC_STRUCT(lp_cs_exec);
+   if (!exec)
+      return NULL;
+
+   exec->threads = CALLOC(num_threads, sizeof *exec->threads);
+   if (!exec->threads) {
+      FREE(exec);
+      return NULL;
+   }
+   exec->num_threads = num_threads;
+
+   for (i = 0; i < num_threads; i++) {
+      exec->threads[i].shared = align_malloc(LP_MAX_CS_SHARED_MEM, 16);
+      if (!exec->threads[i].shared) {
+         exec->num_threads = i;
+         lp_cs_exec_destroy(exec);
+         return NULL;
+      }
+   }
+
+   return exec;
+}
+
+
+static void
+lp_cs_job_setup_context(struct llvmpipe_context *llvmpipe,
+                        struct lp_jit_context *jit_context)
+{
+   const unsigned shader = PIPE_SHADER_COMPUTE;
+   unsigned i;
+
+   memset(jit_context, 0, sizeof *jit_context);
+
+   for (i = 0; i < ARRAY_SIZE(jit_context->constants); ++i) {
+      const struct pipe_constant_buffer *cb = &llvmpipe->constants[shader][i];
+      const ubyte *data = NULL;
+
+      if (cb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(cb->buffer);
+      else if (cb->user_buffer)
+         data = (const ubyte *) cb->user_buffer;
+
+      if (data) {
+         jit_context->constants[i] =
+            (const float *)(data + cb->buffer_offset);
+         jit_context->num_constants[i] =
+            MIN2(cb->buffer_size, LP_MAX_TGSI_CONST_BUFFER_SIZE) /
+            (4 * sizeof(float));
+      }
+   }
+
+   for (i = 0; i < llvmpipe->num_sampler_views[shader]; i++) {
+      struct pipe_sampler_view *view = llvmpipe->sampler_views[shader][i];
+
+      if (view)
+         lp_setup_jit_texture(&jit_context->textures[i], view);
+   }
+
+   for (i = 0; i < llvmpipe->num_samplers[shader]; i++) {
+      const struct pipe_sampler_state *sampler = llvmpipe->samplers[shader][i];
+
+      if (sampler) {
+         struct lp_jit_sampler *jit_sam = &jit_context->samplers[i];
+
+         jit_sam->min_lod = sampler->min_lod;
+         jit_sam->max_lod = sampler->max_lod;
+         jit_sam->lod_bias = sampler->lod_bias;
+         COPY_4V(jit_sam->border_color, sampler->border_color.f);
+      }
+   }
+
+   for (i = 0; i < llvmpipe->num_ssbos[shader]; i++) {
+      const struct pipe_shader_buffer *ssbo = &llvmpipe->ssbos[shader][i];
+
+      if (ssbo->buffer) {
+         const ubyte *data =
+            (const ubyte *) llvmpipe_resource_data(ssbo->buffer);
+
+         jit_context->ssbos[i] =
+            (const uint32_t *)(data + ssbo->buffer_offset);
+         jit_context->num_ssbos[i] = ssbo->buffer_size;
+      }
+   }
+
+   for (i = 0; i < llvmpipe->num_images[shader]; i++) {
+      if (llvmpipe->images[shader][i].resource)
+         lp_jit_image_from_view(&jit_context->images[i],
+                                &llvmpipe->images[shader][i]);
+   }
+}
+
+
+/**
+ * Run a compute grid to completion on the rasterizer threads.
+ */
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const struct pipe_grid_info *info)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_compute_shader_variant *variant;
+   struct lp_cs_job *job;
+   unsigned num_threads;
+   unsigned i;
+
+   if (!llvmpipe->cs)
+      return;
+
+   job = CALLOC_STRUCT(lp_cs_job);
+   if (!job)
+      return;
+
+   /*
+    * The grid, and the indirect grid size, may depend on what earlier
+    * draws wrote, and vice versa.
+    */
+   llvmpipe_finish(pipe, __FUNCTION__);
+
+   if (info->indirect) {
+      const ubyte *data =
+         (const ubyte *) llvmpipe_resource_data(info->indirect);
+
+      memcpy(job->grid, data + info->indirect_offset, sizeof job->grid);
+   }
+   else {
+      for (i = 0; i < 3; i++)
+         job->grid[i] = info->grid[i];
+   }
+
+   for (i = 0; i < 3; i++)
+      job->block[i] = info->block[i];
+
+   job->num_blocks = job->grid[0] * job->grid[1] * job->grid[2];
+   if (job->num_blocks == 0) {
+      FREE(job);
+      return;
+   }
+
+   variant = llvmpipe_update_cs(llvmpipe);
+   if (!variant) {
+      FREE(job);
+      return;
+   }
+
+   num_threads = MAX2(screen->num_threads, 1);
+   if (!llvmpipe->cs_exec) {
+      llvmpipe->cs_exec = lp_cs_exec_create(num_threads);
+      if (!llvmpipe->cs_exec) {
+         FREE(job);
+         return;
+      }
+   }
+
+   job->base.run = lp_cs_job_run;
+   job->variant = variant;
+   job->exec = llvmpipe->cs_exec;
+   job->num_vectors = DIV_ROUND_UP(job->block[0] * job->block[1] *
+                                   job->block[2], variant->vector_length);
+   job->use_fibers = job->num_vectors > 1 &&
+                     llvmpipe->cs->info.base.opcode_count[TGSI_OPCODE_BARRIER];
+   job->next_block = 0;
+
+   lp_cs_job_setup_context(llvmpipe, &job->jit_context);
+
+   job->base.fence = lp_fence_create(1);
+   if (!job->base.fence) {
+      FREE(job);
+      return;
+   }
+
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_rast_queue_job(screen->rast, &job->base);
+   pipe_mutex_unlock(screen->rast_mutex);
+
+   lp_fence_wait(job->base.fence);
+
+   lp_fence_reference(&job->base.fence, NULL);
+   FREE(job);
+}
+
+
+void
+llvmpipe_init_compute_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
+
+
+void
+llvmpipe_cleanup_compute(struct llvmpipe_context *llvmpipe)
+{
+   if (llvmpipe->cs_exec) {
+      lp_cs_exec_destroy(llvmpipe->cs_exec);
+      llvmpipe->cs_exec = NULL;
+   }
+}
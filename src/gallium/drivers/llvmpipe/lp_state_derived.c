@@ -188,7 +188,9 @@ void llvmpipe_update_derived( struct llvmpipe_context *llvmpipe )
     */
    if (llvmpipe->tex_timestamp != lp_screen->timestamp) {
       llvmpipe->tex_timestamp = lp_screen->timestamp;
-      llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
+      llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW |
+                         LP_NEW_FS_SSBOS |
+                         LP_NEW_FS_IMAGES;
    }
 
    /* This needs LP_NEW_RASTERIZER because of draw_prepare_shader_outputs(). */
@@ -245,6 +247,16 @@ void llvmpipe_update_derived( struct llvmpipe_context *llvmpipe )
                                           llvmpipe->num_sampler_views[PIPE_SHADER_FRAGMENT],
                                           llvmpipe->sampler_views[PIPE_SHADER_FRAGMENT]);
 
+   if (llvmpipe->dirty & LP_NEW_FS_SSBOS)
+      lp_setup_set_fragment_ssbos(llvmpipe->setup,
+                                  llvmpipe->num_ssbos[PIPE_SHADER_FRAGMENT],
+                                  llvmpipe->ssbos[PIPE_SHADER_FRAGMENT]);
+
+   if (llvmpipe->dirty & LP_NEW_FS_IMAGES)
+      lp_setup_set_fragment_images(llvmpipe->setup,
+                                   llvmpipe->num_images[PIPE_SHADER_FRAGMENT],
+                                   llvmpipe->images[PIPE_SHADER_FRAGMENT]);
+
    if (llvmpipe->dirty & (LP_NEW_SAMPLER))
       lp_setup_set_fragment_sampler_state(llvmpipe->setup,
                                           llvmpipe->num_samplers[PIPE_SHADER_FRAGMENT],
@@ -63,6 +63,7 @@
 #include "util/u_memory.h"
 #include "util/u_pointer.h"
 #include "util/u_format.h"
+#include "util/u_framebuffer.h"
 #include "util/u_dump.h"
 #include "util/u_string.h"
 #include "util/simple_list.h"
@@ -94,6 +95,7 @@
 #include "lp_bld_interp.h"
 #include "lp_context.h"
 #include "lp_debug.h"
+#include "lp_image.h"
 #include "lp_perf.h"
 #include "lp_setup.h"
 #include "lp_state.h"
@@ -101,6 +103,8 @@
 #include "lp_flush.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_texture.h"
 
 
 /** Fragment shader number (for debugging) */
@@ -286,6 +290,115 @@ lp_build_depth_clamp(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Multisample depth/stencil test.
+ *
+ * The shader runs once per pixel; here each sample's coverage mask is
+ * combined with the shader's mask and tested against the sample's own
+ * depth/stencil values, with z extrapolated to the sample position.
+ * The resulting masks replace the coverage masks in sample_mask_store
+ * and are used for blending each sample.
+ */
+static void
+generate_sample_tests(struct gallivm_state *gallivm,
+                      const struct lp_fragment_shader_variant_key *key,
+                      struct lp_type type,
+                      const struct util_format_description *zs_format_desc,
+                      unsigned depth_mode,
+                      LLVMValueRef context_ptr,
+                      LLVMValueRef thread_data_ptr,
+                      LLVMValueRef shader_mask,
+                      LLVMValueRef sample_mask_store,
+                      LLVMValueRef num_loop,
+                      LLVMValueRef loop_counter,
+                      LLVMValueRef z,
+                      const LLVMValueRef *sample_dz,
+                      LLVMValueRef *stencil_refs,
+                      LLVMValueRef facing,
+                      LLVMValueRef depth_ptr,
+                      LLVMValueRef depth_stride,
+                      LLVMValueRef depth_sample_stride)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context f32_bld;
+   unsigned s;
+
+   lp_build_context_init(&f32_bld, gallivm, type);
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      LLVMValueRef sample = lp_build_const_int32(gallivm, s);
+      LLVMValueRef index, mask_ptr, mask_val;
+
+      index = LLVMBuildAdd(builder, loop_counter,
+                           LLVMBuildMul(builder, sample, num_loop, ""), "");
+      mask_ptr = LLVMBuildGEP(builder, sample_mask_store,
+                              &index, 1, "sample_mask_ptr");
+      mask_val = LLVMBuildAnd(builder, LLVMBuildLoad(builder, mask_ptr, ""),
+                              shader_mask, "");
+
+      if (depth_mode & LATE_DEPTH_TEST) {
+         struct lp_build_mask_context mask;
+         LLVMValueRef sample_offset, sample_depth_ptr;
+         LLVMValueRef z_sample = z;
+         LLVMValueRef z_fb, s_fb, z_value, s_value;
+
+         if (sample_dz) {
+            z_sample = lp_build_add(&f32_bld, z,
+                                    lp_build_broadcast_scalar(&f32_bld,
+                                                              sample_dz[s]));
+            if (key->depth_clamp)
+               z_sample = lp_build_depth_clamp(gallivm, builder, type,
+                                               context_ptr, thread_data_ptr,
+                                               z_sample);
+            else
+               z_sample = lp_build_min(&f32_bld, z_sample, f32_bld.one);
+         }
+
+         sample_offset = LLVMBuildMul(builder, sample, depth_sample_stride, "");
+         sample_depth_ptr = LLVMBuildGEP(builder, depth_ptr,
+                                         &sample_offset, 1, "sample_depth_ptr");
+
+         lp_build_mask_begin(&mask, gallivm, type, mask_val);
+
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              sample_depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_counter);
+
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &mask,
+                                     stencil_refs,
+                                     z_sample, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     FALSE);
+
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_counter,
+                                                  sample_depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
+
+         mask_val = lp_build_mask_end(&mask);
+      }
+
+      if (key->occlusion_count) {
+         LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
+         lp_build_name(counter, "counter");
+         lp_build_occlusion_count(gallivm, type, mask_val, counter);
+      }
+
+      LLVMBuildStore(builder, mask_val, mask_ptr);
+   }
+}
+
+
 /**
  * Generate the fragment shader, depth/stencil test, and alpha tests.
  */
@@ -299,10 +412,14 @@ generate_fs_loop(struct gallivm_state *gallivm,
                  LLVMValueRef num_loop,
                  struct lp_build_interp_soa_context *interp,
                  struct lp_build_sampler_soa *sampler,
+                 const struct lp_build_image_soa *image,
                  LLVMValueRef mask_store,
+                 LLVMValueRef sample_mask_store,
+                 const LLVMValueRef *sample_dz,
                  LLVMValueRef (*out_color)[4],
                  LLVMValueRef depth_ptr,
                  LLVMValueRef depth_stride,
+                 LLVMValueRef depth_sample_stride,
                  LLVMValueRef facing,
                  LLVMValueRef thread_data_ptr)
 {
@@ -319,6 +436,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
    LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
    struct lp_build_for_loop_state loop_state;
    struct lp_build_mask_context mask;
+   struct lp_build_tgsi_mem_iface mem_iface;
    /*
     * TODO: figure out if simple_shader optimization is really worthwile to
     * keep. Disabled because it may hide some real bugs in the (depth/stencil)
@@ -368,6 +486,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
          depth_mode = LATE_DEPTH_TEST | LATE_DEPTH_WRITE;
       }
 
+      /* Fragments failing the depth/stencil test still have their side
+       * effects, unless the shader asks for early tests.
+       */
+      if (shader->info.base.writes_memory &&
+          !shader->info.base.properties[TGSI_PROPERTY_FS_EARLY_DEPTH_STENCIL])
+         depth_mode = LATE_DEPTH_TEST | LATE_DEPTH_WRITE;
+
       if (!(key->depth.enabled && key->depth.writemask) &&
           !(key->stencil[0].enabled && (key->stencil[0].writemask ||
                                         (key->stencil[1].enabled &&
@@ -378,6 +503,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
       depth_mode = 0;
    }
 
+   /* Samples are tested individually, after the shader has run. */
+   if (key->multisample && depth_mode) {
+      depth_mode = LATE_DEPTH_TEST |
+                   (depth_mode & (EARLY_DEPTH_WRITE | LATE_DEPTH_WRITE) ?
+                    LATE_DEPTH_WRITE : 0);
+   }
+
    vec_type = lp_build_vec_type(gallivm, type);
    int_vec_type = lp_build_vec_type(gallivm, int_type);
 
@@ -472,12 +604,17 @@ generate_fs_loop(struct gallivm_state *gallivm,
 
    lp_build_interp_soa_update_inputs_dyn(interp, gallivm, loop_state.counter);
 
+   memset(&mem_iface, 0, sizeof mem_iface);
+   mem_iface.ssbo_ptr = lp_jit_context_ssbos(gallivm, context_ptr);
+   mem_iface.ssbo_sizes_ptr = lp_jit_context_num_ssbos(gallivm, context_ptr);
+   mem_iface.image = image;
+
    /* Build the actual shader */
    lp_build_tgsi_soa(gallivm, tokens, type, &mask,
                      consts_ptr, num_consts_ptr, &system_values,
                      interp->inputs,
                      outputs, context_ptr, thread_data_ptr,
-                     sampler, &shader->info.base, NULL);
+                     sampler, &shader->info.base, NULL, &mem_iface);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -526,6 +663,8 @@ generate_fs_loop(struct gallivm_state *gallivm,
                                           0);
       if (pos0 != -1 && outputs[pos0][2]) {
          z = LLVMBuildLoad(builder, outputs[pos0][2], "output.z");
+         /* the shader output applies to all samples alike */
+         sample_dz = NULL;
       }
       /*
        * Clamp according to ARB_depth_clamp semantics.
@@ -544,29 +683,31 @@ generate_fs_loop(struct gallivm_state *gallivm,
          stencil_refs[1] = stencil_refs[0];
       }
 
-      lp_build_depth_stencil_load_swizzled(gallivm, type,
-                                           zs_format_desc, key->resource_1d,
-                                           depth_ptr, depth_stride,
-                                           &z_fb, &s_fb, loop_state.counter);
-
-      lp_build_depth_stencil_test(gallivm,
-                                  &key->depth,
-                                  key->stencil,
-                                  type,
-                                  zs_format_desc,
-                                  &mask,
-                                  stencil_refs,
-                                  z, z_fb, s_fb,
-                                  facing,
-                                  &z_value, &s_value,
-                                  !simple_shader);
-      /* Late Z write */
-      if (depth_mode & LATE_DEPTH_WRITE) {
-         lp_build_depth_stencil_write_swizzled(gallivm, type,
-                                               zs_format_desc, key->resource_1d,
-                                               NULL, NULL, NULL, loop_state.counter,
-                                               depth_ptr, depth_stride,
-                                               z_value, s_value);
+      if (!key->multisample) {
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_state.counter);
+
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &mask,
+                                     stencil_refs,
+                                     z, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     !simple_shader);
+         /* Late Z write */
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_state.counter,
+                                                  depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
       }
    }
    else if ((depth_mode & EARLY_DEPTH_TEST) &&
@@ -607,7 +748,15 @@ generate_fs_loop(struct gallivm_state *gallivm,
       }
    }
 
-   if (key->occlusion_count) {
+   if (key->multisample) {
+      generate_sample_tests(gallivm, key, type, zs_format_desc, depth_mode,
+                            context_ptr, thread_data_ptr,
+                            lp_build_mask_value(&mask),
+                            sample_mask_store, num_loop, loop_state.counter,
+                            z, sample_dz, stencil_refs, facing,
+                            depth_ptr, depth_stride, depth_sample_stride);
+   }
+   else if (key->occlusion_count) {
       LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
       lp_build_name(counter, "counter");
       lp_build_occlusion_count(gallivm, type,
@@ -1702,7 +1851,9 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    undef_src_val = lp_build_undef(gallivm, fs_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   /* 16-wide shaders are blended in halves, like 8-wide ones */
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, 256) :
+                                         lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2177,8 +2328,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2190,8 +2340,9 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
-   LLVMTypeRef arg_types[13];
+   LLVMTypeRef arg_types[15];
    LLVMTypeRef func_type;
+   LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
    LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
    LLVMValueRef context_ptr;
@@ -2204,18 +2355,22 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef stride_ptr;
    LLVMValueRef depth_ptr;
    LLVMValueRef depth_stride;
+   LLVMValueRef sample_stride_ptr;
+   LLVMValueRef depth_sample_stride;
    LLVMValueRef mask_input;
    LLVMValueRef thread_data_ptr;
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
    struct lp_build_sampler_soa *sampler;
+   struct lp_build_image_soa *image;
    struct lp_build_interp_soa_context interp;
-   LLVMValueRef fs_mask[16 / 4];
+   LLVMValueRef fs_mask[LP_MAX_SAMPLES][16 / 4];
    LLVMValueRef fs_out_color[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS][16 / 4];
    LLVMValueRef function;
    LLVMValueRef facing;
    unsigned num_fs;
-   unsigned i;
+   unsigned nr_samples = key->multisample ? LP_MAX_SAMPLES : 1;
+   unsigned i, s;
    unsigned chan;
    unsigned cbuf;
    boolean cbuf0_write_all;
@@ -2249,6 +2404,10 @@ generate_fragment(struct llvmpipe_context *lp,
    fs_type.norm = FALSE;         /* values are not limited to [0,1] or [-1,1] */
    fs_type.width = 32;           /* 32-bit float */
    fs_type.length = MIN2(lp_native_vector_width / 32, 16); /* n*4 elements per vector */
+   if (key->resource_1d) {
+      /* only the upper half of the stamp is shaded */
+      fs_type.length = MIN2(fs_type.length, 8);
+   }
 
    memset(&blend_type, 0, sizeof blend_type);
    blend_type.floating = FALSE; /* values are integers */
@@ -2278,10 +2437,12 @@ generate_fragment(struct llvmpipe_context *lp,
    arg_types[6] = LLVMPointerType(fs_elem_type, 0);    /* dady */
    arg_types[7] = LLVMPointerType(LLVMPointerType(blend_vec_type, 0), 0);  /* color */
    arg_types[8] = LLVMPointerType(int8_type, 0);       /* depth */
-   arg_types[9] = int32_type;                          /* mask_input */
+   arg_types[9] = int64_type;                          /* mask_input */
    arg_types[10] = variant->jit_thread_data_ptr_type;  /* per thread data */
    arg_types[11] = LLVMPointerType(int32_type, 0);     /* stride */
    arg_types[12] = int32_type;                         /* depth_stride */
+   arg_types[13] = LLVMPointerType(int32_type, 0);     /* sample_stride */
+   arg_types[14] = int32_type;                         /* depth_sample_stride */
 
    func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                                 arg_types, ARRAY_SIZE(arg_types), 0);
@@ -2311,6 +2472,8 @@ generate_fragment(struct llvmpipe_context *lp,
    thread_data_ptr  = LLVMGetParam(function, 10);
    stride_ptr   = LLVMGetParam(function, 11);
    depth_stride = LLVMGetParam(function, 12);
+   sample_stride_ptr = LLVMGetParam(function, 13);
+   depth_sample_stride = LLVMGetParam(function, 14);
 
    lp_build_name(context_ptr, "context");
    lp_build_name(x, "x");
@@ -2324,6 +2487,8 @@ generate_fragment(struct llvmpipe_context *lp,
    lp_build_name(thread_data_ptr, "thread_data");
    lp_build_name(stride_ptr, "stride_ptr");
    lp_build_name(depth_stride, "depth_stride");
+   lp_build_name(sample_stride_ptr, "sample_stride_ptr");
+   lp_build_name(depth_sample_stride, "depth_sample_stride");
 
    /*
     * Function body
@@ -2336,6 +2501,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
    /* code generated texture sampling */
    sampler = lp_llvm_sampler_soa_create(key->state);
+   image = lp_llvm_image_soa_create();
 
    num_fs = 16 / fs_type.length; /* number of loops per 4x4 stamp */
    /* for 1d resources only run "upper half" of stamp */
@@ -2347,6 +2513,9 @@ generate_fragment(struct llvmpipe_context *lp,
       LLVMTypeRef mask_type = lp_build_int_vec_type(gallivm, fs_type);
       LLVMValueRef mask_store = lp_build_array_alloca(gallivm, mask_type,
                                                       num_loop, "mask_store");
+      LLVMValueRef sample_mask_store = NULL;
+      LLVMValueRef sample_dz[LP_MAX_SAMPLES];
+      LLVMValueRef pixel_mask;
       LLVMValueRef color_store[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS];
       boolean pixel_center_integer =
          shader->info.base.properties[TGSI_PROPERTY_FS_COORD_PIXEL_CENTER];
@@ -2366,6 +2535,81 @@ generate_fragment(struct llvmpipe_context *lp,
                                a0_ptr, dadx_ptr, dady_ptr,
                                x, y);
 
+      /*
+       * A pixel is shaded when any of its samples is covered.
+       */
+      pixel_mask = mask_input;
+      if (key->multisample) {
+         for (s = 1; s < LP_MAX_SAMPLES; s++) {
+            pixel_mask = LLVMBuildOr(builder, pixel_mask,
+                                     LLVMBuildLShr(builder, mask_input,
+                                                   LLVMConstInt(int64_type, 16 * s, 0),
+                                                   ""),
+                                     "");
+         }
+
+         sample_mask_store =
+            lp_build_array_alloca(gallivm, mask_type,
+                                  lp_build_const_int32(gallivm,
+                                                       num_fs * LP_MAX_SAMPLES),
+                                  "sample_mask_store");
+
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            LLVMValueRef sample_mask =
+               LLVMBuildTrunc(builder,
+                              LLVMBuildLShr(builder, mask_input,
+                                            LLVMConstInt(int64_type, 16 * s, 0),
+                                            ""),
+                              int32_type, "");
+
+            for (i = 0; i < num_fs; i++) {
+               LLVMValueRef mask;
+               LLVMValueRef indexi = lp_build_const_int32(gallivm,
+                                                          s * num_fs + i);
+               LLVMValueRef mask_ptr = LLVMBuildGEP(builder, sample_mask_store,
+                                                    &indexi, 1, "");
+
+               if (partial_mask) {
+                  mask = generate_quad_mask(gallivm, fs_type,
+                                            i*fs_type.length/4, sample_mask);
+               }
+               else {
+                  mask = lp_build_const_int_vec(gallivm, fs_type, ~0);
+               }
+               LLVMBuildStore(builder, mask, mask_ptr);
+            }
+         }
+
+         /*
+          * z at the sample positions, relative to the pixel centre.
+          */
+         {
+            LLVMValueRef index = lp_build_const_int32(gallivm, 2);
+            LLVMValueRef dzdx = LLVMBuildLoad(builder,
+                                              LLVMBuildGEP(builder, dadx_ptr,
+                                                           &index, 1, ""),
+                                              "dzdx");
+            LLVMValueRef dzdy = LLVMBuildLoad(builder,
+                                              LLVMBuildGEP(builder, dady_ptr,
+                                                           &index, 1, ""),
+                                              "dzdy");
+
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               int sx, sy;
+
+               lp_sample_pos(s, &sx, &sy);
+               sample_dz[s] =
+                  LLVMBuildFAdd(builder,
+                                LLVMBuildFMul(builder, dzdx,
+                                              lp_build_const_float(gallivm, sx / 16.0), ""),
+                                LLVMBuildFMul(builder, dzdy,
+                                              lp_build_const_float(gallivm, sy / 16.0), ""),
+                                "sample_dz");
+            }
+         }
+      }
+      pixel_mask = LLVMBuildTrunc(builder, pixel_mask, int32_type, "");
+
       for (i = 0; i < num_fs; i++) {
          LLVMValueRef mask;
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
@@ -2374,7 +2618,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
          if (partial_mask) {
             mask = generate_quad_mask(gallivm, fs_type,
-                                      i*fs_type.length/4, mask_input);
+                                      i*fs_type.length/4, pixel_mask);
          }
          else {
             mask = lp_build_const_int_vec(gallivm, fs_type, ~0);
@@ -2390,18 +2634,33 @@ generate_fragment(struct llvmpipe_context *lp,
                        num_loop,
                        &interp,
                        sampler,
+                       image,
                        mask_store, /* output */
+                       sample_mask_store, /* output */
+                       sample_dz,
                        color_store,
                        depth_ptr,
                        depth_stride,
+                       depth_sample_stride,
                        facing,
                        thread_data_ptr);
 
       for (i = 0; i < num_fs; i++) {
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
-         LLVMValueRef ptr = LLVMBuildGEP(builder, mask_store,
-                                         &indexi, 1, "");
-         fs_mask[i] = LLVMBuildLoad(builder, ptr, "mask");
+         LLVMValueRef ptr;
+
+         if (key->multisample) {
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               LLVMValueRef index = lp_build_const_int32(gallivm,
+                                                         s * num_fs + i);
+               ptr = LLVMBuildGEP(builder, sample_mask_store, &index, 1, "");
+               fs_mask[s][i] = LLVMBuildLoad(builder, ptr, "sample_mask");
+            }
+         }
+         else {
+            ptr = LLVMBuildGEP(builder, mask_store, &indexi, 1, "");
+            fs_mask[0][i] = LLVMBuildLoad(builder, ptr, "mask");
+         }
          /* This is fucked up need to reorganize things */
          for (cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
             for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
@@ -2424,36 +2683,99 @@ generate_fragment(struct llvmpipe_context *lp,
    }
 
    sampler->destroy(sampler);
+   image->destroy(image);
 
-   /* Loop over color outputs / color buffers to do blending.
-    */
-   for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
-      if (key->cbuf_format[cbuf] != PIPE_FORMAT_NONE) {
-         LLVMValueRef color_ptr;
-         LLVMValueRef stride;
-         LLVMValueRef index = lp_build_const_int32(gallivm, cbuf);
-
-         boolean do_branch = ((key->depth.enabled
-                               || key->stencil[0].enabled
-                               || key->alpha.enabled)
-                              && !shader->info.base.uses_kill);
-
-         color_ptr = LLVMBuildLoad(builder,
-                                   LLVMBuildGEP(builder, color_ptr_ptr,
-                                                &index, 1, ""),
-                                   "");
+   if (fs_type.length == 16) {
+      /*
+       * Blending and color buffer access deal with at most 8 pixels per
+       * vector, so hand them the upper and lower half of the stamp.
+       */
+      struct lp_type half_type = fs_type;
+      LLVMTypeRef half_vec_type;
+      LLVMValueRef two = lp_build_const_int32(gallivm, 2);
+      unsigned num_outs = MAX2(key->nr_cbufs, dual_source_blend ? 2 : 0);
+
+      assert(num_fs == 1);
+
+      half_type.length = 8;
+      half_vec_type = lp_build_vec_type(gallivm, half_type);
+
+      for (s = 0; s < nr_samples; s++) {
+         fs_mask[s][1] = lp_build_extract_range(gallivm, fs_mask[s][0], 8, 8);
+         fs_mask[s][0] = lp_build_extract_range(gallivm, fs_mask[s][0], 0, 8);
+      }
+
+      for (cbuf = 0; cbuf < num_outs; cbuf++) {
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+            LLVMValueRef color = LLVMBuildLoad(builder,
+                                               fs_out_color[cbuf][chan][0], "");
+            LLVMValueRef store = lp_build_array_alloca(gallivm, half_vec_type,
+                                                       two, "");
+
+            for (i = 0; i < 2; i++) {
+               LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
+               LLVMValueRef ptr = LLVMBuildGEP(builder, store, &indexi, 1, "");
+               LLVMBuildStore(builder,
+                              lp_build_extract_range(gallivm, color, i * 8, 8),
+                              ptr);
+               fs_out_color[cbuf][chan][i] = ptr;
+            }
+         }
+      }
 
-         lp_build_name(color_ptr, "color_ptr%d", cbuf);
+      fs_type = half_type;
+      num_fs = 2;
+   }
 
-         stride = LLVMBuildLoad(builder,
-                                LLVMBuildGEP(builder, stride_ptr, &index, 1, ""),
+   /* Loop over samples and color outputs / color buffers to do blending.
+    */
+   for (s = 0; s < nr_samples; s++) {
+      for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
+         if (key->cbuf_format[cbuf] != PIPE_FORMAT_NONE) {
+            LLVMValueRef color_ptr;
+            LLVMValueRef stride;
+            LLVMValueRef index = lp_build_const_int32(gallivm, cbuf);
+
+            boolean do_branch = ((key->depth.enabled
+                                  || key->stencil[0].enabled
+                                  || key->alpha.enabled
+                                  || key->multisample)
+                                 && !shader->info.base.uses_kill);
+
+            color_ptr = LLVMBuildLoad(builder,
+                                      LLVMBuildGEP(builder, color_ptr_ptr,
+                                                   &index, 1, ""),
+                                      "");
+
+            if (s > 0) {
+               LLVMTypeRef color_ptr_type = LLVMTypeOf(color_ptr);
+               LLVMValueRef offset =
+                  LLVMBuildLoad(builder,
+                                LLVMBuildGEP(builder, sample_stride_ptr,
+                                             &index, 1, ""),
                                 "");
 
-         generate_unswizzled_blend(gallivm, cbuf, variant,
-                                   key->cbuf_format[cbuf],
-                                   num_fs, fs_type, fs_mask, fs_out_color,
-                                   context_ptr, color_ptr, stride,
-                                   partial_mask, do_branch);
+               offset = LLVMBuildMul(builder, offset,
+                                     lp_build_const_int32(gallivm, s), "");
+               color_ptr = LLVMBuildBitCast(builder, color_ptr,
+                                            LLVMPointerType(int8_type, 0), "");
+               color_ptr = LLVMBuildGEP(builder, color_ptr, &offset, 1, "");
+               color_ptr = LLVMBuildBitCast(builder, color_ptr,
+                                            color_ptr_type, "");
+            }
+
+            lp_build_name(color_ptr, "color_ptr%d", cbuf);
+
+            stride = LLVMBuildLoad(builder,
+                                   LLVMBuildGEP(builder, stride_ptr, &index, 1, ""),
+                                   "");
+
+            generate_unswizzled_blend(gallivm, cbuf, variant,
+                                      key->cbuf_format[cbuf],
+                                      num_fs, fs_type, fs_mask[s], fs_out_color,
+                                      context_ptr, color_ptr, stride,
+                                      partial_mask, do_branch);
+         }
       }
    }
 
@@ -2497,6 +2819,9 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
       debug_printf("alpha.func = %s\n", util_dump_func(key->alpha.func, TRUE));
    }
 
+   if (key->multisample) {
+      debug_printf("multisample = 1\n");
+   }
    if (key->occlusion_count) {
       debug_printf("occlusion_count = 1\n");
    }
@@ -2550,6 +2875,8 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
                    texture->pot_width,
                    texture->pot_height,
                    texture->pot_depth);
+      debug_printf("  .tiled = %u\n",
+                   texture->tiled);
    }
 }
 
@@ -2566,9 +2893,133 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
 }
 
 
+/**
+ * Generate the code of a variant into variant->gallivm and compile it.
+ */
+static void
+compile_variant(struct lp_fragment_shader *shader,
+                struct lp_fragment_shader_variant *variant)
+{
+   lp_jit_init_types(variant);
+   
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(shader, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(shader, variant, RAST_WHOLE);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   gallivm_free_ir(variant->gallivm);
+}
+
+
+/**
+ * Compile the optimized code of a variant on a compile thread, while
+ * draws use the code compiled fast by generate_variant().
+ *
+ * The code is generated into a private copy of the variant, with its own
+ * LLVMContext, as LLVM contexts can't be shared between threads.
+ */
+static void
+compile_optimized_variant(void *data, int thread_index)
+{
+   struct lp_fragment_shader_variant *variant =
+      (struct lp_fragment_shader_variant *)data;
+   struct lp_fragment_shader_variant *tmp;
+   LLVMContextRef context;
+   char module_name[64];
+
+   tmp = MALLOC_STRUCT(lp_fragment_shader_variant);
+   if (!tmp)
+      return;
+
+   context = LLVMContextCreate();
+   if (!context) {
+      FREE(tmp);
+      return;
+   }
+
+   memcpy(tmp, variant, sizeof *tmp);
+   tmp->jit_context_ptr_type = NULL;
+   tmp->jit_thread_data_ptr_type = NULL;
+   tmp->jit_linear_context_ptr_type = NULL;
+   memset(tmp->function, 0, sizeof tmp->function);
+   memset(tmp->jit_function, 0, sizeof tmp->jit_function);
+
+   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+                 variant->shader->no, variant->no);
+
+   tmp->gallivm = gallivm_create(module_name, context);
+   if (tmp->gallivm) {
+      compile_variant(variant->shader, tmp);
+
+      /* Both versions stay valid until the variant is destroyed, so tiles
+       * already binned with the fast code may run either.
+       */
+      variant->opt_gallivm = tmp->gallivm;
+      variant->jit_function[RAST_EDGE_TEST] =
+         tmp->jit_function[RAST_EDGE_TEST];
+      variant->jit_function[RAST_WHOLE] = tmp->jit_function[RAST_WHOLE];
+   }
+
+   /* Only the IR lived in the context, and that's gone by now */
+   LLVMContextDispose(context);
+   FREE(tmp);
+}
+
+
+/**
+ * Count a draw with the bound variant.  Once a variant compiled with the
+ * fast tier is hot, its optimized code is compiled in the background.
+ */
+void
+llvmpipe_fs_variant_draw(struct llvmpipe_context *lp)
+{
+   struct lp_fragment_shader_variant *variant = lp->fs_variant;
+
+   if (!variant || !variant->gallivm->fast || variant->opt_queued)
+      return;
+
+   if (++variant->draws >=
+       llvmpipe_screen(lp->pipe.screen)->hot_variant_draws) {
+      variant->opt_queued = TRUE;
+      util_queue_add_job(&lp->compile_queue, variant, &variant->opt_fence,
+                         compile_optimized_variant, NULL);
+   }
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * With compile threads, the variant is first compiled with the fast tier,
+ * see llvmpipe_fs_variant_draw().
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
@@ -2578,6 +3029,7 @@ generate_variant(struct llvmpipe_context *lp,
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
    boolean fullcolormask;
+   boolean async = util_queue_is_initialized(&lp->compile_queue);
    char module_name[64];
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
@@ -2593,6 +3045,9 @@ generate_variant(struct llvmpipe_context *lp,
       return NULL;
    }
 
+   variant->gallivm->fast = async;
+   util_queue_fence_init(&variant->opt_fence);
+
    variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
@@ -2631,41 +3086,7 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
-
-   /*
-    * Compile everything
-    */
-
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
-   }
-
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
-   }
-
-   gallivm_free_ir(variant->gallivm);
+   compile_variant(shader, variant);
 
    return variant;
 }
@@ -2802,6 +3223,15 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
+   if (lp->fs_variant == variant)
+      lp->fs_variant = NULL;
+
+   /* The compile thread may still be writing the optimized code */
+   util_queue_job_wait(&variant->opt_fence);
+   util_queue_fence_destroy(&variant->opt_fence);
+   if (variant->opt_gallivm)
+      gallivm_destroy(variant->opt_gallivm);
+
    gallivm_destroy(variant->gallivm);
 
    /* remove from shader's list */
@@ -2926,6 +3356,21 @@ force_dst_alpha_one(unsigned factor, boolean clamped_zero)
 }
 
 
+/**
+ * Static state of a sampler view, including the storage layout of the
+ * texture.
+ */
+static void
+make_texture_state(struct lp_static_texture_state *state,
+                   const struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+
+   if (view && view->texture)
+      state->tiled = llvmpipe_resource_const(view->texture)->tiled;
+}
+
+
 /**
  * We need to generate several variants of the fragment pipeline to match
  * all the combinations of the contributing state atoms.
@@ -2992,6 +3437,7 @@ make_variant_key(struct llvmpipe_context *lp,
    /* alpha.ref_value is passed in jit_context */
 
    key->flatshade = lp->rasterizer->flatshade;
+   key->multisample = util_framebuffer_get_num_samples(&lp->framebuffer) > 1;
    if (lp->active_occlusion_queries) {
       key->occlusion_count = TRUE;
    }
@@ -3102,8 +3548,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            make_texture_state(&key->state[i].texture_state,
+                               lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3111,8 +3557,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            make_texture_state(&key->state[i].texture_state,
+                               lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3204,8 +3650,8 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       variant = generate_variant(lp, shader, &key);
       t1 = os_time_get();
       dt = t1 - t0;
-      LP_COUNT_ADD(llvm_compile_time, dt);
-      LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
+      LP_COUNT_ADD(&lp->counters, llvm_compile_time, dt);
+      LP_COUNT_ADD(&lp->counters, nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
       if (variant) {
@@ -3218,6 +3664,7 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    }
 
    /* Bind this variant */
+   lp->fs_variant = variant;
    lp_setup_set_fs_variant(lp->setup, variant);
 }
 
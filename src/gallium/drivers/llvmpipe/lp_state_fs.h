@@ -32,6 +32,7 @@
 
 #include "pipe/p_compiler.h"
 #include "pipe/p_state.h"
+#include "util/u_queue.h"
 #include "tgsi/tgsi_scan.h" /* for tgsi_shader_info */
 #include "gallivm/lp_bld_sample.h" /* for struct lp_sampler_static_state */
 #include "gallivm/lp_bld_tgsi.h" /* for lp_tgsi_info */
@@ -77,6 +78,7 @@ struct lp_fragment_shader_variant_key
    unsigned occlusion_count:1;
    unsigned resource_1d:1;
    unsigned depth_clamp:1;
+   unsigned multisample:1;
 
    enum pipe_format zsbuf_format;
    enum pipe_format cbuf_format[PIPE_MAX_COLOR_BUFS];
@@ -110,6 +112,17 @@ struct lp_fragment_shader_variant
 
    lp_jit_frag_func jit_function[2];
 
+   /**
+    * With compile threads, gallivm holds code compiled with the fast tier.
+    * After the variant has been drawn with often enough, it is compiled
+    * with the optimized tier, and jit_function[] is switched over to the
+    * code in opt_gallivm once opt_fence is signalled.
+    */
+   struct gallivm_state *opt_gallivm;
+   struct util_queue_fence opt_fence;
+   unsigned draws;
+   boolean opt_queued;
+
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
@@ -150,6 +163,9 @@ void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_fs_variant_draw(struct llvmpipe_context *lp);
+
 boolean
 llvmpipe_rasterization_disabled(struct llvmpipe_context *lp);
 
@@ -0,0 +1,158 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL VMWARE AND/OR ITS SUPPLIERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * Shader buffer and image binding.
+ */
+
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "draw/draw_context.h"
+#include "lp_context.h"
+#include "lp_flush.h"
+#include "lp_state.h"
+#include "lp_texture.h"
+
+
+static void
+llvmpipe_set_shader_buffers(struct pipe_context *pipe,
+                            enum pipe_shader_type shader,
+                            unsigned start,
+                            unsigned num,
+                            const struct pipe_shader_buffer *buffers)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(shader < PIPE_SHADER_TYPES);
+   assert(start + num <= ARRAY_SIZE(llvmpipe->ssbos[shader]));
+
+   if (shader == PIPE_SHADER_FRAGMENT)
+      draw_flush(llvmpipe->draw);
+
+   for (i = 0; i < num; i++) {
+      struct pipe_shader_buffer *ssbo = &llvmpipe->ssbos[shader][start + i];
+      const struct pipe_shader_buffer *buffer = buffers ? &buffers[i] : NULL;
+
+      pipe_resource_reference(&ssbo->buffer, buffer ? buffer->buffer : NULL);
+      ssbo->buffer_offset = buffer ? buffer->buffer_offset : 0;
+      ssbo->buffer_size = buffer ? buffer->buffer_size : 0;
+   }
+
+   /* find highest non-null ssbos[] entry */
+   {
+      unsigned j = MAX2(llvmpipe->num_ssbos[shader], start + num);
+      while (j > 0 && llvmpipe->ssbos[shader][j - 1].buffer == NULL)
+         j--;
+      llvmpipe->num_ssbos[shader] = j;
+   }
+
+   if (shader == PIPE_SHADER_FRAGMENT)
+      llvmpipe->dirty |= LP_NEW_FS_SSBOS;
+}
+
+
+static void
+llvmpipe_set_shader_images(struct pipe_context *pipe,
+                           enum pipe_shader_type shader,
+                           unsigned start,
+                           unsigned num,
+                           const struct pipe_image_view *images)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(shader < PIPE_SHADER_TYPES);
+   assert(start + num <= ARRAY_SIZE(llvmpipe->images[shader]));
+
+   if (shader == PIPE_SHADER_FRAGMENT)
+      draw_flush(llvmpipe->draw);
+
+   for (i = 0; i < num; i++) {
+      struct pipe_image_view *view = &llvmpipe->images[shader][start + i];
+      const struct pipe_image_view *image = images ? &images[i] : NULL;
+
+      if (image && image->resource &&
+          llvmpipe_resource_is_texture(image->resource)) {
+         /* shaders only access the linear layout */
+         llvmpipe_resource_untile(image->resource);
+      }
+
+      pipe_resource_reference(&view->resource,
+                              image ? image->resource : NULL);
+      if (image) {
+         view->format = image->format;
+         view->access = image->access;
+         view->u = image->u;
+      }
+   }
+
+   /* find highest non-null images[] entry */
+   {
+      unsigned j = MAX2(llvmpipe->num_images[shader], start + num);
+      while (j > 0 && llvmpipe->images[shader][j - 1].resource == NULL)
+         j--;
+      llvmpipe->num_images[shader] = j;
+   }
+
+   if (shader == PIPE_SHADER_FRAGMENT)
+      llvmpipe->dirty |= LP_NEW_FS_IMAGES;
+}
+
+
+/**
+ * Scenes are rasterized in order, and compute grids run to completion,
+ * so all that's needed is to end the current scene.
+ */
+static void
+llvmpipe_memory_barrier(struct pipe_context *pipe, unsigned flags)
+{
+   llvmpipe_flush(pipe, NULL, __FUNCTION__);
+}
+
+
+void
+llvmpipe_init_image_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.set_shader_buffers = llvmpipe_set_shader_buffers;
+   llvmpipe->pipe.set_shader_images = llvmpipe_set_shader_images;
+   llvmpipe->pipe.memory_barrier = llvmpipe_memory_barrier;
+}
+
+
+void
+llvmpipe_cleanup_images(struct llvmpipe_context *llvmpipe)
+{
+   unsigned i, j;
+
+   for (i = 0; i < PIPE_SHADER_TYPES; i++) {
+      for (j = 0; j < ARRAY_SIZE(llvmpipe->ssbos[i]); j++)
+         pipe_resource_reference(&llvmpipe->ssbos[i][j].buffer, NULL);
+      for (j = 0; j < ARRAY_SIZE(llvmpipe->images[i]); j++)
+         pipe_resource_reference(&llvmpipe->images[i][j].resource, NULL);
+   }
+}
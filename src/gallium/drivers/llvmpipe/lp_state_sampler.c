@@ -150,6 +150,18 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
       llvmpipe->num_sampler_views[shader] = j;
    }
 
+   if (shader != PIPE_SHADER_FRAGMENT) {
+      /* the draw module and compute shaders only sample from the linear
+       * layout
+       */
+      for (i = 0; i < num; i++) {
+         if (views[i] && views[i]->texture &&
+             llvmpipe_resource_is_texture(views[i]->texture)) {
+            llvmpipe_resource_untile(views[i]->texture);
+         }
+      }
+   }
+
    if (shader == PIPE_SHADER_VERTEX || shader == PIPE_SHADER_GEOMETRY) {
       draw_set_sampler_views(llvmpipe->draw,
                              shader,
@@ -25,6 +25,9 @@
  * 
  **************************************************************************/
 
+#include "util/u_box.h"
+#include "util/u_format.h"
+#include "util/u_memory.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "lp_context.h"
@@ -61,6 +64,196 @@ lp_resource_copy(struct pipe_context *pipe,
 }
 
 
+/**
+ * Average one row of samples of a ?8?8?8?8_UNORM format.
+ */
+static void
+resolve_row_rgba8(uint8_t *dst, const uint8_t *src, unsigned sample_stride,
+                  unsigned width)
+{
+   unsigned i;
+
+   for (i = 0; i < width * 4; i++) {
+      dst[i] = (src[i] +
+                src[i + sample_stride] +
+                src[i + 2 * sample_stride] +
+                src[i + 3 * sample_stride] + 2) >> 2;
+   }
+}
+
+
+/**
+ * Average one row of samples of any color format, in floating point.
+ * \param tmp  scratch space for 8 * width floats
+ */
+static void
+resolve_row_float(uint8_t *dst, const struct util_format_description *dst_desc,
+                  const uint8_t *src, const struct util_format_description *src_desc,
+                  unsigned sample_stride, unsigned nr_samples,
+                  unsigned width, float *tmp)
+{
+   float *sum = tmp;
+   float *texels = tmp + width * 4;
+   unsigned s, i;
+
+   memset(sum, 0, width * 4 * sizeof *sum);
+
+   for (s = 0; s < nr_samples; s++) {
+      src_desc->unpack_rgba_float(texels, 0, src + s * sample_stride, 0,
+                                  width, 1);
+      for (i = 0; i < width * 4; i++)
+         sum[i] += texels[i];
+   }
+
+   for (i = 0; i < width * 4; i++)
+      sum[i] *= 1.0f / nr_samples;
+
+   dst_desc->pack_rgba_float(dst, 0, sum, 0, width, 1);
+}
+
+
+/**
+ * Copy only the depth or only the stencil values of one row of a packed
+ * depth/stencil format, keeping the other ones of the destination.
+ * \param tmp  scratch space for 4 * width bytes
+ */
+static void
+copy_row_zs_masked(uint8_t *dst, const uint8_t *src,
+                   const struct util_format_description *desc,
+                   unsigned mask, unsigned width, void *tmp)
+{
+   if (mask == PIPE_MASK_S) {
+      desc->unpack_s_8uint(tmp, 0, src, 0, width, 1);
+      desc->pack_s_8uint(dst, 0, tmp, 0, width, 1);
+   }
+   else if (desc->format == PIPE_FORMAT_Z32_FLOAT_S8X24_UINT) {
+      desc->unpack_z_float(tmp, 0, src, 0, width, 1);
+      desc->pack_z_float(dst, 0, tmp, 0, width, 1);
+   }
+   else {
+      desc->unpack_z_32unorm(tmp, 0, src, 0, width, 1);
+      desc->pack_z_32unorm(dst, 0, tmp, 0, width, 1);
+   }
+}
+
+
+/**
+ * Resolve a multisample resource into a single-sample one.
+ *
+ * Color samples are averaged, converting sRGB values to linear and back.
+ * Pure integer and depth/stencil formats take sample 0 instead.  Only
+ * what glBlitFramebuffer allows for multisample sources is supported,
+ * that is no scaling, flipping or scissoring, and either all channels or
+ * just the depth or just the stencil values of a packed depth/stencil
+ * format.
+ */
+static boolean
+lp_resolve(struct pipe_context *pipe, const struct pipe_blit_info *info)
+{
+   struct pipe_resource *src = info->src.resource;
+   struct pipe_resource *dst = info->dst.resource;
+   const struct util_format_description *src_desc =
+      util_format_description(info->src.format);
+   const struct util_format_description *dst_desc =
+      util_format_description(info->dst.format);
+   const unsigned sample_stride = llvmpipe_resource(src)->sample_stride;
+   const int width = info->dst.box.width;
+   const int height = info->dst.box.height;
+   const unsigned src_bpp = util_format_get_blocksize(info->src.format);
+   const unsigned src_stride = llvmpipe_resource_stride(src, info->src.level);
+   const unsigned full_mask = util_format_get_mask(info->dst.format);
+   const unsigned mask = info->mask & full_mask;
+   const boolean masked = mask != full_mask;
+   boolean average, rgba8;
+   float *tmp = NULL;
+   int z, y;
+
+   if (info->src.box.width != width || info->src.box.height != height ||
+       info->src.box.depth != info->dst.box.depth ||
+       width <= 0 || height <= 0 ||
+       info->scissor_enable)
+      return FALSE;
+
+   average = !util_format_is_depth_or_stencil(info->src.format) &&
+             !util_format_is_pure_integer(info->src.format);
+   if (!average && info->src.format != info->dst.format)
+      return FALSE;
+
+   if (masked &&
+       (!util_format_is_depth_and_stencil(info->dst.format) ||
+        info->src.format != info->dst.format ||
+        (mask != PIPE_MASK_Z && mask != PIPE_MASK_S)))
+      return FALSE;
+
+   rgba8 = average &&
+           info->src.format == info->dst.format &&
+           src->nr_samples == 4 &&
+           util_format_is_rgba8_variant(src_desc) &&
+           src_desc->colorspace != UTIL_FORMAT_COLORSPACE_SRGB;
+
+   if ((average && !rgba8) || masked) {
+      tmp = MALLOC(width * 8 * sizeof *tmp);
+      if (!tmp)
+         return FALSE;
+   }
+
+   llvmpipe_flush_resource(pipe, dst, info->dst.level,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve dest");
+
+   llvmpipe_flush_resource(pipe, src, info->src.level,
+                           TRUE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve src");
+
+   for (z = 0; z < info->dst.box.depth; z++) {
+      struct pipe_transfer *transfer;
+      struct pipe_box box;
+      const uint8_t *src_map;
+      uint8_t *dst_map;
+
+      u_box_2d_zslice(info->dst.box.x, info->dst.box.y, info->dst.box.z + z,
+                      width, height, &box);
+      dst_map = pipe->transfer_map(pipe, dst, info->dst.level,
+                                   masked ? PIPE_TRANSFER_READ_WRITE :
+                                   (PIPE_TRANSFER_WRITE |
+                                    PIPE_TRANSFER_DISCARD_RANGE),
+                                   &box, &transfer);
+      if (!dst_map)
+         break;
+
+      src_map = llvmpipe_resource_map(src, info->src.level,
+                                      info->src.box.z + z,
+                                      LP_TEX_USAGE_READ);
+      src_map += info->src.box.y * src_stride + info->src.box.x * src_bpp;
+
+      for (y = 0; y < height; y++) {
+         const uint8_t *src_row = src_map + y * src_stride;
+         uint8_t *dst_row = dst_map + y * transfer->stride;
+
+         if (rgba8)
+            resolve_row_rgba8(dst_row, src_row, sample_stride, width);
+         else if (average)
+            resolve_row_float(dst_row, dst_desc, src_row, src_desc,
+                              sample_stride, src->nr_samples, width, tmp);
+         else if (masked)
+            copy_row_zs_masked(dst_row, src_row, src_desc, mask,
+                               width, tmp);
+         else
+            memcpy(dst_row, src_row, width * src_bpp);
+      }
+
+      pipe->transfer_unmap(pipe, transfer);
+   }
+
+   FREE(tmp);
+   return TRUE;
+}
+
+
 static void lp_blit(struct pipe_context *pipe,
                     const struct pipe_blit_info *blit_info)
 {
@@ -71,10 +264,12 @@ static void lp_blit(struct pipe_context *pipe,
       return;
 
    if (info.src.resource->nr_samples > 1 &&
-       info.dst.resource->nr_samples <= 1 &&
-       !util_format_is_depth_or_stencil(info.src.resource->format) &&
-       !util_format_is_pure_integer(info.src.resource->format)) {
-      debug_printf("llvmpipe: color resolve unimplemented\n");
+       info.dst.resource->nr_samples <= 1) {
+      if (!lp_resolve(pipe, &info)) {
+         debug_printf("llvmpipe: resolve unsupported %s -> %s\n",
+                      util_format_short_name(info.src.format),
+                      util_format_short_name(info.dst.format));
+      }
       return;
    }
 
@@ -141,6 +336,11 @@ llvmpipe_create_surface(struct pipe_context *pipe,
       }
    }
 
+   if (llvmpipe_resource_is_texture(pt)) {
+      /* the rasterizer only renders to the linear layout */
+      llvmpipe_resource_untile(pt);
+   }
+
    ps = CALLOC_STRUCT(pipe_surface);
    if (ps) {
       pipe_reference_init(&ps->reference, 1);
@@ -35,6 +35,8 @@
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
 
+#include "util/u_atomic.h"
+#include "util/u_box.h"
 #include "util/u_inlines.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_format.h"
@@ -44,7 +46,9 @@
 #include "util/u_transfer.h"
 
 #include "lp_context.h"
+#include "lp_fence.h"
 #include "lp_flush.h"
+#include "lp_numa.h"
 #include "lp_screen.h"
 #include "lp_texture.h"
 #include "lp_setup.h"
@@ -60,6 +64,218 @@ static struct llvmpipe_resource resource_list;
 static unsigned id_counter = 0;
 
 
+/**
+ * Byte offset of texel (x, y) within a slice of a tiled texture.
+ *
+ * Tiled textures have the same row and image strides as linear ones,
+ * but store each group of 4 rows as a sequence of 4x4 texel tiles, so
+ * that the texels of a bilinear footprint mostly share a cacheline.
+ * This must match lp_build_sample_tiled_coords().
+ */
+static inline unsigned
+tiled_offset(unsigned x, unsigned y, unsigned bpp, unsigned row_stride)
+{
+   return (((x & ~3) + (y & 3)) * 4 + (x & 3)) * bpp + (y & ~3) * row_stride;
+}
+
+
+/**
+ * Copy a box of a texture level between tiled storage and a linear
+ * buffer, in the direction given by to_tiled.
+ */
+static void
+copy_tiled_box(const struct llvmpipe_resource *lpr,
+               void *tex_data,
+               unsigned level,
+               const struct pipe_box *box,
+               ubyte *linear,
+               unsigned stride,
+               unsigned layer_stride,
+               boolean to_tiled)
+{
+   const unsigned bpp = util_format_get_blocksize(lpr->base.format);
+   const unsigned row_stride = lpr->row_stride[level];
+   int x, y, z;
+
+   for (z = 0; z < box->depth; z++) {
+      ubyte *slice = (ubyte *) tex_data + lpr->mip_offsets[level] +
+                     (box->z + z) * lpr->img_stride[level];
+
+      for (y = 0; y < box->height; y++) {
+         ubyte *row = linear + z * layer_stride + y * stride;
+
+         for (x = box->x; x < box->x + box->width; ) {
+            /* texels are contiguous up to the end of the tile row */
+            unsigned n = MIN2(4 - (x & 3), box->x + box->width - x);
+            ubyte *texel = slice + tiled_offset(x, box->y + y, bpp, row_stride);
+            ubyte *pixel = row + (x - box->x) * bpp;
+
+            if (to_tiled)
+               memcpy(texel, pixel, n * bpp);
+            else
+               memcpy(pixel, texel, n * bpp);
+
+            x += n;
+         }
+      }
+   }
+}
+
+
+/**
+ * Whether to store a new texture in 4x4 texel tiles.
+ *
+ * Only textures which are sampled from in two or three dimensions benefit,
+ * and only non-compressed formats can be tiled.  Textures which get rendered
+ * to, sampled by the draw module, or bound as shader images are switched to
+ * the linear layout later on, see llvmpipe_resource_untile().
+ */
+static boolean
+llvmpipe_can_tile(const struct llvmpipe_screen *screen,
+                  const struct pipe_resource *pt)
+{
+   const struct util_format_description *desc =
+      util_format_description(pt->format);
+
+   if (!screen->tiled_textures)
+      return FALSE;
+
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_3D:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      break;
+   default:
+      return FALSE;
+   }
+
+   if (!(pt->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (pt->bind & PIPE_BIND_SHADER_IMAGE) ||
+       (pt->flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT) ||
+       pt->nr_samples > 1)
+      return FALSE;
+
+   return desc->block.width == 1 && desc->block.height == 1;
+}
+
+
+/**
+ * Zeroing of a new render target by the rasterizer threads.
+ */
+struct lp_numa_clear_job
+{
+   struct lp_rast_job base;
+   const struct lp_numa *numa;
+   unsigned num_threads;
+   const struct llvmpipe_resource *lpr;
+};
+
+
+/**
+ * Each thread zeroes its share of the tile rows of its node's band, in
+ * every layer and sample of the first level.  The threads are pinned, so
+ * with the kernel's first-touch policy the pages of each band end up on
+ * the node that rasterizes it.  The bands are computed as in
+ * lp_scene_bin_iter_begin().  Thread 0 also zeroes the smaller levels.
+ */
+static void
+lp_numa_clear_job_run(struct lp_rast_job *base,
+                      unsigned thread_index,
+                      struct lp_jit_thread_data *thread_data)
+{
+   const struct lp_numa_clear_job *job = (const struct lp_numa_clear_job *)base;
+   const struct llvmpipe_resource *lpr = job->lpr;
+   const struct pipe_resource *pt = &lpr->base;
+   const size_t row_stride = lpr->row_stride[0];
+   const size_t img_stride = lpr->img_stride[0];
+   const unsigned rows = (unsigned)(img_stride / row_stride);
+   const unsigned tiles_y = DIV_ROUND_UP(rows, TILE_SIZE);
+   const unsigned layers = pt->target == PIPE_TEXTURE_3D ?
+                           pt->depth0 : pt->array_size;
+   const unsigned samples = MAX2(pt->nr_samples, 1);
+   const size_t sample_stride = samples > 1 ?
+                                lpr->sample_stride : lpr->total_alloc_size;
+   unsigned node = lp_numa_thread_node(job->numa, thread_index,
+                                       job->num_threads);
+   unsigned num_bands = MIN3(lp_numa_num_nodes(job->numa), tiles_y,
+                             LP_MAX_NUMA_NODES);
+   uint8_t *data = lpr->tex_data;
+   unsigned s, z;
+
+   num_bands = MAX2(1, num_bands);
+
+   if (node < num_bands) {
+      unsigned band_start = node * tiles_y / num_bands;
+      unsigned band_end = (node + 1) * tiles_y / num_bands;
+      unsigned rank = 0, count = 0, i;
+      unsigned start_y, end_y;
+
+      /* split the band among the threads of the node */
+      for (i = 0; i < job->num_threads; i++) {
+         if (lp_numa_thread_node(job->numa, i, job->num_threads) == node) {
+            if (i < thread_index)
+               rank++;
+            count++;
+         }
+      }
+
+      start_y = band_start + (band_end - band_start) * rank / count;
+      end_y = band_start + (band_end - band_start) * (rank + 1) / count;
+      start_y *= TILE_SIZE;
+      end_y = MIN2(end_y * TILE_SIZE, rows);
+
+      if (end_y > start_y) {
+         for (s = 0; s < samples; s++) {
+            for (z = 0; z < layers; z++) {
+               memset(data + s * sample_stride + z * img_stride +
+                      start_y * row_stride,
+                      0, (end_y - start_y) * row_stride);
+            }
+         }
+      }
+   }
+
+   if (thread_index == 0) {
+      for (s = 0; s < samples; s++) {
+         memset(data + s * sample_stride + layers * img_stride,
+                0, sample_stride - layers * img_stride);
+      }
+   }
+}
+
+
+/**
+ * Zero a new render target from the rasterizer threads which will render
+ * into it, see lp_numa_clear_job_run().
+ */
+static void
+llvmpipe_numa_clear(struct llvmpipe_screen *screen,
+                    struct llvmpipe_resource *lpr)
+{
+   struct lp_numa_clear_job job;
+
+   job.base.run = lp_numa_clear_job_run;
+   job.base.fence = lp_fence_create(1);
+   if (!job.base.fence) {
+      memset(lpr->tex_data, 0, lpr->total_alloc_size);
+      return;
+   }
+   job.numa = screen->numa;
+   job.num_threads = screen->num_threads;
+   job.lpr = lpr;
+
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_rast_queue_job(screen->rast, &job.base);
+   pipe_mutex_unlock(screen->rast_mutex);
+
+   lp_fence_wait(job.base.fence);
+   lp_fence_reference(&job.base.fence, NULL);
+}
+
+
 /**
  * Conventional allocation path for non-display textures:
  * Compute strides and allocate data (unless asked not to).
@@ -166,11 +382,29 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
       depth = u_minify(depth, 1);
    }
 
+   if (pt->nr_samples > 1) {
+      /* each sample gets a complete copy of the texture */
+      lpr->sample_stride = (unsigned)total_size;
+      total_size *= pt->nr_samples;
+      if (total_size > LP_MAX_TEXTURE_SIZE) {
+         goto fail;
+      }
+   }
+
    if (allocate) {
       lpr->tex_data = align_malloc(total_size, mip_align);
       if (!lpr->tex_data) {
          return FALSE;
       }
+
+      lpr->total_alloc_size = (unsigned)total_size;
+
+      if (screen->numa &&
+          (pt->bind & (PIPE_BIND_RENDER_TARGET |
+                       PIPE_BIND_DEPTH_STENCIL))) {
+         /* spread the pages over the nodes rasterizing each band */
+         llvmpipe_numa_clear(screen, lpr);
+      }
       else {
          memset(lpr->tex_data, 0, total_size);
       }
@@ -264,6 +498,8 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
          /* texture map */
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
+
+         lpr->tiled = llvmpipe_can_tile(screen, &lpr->base);
       }
    }
    else {
@@ -334,6 +570,17 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
       align_free(lpr->data);
    }
 
+   /* Scenes hold a reference to the resource as long as they use its
+    * storage, so there shouldn't be any old storage left.
+    */
+   assert(!lpr->retired);
+   while (lpr->retired) {
+      struct llvmpipe_retired_storage *retired = lpr->retired;
+      lpr->retired = retired->next;
+      align_free(retired->data);
+      FREE(retired);
+   }
+
 #ifdef DEBUG
    if (lpr->next)
       remove_from_list(lpr);
@@ -343,6 +590,29 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
 }
 
 
+/**
+ * Will a transfer overwrite all of the resource's contents?
+ */
+static boolean
+discards_whole_resource(const struct pipe_resource *resource,
+                        unsigned level,
+                        unsigned usage,
+                        const struct pipe_box *box)
+{
+   if (usage & PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE)
+      return TRUE;
+
+   return (usage & PIPE_TRANSFER_DISCARD_RANGE) &&
+          level == 0 &&
+          resource->last_level == 0 &&
+          box->x == 0 && box->y == 0 && box->z == 0 &&
+          box->width == resource->width0 &&
+          box->height == resource->height0 &&
+          box->depth == resource->depth0 &&
+          resource->array_size == 1;
+}
+
+
 /**
  * Map a resource for read/write.
  */
@@ -431,6 +701,249 @@ llvmpipe_resource_data(struct pipe_resource *resource)
 }
 
 
+/**
+ * Note that a scene uses the current storage of a resource (texels it
+ * samples or renders to) and return it.  The storage is kept alive until
+ * the matching llvmpipe_resource_storage_unref(), even when the resource
+ * gets renamed in the meantime.
+ */
+void *
+llvmpipe_resource_storage_ref(struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   void *storage;
+
+   /* display targets and user buffers are never renamed */
+   if (lpr->dt || lpr->userBuffer)
+      return NULL;
+
+   pipe_mutex_lock(screen->storage_mutex);
+   storage = llvmpipe_resource_is_texture(resource) ? lpr->tex_data : lpr->data;
+   lpr->storage_refs++;
+   pipe_mutex_unlock(screen->storage_mutex);
+
+   return storage;
+}
+
+
+void
+llvmpipe_resource_storage_unref(struct pipe_resource *resource,
+                                void *storage)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct llvmpipe_retired_storage **p;
+
+   if (!storage)
+      return;
+
+   pipe_mutex_lock(screen->storage_mutex);
+
+   if (storage == (llvmpipe_resource_is_texture(resource) ?
+                   lpr->tex_data : lpr->data)) {
+      assert(lpr->storage_refs > 0);
+      lpr->storage_refs--;
+   }
+   else {
+      for (p = &lpr->retired; *p; p = &(*p)->next) {
+         struct llvmpipe_retired_storage *retired = *p;
+
+         if (retired->data == storage) {
+            assert(retired->refs > 0);
+            if (--retired->refs == 0) {
+               *p = retired->next;
+               align_free(retired->data);
+               FREE(retired);
+            }
+            break;
+         }
+      }
+   }
+
+   pipe_mutex_unlock(screen->storage_mutex);
+}
+
+
+/**
+ * Note that a scene renders to the resource.  Resources which are
+ * rendered to are not renamed, as the rasterizer looks up their storage
+ * only when it starts on the scene.
+ */
+void
+llvmpipe_resource_fb_ref(struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+
+   pipe_mutex_lock(screen->storage_mutex);
+   lpr->fb_refs++;
+   pipe_mutex_unlock(screen->storage_mutex);
+}
+
+
+void
+llvmpipe_resource_fb_unref(struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+
+   pipe_mutex_lock(screen->storage_mutex);
+   assert(lpr->fb_refs > 0);
+   lpr->fb_refs--;
+   pipe_mutex_unlock(screen->storage_mutex);
+}
+
+
+/**
+ * Install new storage for a resource.  The old storage is freed, or when
+ * scenes still use it, when the last of them is done.
+ * \return FALSE, leaving the resource untouched, if scenes render to it
+ */
+static boolean
+llvmpipe_resource_set_storage(struct llvmpipe_resource *lpr, void *data)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lpr->base.screen);
+   struct llvmpipe_retired_storage *retired;
+   void **storage;
+
+   storage = llvmpipe_resource_is_texture(&lpr->base) ?
+             &lpr->tex_data : &lpr->data;
+
+   retired = CALLOC_STRUCT(llvmpipe_retired_storage);
+   if (!retired)
+      return FALSE;
+
+   pipe_mutex_lock(screen->storage_mutex);
+
+   if (lpr->fb_refs) {
+      pipe_mutex_unlock(screen->storage_mutex);
+      FREE(retired);
+      return FALSE;
+   }
+
+   retired->data = *storage;
+   retired->refs = lpr->storage_refs;
+   *storage = data;
+   lpr->storage_refs = 0;
+
+   if (retired->refs) {
+      retired->next = lpr->retired;
+      lpr->retired = retired;
+      retired = NULL;
+   }
+
+   pipe_mutex_unlock(screen->storage_mutex);
+
+   if (retired) {
+      /* nobody was using the old storage after all */
+      align_free(retired->data);
+      FREE(retired);
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Give a resource new storage with undefined contents, so that the app
+ * can overwrite it without waiting for the scenes which still use the
+ * old contents.  The old storage is freed when the last of them is done.
+ * \return FALSE if the resource can't be renamed
+ */
+boolean
+llvmpipe_resource_rename(struct pipe_resource *resource)
+{
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned size, alignment;
+   void *data;
+
+   if (lpr->dt || lpr->userBuffer ||
+       (resource->bind & PIPE_BIND_SHARED) ||
+       (resource->flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT))
+      return FALSE;
+
+   if (llvmpipe_resource_is_texture(resource)) {
+      size = lpr->total_alloc_size;
+      alignment = MAX2(64, util_cpu_caps.cacheline);
+   }
+   else {
+      size = resource->width0 + (LP_RASTER_BLOCK_SIZE - 1) * 4 * sizeof(float);
+      alignment = 64;
+   }
+
+   if (!size)
+      return FALSE;
+
+   data = align_malloc(size, alignment);
+   if (!data)
+      return FALSE;
+
+   if (!llvmpipe_resource_set_storage(lpr, data)) {
+      align_free(data);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+/**
+ * Switch a tiled texture to the linear layout for good, because it is
+ * about to be used in a way only the linear layout supports: rendered to,
+ * or sampled by the draw module.  Scenes still sampling from the tiled
+ * storage keep it until they are done, with the shader variants they
+ * were binned with.
+ */
+void
+llvmpipe_resource_untile(struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   unsigned level;
+   void *data;
+
+   if (!lpr->tiled)
+      return;
+
+   data = align_malloc(lpr->total_alloc_size,
+                       MAX2(64, util_cpu_caps.cacheline));
+   if (!data) {
+      debug_printf("llvmpipe: out of memory untiling texture %u\n", lpr->id);
+      return;
+   }
+
+   for (level = 0; level <= resource->last_level; level++) {
+      struct pipe_box box;
+
+      u_box_3d(0, 0, 0,
+               u_minify(resource->width0, level),
+               u_minify(resource->height0, level),
+               resource->target == PIPE_TEXTURE_3D ?
+                  u_minify(resource->depth0, level) : resource->array_size,
+               &box);
+
+      copy_tiled_box(lpr, lpr->tex_data, level, &box,
+                     (ubyte *) data + lpr->mip_offsets[level],
+                     lpr->row_stride[level],
+                     lpr->img_stride[level],
+                     FALSE);
+   }
+
+   /* tiled textures are never rendered to */
+   if (!llvmpipe_resource_set_storage(lpr, data)) {
+      assert(0);
+      align_free(data);
+      return;
+   }
+
+   lpr->tiled = FALSE;
+
+   /* make the contexts pick shader variants sampling the linear layout */
+   screen->timestamp++;
+}
+
+
 static struct pipe_resource *
 llvmpipe_resource_from_handle(struct pipe_screen *screen,
                               const struct pipe_resource *template,
@@ -522,19 +1035,30 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
    assert(resource);
    assert(level <= resource->last_level);
 
+   if (lpr->tiled && (usage & PIPE_TRANSFER_MAP_DIRECTLY))
+      return NULL;
+
    /*
     * Transfers, like other pipe operations, must happen in order, so flush the
-    * context if necessary.
+    * context if necessary.  When the whole resource gets overwritten while
+    * scenes are still sampling from it, give it new storage instead.
     */
    if (!(usage & PIPE_TRANSFER_UNSYNCHRONIZED)) {
       boolean read_only = !(usage & PIPE_TRANSFER_WRITE);
       boolean do_not_block = !!(usage & PIPE_TRANSFER_DONTBLOCK);
-      if (!llvmpipe_flush_resource(pipe, resource,
-                                   level,
-                                   read_only,
-                                   TRUE, /* cpu_access */
-                                   do_not_block,
-                                   __FUNCTION__)) {
+      if (screen->num_scenes > 1 &&
+          discards_whole_resource(resource, level, usage, box) &&
+          llvmpipe_is_resource_referenced(pipe, resource, level) ==
+             LP_REFERENCED_FOR_READ &&
+          llvmpipe_resource_rename(resource)) {
+         /* the scenes keep the old contents */
+      }
+      else if (!llvmpipe_flush_resource(pipe, resource,
+                                        level,
+                                        read_only,
+                                        TRUE, /* cpu_access */
+                                        do_not_block,
+                                        __FUNCTION__)) {
          /*
           * It would have blocked, but state tracker requested no to.
           */
@@ -543,6 +1067,10 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
       }
    }
 
+   if (usage & PIPE_TRANSFER_WRITE) {
+      lpr->content_seqno++;
+   }
+
    /* Check if we're mapping a current constant buffer */
    if ((usage & PIPE_TRANSFER_WRITE) &&
        (resource->bind & PIPE_BIND_CONSTANT_BUFFER)) {
@@ -593,11 +1121,41 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
 
    format = lpr->base.format;
 
+   if (lpr->tiled) {
+      /* hand out a linear copy of the box, tiled again on unmap */
+      pt->stride = box->width * util_format_get_blocksize(format);
+      pt->layer_stride = pt->stride * box->height;
+
+      lpt->staging = MALLOC(pt->layer_stride * box->depth);
+      if (!lpt->staging) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         *transfer = NULL;
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE))) {
+         copy_tiled_box(lpr, lpr->tex_data, level, box, lpt->staging,
+                        pt->stride, pt->layer_stride, FALSE);
+      }
+
+      if (usage & PIPE_TRANSFER_WRITE) {
+         screen->timestamp++;
+      }
+
+      return lpt->staging;
+   }
+
    map = llvmpipe_resource_map(resource,
                                level,
                                box->z,
                                tex_usage);
 
+   if ((usage & PIPE_TRANSFER_PERSISTENT) && (usage & PIPE_TRANSFER_WRITE)) {
+      p_atomic_inc(&lpr->persistent_write_maps);
+   }
+
 
    /* May want to do different things here depending on read/write nature
     * of the map:
@@ -620,16 +1178,34 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = (struct llvmpipe_transfer *) transfer;
+
    assert(transfer->resource);
 
-   llvmpipe_resource_unmap(transfer->resource,
-                           transfer->level,
-                           transfer->box.z);
+   if (lpt->staging) {
+      if (transfer->usage & PIPE_TRANSFER_WRITE) {
+         struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+
+         copy_tiled_box(lpr, lpr->tex_data, transfer->level, &transfer->box,
+                        lpt->staging, transfer->stride,
+                        transfer->layer_stride, TRUE);
+      }
+      FREE(lpt->staging);
+   }
+   else {
+      llvmpipe_resource_unmap(transfer->resource,
+                              transfer->level,
+                              transfer->box.z);
+
+      if ((transfer->usage & PIPE_TRANSFER_PERSISTENT) &&
+          (transfer->usage & PIPE_TRANSFER_WRITE)) {
+         struct llvmpipe_resource *lpr = llvmpipe_resource(transfer->resource);
+
+         assert(lpr->persistent_write_maps > 0);
+         p_atomic_dec(&lpr->persistent_write_maps);
+      }
+   }
 
-   /* Effectively do the texture_update work here - if texture images
-    * needed post-processing to put them into hardware layout, this is
-    * where it would happen.  For llvmpipe, nothing to do.
-    */
    assert (transfer->resource);
    pipe_resource_reference(&transfer->resource, NULL);
    FREE(transfer);
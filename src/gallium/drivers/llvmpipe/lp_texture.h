@@ -47,6 +47,7 @@ struct pipe_screen;
 struct llvmpipe_context;
 
 struct sw_displaytarget;
+struct llvmpipe_retired_storage;
 
 
 /**
@@ -68,6 +69,12 @@ struct llvmpipe_resource
    unsigned mip_offsets[LP_MAX_TEXTURE_LEVELS];
    /** allocated total size (for non-display target texture resources only) */
    unsigned total_alloc_size;
+   /**
+    * Offset between the copies of the mipmap tree holding each sample of
+    * a multisample resource, in bytes.  The first copy is sample 0, which
+    * is what transfers and sampler views see.
+    */
+   unsigned sample_stride;
 
    /**
     * Display target, for textures with the PIPE_BIND_DISPLAY_TARGET
@@ -85,9 +92,33 @@ struct llvmpipe_resource
     */
    void *data;
 
+   /**
+    * Whether tex_data is stored in 4x4 texel tiles rather than linearly,
+    * see llvmpipe_resource_untile().
+    */
+   boolean tiled;
+
    boolean userBuffer;  /** Is this a user-space buffer? */
    unsigned timestamp;
 
+   /**
+    * Incremented by every mapping for writing, so that data derived from
+    * the contents can tell when it is stale.
+    */
+   unsigned content_seqno;
+   /**
+    * Number of persistent mappings for writing.  While there are any, the
+    * contents may change without content_seqno changing.
+    */
+   unsigned persistent_write_maps;
+
+   /** Number of scenes sampling from the current tex_data/data */
+   unsigned storage_refs;
+   /** Number of scenes rendering to the resource */
+   unsigned fb_refs;
+   /** Storage replaced by llvmpipe_resource_rename() still used by scenes */
+   struct llvmpipe_retired_storage *retired;
+
    unsigned id;  /**< temporary, for debugging */
 
 #ifdef DEBUG
@@ -97,11 +128,26 @@ struct llvmpipe_resource
 };
 
 
+/**
+ * Old storage of a renamed resource, freed when the last scene using it
+ * is done.
+ */
+struct llvmpipe_retired_storage
+{
+   void *data;
+   unsigned refs;
+   struct llvmpipe_retired_storage *next;
+};
+
+
 struct llvmpipe_transfer
 {
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the box of a tiled texture */
+   void *staging;
 };
 
 
@@ -215,6 +261,26 @@ unsigned
 llvmpipe_resource_size(const struct pipe_resource *resource);
 
 
+void *
+llvmpipe_resource_storage_ref(struct pipe_resource *resource);
+
+void
+llvmpipe_resource_storage_unref(struct pipe_resource *resource,
+                                void *storage);
+
+void
+llvmpipe_resource_fb_ref(struct pipe_resource *resource);
+
+void
+llvmpipe_resource_fb_unref(struct pipe_resource *resource);
+
+boolean
+llvmpipe_resource_rename(struct pipe_resource *resource);
+
+void
+llvmpipe_resource_untile(struct pipe_resource *resource);
+
+
 ubyte *
 llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
                                    unsigned face_slice, unsigned level);
@@ -31,6 +31,7 @@
 #include "archrast/archrast.h"
 #include "archrast/eventmanager.h"
 #include "gen_ar_eventhandlerfile.h"
+#include "gen_ar_eventhandlertrace.h"
 
 namespace ArchRast
 {
@@ -60,7 +61,16 @@ namespace ArchRast
         uint32_t id = counter.fetch_add(1);
 
         EventManager* pManager = new EventManager();
-        EventHandler* pHandler = new EventHandlerStatsFile(id);
+        EventHandler* pHandler;
+
+        if (KNOB_AR_TRACE)
+        {
+            pHandler = new EventHandlerTraceFile(id);
+        }
+        else
+        {
+            pHandler = new EventHandlerStatsFile(id);
+        }
 
         if (pManager && pHandler)
         {
@@ -82,7 +92,7 @@ namespace ArchRast
     }
 
     // Dispatch event for this thread.
-    void dispatch(HANDLE hThreadContext, Event& event)
+    void dispatch(HANDLE hThreadContext, Event&& event)
     {
         EventManager* pManager = FromHandle(hThreadContext);
         SWR_ASSERT(pManager != nullptr);
@@ -43,6 +43,15 @@ namespace ArchRast
     class EventManager
     {
     public:
+        ~EventManager()
+        {
+            // Handlers are owned by the manager, this closes their files.
+            for (auto pHandler : mHandlers)
+            {
+                delete pHandler;
+            }
+        }
+
         void attach(EventHandler* pHandler)
         {
             mHandlers.push_back(pHandler);
@@ -26,6 +26,7 @@
 *
 ******************************************************************************/
 
+#include <algorithm>
 #include <cfloat>
 #include <cmath>
 #include <cstdio>
@@ -76,6 +77,12 @@ HANDLE SwrCreateContext(
     pContext->driverType = pCreateInfo->driver;
     pContext->privateStateSize = pCreateInfo->privateStateSize;
 
+    pContext->batch.pState = (API_STATE*)AlignedMalloc(sizeof(API_STATE), 64);
+    if (pContext->privateStateSize)
+    {
+        pContext->batch.pPrivateState = (uint8_t*)AlignedMalloc(pContext->privateStateSize, KNOB_SIMD_WIDTH*sizeof(float));
+    }
+
     pContext->dcRing.Init(KNOB_MAX_DRAWS_IN_FLIGHT);
     pContext->dsRing.Init(KNOB_MAX_DRAWS_IN_FLIGHT);
 
@@ -126,11 +133,11 @@ HANDLE SwrCreateContext(
         uint32_t numaNode = pContext->threadPool.pThreadData ?
             pContext->threadPool.pThreadData[i].numaId : 0;
         pContext->ppScratch[i] = (uint8_t*)VirtualAllocExNuma(
-            GetCurrentProcess(), nullptr, 32 * sizeof(KILOBYTE),
+            GetCurrentProcess(), nullptr, SWR_CS_SHARED_MEM_SIZE,
             MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE,
             numaNode);
 #else
-        pContext->ppScratch[i] = (uint8_t*)AlignedMalloc(32 * sizeof(KILOBYTE), KNOB_SIMD_WIDTH * 4);
+        pContext->ppScratch[i] = (uint8_t*)AlignedMalloc(SWR_CS_SHARED_MEM_SIZE, KNOB_SIMD_WIDTH * 4);
 #endif
 
 #if KNOB_ENABLE_AR
@@ -248,8 +255,21 @@ INLINE void QueueDispatch(SWR_CONTEXT* pContext)
     QueueWork<false>(pContext);
 }
 
-DRAW_CONTEXT* GetDrawContext(SWR_CONTEXT *pContext, bool isSplitDraw = false)
+void CloseDrawBatch(SWR_CONTEXT *pContext);
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Returns the current draw context, obtaining a new one from the
+///        ring if needed.
+/// @param isSplitDraw - New draw context is for a later part of a split draw.
+/// @param keepBatch - Setting state does not close the open batch of small
+///        draws, see CloseDrawBatch.  Everything else queues it first.
+DRAW_CONTEXT* GetDrawContext(SWR_CONTEXT *pContext, bool isSplitDraw = false, bool keepBatch = false)
 {
+    if (pContext->batch.isOpen && !keepBatch)
+    {
+        CloseDrawBatch(pContext);
+    }
+
     AR_API_BEGIN(APIGetDrawContext, 0);
     // If current draw context is null then need to obtain a new draw context to use from ring.
     if (pContext->pCurDrawContext == nullptr)
@@ -340,9 +360,86 @@ DRAW_CONTEXT* GetDrawContext(SWR_CONTEXT *pContext, bool isSplitDraw = false)
     return pContext->pCurDrawContext;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief Checks whether the state of the current draw context is still the
+///        state the draws of the open batch were issued with.
+bool BatchStateMatches(SWR_CONTEXT *pContext)
+{
+    const DRAW_BATCH& batch = pContext->batch;
+    const DRAW_STATE* pState = pContext->pCurDrawContext->pState;
+
+    if (memcmp(&pState->state, batch.pState, sizeof(API_STATE)) != 0)
+    {
+        return false;
+    }
+
+    if (pContext->privateStateSize == 0)
+    {
+        return true;
+    }
+
+    if ((pState->pPrivateState != nullptr) != batch.hasPrivateState)
+    {
+        return false;
+    }
+
+    return !batch.hasPrivateState ||
+        memcmp(pState->pPrivateState, batch.pPrivateState, pContext->privateStateSize) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Queues the open batch of small draws.
+///        State calls made since the batch was opened went to the batch's
+///        draw context.  If they changed anything, the batched draws get
+///        their own state back and the new state moves on to the next
+///        draw context.
+void CloseDrawBatch(SWR_CONTEXT *pContext)
+{
+    DRAW_BATCH& batch = pContext->batch;
+    DRAW_STATE* pState = pContext->pCurDrawContext->pState;
+
+    SWR_ASSERT(batch.isOpen);
+    batch.isOpen = false;
+
+    bool hasPrivateState = pContext->privateStateSize && pState->pPrivateState != nullptr;
+    bool stateChanged = !BatchStateMatches(pContext);
+
+    if (stateChanged)
+    {
+        // Swap the new state into the batch buffers.
+        uint8_t* pApiState = (uint8_t*)&pState->state;
+        std::swap_ranges(pApiState, pApiState + sizeof(API_STATE), (uint8_t*)batch.pState);
+
+        if (batch.hasPrivateState)
+        {
+            uint8_t* pPrivateState = (uint8_t*)pState->pPrivateState;
+            std::swap_ranges(pPrivateState, pPrivateState + pContext->privateStateSize, batch.pPrivateState);
+        }
+        else if (hasPrivateState)
+        {
+            memcpy(batch.pPrivateState, pState->pPrivateState, pContext->privateStateSize);
+            pState->pPrivateState = nullptr;
+        }
+    }
+
+    QueueDraw(pContext);
+
+    if (stateChanged)
+    {
+        DRAW_CONTEXT* pDC = GetDrawContext(pContext);
+        memcpy(&pDC->pState->state, batch.pState, sizeof(API_STATE));
+
+        if (hasPrivateState)
+        {
+            pDC->pState->pPrivateState = pDC->pState->pArena->AllocAligned(pContext->privateStateSize, KNOB_SIMD_WIDTH*sizeof(float));
+            memcpy(pDC->pState->pPrivateState, batch.pPrivateState, pContext->privateStateSize);
+        }
+    }
+}
+
 API_STATE* GetDrawState(SWR_CONTEXT *pContext)
 {
-    DRAW_CONTEXT* pDC = GetDrawContext(pContext);
+    DRAW_CONTEXT* pDC = GetDrawContext(pContext, false, true);
     SWR_ASSERT(pDC->pState != nullptr);
 
     return &pDC->pState->state;
@@ -388,12 +485,22 @@ void SwrDestroyContext(HANDLE hContext)
 #endif
     }
 
+#if KNOB_ENABLE_AR
+    ArchRast::DestroyThreadContext(pContext->pArContext[pContext->NumWorkerThreads]);
+#endif
+
     delete[] pContext->ppScratch;
     delete[] pContext->pArContext;
     delete[] pContext->pStats;
 
     delete(pContext->pHotTileMgr);
 
+    AlignedFree(pContext->batch.pState);
+    if (pContext->batch.pPrivateState)
+    {
+        AlignedFree(pContext->batch.pPrivateState);
+    }
+
     pContext->~SWR_CONTEXT();
     AlignedFree(GetContext(hContext));
 }
@@ -464,6 +571,11 @@ void SwrWaitForIdle(HANDLE hContext)
 
     AR_API_BEGIN(APIWaitForIdle, 0);
 
+    if (pContext->batch.isOpen)
+    {
+        CloseDrawBatch(pContext);
+    }
+
     while (!pContext->dcRing.IsEmpty())
     {
         _mm_pause();
@@ -478,6 +590,11 @@ void SwrWaitForIdleFE(HANDLE hContext)
 
     AR_API_BEGIN(APIWaitForIdle, 0);
 
+    if (pContext->batch.isOpen)
+    {
+        CloseDrawBatch(pContext);
+    }
+
     while (pContext->drawsOutstandingFE > 0)
     {
         _mm_pause();
@@ -486,6 +603,13 @@ void SwrWaitForIdleFE(HANDLE hContext)
     AR_API_END(APIWaitForIdle, 1);
 }
 
+bool SwrIsIdleFE(HANDLE hContext)
+{
+    SWR_CONTEXT *pContext = GetContext(hContext);
+
+    return pContext->drawsOutstandingFE == 0;
+}
+
 void SwrSetVertexBuffers(
     HANDLE hContext,
     uint32_t numBuffers,
@@ -1008,6 +1132,36 @@ void InitDraw(
     }
 }
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief Split size for list topologies.  Spreads the draw across the FE
+///        threads that are idle, in parts of at least KNOB_MIN_PRIMS_PER_DRAW
+///        and at most KNOB_MAX_PRIMS_PER_DRAW.
+/// @param totalVerts - Total vertices for draw
+/// @param vertsPerPrim - Vertices per primitive of the list topology
+uint32_t BalancedVertsPerDraw(
+    SWR_CONTEXT* pContext,
+    uint32_t totalVerts,
+    uint32_t vertsPerPrim)
+{
+    if (KNOB_MIN_PRIMS_PER_DRAW == 0 || pContext->threadInfo.SINGLE_THREADED)
+    {
+        return KNOB_MAX_PRIMS_PER_DRAW;
+    }
+
+    // FE threads not busy with a queued draw.
+    uint32_t drawsOutstanding = pContext->drawsOutstandingFE;
+    uint32_t idleThreads = (pContext->NumFEThreads > drawsOutstanding) ?
+        pContext->NumFEThreads - drawsOutstanding : 1;
+
+    // Keep parts a multiple of full SIMD primitive batches.
+    uint32_t granularity = vertsPerPrim * KNOB_SIMD_WIDTH;
+    uint32_t minVerts = KNOB_MIN_PRIMS_PER_DRAW * vertsPerPrim;
+    uint32_t vertsPerDraw = std::max((totalVerts + idleThreads - 1) / idleThreads, minVerts);
+    vertsPerDraw = (vertsPerDraw + granularity - 1) / granularity * granularity;
+
+    return std::min(vertsPerDraw, (uint32_t)KNOB_MAX_PRIMS_PER_DRAW);
+}
+
 //////////////////////////////////////////////////////////////////////////
 /// @brief We can split the draw for certain topologies for better performance.
 /// @param totalVerts - Total vertices for draw
@@ -1029,8 +1183,11 @@ uint32_t MaxVertsPerDraw(
     switch (topology)
     {
     case TOP_POINT_LIST:
+        vertsPerDraw = BalancedVertsPerDraw(pDC->pContext, totalVerts, 1);
+        break;
+
     case TOP_TRIANGLE_LIST:
-        vertsPerDraw = KNOB_MAX_PRIMS_PER_DRAW;
+        vertsPerDraw = BalancedVertsPerDraw(pDC->pContext, totalVerts, 3);
         break;
 
     case TOP_PATCHLIST_1:
@@ -1086,6 +1243,112 @@ uint32_t MaxVertsPerDraw(
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief Adds a small draw to the open batch, or opens a new batch for it.
+///        Batching only pays off while the FE threads have queued work, so
+///        otherwise the draw is not batched.
+/// @param isIndexed - Draw is indexed.
+/// @param work - The draw.
+/// @param numPrims - Primitives of the draw, for all instances.
+/// @return false if the caller has to queue the draw itself.
+bool BatchDraw(
+    SWR_CONTEXT* pContext,
+    bool isIndexed,
+    DRAW_WORK& work,
+    uint32_t numPrims)
+{
+    DRAW_BATCH& batch = pContext->batch;
+    DRAW_CONTEXT* pDC = pContext->pCurDrawContext;
+
+    if (batch.isOpen && BatchStateMatches(pContext))
+    {
+        // Same state, so the pipeline set up for the batch applies.
+        const API_STATE& state = pDC->pState->state;
+        PFN_FE_WORK_FUNC pfnDraw = GetProcessDrawFunc(
+            isIndexed,
+            isIndexed && state.frontendState.bEnableCutIndex,
+            state.tsState.tsEnable,
+            state.gsState.gsEnable,
+            state.soState.soEnable,
+            pDC->pState->pfnProcessPrims != nullptr);
+
+        DRAW_BATCH_DESC& desc = pDC->FeWork.desc.batch;
+        if (desc.pfnDraw == pfnDraw)
+        {
+            work.pDC = pDC;
+            desc.pDraws[desc.numDraws++] = work;
+            batch.numPrims += numPrims;
+
+            if (batch.numPrims >= KNOB_MIN_PRIMS_PER_DRAW ||
+                desc.numDraws == KNOB_MIN_PRIMS_PER_DRAW ||
+                pContext->drawsOutstandingFE == 0)
+            {
+                CloseDrawBatch(pContext);
+            }
+            return true;
+        }
+    }
+
+    if (batch.isOpen)
+    {
+        CloseDrawBatch(pContext);
+    }
+
+    if (pContext->drawsOutstandingFE == 0)
+    {
+        return false;
+    }
+
+    pDC = GetDrawContext(pContext);
+    InitDraw(pDC, false);
+
+    const API_STATE& state = pDC->pState->state;
+    DRAW_BATCH_DESC& desc = pDC->FeWork.desc.batch;
+
+    pDC->FeWork.type = DRAW;
+    pDC->FeWork.pfnWork = ProcessDrawBatch;
+    desc.pfnDraw = GetProcessDrawFunc(
+        isIndexed,
+        isIndexed && state.frontendState.bEnableCutIndex,
+        state.tsState.tsEnable,
+        state.gsState.gsEnable,
+        state.soState.soEnable,
+        pDC->pState->pfnProcessPrims != nullptr);
+    desc.pDraws = (DRAW_WORK*)pDC->pArena->AllocAligned(sizeof(DRAW_WORK) * KNOB_MIN_PRIMS_PER_DRAW, 64);
+    desc.numDraws = 1;
+
+    work.pDC = pDC;
+    desc.pDraws[0] = work;
+
+    pDC->cleanupState = true;
+
+    // Snapshot the state the batched draws are issued with.
+    batch.isOpen = true;
+    batch.numPrims = numPrims;
+    memcpy(batch.pState, &pDC->pState->state, sizeof(API_STATE));
+    batch.hasPrivateState = pContext->privateStateSize && pDC->pState->pPrivateState != nullptr;
+    if (batch.hasPrivateState)
+    {
+        memcpy(batch.pPrivateState, pDC->pState->pPrivateState, pContext->privateStateSize);
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Checks whether a draw is small enough to batch.
+/// @param numPrims - Primitives of the draw, for all instances.
+bool IsBatchableDraw(
+    const API_STATE& state,
+    uint32_t numPrims)
+{
+    // Stream out and the GS/tessellation stages are left to the unbatched path.
+    return numPrims < KNOB_MIN_PRIMS_PER_DRAW &&
+        !state.soState.soEnable &&
+        !state.gsState.gsEnable &&
+        !state.tsState.tsEnable;
+}
+
 //////////////////////////////////////////////////////////////////////////
 /// @brief DrawInstanced
 /// @param hContext - Handle passed back from SwrCreateContext
@@ -1108,7 +1371,7 @@ void DrawInstanced(
     }
 
     SWR_CONTEXT *pContext = GetContext(hContext);
-    DRAW_CONTEXT* pDC = GetDrawContext(pContext);
+    DRAW_CONTEXT* pDC = GetDrawContext(pContext, false, true);
 
     AR_API_BEGIN(APIDraw, pDC->drawId);
     AR_API_EVENT(DrawInstancedEvent(pDC->drawId, topology, numVertices, startVertex, numInstances, startInstance));
@@ -1133,6 +1396,27 @@ void DrawInstanced(
         pState->rastState.cullMode = SWR_CULLMODE_NONE;
     }
 
+    uint32_t numPrims = GetNumPrims(topology, numVertices) * numInstances;
+    if (numVertices && numVertices <= maxVertsPerDraw && IsBatchableDraw(*pState, numPrims))
+    {
+        DRAW_WORK work = {};
+        work.numVerts = numVertices;
+        work.startVertex = startVertex;
+        work.numInstances = numInstances;
+        work.startInstance = startInstance;
+
+        if (BatchDraw(pContext, false, work, numPrims))
+        {
+            remainingVerts = 0;
+        }
+    }
+
+    if (remainingVerts)
+    {
+        // Queues the open batch, so the state may have moved to a new draw context.
+        pState = &GetDrawContext(pContext)->pState->state;
+    }
+
     int draw = 0;
     while (remainingVerts)
     {
@@ -1168,7 +1452,7 @@ void DrawInstanced(
     }
 
     // restore culling state
-    pDC = GetDrawContext(pContext);
+    pDC = GetDrawContext(pContext, false, true);
     pDC->pState->state.rastState.cullMode = oldCullMode;
 
     AR_API_END(APIDraw, numVertices * numInstances);
@@ -1233,7 +1517,7 @@ void DrawIndexedInstance(
     }
 
     SWR_CONTEXT *pContext = GetContext(hContext);
-    DRAW_CONTEXT* pDC = GetDrawContext(pContext);
+    DRAW_CONTEXT* pDC = GetDrawContext(pContext, false, true);
     API_STATE* pState = &pDC->pState->state;
 
     AR_API_BEGIN(APIDrawIndexed, pDC->drawId);
@@ -1272,6 +1556,29 @@ void DrawIndexedInstance(
         pState->rastState.cullMode = SWR_CULLMODE_NONE;
     }
 
+    uint32_t numPrims = GetNumPrims(topology, numIndices) * numInstances;
+    if (numIndices && numIndices <= maxIndicesPerDraw && IsBatchableDraw(*pState, numPrims))
+    {
+        DRAW_WORK work = {};
+        work.numIndices = numIndices;
+        work.pIB = (int*)pIB;
+        work.type = pState->indexBuffer.format;
+        work.numInstances = numInstances;
+        work.startInstance = startInstance;
+        work.baseVertex = baseVertex;
+
+        if (BatchDraw(pContext, true, work, numPrims))
+        {
+            remainingIndices = 0;
+        }
+    }
+
+    if (remainingIndices)
+    {
+        // Queues the open batch, so the state may have moved to a new draw context.
+        pState = &GetDrawContext(pContext)->pState->state;
+    }
+
     while (remainingIndices)
     {
         uint32_t numIndicesForDraw = (remainingIndices < maxIndicesPerDraw) ?
@@ -1311,7 +1618,7 @@ void DrawIndexedInstance(
     }
 
     // restore culling state
-    pDC = GetDrawContext(pContext);
+    pDC = GetDrawContext(pContext, false, true);
     pDC->pState->state.rastState.cullMode = oldCullMode;
 
     AR_API_END(APIDrawIndexed, numIndices * numInstances);
@@ -1550,7 +1857,7 @@ VOID* SwrGetPrivateContextState(
     HANDLE hContext)
 {
     SWR_CONTEXT* pContext = GetContext(hContext);
-    DRAW_CONTEXT* pDC = GetDrawContext(pContext);
+    DRAW_CONTEXT* pDC = GetDrawContext(pContext, false, true);
     DRAW_STATE* pState = pDC->pState;
 
     if (pState->pPrivateState == nullptr)
@@ -274,6 +274,12 @@ void SWR_API SwrWaitForIdle(
 void SWR_API SwrWaitForIdleFE(
     HANDLE hContext);
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief Returns true if no draw has FE work outstanding.
+/// @param hContext - Handle passed back from SwrCreateContext
+bool SWR_API SwrIsIdleFE(
+    HANDLE hContext);
+
 //////////////////////////////////////////////////////////////////////////
 /// @brief Set vertex buffer state.
 /// @param hContext - Handle passed back from SwrCreateContext
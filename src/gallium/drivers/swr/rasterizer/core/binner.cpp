@@ -544,6 +544,9 @@ void BinTriangles(
     {
         triMask &= ~cullZeroAreaMask;
     }
+#if defined(KNOB_ENABLE_AR)
+    uint32_t degenerateTriMask = origTriMask & ~triMask;
+#endif
 
     // determine front winding tris
     // CW  +det
@@ -576,6 +579,9 @@ void BinTriangles(
 
     triMask &= ~cullTris;
 
+    AR_EVENT(CullInfoEvent(pDC->drawId, origTriMask, degenerateTriMask,
+        origTriMask & ~triMask & ~degenerateTriMask));
+
     if (origTriMask ^ triMask)
     {
         RDTSC_EVENT(FECullZeroAreaAndBackface, _mm_popcnt_u32(origTriMask ^ triMask), 0);
@@ -197,6 +197,19 @@ struct DRAW_WORK
 };
 
 typedef void(*PFN_FE_WORK_FUNC)(SWR_CONTEXT* pContext, DRAW_CONTEXT* pDC, uint32_t workerId, void* pDesc);
+
+//////////////////////////////////////////////////////////////////////////
+/// DRAW_BATCH_DESC
+/// @brief Consecutive small draws with identical state, queued as one
+/// draw context.
+/////////////////////////////////////////////////////////////////////////
+struct DRAW_BATCH_DESC
+{
+    PFN_FE_WORK_FUNC pfnDraw;       // FE function of each draw
+    DRAW_WORK* pDraws;              // allocated in the DC arena
+    uint32_t numDraws;
+};
+
 struct FE_WORK
 {
     WORK_TYPE type;
@@ -205,6 +218,7 @@ struct FE_WORK
     {
         SYNC_DESC sync;
         DRAW_WORK draw;
+        DRAW_BATCH_DESC batch;
         CLEAR_DESC clear;
         DISCARD_INVALIDATE_TILES_DESC discardInvalidateTiles;
         STORE_TILES_DESC storeTiles;
@@ -437,6 +451,19 @@ INLINE void* GetPrivateState(const DRAW_CONTEXT* pDC)
 
 class HotTileMgr;
 
+//////////////////////////////////////////////////////////////////////////
+/// DRAW_BATCH
+/// @brief Batch of small draws being collected in pCurDrawContext.
+/////////////////////////////////////////////////////////////////////////
+struct DRAW_BATCH
+{
+    bool isOpen;
+    uint32_t numPrims;
+    API_STATE* pState;              // state the batched draws were issued with
+    uint8_t* pPrivateState;         // and their private state
+    bool hasPrivateState;
+};
+
 struct SWR_CONTEXT
 {
     // Draw Context Ring
@@ -460,6 +487,14 @@ struct SWR_CONTEXT
     DRAW_CONTEXT *pCurDrawContext;    // This points to DC entry in ring for an unsubmitted draw.
     DRAW_CONTEXT *pPrevDrawContext;   // This points to DC entry for the previous context submitted that we can copy state from.
 
+    // Draw Batching
+    //  Consecutive small draws are collected in pCurDrawContext instead of taking a DC each.
+    //  State calls in between still set state on pCurDrawContext.  The next draw joins the
+    //  batch if the state is still identical to that of the batched draws, otherwise the
+    //  batch is queued with its own state and the new state moves on to the next DC.
+    //  Any other work queued closes the batch first.
+    DRAW_BATCH batch;
+
     MacroTileMgr* pMacroTileManagerArray;
     DispatchQueue* pDispatchQueueArray;
 
@@ -99,6 +99,27 @@ void ProcessShutdown(
     }
 }
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief FE handler for a batch of small draws with identical state.
+///        Runs the draws in order, so their primitives are binned in order.
+/// @param pContext - pointer to SWR context.
+/// @param pDC - pointer to draw context.
+/// @param workerId - thread's worker id. Even thread has a unique id.
+/// @param pUserData - Pointer to DRAW_BATCH_DESC
+void ProcessDrawBatch(
+    SWR_CONTEXT *pContext,
+    DRAW_CONTEXT *pDC,
+    uint32_t workerId,
+    void *pUserData)
+{
+    DRAW_BATCH_DESC *pBatch = (DRAW_BATCH_DESC*)pUserData;
+
+    for (uint32_t i = 0; i < pBatch->numDraws; ++i)
+    {
+        pBatch->pfnDraw(pContext, pDC, workerId, &pBatch->pDraws[i]);
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////
 /// @brief FE handler for SwrClearRenderTarget.
 /// @param pContext - pointer to SWR context.
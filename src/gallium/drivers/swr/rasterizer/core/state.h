@@ -344,6 +344,11 @@ struct SWR_PS_CONTEXT
 
 };
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief Size in bytes of the thread group shared memory, which is the
+///        per worker scratch space (SWR_CS_CONTEXT::pTGSM).
+#define SWR_CS_SHARED_MEM_SIZE (32 * 1024)
+
 //////////////////////////////////////////////////////////////////////////
 /// SWR_CS_CONTEXT
 /// @brief Input to compute shader.
@@ -526,6 +526,7 @@ bool WorkOnFifoBE(
                     pWork->pfnWork(pDC, workerId, tileID, &pWork->desc);
                     tile->dequeue();
                 }
+                AR_EVENT(MacroTileEvent(pDC->drawId, x, y, numWorkItems));
                 AR_END(WorkerFoundWork, numWorkItems);
 
                 _ReadWriteBarrier();
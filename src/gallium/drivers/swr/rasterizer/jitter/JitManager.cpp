@@ -45,6 +45,7 @@
 
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/MD5.h"
 
 #include "llvm/Analysis/CFGPrinter.h"
 #include "llvm/IRReader/IRReader.h"
@@ -71,6 +72,9 @@
 #define JITTER_OUTPUT_DIR SWR_OUTPUT_DIR "\\Jitter"
 #endif
 
+// Bump when the naming of the cache entries changes
+#define JIT_CACHE_VERSION 1
+
 using namespace llvm;
 using namespace SwrJit;
 
@@ -78,7 +82,7 @@ using namespace SwrJit;
 /// @brief Contructor for JitManager.
 /// @param simdWidth - SIMD width to be used in generated program.
 JitManager::JitManager(uint32_t simdWidth, const char *arch, const char* core)
-    : mContext(), mBuilder(mContext), mIsModuleFinalized(true), mJitNumber(0), mVWidth(simdWidth), mArch(arch)
+    : mContext(), mBuilder(mContext), mIsModuleFinalized(true), mJitNumber(0), mpCache(nullptr), mVWidth(simdWidth), mArch(arch)
 {
     InitializeNativeTarget();
     InitializeNativeTargetAsmPrinter();
@@ -124,6 +128,12 @@ JitManager::JitManager(uint32_t simdWidth, const char *arch, const char* core)
 
     mpExec = EB.create();
 
+    if (!KNOB_JIT_CACHE_DIR.empty())
+    {
+        mpCache = new JitCache(KNOB_JIT_CACHE_DIR);
+        mpExec->setObjectCache(mpCache);
+    }
+
 #if LLVM_USE_INTEL_JITEVENTS
     JITEventListener *vTune = JITEventListener::createIntelJITEventListener();
     mpExec->RegisterJITEventListener(vTune);
@@ -229,6 +239,143 @@ bool JitManager::SetupModuleFromIR(const uint8_t *pIR)
     return true;
 }
 
+//////////////////////////////////////////////////////////////////////////
+/// @brief Look up the object code of the current module in the on-disk
+///        cache.  Must be called on the complete module, before it is
+///        optimized.
+/// @return true if found, the module then needs no optimization.
+bool JitManager::LookupCache()
+{
+    if (mpCache == nullptr)
+    {
+        return false;
+    }
+
+    return mpCache->Lookup(mpCurrentModule, CodeGenOpt::Aggressive);
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Hash the module and look up its object code.  Renames the
+///        functions of the module after the hash, as their names carry
+///        per-process counters.
+/// @param pModule - complete, unoptimized module
+/// @param optLevel - code generation optimization level
+/// @return true if the object code of the module was found.
+bool JitCache::Lookup(Module* pModule, uint32_t optLevel)
+{
+    std::vector<Function*> functions;
+    for (Function& func : *pModule)
+    {
+        if (!func.isDeclaration())
+        {
+            functions.push_back(&func);
+        }
+    }
+
+    // Strip the counters, setName() uniquifies any clashes the same way
+    // in every process
+    for (Function* pFunc : functions)
+    {
+        std::string stem = pFunc->getName().rtrim("0123456789").str();
+        pFunc->setName(stem);
+    }
+
+    std::string moduleId = pModule->getModuleIdentifier();
+    std::string ir;
+    raw_string_ostream irStream(ir);
+    pModule->setModuleIdentifier("");
+#if HAVE_LLVM >= 0x0309
+    pModule->setSourceFileName("");
+#endif
+    pModule->print(irStream, nullptr);
+    irStream.flush();
+    pModule->setModuleIdentifier(moduleId);
+#if HAVE_LLVM >= 0x0309
+    pModule->setSourceFileName(moduleId);
+#endif
+
+    std::stringstream target;
+    target << JIT_CACHE_VERSION << " " << HAVE_LLVM << " " << sizeof(void*) << " "
+           << sys::getHostCPUName().str() << " " << optLevel << "\n";
+
+    MD5 hash;
+    MD5::MD5Result result;
+    SmallString<32> name;
+    hash.update(target.str());
+    hash.update(ir);
+    hash.final(result);
+    MD5::stringifyResult(result, name);
+
+    for (Function* pFunc : functions)
+    {
+        pFunc->setName(pFunc->getName() + "_" + name);
+    }
+
+    mpModule = pModule;
+    mPath = mCacheDir + "/" + name.str().str() + ".o";
+    mpObject.reset();
+
+    ErrorOr<std::unique_ptr<MemoryBuffer>> buffer = MemoryBuffer::getFile(mPath, -1, false);
+    if (buffer && (*buffer)->getBufferSize())
+    {
+        mpObject = std::move(*buffer);
+    }
+
+    return mpObject != nullptr;
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Write the object code of a freshly compiled module to the cache.
+void JitCache::notifyObjectCompiled(const Module* M, MemoryBufferRef Obj)
+{
+    if (M != mpModule)
+    {
+        return;
+    }
+    mpModule = nullptr;
+
+    // Write to a unique file and rename it, so that concurrent processes
+    // never see a partially written entry
+    SmallString<256> tmpPath;
+    int fd;
+
+    sys::fs::create_directories(mCacheDir);
+    if (sys::fs::createUniqueFile(mPath + ".%%%%%%.tmp", fd, tmpPath))
+    {
+        return;
+    }
+
+    {
+        raw_fd_ostream os(fd, true);
+        os.write(Obj.getBufferStart(), Obj.getBufferSize());
+        os.close();
+        if (os.has_error())
+        {
+            os.clear_error();
+            sys::fs::remove(tmpPath);
+            return;
+        }
+    }
+
+    if (sys::fs::rename(tmpPath, mPath))
+    {
+        sys::fs::remove(tmpPath);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+/// @brief Hand MCJIT the object code found by Lookup(), if any.
+std::unique_ptr<MemoryBuffer> JitCache::getObject(const Module* M)
+{
+    if (M != mpModule || mpObject == nullptr)
+    {
+        return nullptr;
+    }
+    mpModule = nullptr;
+
+    return std::move(mpObject);
+}
+
 //////////////////////////////////////////////////////////////////////////
 /// @brief Dump function x86 assembly to file.
 /// @note This should only be called after the module has been jitted to x86 and the
@@ -59,6 +59,7 @@
 
 #include "llvm/IR/Verifier.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/Support/FileSystem.h"
 #define LLVM_F_NONE sys::fs::F_None
 
@@ -140,13 +141,41 @@ struct JitLLVMContext : llvm::LLVMContext
 };
 
 
+//////////////////////////////////////////////////////////////////////////
+/// JitCache
+/// @brief On-disk cache of the object code of jitted modules.  Entries are
+/// named after a hash of the unoptimized module, which is a function of the
+/// compile state, together with the target CPU and the LLVM version.  Later
+/// processes load the object instead of optimizing and compiling the module
+/// again.
+//////////////////////////////////////////////////////////////////////////
+class JitCache : public llvm::ObjectCache
+{
+public:
+    JitCache(const std::string& cacheDir) : mCacheDir(cacheDir) {}
+
+    bool Lookup(llvm::Module* pModule, uint32_t optLevel);
+
+    void notifyObjectCompiled(const llvm::Module* M, llvm::MemoryBufferRef Obj) override;
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module* M) override;
+
+private:
+    std::string mCacheDir;
+
+    // Entry of the module being compiled
+    const llvm::Module* mpModule = nullptr;
+    std::string mPath;
+    std::unique_ptr<llvm::MemoryBuffer> mpObject;
+};
+
+
 //////////////////////////////////////////////////////////////////////////
 /// JitManager
 //////////////////////////////////////////////////////////////////////////
 struct JitManager
 {
     JitManager(uint32_t w, const char* arch, const char* core);
-    ~JitManager(){};
+    ~JitManager() { delete mpCache; };
 
     JitLLVMContext          mContext;   ///< LLVM compiler
     llvm::IRBuilder<>       mBuilder;   ///< LLVM IR Builder
@@ -157,6 +186,8 @@ struct JitManager
     bool mIsModuleFinalized;
     uint32_t mJitNumber;
 
+    JitCache* mpCache;  ///< on-disk object cache, null if disabled
+
     uint32_t                 mVWidth;
 
     // Built in types.
@@ -181,6 +212,7 @@ struct JitManager
 
     void SetupNewModule();
     bool SetupModuleFromIR(const uint8_t *pIR);
+    bool LookupCache();
 
     void DumpAsm(llvm::Function* pFunction, const char* fileName);
     static void DumpToFile(llvm::Function *f, const char *fileName);
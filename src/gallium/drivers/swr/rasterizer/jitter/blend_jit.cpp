@@ -727,6 +727,12 @@ struct BlendJit : public Builder
 
         JitManager::DumpToFile(blendFunc, "");
 
+        if (JM()->LookupCache())
+        {
+            // object code comes from the cache, no need to optimize
+            return blendFunc;
+        }
+
         ::FunctionPassManager passes(JM()->mpCurrentModule);
 
         passes.add(createBreakCriticalEdgesPass());
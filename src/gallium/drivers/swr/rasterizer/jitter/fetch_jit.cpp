@@ -194,6 +194,12 @@ Function* FetchJit::Create(const FETCH_COMPILE_STATE& fetchState)
     verifyFunction(*fetch);
 #endif
 
+    if (JM()->LookupCache())
+    {
+        // object code comes from the cache, no need to optimize
+        return fetch;
+    }
+
     ::FunctionPassManager setupPasses(JM()->mpCurrentModule);
 
     ///@todo We don't need the CFG passes for fetch. (e.g. BreakCriticalEdges and CFGSimplification)
@@ -295,6 +295,12 @@ struct StreamOutJit : public Builder
 
         JitManager::DumpToFile(soFunc, "SoFunc");
 
+        if (JM()->LookupCache())
+        {
+            // object code comes from the cache, no need to optimize
+            return soFunc;
+        }
+
         ::FunctionPassManager passes(JM()->mpCurrentModule);
 
         passes.add(createBreakCriticalEdgesPass());
@@ -0,0 +1,206 @@
+# Copyright (C) 2016 Intel Corporation.   All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice (including the next
+# paragraph) shall be included in all copies or substantial portions of the
+# Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+# Summarizes the ArchRast Chrome trace files written with KNOB_AR_TRACE:
+# time per pipeline stage, culling efficiency and the load balance of the
+# backend across threads and macrotiles.  Optionally merges the per-thread
+# files into one trace for chrome://tracing or Perfetto.
+
+from __future__ import print_function, division
+import os
+import sys
+import json
+import argparse
+from collections import defaultdict
+
+def load_trace(filename):
+    with open(filename, 'r') as f:
+        text = f.read().strip()
+
+    # The closing bracket is missing if the process did not exit cleanly.
+    if not text.endswith(']'):
+        text = text.rstrip(',') + ']'
+
+    return json.loads(text)
+
+def find_traces(paths):
+    files = []
+    for path in paths:
+        if os.path.isdir(path):
+            for name in sorted(os.listdir(path)):
+                if name.startswith('ar_trace') and name.endswith('.json'):
+                    files.append(os.path.join(path, name))
+        else:
+            files.append(path)
+    return files
+
+def popcount(mask):
+    return bin(mask).count('1')
+
+class Summary(object):
+    def __init__(self):
+        self.calls = defaultdict(int)
+        self.total = defaultdict(float)     # inclusive time, us
+        self.self_time = defaultdict(float) # exclusive time, us
+
+        self.thread_fe = defaultdict(float)
+        self.thread_be = defaultdict(float)
+        self.tile_be = defaultdict(float)
+
+        self.cull = defaultdict(int)
+        self.fe_stats = defaultdict(int)
+        self.unmatched = 0
+
+    def add_thread(self, events):
+        # Events of a thread are in timestamp order.
+        stack = []
+        for event in events:
+            phase = event.get('ph')
+            name = event.get('name')
+            tid = (event.get('pid'), event.get('tid'))
+
+            if phase == 'B':
+                stack.append({'name': name, 'ts': event['ts'], 'child': 0.0, 'tile': None})
+
+            elif phase == 'E':
+                if not stack:
+                    self.unmatched += 1
+                    continue
+                frame = stack.pop()
+                duration = event['ts'] - frame['ts']
+
+                self.calls[frame['name']] += 1
+                self.total[frame['name']] += duration
+                self.self_time[frame['name']] += duration - frame['child']
+                if stack:
+                    stack[-1]['child'] += duration
+
+                if frame['name'] == 'WorkerFoundWork':
+                    self.thread_be[tid] += duration
+                    if frame['tile'] is not None:
+                        self.tile_be[frame['tile']] += duration
+                elif frame['name'] in ('FEProcessDraw', 'FEProcessDrawIndexed'):
+                    self.thread_fe[tid] += duration
+
+            elif phase == 'i':
+                args = event.get('args', {})
+                if name == 'MacroTileEvent' and stack:
+                    stack[-1]['tile'] = (args['tileX'], args['tileY'])
+                elif name == 'CullInfoEvent':
+                    self.cull['valid'] += popcount(args['validMask'])
+                    self.cull['degenerate'] += popcount(args['degenerateMask'])
+                    self.cull['backface'] += popcount(args['backfaceMask'])
+                elif name == 'FrontendStatsEvent':
+                    for key in ('IaPrimitives', 'CInvocations', 'CPrimitives'):
+                        self.fe_stats[key] += args[key]
+
+        self.unmatched += len(stack)
+
+def percent(part, whole):
+    return 100.0 * part / whole if whole else 0.0
+
+def print_balance(title, busy, label):
+    if not busy:
+        return
+
+    values = list(busy.values())
+    mean = sum(values) / len(values)
+    print('%s: %d %s, mean %.3f ms, max %.3f ms, max/mean %.2f' %
+          (title, len(values), label, mean / 1000.0, max(values) / 1000.0,
+           max(values) / mean if mean else 0.0))
+
+def print_summary(summary, top):
+    print('Time per stage (ms):')
+    print('  %-28s %10s %12s %12s %7s' % ('stage', 'calls', 'total', 'self', 'self%'))
+    total_self = sum(summary.self_time.values())
+    stages = sorted(summary.self_time, key=lambda n: summary.self_time[n], reverse=True)
+    for name in stages[:top] if top else stages:
+        print('  %-28s %10d %12.3f %12.3f %6.1f%%' %
+              (name, summary.calls[name], summary.total[name] / 1000.0,
+               summary.self_time[name] / 1000.0, percent(summary.self_time[name], total_self)))
+    print()
+
+    cull = summary.cull
+    if cull['valid']:
+        culled = cull['degenerate'] + cull['backface']
+        print('Culling (triangles reaching the binner):')
+        print('  input       %12d' % cull['valid'])
+        print('  degenerate  %12d  %5.1f%%' % (cull['degenerate'], percent(cull['degenerate'], cull['valid'])))
+        print('  backface    %12d  %5.1f%%' % (cull['backface'], percent(cull['backface'], cull['valid'])))
+        print('  binned      %12d  %5.1f%%' % (cull['valid'] - culled, percent(cull['valid'] - culled, cull['valid'])))
+        print()
+
+    stats = summary.fe_stats
+    if stats['CInvocations']:
+        print('Clipping (pipeline statistics):')
+        print('  assembled   %12d' % stats['IaPrimitives'])
+        print('  clip input  %12d' % stats['CInvocations'])
+        print('  clip output %12d  %5.1f%%' % (stats['CPrimitives'], percent(stats['CPrimitives'], stats['CInvocations'])))
+        print()
+
+    print('Load balance:')
+    print_balance('  frontend', summary.thread_fe, 'threads')
+    print_balance('  backend ', summary.thread_be, 'threads')
+    print_balance('  tiles   ', summary.tile_be, 'macrotiles')
+
+    if summary.tile_be and top:
+        tiles = sorted(summary.tile_be, key=lambda t: summary.tile_be[t], reverse=True)
+        print('  busiest macrotiles (x, y):')
+        for tile in tiles[:top]:
+            print('    (%3d, %3d) %10.3f ms' % (tile[0], tile[1], summary.tile_be[tile] / 1000.0))
+
+    if summary.unmatched:
+        print()
+        print('note: %d unmatched Start/End events' % summary.unmatched)
+
+def main():
+    parser = argparse.ArgumentParser(description="Summarize ArchRast Chrome trace files")
+    parser.add_argument("paths", nargs='+', help="Trace files, or directories containing them")
+    parser.add_argument("--merge", "-m", help="Write all events to one trace file")
+    parser.add_argument("--top", "-t", type=int, default=20, help="Number of stages and tiles listed, 0 for all")
+    args = parser.parse_args()
+
+    files = find_traces(args.paths)
+    if not files:
+        print('No trace files found', file=sys.stderr)
+        return 1
+
+    summary = Summary()
+    merged = []
+    for filename in files:
+        events = load_trace(filename)
+        threads = defaultdict(list)
+        for event in events:
+            threads[(event.get('pid'), event.get('tid'))].append(event)
+        for thread_events in threads.values():
+            summary.add_thread(thread_events)
+        if args.merge:
+            merged.extend(events)
+
+    if args.merge:
+        with open(args.merge, 'w') as f:
+            json.dump({'traceEvents': merged, 'displayTimeUnit': 'ms'}, f)
+
+    print_summary(summary, args.top)
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -143,6 +143,7 @@ def main():
     parser.add_argument("--gen_event_cpp", "-gec", help="Generate event cpp", action="store_true", default=False)
     parser.add_argument("--gen_eventhandler_h", "-gehh", help="Generate eventhandler header", action="store_true", default=False)
     parser.add_argument("--gen_eventhandlerfile_h", "-gehf", help="Generate eventhandler header for writing to files", action="store_true", default=False)
+    parser.add_argument("--gen_eventhandlertrace_h", "-geht", help="Generate eventhandler header for writing Chrome trace files", action="store_true", default=False)
     args = parser.parse_args()
 
     proto_filename = args.proto
@@ -203,6 +204,17 @@ def main():
                 event_header="gen_ar_eventhandler.h",   # todo: fix this!
                 protos=protos)
 
+    # Generate trace event handler header
+    if args.gen_eventhandlertrace_h:
+        curdir = os.path.dirname(os.path.abspath(__file__))
+        template_file = os.sep.join([curdir, 'templates', 'ar_eventhandlertrace_h.template'])
+        output_fullpath = os.sep.join([output_dir, output_filename])
+
+        write_template_to_file(template_file, output_fullpath,
+                filename=output_filename,
+                event_header="gen_ar_eventhandler.h",   # todo: fix this!
+                protos=protos)
+
     return 0
 
 if __name__ == '__main__':
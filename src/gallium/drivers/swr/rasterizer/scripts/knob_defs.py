@@ -45,6 +45,15 @@ KNOBS = [
         'category'  : 'debug',
     }],
 
+    ['JIT_CACHE_DIR', {
+        'type'      : 'std::string',
+        'default'   : '',
+        'desc'      : ['Directory of the on-disk cache of jitted fetch, blend and',
+                       'streamout code.  Later processes load the code from there',
+                       'instead of compiling it again.  Empty disables the cache.'],
+        'category'  : 'perf',
+    }],
+
     ['USE_GENERIC_STORETILE', {
         'type'      : 'bool',
         'default'   : 'false',
@@ -144,6 +153,18 @@ KNOBS = [
         'category'  : 'perf',
     }],
 
+    ['MIN_PRIMS_PER_DRAW', {
+        'type'      : 'uint32_t',
+        'default'   : '128',
+        'desc'      : ['Minimum primitives in a single Draw() for load balancing.',
+                       'Large draws are split across the idle frontend threads,',
+                       'in Draw calls of at least this many primitives.',
+                       'Consecutive smaller draws with identical state are',
+                       'batched into one Draw call.',
+                       '0 splits at MAX_PRIMS_PER_DRAW and disables batching.'],
+        'category'  : 'perf',
+    }],
+
     ['MAX_TESS_PRIMS_PER_DRAW', {
         'type'      : 'uint32_t',
         'default'   : '16',
@@ -161,6 +182,18 @@ KNOBS = [
         'category'  : 'debug',
     }],
 
+    ['AR_TRACE', {
+        'type'      : 'bool',
+        'default'   : 'false',
+        'desc'      : ['Write ArchRast events as Chrome trace (JSON) files, one per thread,',
+                       'to DEBUG_OUTPUT_DIR instead of binary event files.',
+                       'Load them in chrome://tracing or Perfetto, or summarize',
+                       'them with scripts/ar_trace_summary.py.',
+                       '',
+                       'NOTE: Requires KNOB_ENABLE_AR to be defined at build time'],
+        'category'  : 'debug',
+    }],
+
     ['TOSS_DRAW', {
         'type'      : 'bool',
         'default'   : 'false',
@@ -0,0 +1,247 @@
+/****************************************************************************
+ * Copyright (C) 2015 Intel Corporation.   All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ ***************************************************************************/
+
+/*
+ * Compute shaders.  The core dispatches one work group at a time to its
+ * worker threads; swr_cs_run_group() runs the jitted shader once per SIMD
+ * vector of the group.  Shaders with barriers run each vector as a fiber,
+ * which yields to the next one at every barrier.
+ */
+
+#include "pipe/p_defines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_fiber.h"
+#include "swr_context.h"
+#include "swr_resource.h"
+#include "swr_screen.h"
+#include "swr_state.h"
+
+/* Stack size of the fibers running work groups with barriers */
+#define SWR_CS_FIBER_STACK_SIZE (256 * 1024)
+
+/*
+ * Fibers of a worker thread, created on its first work group with
+ * barriers and released when the thread exits.
+ */
+struct swr_cs_fibers {
+   struct util_fibers *fibers = NULL;
+   bool warned = false;
+
+   ~swr_cs_fibers()
+   {
+      if (fibers)
+         util_fibers_destroy(fibers);
+   }
+};
+
+static thread_local swr_cs_fibers cs_fibers;
+
+struct swr_cs_group {
+   const swr_draw_context *pDC;
+   uint32_t id[3];
+   uint32_t grid[3];
+   uint8_t *shared;
+   void *barrier_data;
+};
+
+
+static void
+swr_cs_run_vector(void *data, unsigned index)
+{
+   const struct swr_cs_group *group = (const struct swr_cs_group *)data;
+   const swr_draw_context *pDC = group->pDC;
+   PFN_SWR_CS_VECTOR_FUNC func = (PFN_SWR_CS_VECTOR_FUNC)pDC->pCsVectorFunc;
+
+   func((HANDLE)pDC,
+        group->id[0], group->id[1], group->id[2],
+        group->grid[0], group->grid[1], group->grid[2],
+        pDC->csBlockSize[0], pDC->csBlockSize[1], pDC->csBlockSize[2],
+        index * KNOB_SIMD_WIDTH,
+        group->shared,
+        group->barrier_data);
+}
+
+
+/*
+ * PFN_CS_FUNC of the core, called once per work group.
+ */
+static void
+swr_cs_run_group(HANDLE hPrivateData, SWR_CS_CONTEXT *pCsCtx)
+{
+   const swr_draw_context *pDC = (const swr_draw_context *)hPrivateData;
+   struct swr_cs_group group;
+   uint32_t index = pCsCtx->tileCounter;
+
+   group.pDC = pDC;
+   for (unsigned i = 0; i < 3; i++)
+      group.grid[i] = pCsCtx->dispatchDims[i];
+   group.id[0] = index % group.grid[0];
+   group.id[1] = (index / group.grid[0]) % group.grid[1];
+   group.id[2] = index / group.grid[0] / group.grid[1];
+   group.shared = pCsCtx->pTGSM;
+   group.barrier_data = NULL;
+
+   if (pDC->csUseFibers) {
+      if (!cs_fibers.fibers)
+         cs_fibers.fibers = util_fibers_create(SWR_CS_FIBER_STACK_SIZE);
+
+      if (cs_fibers.fibers) {
+         group.barrier_data = cs_fibers.fibers;
+         if (util_fibers_run(cs_fibers.fibers, pDC->csNumVectors,
+                             swr_cs_run_vector, &group))
+            return;
+      }
+
+      /* Running the vectors one after the other would ignore the
+       * barriers, and give wrong results: drop the group instead. */
+      if (!cs_fibers.warned) {
+         debug_printf("swr: out of memory for fibers, "
+                      "dropping compute work groups\n");
+         cs_fibers.warned = true;
+      }
+      return;
+   }
+
+   for (unsigned i = 0; i < pDC->csNumVectors; i++)
+      swr_cs_run_vector(&group, i);
+}
+
+
+static void *
+swr_create_compute_state(struct pipe_context *pipe,
+                         const struct pipe_compute_state *cs)
+{
+   if (cs->ir_type != PIPE_SHADER_IR_TGSI)
+      return NULL;
+
+   struct swr_compute_shader *swr_cs = new swr_compute_shader;
+   if (!swr_cs)
+      return NULL;
+
+   swr_cs->pipe.tokens = tgsi_dup_tokens((const struct tgsi_token *)cs->prog);
+
+   lp_build_tgsi_info(swr_cs->pipe.tokens, &swr_cs->info);
+
+   return swr_cs;
+}
+
+static void
+swr_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct swr_context *ctx = swr_context(pipe);
+
+   ctx->cs = (swr_compute_shader *)cs;
+}
+
+static void
+swr_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct swr_compute_shader *swr_cs = (swr_compute_shader *)cs;
+   FREE((void *)swr_cs->pipe.tokens);
+   delete swr_cs;
+}
+
+
+/*
+ * Whether fibers are available on this platform, see u_fiber.c.
+ */
+static bool
+swr_cs_probe_fibers(void)
+{
+   struct util_fibers *fibers = util_fibers_create(SWR_CS_FIBER_STACK_SIZE);
+
+   if (!fibers)
+      return false;
+
+   util_fibers_destroy(fibers);
+   return true;
+}
+
+
+/*
+ * Run a compute grid to completion.
+ */
+static void
+swr_launch_grid(struct pipe_context *pipe, const struct pipe_grid_info *info)
+{
+   struct swr_context *ctx = swr_context(pipe);
+   uint32_t grid[3];
+
+   if (!ctx->cs)
+      return;
+
+   /* The grid, and the indirect grid size, may depend on what earlier
+    * draws wrote */
+   SwrWaitForIdle(ctx->swrContext);
+
+   if (info->indirect) {
+      const uint8_t *data = swr_resource_data(info->indirect);
+      memcpy(grid, data + info->indirect_offset, sizeof(grid));
+   } else {
+      for (unsigned i = 0; i < 3; i++)
+         grid[i] = info->grid[i];
+   }
+
+   if (!grid[0] || !grid[1] || !grid[2])
+      return;
+
+   PFN_SWR_CS_VECTOR_FUNC func = swr_update_compute_state(pipe);
+
+   uint32_t threads = info->block[0] * info->block[1] * info->block[2];
+   swr_draw_context *pDC = &ctx->swrDC;
+
+   pDC->pCsVectorFunc = (void *)func;
+   for (unsigned i = 0; i < 3; i++)
+      pDC->csBlockSize[i] = info->block[i];
+   pDC->csNumVectors = DIV_ROUND_UP(threads, KNOB_SIMD_WIDTH);
+   pDC->csUseFibers = pDC->csNumVectors > 1 &&
+      ctx->cs->info.base.opcode_count[TGSI_OPCODE_BARRIER];
+
+   /* Without fibers the barriers of a group of several vectors can't be
+    * honoured, so fail the dispatch rather than give wrong results. */
+   static const bool have_fibers = swr_cs_probe_fibers();
+   if (pDC->csUseFibers && !have_fibers) {
+      debug_printf("swr: no fibers, can't run compute work groups of more "
+                   "than %u invocations with barriers\n", KNOB_SIMD_WIDTH);
+      return;
+   }
+
+   swr_update_draw_context(ctx);
+
+   SwrSetCsFunc(ctx->swrContext, swr_cs_run_group, threads, 0);
+   SwrDispatch(ctx->swrContext, grid[0], grid[1], grid[2]);
+
+   /* Results are visible to the next draw, or to a map of the buffers */
+   SwrWaitForIdle(ctx->swrContext);
+}
+
+
+void
+swr_compute_init(struct pipe_context *pipe)
+{
+   pipe->create_compute_state = swr_create_compute_state;
+   pipe->bind_compute_state = swr_bind_compute_state;
+   pipe->delete_compute_state = swr_delete_compute_state;
+   pipe->launch_grid = swr_launch_grid;
+}
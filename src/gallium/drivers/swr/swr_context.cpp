@@ -258,7 +258,7 @@ swr_blit(struct pipe_context *pipe, const struct pipe_blit_info *blit_info)
    util_blitter_save_vertex_buffer_slot(ctx->blitter, ctx->vertex_buffer);
    util_blitter_save_vertex_elements(ctx->blitter, (void *)ctx->velems);
    util_blitter_save_vertex_shader(ctx->blitter, (void *)ctx->vs);
-   /*util_blitter_save_geometry_shader(ctx->blitter, (void*)ctx->gs);*/
+   util_blitter_save_geometry_shader(ctx->blitter, (void *)ctx->gs);
    util_blitter_save_so_targets(
       ctx->blitter,
       ctx->num_so_targets,
@@ -308,12 +308,14 @@ swr_destroy(struct pipe_context *pipe)
 
    pipe_surface_reference(&ctx->framebuffer.zsbuf, NULL);
 
-   for (unsigned i = 0; i < ARRAY_SIZE(ctx->sampler_views[0]); i++) {
-      pipe_sampler_view_reference(&ctx->sampler_views[PIPE_SHADER_FRAGMENT][i], NULL);
+   for (unsigned shader = 0; shader < PIPE_SHADER_TYPES; shader++) {
+      for (unsigned i = 0; i < ARRAY_SIZE(ctx->sampler_views[0]); i++) {
+         pipe_sampler_view_reference(&ctx->sampler_views[shader][i], NULL);
+      }
    }
 
-   for (unsigned i = 0; i < ARRAY_SIZE(ctx->sampler_views[0]); i++) {
-      pipe_sampler_view_reference(&ctx->sampler_views[PIPE_SHADER_VERTEX][i], NULL);
+   for (unsigned i = 0; i < ARRAY_SIZE(ctx->ssbos); i++) {
+      pipe_resource_reference(&ctx->ssbos[i].buffer, NULL);
    }
 
    if (ctx->swrContext)
@@ -435,6 +437,7 @@ swr_create_context(struct pipe_screen *p_screen, void *priv, unsigned flags)
    swr_state_init(&ctx->pipe);
    swr_clear_init(&ctx->pipe);
    swr_draw_init(&ctx->pipe);
+   swr_compute_init(&ctx->pipe);
    swr_query_init(&ctx->pipe);
 
    ctx->pipe.blit = swr_blit;
@@ -47,7 +47,9 @@
 #define SWR_NEW_FRAMEBUFFER (1 << 13)
 #define SWR_NEW_CLIP (1 << 14)
 #define SWR_NEW_SO (1 << 15)
-#define SWR_NEW_ALL 0x0000ffff
+#define SWR_NEW_GS (1 << 16)
+#define SWR_NEW_GSCONSTANTS (1 << 17)
+#define SWR_NEW_ALL 0x0003ffff
 
 namespace std
 {
@@ -83,16 +85,34 @@ struct swr_draw_context {
    uint32_t num_constantsVS[PIPE_MAX_CONSTANT_BUFFERS];
    const float *constantFS[PIPE_MAX_CONSTANT_BUFFERS];
    uint32_t num_constantsFS[PIPE_MAX_CONSTANT_BUFFERS];
+   const float *constantGS[PIPE_MAX_CONSTANT_BUFFERS];
+   uint32_t num_constantsGS[PIPE_MAX_CONSTANT_BUFFERS];
+   const float *constantCS[PIPE_MAX_CONSTANT_BUFFERS];
+   uint32_t num_constantsCS[PIPE_MAX_CONSTANT_BUFFERS];
 
    swr_jit_texture texturesVS[PIPE_MAX_SHADER_SAMPLER_VIEWS];
    swr_jit_sampler samplersVS[PIPE_MAX_SAMPLERS];
    swr_jit_texture texturesFS[PIPE_MAX_SHADER_SAMPLER_VIEWS];
    swr_jit_sampler samplersFS[PIPE_MAX_SAMPLERS];
+   swr_jit_texture texturesGS[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   swr_jit_sampler samplersGS[PIPE_MAX_SAMPLERS];
+   swr_jit_texture texturesCS[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   swr_jit_sampler samplersCS[PIPE_MAX_SAMPLERS];
+
+   /* compute shader buffers, bound with set_shader_buffers */
+   const uint32_t *ssbosCS[PIPE_MAX_SHADER_BUFFERS];
+   uint32_t num_ssbosCS[PIPE_MAX_SHADER_BUFFERS];
 
    float userClipPlanes[PIPE_MAX_CLIP_PLANES][4];
 
    SWR_SURFACE_STATE renderTargets[SWR_NUM_ATTACHMENTS];
    void *pStats;
+
+   /* compute dispatch, read by swr_cs_run_group() */
+   void *pCsVectorFunc; // PFN_SWR_CS_VECTOR_FUNC
+   uint32_t csBlockSize[3];
+   uint32_t csNumVectors;
+   uint32_t csUseFibers;
 };
 
 /* gen_llvm_types FINI */
@@ -110,6 +130,8 @@ struct swr_context {
 
    struct swr_vertex_shader *vs;
    struct swr_fragment_shader *fs;
+   struct swr_geometry_shader *gs;
+   struct swr_compute_shader *cs;
    struct swr_vertex_element_state *velems;
 
    /** Other rendering state */
@@ -128,6 +150,7 @@ struct swr_context {
    struct pipe_viewport_state viewport;
    struct pipe_vertex_buffer vertex_buffer[PIPE_MAX_ATTRIBS];
    struct pipe_index_buffer index_buffer;
+   bool user_arrays_in_place; /**< draw reads client arrays in place */
 
    struct blitter_context *blitter;
 
@@ -141,6 +164,9 @@ struct swr_context {
    unsigned num_samplers[PIPE_SHADER_TYPES];
    unsigned num_sampler_views[PIPE_SHADER_TYPES];
 
+   struct pipe_shader_buffer ssbos[PIPE_MAX_SHADER_BUFFERS];
+   unsigned num_ssbos;
+
    unsigned sample_mask;
 
    // streamout
@@ -187,5 +213,7 @@ void swr_clear_init(struct pipe_context *pipe);
 
 void swr_draw_init(struct pipe_context *pipe);
 
+void swr_compute_init(struct pipe_context *pipe);
+
 void swr_finish(struct pipe_context *pipe);
 #endif
@@ -95,12 +95,21 @@ swr_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
 
    swr_update_draw_context(ctx);
 
-   if (ctx->vs->pipe.stream_output.num_outputs) {
-      if (!ctx->vs->soFunc[info->mode]) {
+   /* stream output is done by the last stage before the rasterizer */
+   struct pipe_stream_output_info *so = &ctx->vs->pipe.stream_output;
+   PFN_SO_FUNC *soFunc = ctx->vs->soFunc;
+   unsigned so_prim = info->mode;
+   if (ctx->gs) {
+      so = &ctx->gs->pipe.stream_output;
+      soFunc = ctx->gs->soFunc;
+      so_prim = ctx->gs->info.base.properties[TGSI_PROPERTY_GS_OUTPUT_PRIM];
+   }
+
+   if (so->num_outputs) {
+      if (!soFunc[so_prim]) {
          STREAMOUT_COMPILE_STATE state = {0};
-         struct pipe_stream_output_info *so = &ctx->vs->pipe.stream_output;
 
-         state.numVertsPerPrim = u_vertices_per_prim(info->mode);
+         state.numVertsPerPrim = u_vertices_per_prim(so_prim);
 
          uint32_t offsets[MAX_SO_STREAMS] = {0};
          uint32_t num = 0;
@@ -133,12 +142,12 @@ swr_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
          state.stream.numDecls = num;
 
          HANDLE hJitMgr = swr_screen(pipe->screen)->hJitMgr;
-         ctx->vs->soFunc[info->mode] = JitCompileStreamout(hJitMgr, state);
-         debug_printf("so shader    %p\n", ctx->vs->soFunc[info->mode]);
-         assert(ctx->vs->soFunc[info->mode] && "Error: SoShader = NULL");
+         soFunc[so_prim] = JitCompileStreamout(hJitMgr, state);
+         debug_printf("so shader    %p\n", soFunc[so_prim]);
+         assert(soFunc[so_prim] && "Error: SoShader = NULL");
       }
 
-      SwrSetSoFunc(ctx->swrContext, ctx->vs->soFunc[info->mode], 0);
+      SwrSetSoFunc(ctx->swrContext, soFunc[so_prim], 0);
    }
 
    struct swr_vertex_element_state *velems = ctx->velems;
@@ -210,6 +219,12 @@ swr_draw_vbo(struct pipe_context *pipe, const struct pipe_draw_info *info)
                        info->instance_count,
                        info->start,
                        info->start_instance);
+
+   /* The client arrays the draw reads in place are the caller's again
+    * once this returns.  Only the frontend reads vertices, so rasterization
+    * carries on. */
+   if (ctx->user_arrays_in_place)
+      SwrWaitForIdleFE(ctx->swrContext);
 }
 
 
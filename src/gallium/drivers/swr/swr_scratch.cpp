@@ -107,6 +107,10 @@ swr_destroy_scratch_buffers(struct swr_context *ctx)
          align_free(scratch->vs_constants.base);
       if (scratch->fs_constants.base)
          align_free(scratch->fs_constants.base);
+      if (scratch->gs_constants.base)
+         align_free(scratch->gs_constants.base);
+      if (scratch->cs_constants.base)
+         align_free(scratch->cs_constants.base);
       if (scratch->vertex_buffer.base)
          align_free(scratch->vertex_buffer.base);
       if (scratch->index_buffer.base)
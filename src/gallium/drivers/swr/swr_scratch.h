@@ -35,6 +35,8 @@ struct swr_scratch_space {
 struct swr_scratch_buffers {
    struct swr_scratch_space vs_constants;
    struct swr_scratch_space fs_constants;
+   struct swr_scratch_space gs_constants;
+   struct swr_scratch_space cs_constants;
    struct swr_scratch_space vertex_buffer;
    struct swr_scratch_space index_buffer;
 };
@@ -46,7 +48,7 @@ struct swr_scratch_buffers {
  * Used to store temporary data such as client arrays and constants.
  *
  * Inputs:
- *   space ptr to scratch pool (vs_constants, fs_constants)
+ *   space ptr to scratch pool (vs_constants, fs_constants, ...)
  *   user_buffer, data to copy into scratch space
  *   size to be copied
  * Returns:
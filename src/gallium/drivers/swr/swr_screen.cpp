@@ -33,6 +33,7 @@
 
 extern "C" {
 #include "gallivm/lp_bld_limits.h"
+#include "gallivm/lp_bld_cache.h"
 }
 
 #include "swr_public.h"
@@ -243,7 +244,11 @@ swr_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 1;
    case PIPE_CAP_COMPUTE:
+#if HAVE_LLVM >= 0x0307
+      return 1;
+#else
       return 0;
+#endif
    case PIPE_CAP_USER_VERTEX_BUFFERS:
    case PIPE_CAP_USER_INDEX_BUFFERS:
    case PIPE_CAP_USER_CONSTANT_BUFFERS:
@@ -381,10 +386,67 @@ swr_get_shader_param(struct pipe_screen *screen,
                      unsigned shader,
                      enum pipe_shader_cap param)
 {
-   if (shader == PIPE_SHADER_VERTEX || shader == PIPE_SHADER_FRAGMENT)
+   if (shader == PIPE_SHADER_VERTEX || shader == PIPE_SHADER_FRAGMENT ||
+       shader == PIPE_SHADER_GEOMETRY)
       return gallivm_get_shader_param(param);
 
-   // Todo: geometry, tesselation, compute
+#if HAVE_LLVM >= 0x0307
+   if (shader == PIPE_SHADER_COMPUTE) {
+      switch (param) {
+      case PIPE_SHADER_CAP_MAX_SHADER_BUFFERS:
+         return PIPE_MAX_SHADER_BUFFERS;
+      default:
+         return gallivm_get_shader_param(param);
+      }
+   }
+#endif
+
+   // Todo: tesselation
+   return 0;
+}
+
+
+static int
+swr_get_compute_param(struct pipe_screen *screen,
+                      enum pipe_shader_ir ir_type,
+                      enum pipe_compute_cap param,
+                      void *ret)
+{
+   switch (param) {
+   case PIPE_COMPUTE_CAP_IR_TARGET:
+      return 0;
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      if (ret) {
+         uint64_t *grid_size = (uint64_t *)ret;
+         grid_size[0] = 65535;
+         grid_size[1] = 65535;
+         grid_size[2] = 65535;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      if (ret) {
+         uint64_t *block_size = (uint64_t *)ret;
+         block_size[0] = 1024;
+         block_size[1] = 1024;
+         block_size[2] = 64;
+      }
+      return 3 * sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      if (ret) {
+         uint64_t *max_threads_per_block = (uint64_t *)ret;
+         *max_threads_per_block = 1024;
+      }
+      return sizeof(uint64_t);
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      if (ret) {
+         /* the core's per worker scratch, see SWR_CS_CONTEXT::pTGSM */
+         uint64_t *max_local_size = (uint64_t *)ret;
+         *max_local_size = SWR_CS_SHARED_MEM_SIZE;
+      }
+      return sizeof(uint64_t);
+   default:
+      break;
+   }
    return 0;
 }
 
@@ -994,6 +1056,13 @@ swr_create_screen(struct sw_winsys *winsys)
       g_GlobalKnobs.MAX_PRIMS_PER_DRAW.Value(49152);
    }
 
+   /* Shaders are cached by gallivm, keep the fetch, blend and streamout
+    * code of the core next to them.
+    */
+   if (!getenv("KNOB_JIT_CACHE_DIR") && lp_object_cache_dir()) {
+      g_GlobalKnobs.JIT_CACHE_DIR.Value(lp_object_cache_dir());
+   }
+
    screen->winsys = winsys;
    screen->base.get_name = swr_get_name;
    screen->base.get_vendor = swr_get_vendor;
@@ -1004,6 +1073,7 @@ swr_create_screen(struct sw_winsys *winsys)
    screen->base.destroy = swr_destroy_screen;
    screen->base.get_param = swr_get_param;
    screen->base.get_shader_param = swr_get_shader_param;
+   screen->base.get_compute_param = swr_get_compute_param;
    screen->base.get_paramf = swr_get_paramf;
 
    screen->base.resource_create = swr_resource_create;
@@ -34,7 +34,10 @@
 #include "builder.h"
 
 #include "tgsi/tgsi_strings.h"
+#include "util/u_fiber.h"
+#include "util/u_pointer.h"
 #include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_flow.h"
 #include "gallivm/lp_bld_struct.h"
 #include "gallivm/lp_bld_tgsi.h"
@@ -47,7 +50,7 @@
 using namespace SwrJit;
 
 static unsigned
-locate_linkage(ubyte name, ubyte index, struct tgsi_shader_info *info);
+locate_linkage(ubyte name, ubyte index, const struct tgsi_shader_info *info);
 
 bool operator==(const swr_jit_fs_key &lhs, const swr_jit_fs_key &rhs)
 {
@@ -59,6 +62,24 @@ bool operator==(const swr_jit_vs_key &lhs, const swr_jit_vs_key &rhs)
    return !memcmp(&lhs, &rhs, sizeof(lhs));
 }
 
+bool operator==(const swr_jit_gs_key &lhs, const swr_jit_gs_key &rhs)
+{
+   return !memcmp(&lhs, &rhs, sizeof(lhs));
+}
+
+bool operator==(const swr_jit_cs_key &lhs, const swr_jit_cs_key &rhs)
+{
+   return !memcmp(&lhs, &rhs, sizeof(lhs));
+}
+
+struct tgsi_shader_info *
+swr_get_last_fe(const struct swr_context *ctx)
+{
+   if (ctx->gs)
+      return &ctx->gs->info.base;
+   return &ctx->vs->info.base;
+}
+
 static void
 swr_generate_sampler_key(const struct lp_tgsi_info &info,
                          struct swr_context *ctx,
@@ -112,10 +133,10 @@ swr_generate_fs_key(struct swr_jit_fs_key &key,
    key.nr_cbufs = ctx->framebuffer.nr_cbufs;
    key.light_twoside = ctx->rasterizer->light_twoside;
    memcpy(&key.vs_output_semantic_name,
-          &ctx->vs->info.base.output_semantic_name,
+          &swr_get_last_fe(ctx)->output_semantic_name,
           sizeof(key.vs_output_semantic_name));
    memcpy(&key.vs_output_semantic_idx,
-          &ctx->vs->info.base.output_semantic_index,
+          &swr_get_last_fe(ctx)->output_semantic_index,
           sizeof(key.vs_output_semantic_idx));
 
    swr_generate_sampler_key(swr_fs->info, ctx, PIPE_SHADER_FRAGMENT, key);
@@ -136,6 +157,37 @@ swr_generate_vs_key(struct swr_jit_vs_key &key,
    swr_generate_sampler_key(swr_vs->info, ctx, PIPE_SHADER_VERTEX, key);
 }
 
+void
+swr_generate_gs_key(struct swr_jit_gs_key &key,
+                    struct swr_context *ctx,
+                    swr_geometry_shader *swr_gs)
+{
+   memset(&key, 0, sizeof(key));
+
+   key.clip_plane_mask =
+      swr_gs->info.base.clipdist_writemask ?
+      swr_gs->info.base.clipdist_writemask & ctx->rasterizer->clip_plane_enable :
+      ctx->rasterizer->clip_plane_enable;
+   memcpy(&key.vs_output_semantic_name,
+          &ctx->vs->info.base.output_semantic_name,
+          sizeof(key.vs_output_semantic_name));
+   memcpy(&key.vs_output_semantic_idx,
+          &ctx->vs->info.base.output_semantic_index,
+          sizeof(key.vs_output_semantic_idx));
+
+   swr_generate_sampler_key(swr_gs->info, ctx, PIPE_SHADER_GEOMETRY, key);
+}
+
+void
+swr_generate_cs_key(struct swr_jit_cs_key &key,
+                    struct swr_context *ctx,
+                    swr_compute_shader *swr_cs)
+{
+   memset(&key, 0, sizeof(key));
+
+   swr_generate_sampler_key(swr_cs->info, ctx, PIPE_SHADER_COMPUTE, key);
+}
+
 struct BuilderSWR : public Builder {
    BuilderSWR(JitManager *pJitMgr, const char *pName)
       : Builder(pJitMgr)
@@ -152,8 +204,103 @@ struct BuilderSWR : public Builder {
    struct gallivm_state *gallivm;
    PFN_VERTEX_FUNC CompileVS(struct swr_context *ctx, swr_jit_vs_key &key);
    PFN_PIXEL_KERNEL CompileFS(struct swr_context *ctx, swr_jit_fs_key &key);
+   PFN_GS_FUNC CompileGS(struct swr_context *ctx, swr_jit_gs_key &key);
+   PFN_SWR_CS_VECTOR_FUNC CompileCS(struct swr_context *ctx,
+                                    swr_jit_cs_key &key);
+
+   void BuildClipDistances(struct swr_context *ctx,
+                           const struct tgsi_shader_info *info,
+                           LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
+                           Value *hPrivateData,
+                           Value *dist[PIPE_MAX_CLIP_PLANES]);
+
+   LLVMValueRef
+   swr_gs_llvm_fetch_input(const struct lp_build_tgsi_gs_iface *gs_iface,
+                           struct lp_build_tgsi_context *bld_base,
+                           boolean is_vindex_indirect,
+                           LLVMValueRef vertex_index,
+                           boolean is_aindex_indirect,
+                           LLVMValueRef attrib_index,
+                           LLVMValueRef swizzle_index);
+   void
+   swr_gs_llvm_emit_vertex(const struct lp_build_tgsi_gs_iface *gs_iface,
+                           struct lp_build_tgsi_context *bld_base,
+                           LLVMValueRef (*outputs)[4],
+                           LLVMValueRef emitted_vertices_vec);
+   void
+   swr_gs_llvm_end_primitive(const struct lp_build_tgsi_gs_iface *gs_iface,
+                             struct lp_build_tgsi_context *bld_base,
+                             LLVMValueRef verts_per_prim_vec,
+                             LLVMValueRef emitted_prims_vec);
+   void
+   swr_gs_llvm_epilogue(const struct lp_build_tgsi_gs_iface *gs_iface,
+                        struct lp_build_tgsi_context *bld_base,
+                        LLVMValueRef total_emitted_vertices_vec,
+                        LLVMValueRef emitted_prims_vec);
 };
 
+/*
+ * Clip distances of a shader's outputs: the written CLIPDIST outputs, or
+ * the user clip planes applied to CLIPVERTEX or POSITION.  Unused
+ * distances are left NULL.
+ */
+void
+BuilderSWR::BuildClipDistances(struct swr_context *ctx,
+                               const struct tgsi_shader_info *info,
+                               LLVMValueRef (*outputs)[TGSI_NUM_CHANNELS],
+                               Value *hPrivateData,
+                               Value *dist[PIPE_MAX_CLIP_PLANES])
+{
+   for (unsigned val = 0; val < PIPE_MAX_CLIP_PLANES; val++)
+      dist[val] = nullptr;
+
+   if (!(ctx->rasterizer->clip_plane_enable || info->culldist_writemask))
+      return;
+
+   unsigned clip_mask = ctx->rasterizer->clip_plane_enable;
+
+   unsigned cv = 0;
+   if (info->writes_clipvertex) {
+      cv = 1 + locate_linkage(TGSI_SEMANTIC_CLIPVERTEX, 0, info);
+   } else {
+      for (int i = 0; i < PIPE_MAX_SHADER_OUTPUTS; i++) {
+         if (info->output_semantic_name[i] == TGSI_SEMANTIC_POSITION &&
+             info->output_semantic_index[i] == 0) {
+            cv = i;
+            break;
+         }
+      }
+   }
+   LLVMValueRef cx = LLVMBuildLoad(gallivm->builder, outputs[cv][0], "");
+   LLVMValueRef cy = LLVMBuildLoad(gallivm->builder, outputs[cv][1], "");
+   LLVMValueRef cz = LLVMBuildLoad(gallivm->builder, outputs[cv][2], "");
+   LLVMValueRef cw = LLVMBuildLoad(gallivm->builder, outputs[cv][3], "");
+
+   for (unsigned val = 0; val < PIPE_MAX_CLIP_PLANES; val++) {
+      // clip distance overrides user clip planes
+      if ((info->clipdist_writemask & clip_mask & (1 << val)) ||
+          ((info->culldist_writemask << info->num_written_clipdistance) & (1 << val))) {
+         unsigned cv = 1 + locate_linkage(TGSI_SEMANTIC_CLIPDIST, val < 4 ? 0 : 1,
+                                          info);
+         dist[val] = unwrap(LLVMBuildLoad(gallivm->builder,
+                                          outputs[cv][val % 4], ""));
+         continue;
+      }
+
+      if (!(clip_mask & (1 << val)))
+         continue;
+
+      Value *px = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 0}));
+      Value *py = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 1}));
+      Value *pz = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 2}));
+      Value *pw = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 3}));
+      dist[val] = FADD(FMUL(unwrap(cx), VBROADCAST(px)),
+                       FADD(FMUL(unwrap(cy), VBROADCAST(py)),
+                            FADD(FMUL(unwrap(cz), VBROADCAST(pz)),
+                                 FMUL(unwrap(cw), VBROADCAST(pw)))));
+   }
+}
+
 PFN_VERTEX_FUNC
 BuilderSWR::CompileVS(struct swr_context *ctx, swr_jit_vs_key &key)
 {
@@ -231,7 +378,8 @@ BuilderSWR::CompileVS(struct swr_context *ctx, swr_jit_vs_key &key)
                      NULL, // thread data
                      sampler, // sampler
                      &swr_vs->info.base,
-                     NULL); // geometry shader face
+                     NULL, // geometry shader face
+                     NULL); // memory
 
    sampler->destroy(sampler);
 
@@ -253,61 +401,17 @@ BuilderSWR::CompileVS(struct swr_context *ctx, swr_jit_vs_key &key)
       }
    }
 
-   if (ctx->rasterizer->clip_plane_enable ||
-       swr_vs->info.base.culldist_writemask) {
-      unsigned clip_mask = ctx->rasterizer->clip_plane_enable;
-
-      unsigned cv = 0;
-      if (swr_vs->info.base.writes_clipvertex) {
-         cv = 1 + locate_linkage(TGSI_SEMANTIC_CLIPVERTEX, 0,
-                                 &swr_vs->info.base);
-      } else {
-         for (int i = 0; i < PIPE_MAX_SHADER_OUTPUTS; i++) {
-            if (swr_vs->info.base.output_semantic_name[i] == TGSI_SEMANTIC_POSITION &&
-                swr_vs->info.base.output_semantic_index[i] == 0) {
-               cv = i;
-               break;
-            }
-         }
-      }
-      LLVMValueRef cx = LLVMBuildLoad(gallivm->builder, outputs[cv][0], "");
-      LLVMValueRef cy = LLVMBuildLoad(gallivm->builder, outputs[cv][1], "");
-      LLVMValueRef cz = LLVMBuildLoad(gallivm->builder, outputs[cv][2], "");
-      LLVMValueRef cw = LLVMBuildLoad(gallivm->builder, outputs[cv][3], "");
-
-      for (unsigned val = 0; val < PIPE_MAX_CLIP_PLANES; val++) {
-         // clip distance overrides user clip planes
-         if ((swr_vs->info.base.clipdist_writemask & clip_mask & (1 << val)) ||
-             ((swr_vs->info.base.culldist_writemask << swr_vs->info.base.num_written_clipdistance) & (1 << val))) {
-            unsigned cv = 1 + locate_linkage(TGSI_SEMANTIC_CLIPDIST, val < 4 ? 0 : 1,
-                                             &swr_vs->info.base);
-            if (val < 4) {
-               LLVMValueRef dist = LLVMBuildLoad(gallivm->builder, outputs[cv][val], "");
-               STORE(unwrap(dist), vtxOutput, {0, 0, VERTEX_CLIPCULL_DIST_LO_SLOT, val});
-            } else {
-               LLVMValueRef dist = LLVMBuildLoad(gallivm->builder, outputs[cv][val - 4], "");
-               STORE(unwrap(dist), vtxOutput, {0, 0, VERTEX_CLIPCULL_DIST_HI_SLOT, val - 4});
-            }
-            continue;
-         }
+   Value *dist[PIPE_MAX_CLIP_PLANES];
+   BuildClipDistances(ctx, &swr_vs->info.base, outputs, hPrivateData, dist);
 
-         if (!(clip_mask & (1 << val)))
-            continue;
+   for (unsigned val = 0; val < PIPE_MAX_CLIP_PLANES; val++) {
+      if (!dist[val])
+         continue;
 
-         Value *px = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 0}));
-         Value *py = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 1}));
-         Value *pz = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 2}));
-         Value *pw = LOAD(GEP(hPrivateData, {0, swr_draw_context_userClipPlanes, val, 3}));
-         Value *dist = FADD(FMUL(unwrap(cx), VBROADCAST(px)),
-                            FADD(FMUL(unwrap(cy), VBROADCAST(py)),
-                                 FADD(FMUL(unwrap(cz), VBROADCAST(pz)),
-                                      FMUL(unwrap(cw), VBROADCAST(pw)))));
-
-         if (val < 4)
-            STORE(dist, vtxOutput, {0, 0, VERTEX_CLIPCULL_DIST_LO_SLOT, val});
-         else
-            STORE(dist, vtxOutput, {0, 0, VERTEX_CLIPCULL_DIST_HI_SLOT, val - 4});
-      }
+      if (val < 4)
+         STORE(dist[val], vtxOutput, {0, 0, VERTEX_CLIPCULL_DIST_LO_SLOT, val});
+      else
+         STORE(dist[val], vtxOutput, {0, 0, VERTEX_CLIPCULL_DIST_HI_SLOT, val - 4});
    }
 
    RET_VOID();
@@ -343,7 +447,7 @@ swr_compile_vs(struct swr_context *ctx, swr_jit_vs_key &key)
 }
 
 static unsigned
-locate_linkage(ubyte name, ubyte index, struct tgsi_shader_info *info)
+locate_linkage(ubyte name, ubyte index, const struct tgsi_shader_info *info)
 {
    for (int i = 0; i < PIPE_MAX_SHADER_OUTPUTS; i++) {
       if ((info->output_semantic_name[i] == name)
@@ -496,11 +600,11 @@ BuilderSWR::CompileFS(struct swr_context *ctx, swr_jit_fs_key &key)
       }
 
       unsigned linkedAttrib =
-         locate_linkage(semantic_name, semantic_idx, &ctx->vs->info.base);
+         locate_linkage(semantic_name, semantic_idx, swr_get_last_fe(ctx));
       if (linkedAttrib == 0xFFFFFFFF) {
          // not found - check for point sprite
          if (ctx->rasterizer->sprite_coord_enable) {
-            linkedAttrib = ctx->vs->info.base.num_outputs - 1;
+            linkedAttrib = swr_get_last_fe(ctx)->num_outputs - 1;
             swr_fs->pointSpriteMask |= (1 << linkedAttrib);
          } else {
             fprintf(stderr,
@@ -526,7 +630,7 @@ BuilderSWR::CompileFS(struct swr_context *ctx, swr_jit_fs_key &key)
             if ((semantic_name == TGSI_SEMANTIC_COLOR)
                 && ctx->rasterizer->light_twoside) {
                unsigned bcolorAttrib = locate_linkage(
-                  TGSI_SEMANTIC_BCOLOR, semantic_idx, &ctx->vs->info.base);
+                  TGSI_SEMANTIC_BCOLOR, semantic_idx, swr_get_last_fe(ctx));
 
                unsigned diff = 12 * (bcolorAttrib - linkedAttrib);
 
@@ -596,7 +700,8 @@ BuilderSWR::CompileFS(struct swr_context *ctx, swr_jit_fs_key &key)
                      NULL, // thread data
                      sampler, // sampler
                      &swr_fs->info.base,
-                     NULL); // geometry shader face
+                     NULL, // geometry shader face
+                     NULL); // memory
 
    sampler->destroy(sampler);
 
@@ -687,3 +792,638 @@ swr_compile_fs(struct swr_context *ctx, swr_jit_fs_key &key)
    ctx->fs->map.insert(std::make_pair(key, make_unique<VariantFS>(builder.gallivm, func)));
    return func;
 }
+
+/*
+ * Geometry shader callbacks of the TGSI translation.  They forward to the
+ * BuilderSWR doing the translation.
+ */
+struct swr_gs_llvm_iface {
+   struct lp_build_tgsi_gs_iface base;
+   struct tgsi_shader_info *info;
+
+   BuilderSWR *pBuilder;
+
+   Value *pGsCtx;
+   Value *hPrivateData;
+   struct swr_context *ctx;
+   SWR_GS_STATE *pGsState;
+
+   /* vertex slot of each geometry shader input */
+   uint32_t input_slot[PIPE_MAX_SHADER_INPUTS];
+   uint32_t num_inputs;
+};
+
+static LLVMValueRef
+swr_gs_llvm_fetch_input(const struct lp_build_tgsi_gs_iface *gs_iface,
+                        struct lp_build_tgsi_context *bld_base,
+                        boolean is_vindex_indirect,
+                        LLVMValueRef vertex_index,
+                        boolean is_aindex_indirect,
+                        LLVMValueRef attrib_index,
+                        LLVMValueRef swizzle_index)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+
+   return iface->pBuilder->swr_gs_llvm_fetch_input(gs_iface, bld_base,
+                                                  is_vindex_indirect,
+                                                  vertex_index,
+                                                  is_aindex_indirect,
+                                                  attrib_index,
+                                                  swizzle_index);
+}
+
+static void
+swr_gs_llvm_emit_vertex(const struct lp_build_tgsi_gs_iface *gs_iface,
+                        struct lp_build_tgsi_context *bld_base,
+                        LLVMValueRef (*outputs)[4],
+                        LLVMValueRef emitted_vertices_vec)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+
+   iface->pBuilder->swr_gs_llvm_emit_vertex(gs_iface, bld_base, outputs,
+                                            emitted_vertices_vec);
+}
+
+static void
+swr_gs_llvm_end_primitive(const struct lp_build_tgsi_gs_iface *gs_iface,
+                          struct lp_build_tgsi_context *bld_base,
+                          LLVMValueRef verts_per_prim_vec,
+                          LLVMValueRef emitted_prims_vec)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+
+   iface->pBuilder->swr_gs_llvm_end_primitive(gs_iface, bld_base,
+                                              verts_per_prim_vec,
+                                              emitted_prims_vec);
+}
+
+static void
+swr_gs_llvm_epilogue(const struct lp_build_tgsi_gs_iface *gs_iface,
+                     struct lp_build_tgsi_context *bld_base,
+                     LLVMValueRef total_emitted_vertices_vec,
+                     LLVMValueRef emitted_prims_vec)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+
+   iface->pBuilder->swr_gs_llvm_epilogue(gs_iface, bld_base,
+                                         total_emitted_vertices_vec,
+                                         emitted_prims_vec);
+}
+
+LLVMValueRef
+BuilderSWR::swr_gs_llvm_fetch_input(const struct lp_build_tgsi_gs_iface *gs_iface,
+                                    struct lp_build_tgsi_context *bld_base,
+                                    boolean is_vindex_indirect,
+                                    LLVMValueRef vertex_index,
+                                    boolean is_aindex_indirect,
+                                    LLVMValueRef attrib_index,
+                                    LLVMValueRef swizzle_index)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+   Value *vert_index = unwrap(vertex_index);
+   Value *attr_index = unwrap(attrib_index);
+
+   IRB()->SetInsertPoint(unwrap(LLVMGetInsertBlock(gallivm->builder)));
+
+   // map the input index to the vertex slot the VS output was stored at
+   auto input_slot = [&](Value *index) -> Value * {
+      Value *slot = C(iface->input_slot[0]);
+      for (uint32_t i = 1; i < iface->num_inputs; i++)
+         slot = SELECT(ICMP_EQ(index, C(i)), C(iface->input_slot[i]), slot);
+      return slot;
+   };
+
+   if (is_vindex_indirect || is_aindex_indirect) {
+      struct lp_type type = bld_base->base.type;
+      Value *res = unwrap(bld_base->base.zero);
+
+      for (uint32_t i = 0; i < type.length; i++) {
+         Value *vert_chan_index = vert_index;
+         Value *attr_chan_index = attr_index;
+
+         if (is_vindex_indirect)
+            vert_chan_index = VEXTRACT(vert_index, C(i));
+         if (is_aindex_indirect)
+            attr_chan_index = VEXTRACT(attr_index, C(i));
+
+         Value *attrib =
+            LOADV(iface->pGsCtx, {C(0), C(SWR_GS_CONTEXT_vert),
+                                  vert_chan_index, C(0),
+                                  input_slot(attr_chan_index),
+                                  unwrap(swizzle_index)});
+
+         res = VINSERT(res, VEXTRACT(attrib, C(i)), C(i));
+      }
+
+      return wrap(res);
+   }
+
+   uint32_t attrib = IMMED(attr_index);
+   assert(attrib < iface->num_inputs);
+
+   Value *value =
+      LOADV(iface->pGsCtx, {C(0), C(SWR_GS_CONTEXT_vert), vert_index, C(0),
+                            C(iface->input_slot[attrib]),
+                            unwrap(swizzle_index)});
+
+   return wrap(value);
+}
+
+/*
+ * Stores the outputs of each lane at its vertex index in the GS output
+ * stream.  The core lays the stream out as simdvertex batches of 8
+ * vertices per primitive (lane), so each lane is stored separately.
+ * Lanes are not masked: the translation only counts the vertices of the
+ * active ones, and maxNumVerts has a spare slot for excess vertices.
+ */
+void
+BuilderSWR::swr_gs_llvm_emit_vertex(const struct lp_build_tgsi_gs_iface *gs_iface,
+                                    struct lp_build_tgsi_context *bld_base,
+                                    LLVMValueRef (*outputs)[4],
+                                    LLVMValueRef emitted_vertices_vec)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+   const struct tgsi_shader_info *info = iface->info;
+
+   IRB()->SetInsertPoint(unwrap(LLVMGetInsertBlock(gallivm->builder)));
+
+   const uint32_t vertexStride = sizeof(simdvertex);
+   const uint32_t numSimdBatches =
+      (iface->pGsState->maxNumVerts + KNOB_SIMD_WIDTH - 1) / KNOB_SIMD_WIDTH;
+   const uint32_t inputPrimStride = numSimdBatches * vertexStride;
+   const uint32_t cutPrimStride =
+      (iface->pGsState->maxNumVerts + 7) / 8;
+
+   Value *attribs[KNOB_NUM_ATTRIBUTES][TGSI_NUM_CHANNELS];
+   memset(attribs, 0, sizeof(attribs));
+
+   for (uint32_t attrib = 0; attrib < info->num_outputs; attrib++) {
+      uint32_t outSlot = attrib;
+      if (info->output_semantic_name[attrib] == TGSI_SEMANTIC_PSIZE)
+         outSlot = VERTEX_POINT_SIZE_SLOT;
+
+      for (uint32_t channel = 0; channel < TGSI_NUM_CHANNELS; channel++) {
+         if (outputs[attrib][channel])
+            attribs[outSlot][channel] = LOAD(unwrap(outputs[attrib][channel]));
+      }
+   }
+
+   Value *dist[PIPE_MAX_CLIP_PLANES];
+   BuildClipDistances(iface->ctx, info, outputs, iface->hPrivateData, dist);
+   IRB()->SetInsertPoint(unwrap(LLVMGetInsertBlock(gallivm->builder)));
+
+   for (unsigned val = 0; val < PIPE_MAX_CLIP_PLANES; val++) {
+      if (val < 4)
+         attribs[VERTEX_CLIPCULL_DIST_LO_SLOT][val] = dist[val];
+      else
+         attribs[VERTEX_CLIPCULL_DIST_HI_SLOT][val - 4] = dist[val];
+   }
+
+   Value *pStream = LOAD(iface->pGsCtx, {0, SWR_GS_CONTEXT_pStream});
+   Value *pCutBuffer =
+      LOAD(iface->pGsCtx, {0, SWR_GS_CONTEXT_pCutOrStreamIdBuffer});
+   Value *vVertexIndex = unwrap(emitted_vertices_vec);
+
+   for (uint32_t lane = 0; lane < JM()->mVWidth; lane++) {
+      Value *vertexIndex = VEXTRACT(vVertexIndex, C(lane));
+      Value *batchOffset =
+         MUL(UDIV(vertexIndex, C(KNOB_SIMD_WIDTH)), C(vertexStride));
+      Value *laneOffset =
+         MUL(UREM(vertexIndex, C(KNOB_SIMD_WIDTH)), C((uint32_t)sizeof(float)));
+      Value *pVertex =
+         GEP(pStream, ADD(C(lane * inputPrimStride),
+                          ADD(batchOffset, laneOffset)));
+
+      for (uint32_t slot = 0; slot < KNOB_NUM_ATTRIBUTES; slot++) {
+         for (uint32_t channel = 0; channel < TGSI_NUM_CHANNELS; channel++) {
+            if (!attribs[slot][channel])
+               continue;
+
+            uint32_t attribOffset = slot * sizeof(simdvector) +
+                                    channel * sizeof(simdscalar);
+            Value *pDst = BITCAST(GEP(pVertex, C(attribOffset)),
+                                  PointerType::get(mFP32Ty, 0));
+            STORE(VEXTRACT(attribs[slot][channel], C(lane)), pDst);
+         }
+      }
+
+      // the cut buffer isn't cleared by the core, reset the bit of the
+      // vertex before end_primitive may set it
+      Value *pCut = GEP(pCutBuffer, ADD(C(lane * cutPrimStride),
+                                        UDIV(vertexIndex, C(8))));
+      Value *bit = SHL(C((uint8_t)1),
+                       TRUNC(UREM(vertexIndex, C(8)), mInt8Ty));
+      STORE(AND(LOAD(pCut), NOT(bit)), pCut);
+   }
+}
+
+/*
+ * Ends the primitive of the active lanes with pending vertices by setting
+ * the cut bit of their last emitted vertex.
+ */
+void
+BuilderSWR::swr_gs_llvm_end_primitive(const struct lp_build_tgsi_gs_iface *gs_iface,
+                                      struct lp_build_tgsi_context *bld_base,
+                                      LLVMValueRef verts_per_prim_vec,
+                                      LLVMValueRef emitted_prims_vec)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+   struct lp_build_tgsi_soa_context *bld = lp_soa_context(bld_base);
+
+   LLVMValueRef mask_val = lp_build_mask_value(bld->mask);
+   if (bld->exec_mask.has_mask)
+      mask_val = LLVMBuildAnd(gallivm->builder, mask_val,
+                              bld->exec_mask.exec_mask, "");
+   LLVMValueRef total_emitted_vertices_vec =
+      LLVMBuildLoad(gallivm->builder, bld->total_emitted_vertices_vec_ptr, "");
+
+   IRB()->SetInsertPoint(unwrap(LLVMGetInsertBlock(gallivm->builder)));
+
+   const uint32_t cutPrimStride =
+      (iface->pGsState->maxNumVerts + 7) / 8;
+
+   Value *vMask = AND(unwrap(mask_val),
+                      S_EXT(ICMP_NE(unwrap(verts_per_prim_vec), VIMMED1(0)),
+                            mSimdInt32Ty));
+   Value *vCount = unwrap(total_emitted_vertices_vec);
+   Value *pCutBuffer =
+      LOAD(iface->pGsCtx, {0, SWR_GS_CONTEXT_pCutOrStreamIdBuffer});
+
+   for (uint32_t lane = 0; lane < JM()->mVWidth; lane++) {
+      Value *active = ICMP_NE(VEXTRACT(vMask, C(lane)), C(0));
+      Value *vertexIndex = SELECT(active,
+                                  SUB(VEXTRACT(vCount, C(lane)), C(1)),
+                                  C(0));
+      Value *pCut = GEP(pCutBuffer, ADD(C(lane * cutPrimStride),
+                                        UDIV(vertexIndex, C(8))));
+      Value *bit = SELECT(active,
+                          SHL(C((uint8_t)1),
+                              TRUNC(UREM(vertexIndex, C(8)), mInt8Ty)),
+                          C((uint8_t)0));
+      STORE(OR(LOAD(pCut), bit), pCut);
+   }
+}
+
+void
+BuilderSWR::swr_gs_llvm_epilogue(const struct lp_build_tgsi_gs_iface *gs_iface,
+                                 struct lp_build_tgsi_context *bld_base,
+                                 LLVMValueRef total_emitted_vertices_vec,
+                                 LLVMValueRef emitted_prims_vec)
+{
+   swr_gs_llvm_iface *iface = (swr_gs_llvm_iface *)gs_iface;
+
+   IRB()->SetInsertPoint(unwrap(LLVMGetInsertBlock(gallivm->builder)));
+
+   STORE(unwrap(total_emitted_vertices_vec),
+         iface->pGsCtx, {0, SWR_GS_CONTEXT_vertexCount});
+}
+
+PFN_GS_FUNC
+BuilderSWR::CompileGS(struct swr_context *ctx, swr_jit_gs_key &key)
+{
+   struct swr_geometry_shader *swr_gs = ctx->gs;
+
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+
+   memset(outputs, 0, sizeof(outputs));
+
+   AttrBuilder attrBuilder;
+   attrBuilder.addStackAlignmentAttr(JM()->mVWidth * sizeof(float));
+   AttributeSet attrSet = AttributeSet::get(
+      JM()->mContext, AttributeSet::FunctionIndex, attrBuilder);
+
+   std::vector<Type *> gsArgs{PointerType::get(Gen_swr_draw_context(JM()), 0),
+                              PointerType::get(Gen_SWR_GS_CONTEXT(JM()), 0)};
+   FunctionType *gsFuncType =
+      FunctionType::get(Type::getVoidTy(JM()->mContext), gsArgs, false);
+
+   // create new geometry shader function
+   auto pFunction = Function::Create(gsFuncType,
+                                     GlobalValue::ExternalLinkage,
+                                     "GS",
+                                     JM()->mpCurrentModule);
+   pFunction->addAttributes(AttributeSet::FunctionIndex, attrSet);
+
+   BasicBlock *block = BasicBlock::Create(JM()->mContext, "entry", pFunction);
+   IRB()->SetInsertPoint(block);
+   LLVMPositionBuilderAtEnd(gallivm->builder, wrap(block));
+
+   auto argitr = pFunction->arg_begin();
+   Value *hPrivateData = &*argitr++;
+   hPrivateData->setName("hPrivateData");
+   Value *pGsCtx = &*argitr++;
+   pGsCtx->setName("gsCtx");
+
+   Value *consts_ptr =
+      GEP(hPrivateData, {C(0), C(swr_draw_context_constantGS)});
+   consts_ptr->setName("gs_constants");
+   Value *const_sizes_ptr =
+      GEP(hPrivateData, {0, swr_draw_context_num_constantsGS});
+   const_sizes_ptr->setName("num_gs_constants");
+
+   STORE(VIMMED1(0), pGsCtx, {0, SWR_GS_CONTEXT_vertexCount});
+
+   struct swr_gs_llvm_iface gs_iface;
+   memset(&gs_iface, 0, sizeof(gs_iface));
+   gs_iface.base.fetch_input = ::swr_gs_llvm_fetch_input;
+   gs_iface.base.emit_vertex = ::swr_gs_llvm_emit_vertex;
+   gs_iface.base.end_primitive = ::swr_gs_llvm_end_primitive;
+   gs_iface.base.gs_epilogue = ::swr_gs_llvm_epilogue;
+   gs_iface.info = &swr_gs->info.base;
+   gs_iface.pBuilder = this;
+   gs_iface.pGsCtx = pGsCtx;
+   gs_iface.hPrivateData = hPrivateData;
+   gs_iface.ctx = ctx;
+   gs_iface.pGsState = &swr_gs->gsState;
+
+   /*
+    * The VS stores output i at vertex slot i (position being output 0),
+    * and the point size at VERTEX_POINT_SIZE_SLOT; find the slot of each
+    * GS input from its semantic.
+    */
+   gs_iface.num_inputs = swr_gs->info.base.num_inputs;
+   for (uint32_t i = 0; i < gs_iface.num_inputs; i++) {
+      ubyte name = swr_gs->info.base.input_semantic_name[i];
+      ubyte idx = swr_gs->info.base.input_semantic_index[i];
+
+      if (name == TGSI_SEMANTIC_PSIZE) {
+         gs_iface.input_slot[i] = VERTEX_POINT_SIZE_SLOT;
+         continue;
+      }
+
+      gs_iface.input_slot[i] = VERTEX_POSITION_SLOT;
+      for (uint32_t j = 0; j < PIPE_MAX_SHADER_OUTPUTS; j++) {
+         if (key.vs_output_semantic_name[j] == name &&
+             key.vs_output_semantic_idx[j] == idx) {
+            gs_iface.input_slot[i] = j;
+            break;
+         }
+      }
+   }
+
+   struct lp_build_sampler_soa *sampler =
+      swr_sampler_soa_create(key.sampler, PIPE_SHADER_GEOMETRY);
+
+   struct lp_bld_tgsi_system_values system_values;
+   memset(&system_values, 0, sizeof(system_values));
+   system_values.prim_id = wrap(LOAD(pGsCtx, {0, SWR_GS_CONTEXT_PrimitiveID}));
+   system_values.invocation_id =
+      wrap(VECTOR_SPLAT(JM()->mVWidth,
+                        LOAD(pGsCtx, {0, SWR_GS_CONTEXT_InstanceID})));
+
+   struct lp_build_mask_context mask;
+   Value *mask_val = LOAD(pGsCtx, {0, SWR_GS_CONTEXT_mask}, "gsMask");
+   lp_build_mask_begin(&mask, gallivm,
+                       lp_type_float_vec(32, 32 * 8), wrap(mask_val));
+
+   lp_build_tgsi_soa(gallivm,
+                     swr_gs->pipe.tokens,
+                     lp_type_float_vec(32, 32 * 8),
+                     &mask,
+                     wrap(consts_ptr),
+                     wrap(const_sizes_ptr),
+                     &system_values,
+                     NULL, // inputs, fetched by the gs iface
+                     outputs,
+                     wrap(hPrivateData), // (sampler context)
+                     NULL, // thread data
+                     sampler, // sampler
+                     &swr_gs->info.base,
+                     &gs_iface.base,
+                     NULL); // memory
+
+   lp_build_mask_end(&mask);
+
+   sampler->destroy(sampler);
+
+   IRB()->SetInsertPoint(unwrap(LLVMGetInsertBlock(gallivm->builder)));
+
+   RET_VOID();
+
+   gallivm_verify_function(gallivm, wrap(pFunction));
+   gallivm_compile_module(gallivm);
+
+   PFN_GS_FUNC pFunc =
+      (PFN_GS_FUNC)gallivm_jit_function(gallivm, wrap(pFunction));
+
+   debug_printf("geom shader  %p\n", pFunc);
+   assert(pFunc && "Error: GeomShader = NULL");
+
+#if (LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR >= 5)
+   JM()->mIsModuleFinalized = true;
+#endif
+
+   return pFunc;
+}
+
+PFN_GS_FUNC
+swr_compile_gs(struct swr_context *ctx, swr_jit_gs_key &key)
+{
+   BuilderSWR builder(
+      reinterpret_cast<JitManager *>(swr_screen(ctx->pipe.screen)->hJitMgr),
+      "GS");
+   PFN_GS_FUNC func = builder.CompileGS(ctx, key);
+
+   ctx->gs->map.insert(std::make_pair(key, make_unique<VariantGS>(builder.gallivm, func)));
+   return func;
+}
+
+/*
+ * Memory interface of compute shaders, with the barrier data: the fibers
+ * running the vectors of the work group, or NULL.
+ */
+struct swr_cs_mem_iface {
+   struct lp_build_tgsi_mem_iface base;
+   LLVMValueRef barrier_data;
+};
+
+/*
+ * Called by the generated code at TGSI_OPCODE_BARRIER.
+ */
+static void
+swr_cs_barrier(void *barrier_data)
+{
+   if (barrier_data)
+      util_fibers_yield((struct util_fibers *)barrier_data);
+}
+
+static void
+swr_cs_emit_barrier(const struct lp_build_tgsi_mem_iface *mem_iface,
+                    struct gallivm_state *gallivm)
+{
+   const struct swr_cs_mem_iface *iface =
+      (const struct swr_cs_mem_iface *)mem_iface;
+   LLVMTypeRef arg_type =
+      LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0);
+
+   LLVMValueRef function =
+      lp_build_const_func_pointer(gallivm,
+                                  func_to_pointer((func_pointer)swr_cs_barrier),
+                                  LLVMVoidTypeInContext(gallivm->context),
+                                  &arg_type, 1, "swr_cs_barrier");
+
+   LLVMBuildCall(gallivm->builder, function,
+                 (LLVMValueRef *)&iface->barrier_data, 1, "");
+}
+
+PFN_SWR_CS_VECTOR_FUNC
+BuilderSWR::CompileCS(struct swr_context *ctx, swr_jit_cs_key &key)
+{
+   struct swr_compute_shader *swr_cs = ctx->cs;
+
+   LLVMValueRef outputs[PIPE_MAX_SHADER_OUTPUTS][TGSI_NUM_CHANNELS];
+
+   memset(outputs, 0, sizeof(outputs));
+
+   AttrBuilder attrBuilder;
+   attrBuilder.addStackAlignmentAttr(JM()->mVWidth * sizeof(float));
+   AttributeSet attrSet = AttributeSet::get(
+      JM()->mContext, AttributeSet::FunctionIndex, attrBuilder);
+
+   // see PFN_SWR_CS_VECTOR_FUNC
+   std::vector<Type *> csArgs{PointerType::get(Gen_swr_draw_context(JM()), 0)};
+   for (uint32_t i = 0; i < 10; i++)
+      csArgs.push_back(mInt32Ty); // block_id, grid_size, block_size,
+                                  // first_thread
+   csArgs.push_back(mInt8PtrTy); // shared
+   csArgs.push_back(mInt8PtrTy); // barrier_data
+   FunctionType *csFuncType =
+      FunctionType::get(Type::getVoidTy(JM()->mContext), csArgs, false);
+
+   // create new compute shader function
+   auto pFunction = Function::Create(csFuncType,
+                                     GlobalValue::ExternalLinkage,
+                                     "CS",
+                                     JM()->mpCurrentModule);
+   pFunction->addAttributes(AttributeSet::FunctionIndex, attrSet);
+
+   BasicBlock *block = BasicBlock::Create(JM()->mContext, "entry", pFunction);
+   IRB()->SetInsertPoint(block);
+   LLVMPositionBuilderAtEnd(gallivm->builder, wrap(block));
+
+   auto argitr = pFunction->arg_begin();
+   Value *hPrivateData = &*argitr++;
+   hPrivateData->setName("hPrivateData");
+   Value *block_id[3], *grid_size[3], *block_size[3];
+   for (uint32_t i = 0; i < 3; i++)
+      block_id[i] = &*argitr++;
+   for (uint32_t i = 0; i < 3; i++)
+      grid_size[i] = &*argitr++;
+   for (uint32_t i = 0; i < 3; i++)
+      block_size[i] = &*argitr++;
+   Value *first_thread = &*argitr++;
+   first_thread->setName("first_thread");
+   Value *shared = &*argitr++;
+   shared->setName("shared");
+   Value *barrier_data = &*argitr++;
+   barrier_data->setName("barrier_data");
+
+   Value *consts_ptr =
+      GEP(hPrivateData, {C(0), C(swr_draw_context_constantCS)});
+   consts_ptr->setName("cs_constants");
+   Value *const_sizes_ptr =
+      GEP(hPrivateData, {0, swr_draw_context_num_constantsCS});
+   const_sizes_ptr->setName("num_cs_constants");
+   Value *ssbo_ptr = GEP(hPrivateData, {0, swr_draw_context_ssbosCS});
+   ssbo_ptr->setName("cs_ssbos");
+   Value *ssbo_sizes_ptr =
+      GEP(hPrivateData, {0, swr_draw_context_num_ssbosCS});
+   ssbo_sizes_ptr->setName("num_cs_ssbos");
+
+   // linear index of each invocation within the work group
+   std::vector<Constant *> lanes;
+   for (uint32_t i = 0; i < JM()->mVWidth; i++)
+      lanes.push_back(C(i));
+   Value *linear = ADD(VECTOR_SPLAT(JM()->mVWidth, first_thread),
+                       ConstantVector::get(lanes));
+
+   struct lp_bld_tgsi_system_values system_values;
+   memset(&system_values, 0, sizeof(system_values));
+
+   Value *size = VECTOR_SPLAT(JM()->mVWidth, block_size[0]);
+   system_values.thread_id[0] = wrap(UREM(linear, size));
+   linear = UDIV(linear, size);
+   size = VECTOR_SPLAT(JM()->mVWidth, block_size[1]);
+   system_values.thread_id[1] = wrap(UREM(linear, size));
+   system_values.thread_id[2] = wrap(UDIV(linear, size));
+
+   for (uint32_t i = 0; i < 3; i++) {
+      system_values.block_id[i] = wrap(block_id[i]);
+      system_values.grid_size[i] = wrap(grid_size[i]);
+      system_values.block_size[i] = wrap(block_size[i]);
+   }
+
+   // the last vector of a work group may be partially used: its excess
+   // invocations are the ones past the last z slice
+   Value *mask_val =
+      S_EXT(ICMP_ULT(unwrap(system_values.thread_id[2]),
+                     VECTOR_SPLAT(JM()->mVWidth, block_size[2])),
+            mSimdInt32Ty);
+
+   struct lp_build_mask_context mask;
+   lp_build_mask_begin(&mask, gallivm,
+                       lp_type_float_vec(32, 32 * 8), wrap(mask_val));
+
+   struct lp_build_sampler_soa *sampler =
+      swr_sampler_soa_create(key.sampler, PIPE_SHADER_COMPUTE);
+
+   struct swr_cs_mem_iface mem_iface;
+   memset(&mem_iface, 0, sizeof(mem_iface));
+   mem_iface.base.ssbo_ptr = wrap(ssbo_ptr);
+   mem_iface.base.ssbo_sizes_ptr = wrap(ssbo_sizes_ptr);
+   mem_iface.base.shared_ptr = wrap(shared);
+   mem_iface.base.shared_size = SWR_CS_SHARED_MEM_SIZE;
+   mem_iface.base.emit_barrier = swr_cs_emit_barrier;
+   mem_iface.barrier_data = wrap(barrier_data);
+
+   lp_build_tgsi_soa(gallivm,
+                     swr_cs->pipe.tokens,
+                     lp_type_float_vec(32, 32 * 8),
+                     &mask,
+                     wrap(consts_ptr),
+                     wrap(const_sizes_ptr),
+                     &system_values,
+                     NULL, // inputs
+                     outputs,
+                     wrap(hPrivateData), // (sampler context)
+                     NULL, // thread data
+                     sampler, // sampler
+                     &swr_cs->info.base,
+                     NULL, // geometry shader face
+                     &mem_iface.base);
+
+   lp_build_mask_end(&mask);
+
+   sampler->destroy(sampler);
+
+   IRB()->SetInsertPoint(unwrap(LLVMGetInsertBlock(gallivm->builder)));
+
+   RET_VOID();
+
+   gallivm_verify_function(gallivm, wrap(pFunction));
+   gallivm_compile_module(gallivm);
+
+   PFN_SWR_CS_VECTOR_FUNC pFunc =
+      (PFN_SWR_CS_VECTOR_FUNC)gallivm_jit_function(gallivm, wrap(pFunction));
+
+   debug_printf("comp shader  %p\n", pFunc);
+   assert(pFunc && "Error: CompShader = NULL");
+
+#if (LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR >= 5)
+   JM()->mIsModuleFinalized = true;
+#endif
+
+   return pFunc;
+}
+
+PFN_SWR_CS_VECTOR_FUNC
+swr_compile_cs(struct swr_context *ctx, swr_jit_cs_key &key)
+{
+   BuilderSWR builder(
+      reinterpret_cast<JitManager *>(swr_screen(ctx->pipe.screen)->hJitMgr),
+      "CS");
+   PFN_SWR_CS_VECTOR_FUNC func = builder.CompileCS(ctx, key);
+
+   ctx->cs->map.insert(std::make_pair(key, make_unique<VariantCS>(builder.gallivm, func)));
+   return func;
+}
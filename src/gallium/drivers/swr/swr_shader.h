@@ -25,8 +25,31 @@
 
 struct swr_vertex_shader;
 struct swr_fragment_shader;
+struct swr_geometry_shader;
+struct swr_compute_shader;
 struct swr_jit_fs_key;
 struct swr_jit_vs_key;
+struct swr_jit_gs_key;
+struct swr_jit_cs_key;
+
+/*
+ * Compute shaders are jitted per SIMD vector of a work group, and called
+ * from swr_cs_run_group() once per vector, or once per fiber for work
+ * groups with barriers.
+ */
+typedef void(__cdecl *PFN_SWR_CS_VECTOR_FUNC)(HANDLE hPrivateData,
+                                              uint32_t block_id_x,
+                                              uint32_t block_id_y,
+                                              uint32_t block_id_z,
+                                              uint32_t grid_size_x,
+                                              uint32_t grid_size_y,
+                                              uint32_t grid_size_z,
+                                              uint32_t block_size_x,
+                                              uint32_t block_size_y,
+                                              uint32_t block_size_z,
+                                              uint32_t first_thread,
+                                              uint8_t *shared,
+                                              void *barrier_data);
 
 PFN_VERTEX_FUNC
 swr_compile_vs(struct swr_context *ctx, swr_jit_vs_key &key);
@@ -34,6 +57,12 @@ swr_compile_vs(struct swr_context *ctx, swr_jit_vs_key &key);
 PFN_PIXEL_KERNEL
 swr_compile_fs(struct swr_context *ctx, swr_jit_fs_key &key);
 
+PFN_GS_FUNC
+swr_compile_gs(struct swr_context *ctx, swr_jit_gs_key &key);
+
+PFN_SWR_CS_VECTOR_FUNC
+swr_compile_cs(struct swr_context *ctx, swr_jit_cs_key &key);
+
 void swr_generate_fs_key(struct swr_jit_fs_key &key,
                          struct swr_context *ctx,
                          swr_fragment_shader *swr_fs);
@@ -42,6 +71,17 @@ void swr_generate_vs_key(struct swr_jit_vs_key &key,
                          struct swr_context *ctx,
                          swr_vertex_shader *swr_vs);
 
+void swr_generate_gs_key(struct swr_jit_gs_key &key,
+                         struct swr_context *ctx,
+                         swr_geometry_shader *swr_gs);
+
+void swr_generate_cs_key(struct swr_jit_cs_key &key,
+                         struct swr_context *ctx,
+                         swr_compute_shader *swr_cs);
+
+/* the stage feeding the rasterizer: geometry shader if bound, else vs */
+struct tgsi_shader_info *swr_get_last_fe(const struct swr_context *ctx);
+
 struct swr_jit_sampler_key {
    unsigned nr_samplers;
    unsigned nr_sampler_views;
@@ -59,6 +99,15 @@ struct swr_jit_vs_key : swr_jit_sampler_key {
    unsigned clip_plane_mask; // from rasterizer state & vs_info
 };
 
+struct swr_jit_gs_key : swr_jit_sampler_key {
+   unsigned clip_plane_mask; // from rasterizer state & gs_info
+   ubyte vs_output_semantic_name[PIPE_MAX_SHADER_OUTPUTS];
+   ubyte vs_output_semantic_idx[PIPE_MAX_SHADER_OUTPUTS];
+};
+
+struct swr_jit_cs_key : swr_jit_sampler_key {
+};
+
 namespace std
 {
 template <> struct hash<swr_jit_fs_key> {
@@ -74,7 +123,23 @@ template <> struct hash<swr_jit_vs_key> {
       return util_hash_crc32(&k, sizeof(k));
    }
 };
+
+template <> struct hash<swr_jit_gs_key> {
+   std::size_t operator()(const swr_jit_gs_key &k) const
+   {
+      return util_hash_crc32(&k, sizeof(k));
+   }
+};
+
+template <> struct hash<swr_jit_cs_key> {
+   std::size_t operator()(const swr_jit_cs_key &k) const
+   {
+      return util_hash_crc32(&k, sizeof(k));
+   }
+};
 };
 
 bool operator==(const swr_jit_fs_key &lhs, const swr_jit_fs_key &rhs);
 bool operator==(const swr_jit_vs_key &lhs, const swr_jit_vs_key &rhs);
+bool operator==(const swr_jit_gs_key &lhs, const swr_jit_gs_key &rhs);
+bool operator==(const swr_jit_cs_key &lhs, const swr_jit_cs_key &rhs);
@@ -318,6 +318,29 @@ swr_sampler_view_destroy(struct pipe_context *pipe,
    FREE(view);
 }
 
+static void
+swr_init_so_state(SWR_STREAMOUT_STATE *soState,
+                  const pipe_stream_output_info *stream_output)
+{
+   *soState = {0};
+
+   if (!stream_output->num_outputs)
+      return;
+
+   soState->soEnable = true;
+   // soState.rasterizerDisable set on state dirty
+   // soState.streamToRasterizer not used
+
+   for (uint32_t i = 0; i < stream_output->num_outputs; i++) {
+      soState->streamMasks[stream_output->output[i].stream] |=
+         1 << (stream_output->output[i].register_index - 1);
+   }
+   for (uint32_t i = 0; i < MAX_SO_STREAMS; i++) {
+      soState->streamNumEntries[i] =
+         _mm_popcnt_u32(soState->streamMasks[i]);
+   }
+}
+
 static void *
 swr_create_vs_state(struct pipe_context *pipe,
                     const struct pipe_shader_state *vs)
@@ -331,24 +354,7 @@ swr_create_vs_state(struct pipe_context *pipe,
 
    lp_build_tgsi_info(vs->tokens, &swr_vs->info);
 
-   swr_vs->soState = {0};
-
-   if (swr_vs->pipe.stream_output.num_outputs) {
-      pipe_stream_output_info *stream_output = &swr_vs->pipe.stream_output;
-
-      swr_vs->soState.soEnable = true;
-      // soState.rasterizerDisable set on state dirty
-      // soState.streamToRasterizer not used
-
-      for (uint32_t i = 0; i < stream_output->num_outputs; i++) {
-         swr_vs->soState.streamMasks[stream_output->output[i].stream] |=
-            1 << (stream_output->output[i].register_index - 1);
-      }
-      for (uint32_t i = 0; i < MAX_SO_STREAMS; i++) {
-        swr_vs->soState.streamNumEntries[i] =
-             _mm_popcnt_u32(swr_vs->soState.streamMasks[i]);
-       }
-   }
+   swr_init_so_state(&swr_vs->soState, &swr_vs->pipe.stream_output);
 
    return swr_vs;
 }
@@ -410,6 +416,72 @@ swr_delete_fs_state(struct pipe_context *pipe, void *fs)
 }
 
 
+static void *
+swr_create_gs_state(struct pipe_context *pipe,
+                    const struct pipe_shader_state *gs)
+{
+   struct swr_geometry_shader *swr_gs = new swr_geometry_shader;
+   if (!swr_gs)
+      return NULL;
+
+   swr_gs->pipe.tokens = tgsi_dup_tokens(gs->tokens);
+   swr_gs->pipe.stream_output = gs->stream_output;
+
+   lp_build_tgsi_info(gs->tokens, &swr_gs->info);
+
+   const unsigned *properties = swr_gs->info.base.properties;
+   SWR_GS_STATE *gsState = &swr_gs->gsState;
+
+   *gsState = {0};
+   gsState->gsEnable = true;
+   // gsState.numInputAttribs set from the vertex shader on state dirty
+   switch (properties[TGSI_PROPERTY_GS_OUTPUT_PRIM]) {
+   case PIPE_PRIM_POINTS:
+      gsState->outputTopology = TOP_POINT_LIST;
+      break;
+   case PIPE_PRIM_LINE_STRIP:
+      gsState->outputTopology = TOP_LINE_STRIP;
+      break;
+   default:
+      gsState->outputTopology = TOP_TRIANGLE_STRIP;
+      break;
+   }
+   /* The shader stores the vertices past the maximum without counting
+    * them, keep a spare slot for those (see swr_gs_llvm_emit_vertex). */
+   gsState->maxNumVerts =
+      (properties[TGSI_PROPERTY_GS_MAX_OUTPUT_VERTICES] ?
+       properties[TGSI_PROPERTY_GS_MAX_OUTPUT_VERTICES] : 32) + 1;
+   /* The core reuses the vertex counts between instances, invocations
+    * aren't supported. */
+   gsState->instanceCount = 1;
+   gsState->isSingleStream = true;
+   gsState->singleStreamID = 0;
+
+   swr_init_so_state(&swr_gs->soState, &swr_gs->pipe.stream_output);
+
+   return swr_gs;
+}
+
+static void
+swr_bind_gs_state(struct pipe_context *pipe, void *gs)
+{
+   struct swr_context *ctx = swr_context(pipe);
+
+   if (ctx->gs == gs)
+      return;
+
+   ctx->gs = (swr_geometry_shader *)gs;
+   ctx->dirty |= SWR_NEW_GS;
+}
+
+static void
+swr_delete_gs_state(struct pipe_context *pipe, void *gs)
+{
+   struct swr_geometry_shader *swr_gs = (swr_geometry_shader *)gs;
+   FREE((void *)swr_gs->pipe.tokens);
+   delete swr_gs;
+}
+
 static void
 swr_set_constant_buffer(struct pipe_context *pipe,
                         uint shader,
@@ -425,11 +497,14 @@ swr_set_constant_buffer(struct pipe_context *pipe,
    /* note: reference counting */
    util_copy_constant_buffer(&ctx->constants[shader][index], cb);
 
-   if (shader == PIPE_SHADER_VERTEX || shader == PIPE_SHADER_GEOMETRY) {
+   if (shader == PIPE_SHADER_VERTEX) {
       ctx->dirty |= SWR_NEW_VSCONSTANTS;
    } else if (shader == PIPE_SHADER_FRAGMENT) {
       ctx->dirty |= SWR_NEW_FSCONSTANTS;
+   } else if (shader == PIPE_SHADER_GEOMETRY) {
+      ctx->dirty |= SWR_NEW_GSCONSTANTS;
    }
+   /* compute constants are updated at each launch_grid */
 
    if (cb && cb->user_buffer) {
       pipe_resource_reference(&constants, NULL);
@@ -437,6 +512,39 @@ swr_set_constant_buffer(struct pipe_context *pipe,
 }
 
 
+static void
+swr_set_shader_buffers(struct pipe_context *pipe,
+                       enum pipe_shader_type shader,
+                       unsigned start,
+                       unsigned num,
+                       const struct pipe_shader_buffer *buffers)
+{
+   struct swr_context *ctx = swr_context(pipe);
+
+   /* only compute shaders have shader buffers */
+   if (shader != PIPE_SHADER_COMPUTE)
+      return;
+
+   assert(start + num <= ARRAY_SIZE(ctx->ssbos));
+
+   for (unsigned i = 0; i < num; i++) {
+      struct pipe_shader_buffer *buf = &ctx->ssbos[start + i];
+
+      if (buffers && buffers[i].buffer) {
+         pipe_resource_reference(&buf->buffer, buffers[i].buffer);
+         buf->buffer_offset = buffers[i].buffer_offset;
+         buf->buffer_size = buffers[i].buffer_size;
+      } else {
+         pipe_resource_reference(&buf->buffer, NULL);
+         buf->buffer_offset = 0;
+         buf->buffer_size = 0;
+      }
+   }
+
+   ctx->num_ssbos = MAX2(ctx->num_ssbos, start + num);
+}
+
+
 static void *
 swr_create_vertex_elements_state(struct pipe_context *pipe,
                                  unsigned num_elements,
@@ -753,6 +861,16 @@ swr_update_constants(struct swr_context *ctx, enum pipe_shader_type shaderType)
       num_constants = pDC->num_constantsFS;
       scratch = &ctx->scratch->fs_constants;
       break;
+   case PIPE_SHADER_GEOMETRY:
+      constant = pDC->constantGS;
+      num_constants = pDC->num_constantsGS;
+      scratch = &ctx->scratch->gs_constants;
+      break;
+   case PIPE_SHADER_COMPUTE:
+      constant = pDC->constantCS;
+      num_constants = pDC->num_constantsCS;
+      scratch = &ctx->scratch->cs_constants;
+      break;
    default:
       debug_printf("Unsupported shader type constants\n");
       return;
@@ -863,7 +981,7 @@ swr_update_derived(struct pipe_context *pipe,
 
    /* Raster state */
    if (ctx->dirty & (SWR_NEW_RASTERIZER |
-                     SWR_NEW_VS | // clipping
+                     SWR_NEW_VS | SWR_NEW_GS | // clipping
                      SWR_NEW_FRAMEBUFFER)) {
       pipe_rasterizer_state *rasterizer = ctx->rasterizer;
       pipe_framebuffer_state *fb = &ctx->framebuffer;
@@ -921,13 +1039,15 @@ swr_update_derived(struct pipe_context *pipe,
 
       rastState->depthClipEnable = rasterizer->depth_clip;
 
+      struct tgsi_shader_info *fe_info = swr_get_last_fe(ctx);
+
       rastState->clipDistanceMask =
-         ctx->vs->info.base.num_written_clipdistance ?
-         ctx->vs->info.base.clipdist_writemask & rasterizer->clip_plane_enable :
+         fe_info->num_written_clipdistance ?
+         fe_info->clipdist_writemask & rasterizer->clip_plane_enable :
          rasterizer->clip_plane_enable;
 
       rastState->cullDistanceMask =
-         ctx->vs->info.base.culldist_writemask << ctx->vs->info.base.num_written_clipdistance;
+         fe_info->culldist_writemask << fe_info->num_written_clipdistance;
 
       SwrSetRastState(ctx->swrContext, rastState);
    }
@@ -987,6 +1107,13 @@ swr_update_derived(struct pipe_context *pipe,
       if (p_draw_info)
          info = *p_draw_info;
 
+      /* Client memory is only valid during the draw call.  If no earlier
+       * draw is still in the frontend, the draw reads it in place and
+       * swr_draw_vbo waits for the frontend to be done with it.  Otherwise
+       * the draw would queue past the call, so it gets a copy. */
+      bool in_place = p_draw_info && SwrIsIdleFE(ctx->swrContext);
+      ctx->user_arrays_in_place = false;
+
       /* vertex buffers */
       SWR_VERTEX_BUFFER_STATE swrVertexBuffers[PIPE_MAX_ATTRIBS];
       for (UINT i = 0; i < ctx->num_vertex_buffers; i++) {
@@ -1019,13 +1146,18 @@ swr_update_derived(struct pipe_context *pipe,
             max_vertex = info.max_index + 1;
             partial_inbounds = 0;
 
-            /* Copy only needed vertices to scratch space */
-            size = AlignUp(size, 4);
-            const void *ptr = (const uint8_t *) vb->user_buffer
-               + info.min_index * pitch;
-            ptr = swr_copy_to_scratch_space(
-               ctx, &ctx->scratch->vertex_buffer, ptr, size);
-            p_data = (const uint8_t *)ptr - info.min_index * pitch;
+            if (in_place) {
+               p_data = (const uint8_t *) vb->user_buffer;
+               ctx->user_arrays_in_place = true;
+            } else {
+               /* Copy only needed vertices to scratch space */
+               size = AlignUp(size, 4);
+               const void *ptr = (const uint8_t *) vb->user_buffer
+                  + info.min_index * pitch;
+               ptr = swr_copy_to_scratch_space(
+                  ctx, &ctx->scratch->vertex_buffer, ptr, size);
+               p_data = (const uint8_t *)ptr - info.min_index * pitch;
+            }
          }
 
          swrVertexBuffers[i] = {0};
@@ -1061,13 +1193,18 @@ swr_update_derived(struct pipe_context *pipe,
             post_update_dirty_flags |= SWR_NEW_VERTEX;
 
             size = info.count * pitch;
-            size = AlignUp(size, 4);
 
-            /* Copy indices to scratch space */
-            const void *ptr = ib->user_buffer;
-            ptr = swr_copy_to_scratch_space(
-               ctx, &ctx->scratch->index_buffer, ptr, size);
-            p_data = (const uint8_t *)ptr;
+            if (in_place) {
+               p_data = (const uint8_t *)ib->user_buffer;
+               ctx->user_arrays_in_place = true;
+            } else {
+               /* Copy indices to scratch space */
+               size = AlignUp(size, 4);
+               const void *ptr = ib->user_buffer;
+               ptr = swr_copy_to_scratch_space(
+                  ctx, &ctx->scratch->index_buffer, ptr, size);
+               p_data = (const uint8_t *)ptr;
+            }
          }
 
          SWR_INDEX_BUFFER_STATE swrIndexBuffer;
@@ -1119,9 +1256,55 @@ swr_update_derived(struct pipe_context *pipe,
       }
    }
 
+   /* GeometryShader */
+   if (ctx->dirty & (SWR_NEW_GS |
+                     SWR_NEW_VS | // for input linkage
+                     SWR_NEW_RASTERIZER | // for clip planes
+                     SWR_NEW_SAMPLER |
+                     SWR_NEW_SAMPLER_VIEW |
+                     SWR_NEW_FRAMEBUFFER)) {
+      if (ctx->gs) {
+         swr_jit_gs_key key;
+         swr_generate_gs_key(key, ctx, ctx->gs);
+         auto search = ctx->gs->map.find(key);
+         PFN_GS_FUNC func;
+         if (search != ctx->gs->map.end()) {
+            func = search->second->shader;
+         } else {
+            func = swr_compile_gs(ctx, key);
+         }
+         SwrSetGsFunc(ctx->swrContext, func);
+
+         /* VS outputs, but position, are the GS input attributes */
+         ctx->gs->gsState.numInputAttribs =
+            ctx->vs->info.base.num_outputs - 1;
+         SwrSetGsState(ctx->swrContext, &ctx->gs->gsState);
+
+         /* JIT sampler state */
+         if (ctx->dirty & SWR_NEW_SAMPLER) {
+            swr_update_sampler_state(ctx,
+                                     PIPE_SHADER_GEOMETRY,
+                                     key.nr_samplers,
+                                     ctx->swrDC.samplersGS);
+         }
+
+         /* JIT sampler view state */
+         if (ctx->dirty & (SWR_NEW_SAMPLER_VIEW | SWR_NEW_FRAMEBUFFER)) {
+            swr_update_texture_state(ctx,
+                                     PIPE_SHADER_GEOMETRY,
+                                     key.nr_sampler_views,
+                                     ctx->swrDC.texturesGS);
+         }
+      } else {
+         SWR_GS_STATE state = {0};
+         SwrSetGsState(ctx->swrContext, &state);
+      }
+   }
+
    /* FragmentShader */
    if (ctx->dirty & (SWR_NEW_FS | SWR_NEW_SAMPLER | SWR_NEW_SAMPLER_VIEW
-                     | SWR_NEW_RASTERIZER | SWR_NEW_FRAMEBUFFER)) {
+                     | SWR_NEW_RASTERIZER | SWR_NEW_FRAMEBUFFER
+                     | SWR_NEW_GS)) { // for input linkage
       swr_jit_fs_key key;
       swr_generate_fs_key(key, ctx, ctx->fs);
       auto search = ctx->fs->map.find(key);
@@ -1200,6 +1383,11 @@ swr_update_derived(struct pipe_context *pipe,
       swr_update_constants(ctx, PIPE_SHADER_FRAGMENT);
    }
 
+   /* GeometryShader Constants */
+   if (ctx->gs && (ctx->dirty & (SWR_NEW_GSCONSTANTS | SWR_NEW_GS))) {
+      swr_update_constants(ctx, PIPE_SHADER_GEOMETRY);
+   }
+
    /* Depth/stencil state */
    if (ctx->dirty & (SWR_NEW_DEPTH_STENCIL_ALPHA | SWR_NEW_FRAMEBUFFER)) {
       struct pipe_depth_state *depth = &(ctx->depth_stencil->depth);
@@ -1342,12 +1530,16 @@ swr_update_derived(struct pipe_context *pipe,
       /* XXX What to do with this one??? SWR doesn't stipple */
    }
 
-   if (ctx->dirty & (SWR_NEW_VS | SWR_NEW_SO | SWR_NEW_RASTERIZER)) {
-      ctx->vs->soState.rasterizerDisable =
-         ctx->rasterizer->rasterizer_discard;
-      SwrSetSoState(ctx->swrContext, &ctx->vs->soState);
+   if (ctx->dirty & (SWR_NEW_VS | SWR_NEW_GS | SWR_NEW_SO |
+                     SWR_NEW_RASTERIZER)) {
+      /* stream output is done by the last stage before the rasterizer */
+      SWR_STREAMOUT_STATE *soState =
+         ctx->gs ? &ctx->gs->soState : &ctx->vs->soState;
+      soState->rasterizerDisable = ctx->rasterizer->rasterizer_discard;
+      SwrSetSoState(ctx->swrContext, soState);
 
-      pipe_stream_output_info *stream_output = &ctx->vs->pipe.stream_output;
+      pipe_stream_output_info *stream_output =
+         ctx->gs ? &ctx->gs->pipe.stream_output : &ctx->vs->pipe.stream_output;
 
       for (uint32_t i = 0; i < ctx->num_so_targets; i++) {
          SWR_STREAMOUT_BUFFER buffer = {0};
@@ -1364,10 +1556,10 @@ swr_update_derived(struct pipe_context *pipe,
       }
    }
 
-   if (ctx->dirty & SWR_NEW_CLIP) {
+   if (ctx->dirty & (SWR_NEW_CLIP | SWR_NEW_VS | SWR_NEW_GS)) {
       // shader exporting clip distances overrides all user clip planes
       if (ctx->rasterizer->clip_plane_enable &&
-          !ctx->vs->info.base.num_written_clipdistance)
+          !swr_get_last_fe(ctx)->num_written_clipdistance)
       {
          swr_draw_context *pDC = &ctx->swrDC;
          memcpy(pDC->userClipPlanes,
@@ -1379,7 +1571,7 @@ swr_update_derived(struct pipe_context *pipe,
    // set up backend state
    SWR_BACKEND_STATE backendState = {0};
    backendState.numAttributes =
-      ctx->vs->info.base.num_outputs - 1 +
+      swr_get_last_fe(ctx)->num_outputs - 1 +
       (ctx->rasterizer->sprite_coord_enable ? 1 : 0);
    for (unsigned i = 0; i < backendState.numAttributes; i++)
       backendState.numComponents[i] = 4;
@@ -1402,6 +1594,63 @@ swr_update_derived(struct pipe_context *pipe,
 }
 
 
+/*
+ * Compute counterpart of swr_update_derived: looks up or compiles the
+ * compute shader variant and fills its part of the draw context.
+ */
+PFN_SWR_CS_VECTOR_FUNC
+swr_update_compute_state(struct pipe_context *pipe)
+{
+   struct swr_context *ctx = swr_context(pipe);
+   swr_draw_context *pDC = &ctx->swrDC;
+
+   swr_jit_cs_key key;
+   swr_generate_cs_key(key, ctx, ctx->cs);
+   auto search = ctx->cs->map.find(key);
+   PFN_SWR_CS_VECTOR_FUNC func;
+   if (search != ctx->cs->map.end()) {
+      func = search->second->shader;
+   } else {
+      func = swr_compile_cs(ctx, key);
+   }
+
+   swr_update_sampler_state(ctx,
+                            PIPE_SHADER_COMPUTE,
+                            key.nr_samplers,
+                            pDC->samplersCS);
+   swr_update_texture_state(ctx,
+                            PIPE_SHADER_COMPUTE,
+                            key.nr_sampler_views,
+                            pDC->texturesCS);
+
+   swr_update_constants(ctx, PIPE_SHADER_COMPUTE);
+
+   for (unsigned i = 0; i < PIPE_MAX_SHADER_BUFFERS; i++) {
+      const struct pipe_shader_buffer *buf = &ctx->ssbos[i];
+
+      if (i < ctx->num_ssbos && buf->buffer) {
+         pDC->ssbosCS[i] =
+            (const uint32_t *)(swr_resource_data(buf->buffer) +
+                               buf->buffer_offset);
+         pDC->num_ssbosCS[i] = buf->buffer_size;
+         swr_resource_write(buf->buffer);
+      } else {
+         pDC->ssbosCS[i] = NULL;
+         pDC->num_ssbosCS[i] = 0;
+      }
+   }
+
+   for (unsigned i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+      struct pipe_sampler_view *view =
+         ctx->sampler_views[PIPE_SHADER_COMPUTE][i];
+      if (view)
+         swr_resource_read(view->texture);
+   }
+
+   return func;
+}
+
+
 static struct pipe_stream_output_target *
 swr_create_so_target(struct pipe_context *pipe,
                      struct pipe_resource *buffer,
@@ -1489,7 +1738,12 @@ swr_state_init(struct pipe_context *pipe)
    pipe->bind_fs_state = swr_bind_fs_state;
    pipe->delete_fs_state = swr_delete_fs_state;
 
+   pipe->create_gs_state = swr_create_gs_state;
+   pipe->bind_gs_state = swr_bind_gs_state;
+   pipe->delete_gs_state = swr_delete_gs_state;
+
    pipe->set_constant_buffer = swr_set_constant_buffer;
+   pipe->set_shader_buffers = swr_set_shader_buffers;
 
    pipe->create_vertex_elements_state = swr_create_vertex_elements_state;
    pipe->bind_vertex_elements_state = swr_bind_vertex_elements_state;
@@ -48,6 +48,8 @@ struct ShaderVariant {
 
 typedef ShaderVariant<PFN_VERTEX_FUNC> VariantVS;
 typedef ShaderVariant<PFN_PIXEL_KERNEL> VariantFS;
+typedef ShaderVariant<PFN_GS_FUNC> VariantGS;
+typedef ShaderVariant<PFN_SWR_CS_VECTOR_FUNC> VariantCS;
 
 /* skeleton */
 struct swr_vertex_shader {
@@ -67,6 +69,21 @@ struct swr_fragment_shader {
    std::unordered_map<swr_jit_fs_key, std::unique_ptr<VariantFS>> map;
 };
 
+struct swr_geometry_shader {
+   struct pipe_shader_state pipe;
+   struct lp_tgsi_info info;
+   SWR_GS_STATE gsState;
+   std::unordered_map<swr_jit_gs_key, std::unique_ptr<VariantGS>> map;
+   SWR_STREAMOUT_STATE soState;
+   PFN_SO_FUNC soFunc[PIPE_PRIM_MAX] {0};
+};
+
+struct swr_compute_shader {
+   struct pipe_shader_state pipe;
+   struct lp_tgsi_info info;
+   std::unordered_map<swr_jit_cs_key, std::unique_ptr<VariantCS>> map;
+};
+
 /* Vertex element state */
 struct swr_vertex_element_state {
    FETCH_COMPILE_STATE fsState;
@@ -93,6 +110,8 @@ struct swr_derived_state {
 void swr_update_derived(struct pipe_context *,
                         const struct pipe_draw_info * = nullptr);
 
+PFN_SWR_CS_VECTOR_FUNC swr_update_compute_state(struct pipe_context *);
+
 /*
  * Conversion functions: Convert mesa state defines to SWR.
  */
@@ -123,6 +123,12 @@ swr_texture_member(const struct lp_sampler_dynamic_state *base,
    case PIPE_SHADER_VERTEX:
       indices[1] = lp_build_const_int32(gallivm, swr_draw_context_texturesVS);
       break;
+   case PIPE_SHADER_GEOMETRY:
+      indices[1] = lp_build_const_int32(gallivm, swr_draw_context_texturesGS);
+      break;
+   case PIPE_SHADER_COMPUTE:
+      indices[1] = lp_build_const_int32(gallivm, swr_draw_context_texturesCS);
+      break;
    default:
       assert(0 && "unsupported shader type");
       break;
@@ -217,6 +223,12 @@ swr_sampler_member(const struct lp_sampler_dynamic_state *base,
    case PIPE_SHADER_VERTEX:
       indices[1] = lp_build_const_int32(gallivm, swr_draw_context_samplersVS);
       break;
+   case PIPE_SHADER_GEOMETRY:
+      indices[1] = lp_build_const_int32(gallivm, swr_draw_context_samplersGS);
+      break;
+   case PIPE_SHADER_COMPUTE:
+      indices[1] = lp_build_const_int32(gallivm, swr_draw_context_samplersCS);
+      break;
    default:
       assert(0 && "unsupported shader type");
       break;
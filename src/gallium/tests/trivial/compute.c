@@ -427,7 +427,7 @@ static void launch_grid(struct context *ctx, const uint *block_layout,
                         void *input)
 {
         struct pipe_context *pipe = ctx->pipe;
-        struct pipe_grid_info info;
+        struct pipe_grid_info info = { 0 };
         int i;
 
         for (i = 0; i < 3; i++) {
@@ -1345,6 +1345,53 @@ static void test_barrier(struct context *ctx)
         destroy_prog(ctx);
 }
 
+/* test_shared_memory */
+static void test_shared_memory_expect(void *p, int s, int x, int y)
+{
+        *(uint32_t *)p = (x % 64 + 1) % 64 + 1;
+}
+
+static void test_shared_memory(struct context *ctx)
+{
+        struct pipe_context *pipe = ctx->pipe;
+        const char *src = "COMP\n"
+                "DCL SV[0], BLOCK_ID[0]\n"
+                "DCL SV[1], BLOCK_SIZE[0]\n"
+                "DCL SV[2], THREAD_ID[0]\n"
+                "DCL BUFFER[0]\n"
+                "DCL MEMORY[0], SHARED\n"
+                "DCL TEMP[0], LOCAL\n"
+                "DCL TEMP[1], LOCAL\n"
+                "DCL TEMP[2], LOCAL\n"
+                "IMM UINT32 { 1, 4, 0, 0 }\n"
+                "\n"
+                "       UMUL TEMP[0].x, SV[2].xxxx, IMM[0].yyyy\n"
+                "       UADD TEMP[1].x, SV[2].xxxx, IMM[0].xxxx\n"
+                "       STORE MEMORY[0].x, TEMP[0].xxxx, TEMP[1].xxxx\n"
+                "       BARRIER\n"
+                "       UMOD TEMP[1].x, TEMP[1].xxxx, SV[1].xxxx\n"
+                "       UMUL TEMP[1].x, TEMP[1].xxxx, IMM[0].yyyy\n"
+                "       LOAD TEMP[2].x, MEMORY[0], TEMP[1].xxxx\n"
+                "       UMAD TEMP[1].x, SV[0].xxxx, SV[1].xxxx, SV[2].xxxx\n"
+                "       UMUL TEMP[1].x, TEMP[1].xxxx, IMM[0].yyyy\n"
+                "       STORE BUFFER[0].x, TEMP[1].xxxx, TEMP[2].xxxx\n"
+                "       END\n";
+        struct pipe_shader_buffer sb = { .buffer_size = 4096 };
+
+        printf("- %s\n", __func__);
+
+        init_prog(ctx, 256, 0, 0, src, NULL);
+        init_tex(ctx, 0, PIPE_BUFFER, true, PIPE_FORMAT_R32_FLOAT,
+                 4096, 0, test_default_init);
+        sb.buffer = ctx->tex[0];
+        pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, &sb);
+        launch_grid(ctx, (uint []){64, 1, 1}, (uint []){16, 1, 1}, 0, NULL);
+        check_tex(ctx, 0, test_shared_memory_expect, NULL);
+        pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, NULL);
+        destroy_tex(ctx);
+        destroy_prog(ctx);
+}
+
 /* test_atom_ops */
 static void test_atom_ops_init(void *p, int s, int x, int y)
 {
@@ -1683,6 +1730,8 @@ int main(int argc, char *argv[])
            test_atom_ops(ctx, false);
         if (tests & (1 << 16))
            test_atom_race(ctx, false);
+        if (tests & (1 << 17))
+           test_shared_memory(ctx);
 
         destroy_ctx(ctx);
 
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "util/u_memory.h"
+#include "util/u_vcache_opt.h"
+
+
+#define GRID 64
+#define NUM_INDICES (GRID * GRID * 6)
+
+
+static int
+compare_tris(const void *a, const void *b)
+{
+   return memcmp(a, b, 3 * sizeof(unsigned));
+}
+
+
+/**
+ * Sort the triangles of a list, after rotating each to start at its
+ * smallest index, so that lists of the same triangles compare equal.
+ */
+static void
+canonicalize(unsigned *indices, unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i += 3) {
+      while (indices[i] > indices[i + 1] || indices[i] > indices[i + 2]) {
+         unsigned tmp = indices[i];
+         indices[i] = indices[i + 1];
+         indices[i + 1] = indices[i + 2];
+         indices[i + 2] = tmp;
+      }
+   }
+
+   qsort(indices, count / 3, 3 * sizeof(unsigned), compare_tris);
+}
+
+
+int
+main(int argc, char **argv)
+{
+   unsigned *src = MALLOC(NUM_INDICES * sizeof(unsigned));
+   unsigned *dst = MALLOC(NUM_INDICES * sizeof(unsigned));
+   unsigned x, y, i, n = 0;
+   float acmr_src, acmr_dst;
+   boolean success = TRUE;
+
+   /* a grid of quads, in random order */
+   for (y = 0; y < GRID; y++) {
+      for (x = 0; x < GRID; x++) {
+         unsigned v = y * (GRID + 1) + x;
+         src[n++] = v;
+         src[n++] = v + 1;
+         src[n++] = v + GRID + 1;
+         src[n++] = v + 1;
+         src[n++] = v + GRID + 2;
+         src[n++] = v + GRID + 1;
+      }
+   }
+
+   srand(1);
+   for (i = NUM_INDICES / 3 - 1; i > 0; i--) {
+      unsigned j = rand() % (i + 1);
+      unsigned tmp[3];
+      memcpy(tmp, &src[i * 3], sizeof tmp);
+      memcpy(&src[i * 3], &src[j * 3], sizeof tmp);
+      memcpy(&src[j * 3], tmp, sizeof tmp);
+   }
+
+   if (!util_optimize_vertex_cache(dst, src, sizeof(unsigned), NUM_INDICES)) {
+      printf("util_optimize_vertex_cache failed\n");
+      return 1;
+   }
+
+   acmr_src = util_vertex_cache_acmr(src, sizeof(unsigned), NUM_INDICES, 16);
+   acmr_dst = util_vertex_cache_acmr(dst, sizeof(unsigned), NUM_INDICES, 16);
+   printf("ACMR: %f -> %f\n", acmr_src, acmr_dst);
+
+   if (acmr_dst > 1.0f) {
+      printf("Failure! ACMR too high.\n");
+      success = FALSE;
+   }
+
+   /* triangles must only be reordered, with the same winding */
+   canonicalize(src, NUM_INDICES);
+   canonicalize(dst, NUM_INDICES);
+   if (memcmp(src, dst, NUM_INDICES * sizeof(unsigned)) != 0) {
+      printf("Failure! Triangles changed.\n");
+      success = FALSE;
+   }
+
+   if (success)
+      printf("Success!\n");
+
+   FREE(src);
+   FREE(dst);
+
+   return success ? 0 : 1;
+}